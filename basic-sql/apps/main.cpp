@@ -75,6 +75,11 @@ int main() {
     if (string_input_slice.case_insensitive_compare(".EXIT")) {
       should_exit = true;
       std::cout << "All done." << std::endl;
+    } else if (string_input_slice.case_insensitive_compare(".STATS")) {
+      const SqlBufferPoolStats &stats = manager.buffer_pool_stats();
+      std::cout << "Buffer pool: " << stats.hits << " hits, " << stats.misses
+                << " misses, " << stats.evictions << " evictions, "
+                << stats.write_backs << " write backs." << std::endl;
     } else if (string_input_slice.starts_with("--")) {
       // TODO: Lex and parse this instead of ignoring
       // ignore line
@@ -191,7 +196,8 @@ int main() {
           std::string table_name(statement.table_name.get_ptr(),
                                  statement.table_name.size());
           SqlError error;
-          manager.create_table(table_name, statement.columns, error);
+          manager.create_table(table_name, statement.columns,
+                               statement.layout, statement.primary_key, error);
           SqlErrorType error_type = error.type();
           switch (error_type) {
           case SqlErrorType::Ok:
@@ -234,38 +240,96 @@ int main() {
           }
           break;
         }
+        case SqlStatementType::CREATE_INDEX: {
+          // process create index
+          SqlStatementCreateIndex &statement = statements[i].create_index();
+          SqlError error;
+          manager.create_index(statement, error);
+          SqlErrorType error_type = error.type();
+          switch (error_type) {
+          case SqlErrorType::Ok:
+            std::cout << "Index " << statement.index_name << " created."
+                      << std::endl;
+            break;
+          case SqlErrorType::AlreadyExists:
+            std::cout << "!Failed to create " << statement.index_name
+                      << " because it already exists." << std::endl;
+            break;
+          case SqlErrorType::Missing:
+            std::cout << "!Failed to create " << statement.index_name
+                      << " because " << statement.table_name << "."
+                      << statement.column_name << " does not exist."
+                      << std::endl;
+            break;
+          default:
+            std::cout << "!Failed to create index. (" << error.type() << ")"
+                      << std::endl;
+            break;
+          }
+          break;
+        }
+        case SqlStatementType::DROP_INDEX: {
+          // process drop index
+          SqlStatementDropIndex &statement = statements[i].drop_index();
+          SqlError error;
+          manager.remove_index(statement, error);
+          SqlErrorType error_type = error.type();
+          switch (error_type) {
+          case SqlErrorType::Ok:
+            std::cout << "Index " << statement.index_name << " deleted."
+                      << std::endl;
+            break;
+          case SqlErrorType::Missing:
+            std::cout << "!Failed to delete " << statement.index_name
+                      << " because it does not exist." << std::endl;
+            break;
+          default:
+            std::cout << "!Failed to delete index. (" << error.type() << ")"
+                      << std::endl;
+            break;
+          }
+          break;
+        }
         case SqlStatementType::SELECT: {
           // process select
           SqlStatementSelect &statement = statements[i].select();
-          basic_sql::QueryRowsResult result;
+          basic_sql::SqlSelectCursor cursor;
           SqlError error;
-          manager.run_select_statement(statement, result, error);
+          manager.open_select(statement, cursor, error);
 
-          // handle results
+          // handle results, printing rows as they are read
           SqlErrorType error_type = error.type();
           switch (error_type) {
-          case SqlErrorType::Ok:
-            for (size_t i = 0; i < result.columns.size(); i++) {
-              std::cout << result.columns[i].name;
-              fmt_sql_type(std::cout, result.columns[i].type);
-              if (i + 1 < result.columns.size()) {
+          case SqlErrorType::Ok: {
+            const basic_sql::SmallVec<basic_sql::COLUMN_MAX,
+                                      basic_sql::parser::SqlColumn>
+                &columns = cursor.columns();
+            for (size_t i = 0; i < columns.size(); i++) {
+              std::cout << columns[i].name;
+              fmt_sql_type(std::cout, columns[i].type);
+              if (i + 1 < columns.size()) {
                 std::cout << " | ";
               }
             }
             std::cout << std::endl;
 
-            for (size_t row_index = 0; row_index != result.rows.size();
-                 row_index++) {
-              for (size_t i = 0; i < result.rows[row_index].size(); i++) {
-                std::cout << result.rows[row_index][i];
-                if (i + 1 < result.rows[row_index].size()) {
+            basic_sql::SmallVec<basic_sql::COLUMN_MAX, basic_sql::SqlValue> row;
+            while (cursor.next(row, error)) {
+              for (size_t i = 0; i < row.size(); i++) {
+                std::cout << row[i];
+                if (i + 1 < row.size()) {
                   std::cout << " | ";
                 }
               }
               std::cout << std::endl;
             }
+            if (!error.is_ok()) {
+              std::cout << "!Failed to select. (" << error.type() << ")"
+                        << std::endl;
+            }
 
             break;
+          }
           case SqlErrorType::Missing:
             std::cout << "!Failed to query table " << statement.table_name
                       << " because it does not exist." << std::endl;
@@ -310,6 +374,16 @@ int main() {
           case SqlErrorType::Ok:
             std::cout << "1 new record inserted." << std::endl;
             break;
+          case SqlErrorType::TypeMismatch:
+            std::cout << "!Failed to insert because a value does not match "
+                         "the type of its column."
+                      << std::endl;
+            break;
+          case SqlErrorType::AlreadyExists:
+            std::cout << "!Failed to insert because the primary key already "
+                         "exists."
+                      << std::endl;
+            break;
           default:
             std::cout << "!Failed to insert. (" << error.type() << ")"
                       << std::endl;
@@ -341,6 +415,16 @@ int main() {
             std::cout << "Error: Table " << statement.table_name
                       << " is locked!" << std::endl;
             break;
+          case SqlErrorType::TypeMismatch:
+            std::cout << "!Failed to update because the value does not match "
+                         "the type of its column."
+                      << std::endl;
+            break;
+          case SqlErrorType::AlreadyExists:
+            std::cout << "!Failed to update because the primary key already "
+                         "exists."
+                      << std::endl;
+            break;
           default:
             std::cout << "!Failed to update. (" << error.type() << ")"
                       << std::endl;
@@ -6,6 +6,7 @@
 #include "ConstStringSlice.h"
 #include "SmallString.h"
 #include "SmallVec.h"
+#include "SqlBufferPool.h"
 #include "SqlDatabase.h"
 #include "SqlError.h"
 #include "SqlFile.h"
@@ -19,6 +20,8 @@
 
 using basic_sql::SmallString;
 using basic_sql::SmallVec;
+using basic_sql::SqlBufferPool;
+using basic_sql::SqlBufferPoolStats;
 using basic_sql::SqlDatabase;
 using basic_sql::SqlError;
 using basic_sql::SqlErrorType;
@@ -26,10 +29,13 @@ using basic_sql::SqlFile;
 using basic_sql::SqlIndexFile;
 
 // Temp
+using basic_sql::BUFFER_POOL_DEFAULT_SIZE;
 using basic_sql::COLUMN_MAX;
 using basic_sql::COLUMN_NAME_MAX_LENGTH;
 using basic_sql::DATABASE_MAX_NAME_SIZE;
+using basic_sql::JOIN_MEMORY_DEFAULT_SIZE;
 using basic_sql::SqlError;
+using basic_sql::TABLE_CACHE_DEFAULT_SIZE;
 using basic_sql::TABLE_NAME_MAX_LENGTH;
 using basic_sql::parser::SqlColumn;
 using basic_sql::parser::SqlParser;
@@ -37,8 +43,10 @@ using basic_sql::parser::SqlParserError;
 using basic_sql::parser::SqlStatement;
 using basic_sql::parser::SqlStatementAlter;
 using basic_sql::parser::SqlStatementCreateDatabase;
+using basic_sql::parser::SqlStatementCreateIndex;
 using basic_sql::parser::SqlStatementCreateTable;
 using basic_sql::parser::SqlStatementDropDatabase;
+using basic_sql::parser::SqlStatementDropIndex;
 using basic_sql::parser::SqlStatementDropTable;
 using basic_sql::parser::SqlStatementSelect;
 using basic_sql::parser::SqlStatementType;
@@ -55,11 +63,19 @@ using tokenizer::SqlTokenizerError;
 /// A manager for sql databases
 class SqlDatabaseManager {
 public:
-  SqlDatabaseManager() : current_database_name("") {}
+  /// Make a manager whose databases share a buffer pool of `buffer_pool_size`
+  /// bytes, and each keep at most `table_cache_size` tables open. Joins hold
+  /// at most about `join_memory_size` bytes of join values in memory.
+  SqlDatabaseManager(size_t buffer_pool_size = BUFFER_POOL_DEFAULT_SIZE,
+                     size_t table_cache_size = TABLE_CACHE_DEFAULT_SIZE,
+                     size_t join_memory_size = JOIN_MEMORY_DEFAULT_SIZE)
+      : buffer_pool(buffer_pool_size), table_cache_size(table_cache_size),
+        join_memory_size(join_memory_size), current_database_name("") {}
 
   /// Load a db, without creating it
-  void load_database(std::string name, SqlError error) {
-    SqlDatabase database(name);
+  void load_database(std::string name, SqlError &error) {
+    SqlDatabase database(name, &this->buffer_pool, this->table_cache_size,
+                         this->join_memory_size);
     bool create = false;
     database.open(create, error);
     if (!error.is_ok())
@@ -81,7 +97,8 @@ public:
       return;
     }
 
-    SqlDatabase database(name);
+    SqlDatabase database(name, &this->buffer_pool, this->table_cache_size,
+                         this->join_memory_size);
     bool create = true;
     database.open(create, error);
     if (error.type() == SqlErrorType::AlreadyExists) {
@@ -126,13 +143,15 @@ public:
       std::string name,
       const basic_sql::SmallVec<COLUMN_MAX, basic_sql::parser::SqlColumn>
           columns,
+      basic_sql::parser::SqlTableLayout layout, int primary_key,
       SqlError &error) {
     if (this->current_database_name.size() == 0) {
       error.set_missing();
       return;
     }
 
-    databases[this->current_database_name].create_table(name, columns, error);
+    databases[this->current_database_name].create_table(
+        name, columns, layout, primary_key, error);
   }
 
   /// Remove a table
@@ -145,6 +164,28 @@ public:
     databases[this->current_database_name].remove_table(name, error);
   }
 
+  /// Create an index on the current db
+  void create_index(const basic_sql::parser::SqlStatementCreateIndex &statement,
+                    SqlError &error) {
+    if (this->current_database_name.size() == 0) {
+      error.set_missing();
+      return;
+    }
+
+    databases[this->current_database_name].run_create_index(statement, error);
+  }
+
+  /// Remove an index
+  void remove_index(const basic_sql::parser::SqlStatementDropIndex &statement,
+                    SqlError &error) {
+    if (this->current_database_name.size() == 0) {
+      error.set_missing();
+      return;
+    }
+
+    databases[this->current_database_name].run_drop_index(statement, error);
+  }
+
   /// Run a select statement
   void run_select_statement(basic_sql::parser::SqlStatementSelect &statement,
                             basic_sql::QueryRowsResult &result,
@@ -158,6 +199,21 @@ public:
                                                                 result, error);
   }
 
+  /// Start reading the rows of a select statement.
+  ///
+  /// The statement must outlive the cursor, and no other statement may run
+  /// while it is open.
+  void open_select(basic_sql::parser::SqlStatementSelect &statement,
+                   basic_sql::SqlSelectCursor &cursor, SqlError &error) {
+    if (this->current_database_name.size() == 0) {
+      error.set_missing();
+      return;
+    }
+
+    databases[this->current_database_name].open_select(statement, cursor,
+                                                       error);
+  }
+
   /// Run an alter statement
   void run_alter_statement(basic_sql::parser::SqlStatementAlter &statement,
                            SqlError &error) {
@@ -224,7 +280,20 @@ public:
     databases[this->current_database_name].commit_transaction(error);
   }
 
+  /// Get the buffer pool counters
+  const SqlBufferPoolStats &buffer_pool_stats() const {
+    return this->buffer_pool.stats();
+  }
+
 private:
+  /// The pages of every db.
+  ///
+  /// This must be declared before the dbs, so it outlives them.
+  SqlBufferPool buffer_pool;
+  /// The max # of tables each db keeps open
+  size_t table_cache_size;
+  /// The # of bytes of join values each join may sort in memory
+  size_t join_memory_size;
   std::unordered_map<std::string, SqlDatabase> databases;
   /// The current db name.
   ///
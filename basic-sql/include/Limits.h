@@ -17,6 +17,23 @@ const size_t TABLE_NAME_MAX_LENGTH = 16;
 const size_t COLUMN_MAX = 16;
 /// The max type size
 const size_t MAX_TYPE_SIZE = 64;
+/// The max size of an encoded row
+///
+/// every column is at most a length byte plus MAX_TYPE_SIZE bytes.
+const size_t ROW_MAX_SIZE = COLUMN_MAX * (1 + MAX_TYPE_SIZE);
+/// The size of a storage page in a table file
+const size_t STORAGE_PAGE_SIZE = 8192;
+/// The default # of bytes of pages the buffer pool may hold
+const size_t BUFFER_POOL_DEFAULT_SIZE = 32 * 1024 * 1024;
+/// The default # of tables a db keeps open
+const size_t TABLE_CACHE_DEFAULT_SIZE = 64;
+/// The default # of bytes of join values a join sorts in memory
+///
+/// joins of more rows than fit in this sort their join values, spilling
+/// sorted runs to files.
+const size_t JOIN_MEMORY_DEFAULT_SIZE = 64 * 1024 * 1024;
+/// The # of bytes of log records that make a db checkpoint
+const size_t WAL_CHECKPOINT_SIZE = 4 * 1024 * 1024;
 } // namespace basic_sql
 
 #endif
\ No newline at end of file
@@ -4,14 +4,61 @@
 #ifndef _SER_DE_H_
 #define _SER_DE_H_
 
+#include "Limits.h"
 #include "SmallString.h"
+#include "SmallVec.h"
+#include "SqlColumn.h"
 #include "SqlError.h"
 #include "SqlFile.h"
 #include "SqlValue.h"
 #include "parser/SqlType.h"
 #include "tokenizer/SqlType.h"
+#include <cstring>
+#include <vector>
 
 namespace basic_sql {
+/// Read a u16 from memory
+inline uint16_t read_u16(const uint8_t *data) {
+  uint16_t value = 0;
+  memcpy(&value, data, 2);
+  return value;
+}
+
+/// Read a u32 from memory
+inline uint32_t read_u32(const uint8_t *data) {
+  uint32_t value = 0;
+  memcpy(&value, data, 4);
+  return value;
+}
+
+/// Read a u64 from memory
+inline uint64_t read_u64(const uint8_t *data) {
+  uint64_t value = 0;
+  memcpy(&value, data, 8);
+  return value;
+}
+
+/// Append a u16 to a buffer
+inline void push_u16(std::vector<uint8_t> &buffer, uint16_t value) {
+  uint8_t bytes[2];
+  memcpy(bytes, &value, 2);
+  buffer.insert(buffer.end(), bytes, bytes + 2);
+}
+
+/// Append a u32 to a buffer
+inline void push_u32(std::vector<uint8_t> &buffer, uint32_t value) {
+  uint8_t bytes[4];
+  memcpy(bytes, &value, 4);
+  buffer.insert(buffer.end(), bytes, bytes + 4);
+}
+
+/// Append a u64 to a buffer
+inline void push_u64(std::vector<uint8_t> &buffer, uint64_t value) {
+  uint8_t bytes[8];
+  memcpy(bytes, &value, 8);
+  buffer.insert(buffer.end(), bytes, bytes + 8);
+}
+
 
 /// Write a small string to a file.
 template <size_t N>
@@ -45,8 +92,11 @@ void read_small_string_from_file(SmallString<N> &small_string, SqlFile &file,
     return;
   small_string.clear();
 
-  // TODO: maybe error here. This should only be possible with data corruption.
-  assert(len <= N);
+  // a longer string is only possible with data corruption.
+  if (len > N) {
+    error.set_invalid_file();
+    return;
+  }
 
   // read data
   // always read N to update the position pointer correctly.
@@ -72,11 +122,68 @@ void read_sql_type(parser::SqlType &type, SqlFile &file, SqlError &error);
 void write_sql_type(const parser::SqlType &type, SqlFile &file,
                     SqlError &error);
 
-/// write a sql value to a file
-void write_sql_value(const SqlValue &value, SqlFile &file, SqlError &error);
-
-/// read a sql value from a file
-void read_sql_value(SqlValue &value, tokenizer::SqlType expected_type,
+/// Get the # of bytes a value of the given sql type takes up on disk.
+///
+/// INT and FLOAT are 4 bytes, CHAR(n) and VARCHAR(n) are a length byte plus
+/// n bytes.
+size_t sql_type_width(const parser::SqlType &type);
+
+/// Get the # of bytes a value takes up on disk, excluding padding.
+size_t sql_value_encoded_size(const SqlValue &value);
+
+/// Convert a value to the type of a column.
+///
+/// An INT becomes the FLOAT it converts to in a FLOAT column. Returns false
+/// if a value of its type cannot be stored in the column.
+bool convert_sql_value(SqlValue &value, const parser::SqlType &type);
+
+/// Returns true if a value can be stored in a column of a type as it is.
+bool sql_value_has_type(const SqlValue &value, const parser::SqlType &type);
+
+/// encode a sql value into memory, padding it to the width of the given type.
+///
+/// the value must fit in the type's width.
+void encode_sql_value(const SqlValue &value, const parser::SqlType &type,
+                      uint8_t *data);
+
+/// Get the # of bytes a row of the given columns takes up on disk.
+size_t sql_row_width(const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns);
+
+/// encode a row into a contiguous buffer.
+///
+/// columns without a value are zeroed. `data` must hold the row width of the
+/// columns. Returns the row width.
+size_t encode_row(const SmallVec<COLUMN_MAX, SqlValue> &row,
+                  const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns,
+                  uint8_t *data);
+
+/// decode a row of the given columns from a contiguous buffer.
+///
+/// the values are appended to `row`. Returns false if a value is corrupt.
+bool decode_row(SmallVec<COLUMN_MAX, SqlValue> &row,
+                const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns,
+                const uint8_t *data);
+
+/// write a sql value to a file, padding it to the width of the given type.
+///
+/// the value must fit in the type's width.
+void write_sql_value(const SqlValue &value, const parser::SqlType &type,
+                     SqlFile &file, SqlError &error);
+
+/// decode a sql value of the given type from memory.
+///
+/// `data` must hold the full width of the type. Returns false if the value is
+/// corrupt, as a string longer than the type.
+bool decode_sql_value(SqlValue &value, const parser::SqlType &type,
+                      const uint8_t *data);
+
+/// hash an encoded sql value of the given type.
+///
+/// equal values hash alike, the way `SqlValue` compares values of the type.
+uint64_t hash_sql_value(const parser::SqlType &type, const uint8_t *data);
+
+/// read a sql value from a file, consuming the width of the given type.
+void read_sql_value(SqlValue &value, const parser::SqlType &type,
                     SqlFile &file, SqlError &error);
 
 } // namespace basic_sql
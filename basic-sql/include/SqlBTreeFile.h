@@ -0,0 +1,181 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_BTREE_FILE_H_
+#define _SQL_BTREE_FILE_H_
+
+#include "Limits.h"
+#include "SqlFile.h"
+#include "SqlStatement.h"
+#include <string>
+#include <vector>
+
+namespace basic_sql {
+/// b+tree file magic #
+static const char *SQL_BTREE_FILE_MAGIC = "btree-db";
+/// b+tree file magic # length
+static const size_t SQL_BTREE_FILE_MAGIC_SIZE = 8;
+/// the offset to the key type field
+///
+/// a u8 `tokenizer::SqlType`, then a u8 type size.
+static const size_t SQL_BTREE_FILE_KEY_TYPE_OFFSET = SQL_BTREE_FILE_MAGIC_SIZE;
+/// the offset to the root page field
+///
+/// this is a u64 page number.
+static const size_t SQL_BTREE_FILE_ROOT_OFFSET = 16;
+/// the offset to the num_pages field
+///
+/// num_pages is a u64 counting every page in the file, including the header.
+static const size_t SQL_BTREE_FILE_NUM_PAGES_OFFSET =
+    SQL_BTREE_FILE_ROOT_OFFSET + 8;
+/// the size of the header fields in page 0
+static const size_t SQL_BTREE_FILE_HEADER_SIZE =
+    SQL_BTREE_FILE_NUM_PAGES_OFFSET + 8;
+/// the size of the header of a node page
+///
+/// a u8 set if the node is a leaf, a reserved u8, a u16 entry count, 4
+/// reserved bytes, then a u64 link. the link of a leaf is the next leaf (0 if
+/// none), the link of an internal node is its first child.
+static const size_t SQL_BTREE_FILE_NODE_HEADER_SIZE = 1 + 1 + 2 + 4 + 8;
+
+/// A b+tree of (column value, row id) keys, stored in a file
+///
+/// Keys are encoded column values, compared the way `SqlValue` compares values
+/// of the column type. Row ids make every key unique, so a value can have many
+/// rows. Leaves hold the keys and are chained in key order. Internal nodes
+/// hold separator keys, where entry i leads to the keys >= it. Removing keys
+/// never merges nodes.
+class SqlBTreeFile {
+public:
+  /// Make a new unopened file
+  ///
+  /// If a buffer pool is given, the file is read and written through it.
+  SqlBTreeFile(std::string name, SqlBufferPool *buffer_pool = nullptr);
+  SqlBTreeFile(const SqlBTreeFile &other) = delete;
+  SqlBTreeFile &operator=(SqlBTreeFile &other) = delete;
+  SqlBTreeFile(SqlBTreeFile &&other) noexcept;
+  SqlBTreeFile &operator=(SqlBTreeFile &&other);
+
+  /// Open the file.
+  ///
+  /// A new file is an empty tree of keys of the given type. An existing file
+  /// keeps the type it was created with.
+  void open(bool create, const parser::SqlType &key_type, SqlError &error);
+
+  /// Replace the contents of a new tree with keys.
+  ///
+  /// The keys are sorted, then leaves are filled up and the levels above are
+  /// built on them. `keys` holds an encoded value for each row in `row_ids`.
+  void bulk_load(const std::vector<uint8_t> &keys,
+                 const std::vector<uint64_t> &row_ids, SqlError &error);
+
+  /// Add a key. Adding a key that is already there does nothing.
+  void insert(const uint8_t *key, uint64_t row_id, SqlError &error);
+
+  /// Remove a key. Removing a key that is not there does nothing.
+  void remove(const uint8_t *key, uint64_t row_id, SqlError &error);
+
+  /// Find the rows whose value matches an encoded value.
+  ///
+  /// Only `=` and `>` are supported. Row ids are appended in key order.
+  void find(tokenizer::SqlOperator op, const uint8_t *key,
+            std::vector<uint64_t> &row_ids, SqlError &error);
+
+  /// Get the row id of every key, in key order.
+  void scan(std::vector<uint64_t> &row_ids, SqlError &error);
+
+  /// Get the type of the keys
+  const parser::SqlType &key_type() const;
+
+  /// Returns true if this is closed
+  bool is_closed() const;
+
+  /// Close this file
+  void close(SqlError &error);
+
+  /// Write back buffered pages to the file
+  void flush(SqlError &error);
+
+  /// Write back buffered pages, then wait until the file is on disk.
+  void sync(SqlError &error);
+
+  /// Drop cached pages if another process changed the file, then read the
+  /// header again.
+  void invalidate_if_modified(SqlError &error);
+
+  /// remove the file and close this file.
+  void remove_file(SqlError &error);
+
+  /// Get the file name
+  const std::string &file_name() const;
+
+private:
+  /// A split node, to be linked into its parent
+  struct Split {
+    /// The first key of the new node
+    std::vector<uint8_t> key;
+    uint64_t row_id;
+    /// The new node, which follows the split one
+    uint64_t page;
+  };
+
+  /// Compare a stored key to a key. Returns <0, 0 or >0 like memcmp.
+  int compare(const uint8_t *lhs, uint64_t lhs_row_id, const uint8_t *rhs,
+              uint64_t rhs_row_id) const;
+
+  /// Get the # of entries that fit in a leaf
+  size_t leaf_capacity() const;
+
+  /// Get the # of entries that fit in an internal node
+  size_t internal_capacity() const;
+
+  /// Get the size of an entry of a leaf, or of an internal node
+  size_t entry_size(bool is_leaf) const;
+
+  /// Find the first entry of a node not less than a key.
+  size_t lower_bound(const uint8_t *node, const uint8_t *key,
+                     uint64_t row_id) const;
+
+  /// Find the child of an internal node that leads to a key.
+  uint64_t child_for(const uint8_t *node, const uint8_t *key,
+                     uint64_t row_id) const;
+
+  /// Find the leaf that holds a key, or would.
+  uint64_t find_leaf(const uint8_t *key, uint64_t row_id, SqlError &error);
+
+  /// Insert a key below a node.
+  ///
+  /// Returns true and fills `split` if the node was split.
+  bool insert_into(uint64_t page, const uint8_t *key, uint64_t row_id,
+                   Split &split, SqlError &error);
+
+  /// Allocate a zeroed page at the end of the file.
+  ///
+  /// Returns the new page number.
+  uint64_t allocate_page(SqlError &error);
+
+  /// Read a page.
+  void read_page(uint64_t page, uint8_t *data, SqlError &error);
+
+  /// Write a page.
+  void write_page(uint64_t page, const uint8_t *data, SqlError &error);
+
+  /// Write the root and num_pages fields
+  void write_header(SqlError &error);
+
+  /// Read the header fields
+  void read_header(SqlError &error);
+
+  SqlFile m_file;
+  /// The type of the keys
+  parser::SqlType m_key_type;
+  /// The size of an encoded key
+  size_t m_key_size;
+  /// The root node page
+  uint64_t m_root;
+  /// The # of pages in the file
+  uint64_t m_num_pages;
+};
+} // namespace basic_sql
+
+#endif
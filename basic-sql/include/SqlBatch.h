@@ -0,0 +1,43 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_BATCH_H_
+#define _SQL_BATCH_H_
+
+#include "SqlStatement.h"
+#include <vector>
+
+namespace basic_sql {
+/// The # of rows a batch holds at most
+static const size_t SQL_BATCH_SIZE = 1024;
+
+/// A batch of rows of a table, held a column at a time
+///
+/// Each read column holds the encoded values of the rows back to back, each
+/// `sql_type_width` bytes, as on disk. Rows are filtered by removing them
+/// from the selection, so values are never moved.
+struct SqlBatch {
+  /// The id of each row
+  std::vector<uint64_t> row_ids;
+  /// The encoded values of each column. Columns that were not read are
+  /// empty.
+  std::vector<std::vector<uint8_t>> columns;
+  /// The positions of the selected rows, in order
+  std::vector<uint16_t> selection;
+};
+
+/// Select every row of a batch
+void select_all(SqlBatch &batch);
+
+/// Decode a row of a batch.
+///
+/// Like `SqlTableFile::get_row_columns`, the row gets a value for every
+/// column, but columns not in `column_mask` are left null. Returns false if
+/// a value is corrupt.
+bool decode_batch_row(const SqlBatch &batch,
+                      const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns,
+                      uint32_t column_mask, size_t position,
+                      SmallVec<COLUMN_MAX, SqlValue> &row);
+} // namespace basic_sql
+
+#endif
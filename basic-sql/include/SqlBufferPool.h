@@ -0,0 +1,131 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_BUFFER_POOL_H_
+#define _SQL_BUFFER_POOL_H_
+
+#include "Limits.h"
+#include "SqlError.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace basic_sql {
+class SqlFile;
+
+/// Buffer pool counters
+struct SqlBufferPoolStats {
+  /// # of page fetches served from memory
+  uint64_t hits;
+  /// # of page fetches that had to read the file
+  uint64_t misses;
+  /// # of pages evicted to make room
+  uint64_t evictions;
+  /// # of dirty pages written back to their file
+  uint64_t write_backs;
+};
+
+/// A cached page
+struct SqlBufferPoolFrame {
+  /// The id of the file the page belongs to, 0 if the frame is free
+  uint32_t file_id;
+  /// The page number in the file
+  uint64_t page;
+  /// True if the page was modified since it was read or written back
+  bool dirty;
+  /// The CLOCK reference bit
+  bool referenced;
+  /// The position of the frame in the dirty frames of its file, if dirty
+  size_t dirty_index;
+  /// The page data
+  std::unique_ptr<uint8_t[]> data;
+};
+
+/// A fixed-size cache of file pages shared by many files.
+///
+/// Pages are evicted with the CLOCK algorithm, and dirty pages are written
+/// back when they are evicted or their file is flushed. The dirty frames of
+/// each file are listed, so flushing costs the # of dirty pages, not the
+/// size of the pool.
+class SqlBufferPool {
+public:
+  /// Make a buffer pool that holds at most `budget` bytes of pages.
+  ///
+  /// The pool always holds at least 1 page.
+  SqlBufferPool(size_t budget);
+  SqlBufferPool(const SqlBufferPool &other) = delete;
+  SqlBufferPool &operator=(const SqlBufferPool &other) = delete;
+
+  /// Register a file with the pool, returning its id.
+  ///
+  /// Ids of unregistered files are given out again.
+  uint32_t register_file(SqlFile *file);
+
+  /// Point a registered file id at a new file object, after a move.
+  void rebind_file(uint32_t file_id, SqlFile *file);
+
+  /// Drop the pages of a file without writing them back, and forget it.
+  void unregister_file(uint32_t file_id);
+
+  /// Get a page of a file, reading it on a miss.
+  ///
+  /// The returned ptr is valid until the next call into the pool.
+  /// If `for_write` is true, the page is marked dirty.
+  uint8_t *fetch_page(uint32_t file_id, uint64_t page, bool for_write,
+                      SqlError &error);
+
+  /// Write back every dirty page of a file.
+  ///
+  /// Runs of consecutive dirty pages are written with one vectored write.
+  void flush_file(uint32_t file_id, SqlError &error);
+
+  /// Drop every page of a file without writing it back.
+  void drop_file_pages(uint32_t file_id);
+
+  /// Returns true if the file has dirty pages in the pool.
+  bool has_dirty_pages(uint32_t file_id) const;
+
+  /// Get the max # of pages in the pool
+  size_t capacity() const;
+
+  /// Get the counters
+  const SqlBufferPoolStats &stats() const;
+
+private:
+  /// Find a frame for a new page, evicting one if the pool is full.
+  ///
+  /// Returns the frame index.
+  size_t allocate_frame(SqlError &error);
+
+  /// Write back a frame if it is dirty.
+  void write_back(size_t frame_index, SqlError &error);
+
+  /// Mark a frame dirty, listing it with the dirty frames of its file.
+  void set_dirty(size_t frame_index);
+
+  /// Mark a frame clean, removing it from the dirty frames of its file.
+  void clear_dirty(size_t frame_index);
+
+  /// Make a map key for a page
+  static uint64_t page_key(uint32_t file_id, uint64_t page);
+
+  size_t m_capacity;
+  std::vector<SqlBufferPoolFrame> m_frames;
+  /// page key -> frame index
+  std::unordered_map<uint64_t, size_t> m_page_table;
+  /// The CLOCK hand
+  size_t m_clock_hand;
+  /// file id -> indexes of its dirty frames, in no order
+  std::unordered_map<uint32_t, std::vector<size_t>> m_dirty_frames;
+
+  /// file id -> file
+  std::unordered_map<uint32_t, SqlFile *> m_files;
+  uint32_t m_next_file_id;
+  /// ids of unregistered files, to give out before new ones
+  std::vector<uint32_t> m_free_file_ids;
+
+  SqlBufferPoolStats m_stats;
+};
+} // namespace basic_sql
+#endif
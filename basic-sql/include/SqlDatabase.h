@@ -5,9 +5,20 @@
 #define _SQL_DATABASE_H_
 
 #include "Limits.h"
+#include "SqlBTreeFile.h"
+#include "SqlBufferPool.h"
 #include "SqlError.h"
+#include "SqlHashFile.h"
 #include "SqlIndexFile.h"
+#include "SqlJoin.h"
+#include "SqlSelectCursor.h"
 #include "SqlTableFile.h"
+#include "SqlWriteAheadLog.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <list>
+#include <map>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <unordered_map>
@@ -18,28 +29,55 @@ public:
   // TODO: Remove
   /// This is invalid, but needed for unordered_map's [] accessor. This is very
   /// bug prone.
-  SqlDatabase() : m_name("INVALID"), m_index(""), m_in_transaction(false) {}
+  SqlDatabase()
+      : m_name("INVALID"), m_buffer_pool(nullptr), m_index(""), m_wal(""),
+        m_table_cache_size(TABLE_CACHE_DEFAULT_SIZE),
+        m_join_memory_size(JOIN_MEMORY_DEFAULT_SIZE),
+        m_in_transaction(false) {}
 
   /// Make a new sql database
   ///
   /// name MUST be validated at this point.
   /// This does not open the db.
-  SqlDatabase(std::string name)
-      : m_name(name), m_index(name + "/index.db-index"),
+  /// If a buffer pool is given, all files of the db go through it.
+  /// Tables are opened when first used, and at most `table_cache_size` stay
+  /// open at once. This is at least 2, so a join can hold both its tables.
+  /// Joins too large for `join_memory_size` bytes sort their join values,
+  /// spilling to files in the db directory.
+  SqlDatabase(std::string name, SqlBufferPool *buffer_pool = nullptr,
+              size_t table_cache_size = TABLE_CACHE_DEFAULT_SIZE,
+              size_t join_memory_size = JOIN_MEMORY_DEFAULT_SIZE)
+      : m_name(name), m_buffer_pool(buffer_pool),
+        m_index(name + "/index.db-index", buffer_pool),
+        m_wal(name + "/wal.db-wal"),
+        m_table_cache_size(table_cache_size < 2 ? 2 : table_cache_size),
+        m_join_memory_size(join_memory_size),
         m_in_transaction(false), m_abort_transaction(false) {}
   SqlDatabase(const SqlDatabase &other) = delete;
   SqlDatabase &operator=(SqlDatabase &other) = delete;
   SqlDatabase(SqlDatabase &&other) noexcept
-      : m_name(other.m_name), m_index(std::move(other.m_index)),
-        tables(std::move(other.tables)),
+      : m_name(other.m_name), m_buffer_pool(other.m_buffer_pool),
+        m_index(std::move(other.m_index)), m_wal(std::move(other.m_wal)),
+        m_table_cache_size(other.m_table_cache_size),
+        m_join_memory_size(other.m_join_memory_size),
         m_in_transaction(other.m_in_transaction),
-        m_abort_transaction(other.m_abort_transaction) {}
+        m_abort_transaction(other.m_abort_transaction),
+        m_locks(std::move(other.m_locks)), tables(std::move(other.tables)),
+        m_table_lru(std::move(other.m_table_lru)),
+        m_table_lru_positions(std::move(other.m_table_lru_positions)) {}
   SqlDatabase &operator=(SqlDatabase &&other) {
     this->m_name = other.m_name;
+    this->m_buffer_pool = other.m_buffer_pool;
     this->m_index = std::move(other.m_index);
-    this->tables = std::move(other.tables);
+    this->m_wal = std::move(other.m_wal);
+    this->m_table_cache_size = other.m_table_cache_size;
+    this->m_join_memory_size = other.m_join_memory_size;
     this->m_in_transaction = other.m_in_transaction;
     this->m_abort_transaction = other.m_abort_transaction;
+    this->m_locks = std::move(other.m_locks);
+    this->tables = std::move(other.tables);
+    this->m_table_lru = std::move(other.m_table_lru);
+    this->m_table_lru_positions = std::move(other.m_table_lru_positions);
 
     return *this;
   }
@@ -67,6 +105,9 @@ public:
           error.set_bad_mkdir();
           return;
         }
+      } else if (errno == ENOENT) {
+        error.set_missing();
+        return;
       } else {
         error.set_dir_stat();
         return;
@@ -97,28 +138,41 @@ public:
       }
     }
 
-    // Open index file
+    // Open index file, tables are opened when first used.
     this->m_index.open(create, error);
     if (!error.is_ok())
       return;
 
-    // load entries
-    size_t num_tables = this->m_index.get_num_tables();
-    SmallString<TABLE_NAME_MAX_LENGTH> table_name;
-    for (size_t i = 0; i < num_tables; i++) {
-      this->m_index.get_table_name(i, table_name, error);
-      if (!error.is_ok())
-        return;
-      std::string table_name_string(table_name.get_ptr(), table_name.size());
-      std::string table_file_name;
-      table_file_name += this->m_name + "/" + table_name_string + ".table";
-      SqlTableFile table_file(table_file_name);
-      bool create = false;
-      table_file.open(create, error);
-      if (!error.is_ok())
-        return;
-      this->tables.insert({table_name_string, std::move(table_file)});
-    }
+    // Open the log, dbs from before it have none yet.
+    struct stat wal_stat = {0};
+    bool wal_exists = stat(this->m_wal.file_name().c_str(), &wal_stat) == 0;
+    this->m_wal.open(!wal_exists, error);
+    if (!error.is_ok())
+      return;
+
+    // replay what the last session logged but may not have written
+    this->checkpoint(error);
+    if (!error.is_ok())
+      return;
+  }
+
+  /// Apply the log to the tables, write them to disk, then empty the log.
+  ///
+  /// Tables are read again first, so the log lands on top of what other
+  /// processes wrote. Applying a record twice is harmless.
+  void checkpoint(SqlError &error) {
+    this->m_wal.lock(error);
+    if (!error.is_ok())
+      return;
+
+    this->apply_wal(error);
+    if (error.is_ok())
+      this->m_wal.reset(error);
+
+    SqlError unlock_error;
+    this->m_wal.unlock(unlock_error);
+    if (error.is_ok())
+      error = unlock_error;
   }
 
   /// Remove this db
@@ -127,12 +181,34 @@ public:
     if (!error.is_ok())
       return;
     this->m_index.remove_file(error);
+    if (!error.is_ok())
+      return;
+    this->m_wal.remove_file(error);
     if (!error.is_ok())
       return;
 
-    for (auto table_it = this->tables.begin(); table_it != this->tables.end();
-         table_it++) {
-      table_it->second.remove_file(error);
+    // the index still knows every table after it is closed
+    const std::unordered_map<std::string, uint32_t> &table_names =
+        this->m_index.get_table_names();
+    for (auto name_it = table_names.begin(); name_it != table_names.end();
+         name_it++) {
+      SqlTableFile table_file(this->table_file_name(name_it->first),
+                              this->m_buffer_pool);
+      table_file.remove_file(error);
+      if (!error.is_ok())
+        return;
+      this->remove_primary_key_file(name_it->first, error);
+      if (!error.is_ok())
+        return;
+    }
+    const std::unordered_map<std::string, SqlIndexEntry> &indexes =
+        this->m_index.get_indexes();
+    for (auto index_it = indexes.begin(); index_it != indexes.end();
+         index_it++) {
+      SqlFile index_file(
+          this->index_file_name(index_it->second.table_name, index_it->first),
+          this->m_buffer_pool);
+      index_file.remove_file(error);
       if (!error.is_ok())
         return;
     }
@@ -141,24 +217,32 @@ public:
     assert(rmdir(m_name.c_str()) == 0);
   }
 
-  /// Create a new table
+  /// Create a new table with the given storage layout
+  ///
+  /// `primary_key` is the index of the primary key column, or -1 if there is
+  /// none. The primary key gets an index of its own.
   void create_table(std::string input_name,
                     const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns,
+                    parser::SqlTableLayout layout, int primary_key,
                     SqlError &error) {
     // check for dupes in index
     SmallString<TABLE_NAME_MAX_LENGTH> name;
     name.append(input_name.c_str());
-    if (this->m_index.index_of_table_name(name, error) != -1) {
+    if (this->m_index.index_of_table_name(name) != -1) {
       error.set_already_exists();
       return;
     }
 
+    // no record may outlive its table, or it would apply to a new one.
+    this->checkpoint(error);
+    if (!error.is_ok())
+      return;
+
     // create table file
-    std::string table_file_name;
-    table_file_name += this->m_name + "/" + input_name + ".table";
-    SqlTableFile table_file(table_file_name);
+    SqlTableFile table_file(this->table_file_name(input_name),
+                            this->m_buffer_pool);
     bool create = true;
-    table_file.open(create, error);
+    table_file.open(create, layout, error);
     if (!error.is_ok())
       return;
 
@@ -169,17 +253,37 @@ public:
         return;
     }
 
+    // and the primary key, with its index
+    if (primary_key != -1) {
+      table_file.set_primary_key(primary_key, error);
+      if (!error.is_ok())
+        return;
+
+      SqlBTreeFile tree(this->primary_key_file_name(input_name),
+                        this->m_buffer_pool);
+      tree.open(create, columns[primary_key].type, error);
+      if (!error.is_ok())
+        return;
+      table_file.attach_index("", primary_key, std::move(tree));
+    }
+
+    // persist
+    table_file.flush(error);
+    if (!error.is_ok())
+      return;
+
     // insert into memory tables
-    this->tables.insert({input_name, std::move(table_file)});
+    this->cache_table(input_name, std::move(table_file), error);
+    if (!error.is_ok())
+      return;
 
     // insert into index
-    name.clear();
-    uint8_t num_tables = this->m_index.get_num_tables();
-    name.append(input_name.c_str());
-    this->m_index.insert_table_name(num_tables, name, error);
+    this->m_index.add_table_name(name, error);
     if (!error.is_ok())
       return;
-    this->m_index.update_num_tables(num_tables + 1, error);
+
+    // persist
+    this->m_index.flush(error);
     if (!error.is_ok())
       return;
   }
@@ -190,192 +294,392 @@ public:
     table_name.append(input_name.c_str());
 
     // Locate index of name
-    size_t index = this->m_index.index_of_table_name(table_name, error);
-    if (!error.is_ok())
-      return;
+    size_t index = this->m_index.index_of_table_name(table_name);
     if (index == -1) {
       error.set_missing();
       return;
     }
 
-    // Locate index file
-    auto table_it = this->tables.find(input_name);
-    if (table_it == this->tables.end()) {
-      panic("table present in index, missing in map");
-      error.set_missing();
+    // no record may outlive its table, or it would apply to a new one.
+    this->checkpoint(error);
+    if (!error.is_ok())
       return;
-    }
 
     // Remove
-    this->m_index.remove(index, error);
+    this->m_index.remove_table_name(table_name, error);
     if (!error.is_ok())
       return;
 
     // Remove table as well
-    table_it->second.remove_file(error);
+    this->uncache_table(input_name, error);
+    if (!error.is_ok())
+      return;
+    SqlTableFile table_file(this->table_file_name(input_name),
+                            this->m_buffer_pool);
+    table_file.remove_file(error);
     if (!error.is_ok())
       return;
-    this->tables.erase(table_it);
-  }
 
-  /// Run a select statement
-  void run_select_statement(parser::SqlStatementSelect &statement,
-                            QueryRowsResult &result,
+    // and its indexes
+    this->remove_primary_key_file(input_name, error);
+    if (!error.is_ok())
+      return;
+    std::vector<std::string> index_names;
+    const std::unordered_map<std::string, SqlIndexEntry> &indexes =
+        this->m_index.get_indexes();
+    for (auto index_it = indexes.begin(); index_it != indexes.end();
+         index_it++) {
+      if (index_it->second.table_name == input_name)
+        index_names.push_back(index_it->first);
+    }
+    for (size_t i = 0; i < index_names.size(); i++) {
+      SmallString<TABLE_NAME_MAX_LENGTH> index_name(index_names[i].c_str(),
+                                                    index_names[i].size());
+      this->m_index.remove_index(index_name, error);
+      if (!error.is_ok())
+        return;
+      SqlFile index_file(this->index_file_name(input_name, index_names[i]),
+                         this->m_buffer_pool);
+      index_file.remove_file(error);
+      if (!error.is_ok())
+        return;
+    }
 
-                            SqlError &error) {
-    // Locate index of name
-    size_t index =
-        this->m_index.index_of_table_name(statement.table_name, error);
+    // persist
+    this->m_index.flush(error);
     if (!error.is_ok())
       return;
-    if (index == -1) {
-      error.set_missing();
+  }
+
+  /// Create a b+tree or hash index of a table column from its rows
+  void run_create_index(const parser::SqlStatementCreateIndex &statement,
+                        SqlError &error) {
+    // check for dupes in index
+    if (this->m_index.find_index(statement.index_name) != nullptr) {
+      error.set_already_exists();
       return;
     }
 
-    // fetch file
+    // fetch file, opening it if needed
     std::string table_name(statement.table_name.get_ptr(),
                            statement.table_name.size());
-    auto table_it = this->tables.find(table_name);
-    if (table_it == this->tables.end()) {
-      panic("select table present in index, missing in map");
+    SqlTableFile *table = this->get_table(table_name, error);
+    if (!error.is_ok())
+      return;
+    int column = table->get_index_of_column_name(statement.column_name);
+    if (column == -1) {
       error.set_missing();
       return;
     }
 
-    if (statement.join_type == parser::SqlJoinType::None) {
-      const parser::SqlWhereClause *where_clause =
-          statement.has_where_clause ? &statement.where_clause : nullptr;
-      table_it->second.query_rows(statement.column_names, where_clause, result,
-                                  error);
+    // build from every logged row
+    this->checkpoint(error);
+    if (!error.is_ok())
+      return;
+
+    std::string index_name(statement.index_name.get_ptr(),
+                           statement.index_name.size());
+    std::string file_name = this->index_file_name(table_name, index_name);
+    const parser::SqlType &key_type = table->get_columns()[column].type;
+    bool create = true;
+    SqlIndexSlotKind kind = SqlIndexSlotKind::BTREE_INDEX;
+    switch (statement.type) {
+    case parser::SqlIndexType::BTREE: {
+      SqlBTreeFile tree(file_name, this->m_buffer_pool);
+      tree.open(create, key_type, error);
       if (!error.is_ok())
         return;
-    } else {
-      // Locate index of joined table name
-      size_t joined_index =
-          this->m_index.index_of_table_name(statement.joined_table_name, error);
+      table->build_index(column, tree, error);
       if (!error.is_ok())
         return;
-      if (index == -1) {
-        error.set_missing();
-        return;
-      }
 
-      // fetch file
-      std::string joined_table_name(statement.joined_table_name.get_ptr(),
-                                    statement.joined_table_name.size());
-      auto joined_table_it = this->tables.find(joined_table_name);
-      if (joined_table_it == this->tables.end()) {
-        panic("select joined table present in index, missing in map");
-        error.set_missing();
+      // persist
+      tree.flush(error);
+      if (!error.is_ok())
+        return;
+      table->attach_index(index_name, column, std::move(tree));
+      break;
+    }
+    case parser::SqlIndexType::HASH: {
+      SqlHashFile hash(file_name, this->m_buffer_pool);
+      hash.open(create, key_type, error);
+      if (!error.is_ok())
+        return;
+      table->build_index(column, hash, error);
+      if (!error.is_ok())
         return;
-      }
 
-      // fetch first table
-      QueryRowsResult first_result;
-      table_it->second.query_rows(statement.column_names, nullptr, first_result,
-                                  error);
+      // persist
+      hash.flush(error);
       if (!error.is_ok())
         return;
+      table->attach_index(index_name, column, std::move(hash));
+      kind = SqlIndexSlotKind::HASH_INDEX;
+      break;
+    }
+    }
+
+    // insert into index
+    this->m_index.add_index(statement.index_name, kind, statement.table_name,
+                            statement.column_name, error);
+    if (!error.is_ok())
+      return;
 
-      // fetch second table
-      QueryRowsResult second_result;
-      joined_table_it->second.query_rows(statement.column_names, nullptr,
-                                         second_result, error);
+    // persist
+    this->m_index.flush(error);
+    if (!error.is_ok())
+      return;
+  }
+
+  /// Remove an index
+  void run_drop_index(const parser::SqlStatementDropIndex &statement,
+                      SqlError &error) {
+    const SqlIndexEntry *entry = this->m_index.find_index(statement.index_name);
+    if (entry == nullptr) {
+      error.set_missing();
+      return;
+    }
+    std::string table_name = entry->table_name;
+    std::string index_name(statement.index_name.get_ptr(),
+                           statement.index_name.size());
+
+    // no record may be applied to a half removed index
+    this->checkpoint(error);
+    if (!error.is_ok())
+      return;
+
+    // Remove
+    this->m_index.remove_index(statement.index_name, error);
+    if (!error.is_ok())
+      return;
+
+    // Remove the file as well
+    SqlTableFile *table = this->get_table(table_name, error);
+    if (!error.is_ok())
+      return;
+    table->remove_index(index_name, error);
+    if (!error.is_ok())
+      return;
+
+    // persist
+    this->m_index.flush(error);
+    if (!error.is_ok())
+      return;
+  }
+
+  /// Run a select statement, reading every row into `result`
+  void run_select_statement(parser::SqlStatementSelect &statement,
+                            QueryRowsResult &result, SqlError &error) {
+    SqlSelectCursor cursor;
+    this->open_select(statement, cursor, error);
+    if (!error.is_ok())
+      return;
+
+    result.columns = cursor.columns();
+    SmallVec<COLUMN_MAX, SqlValue> row;
+    while (cursor.next(row, error))
+      result.rows.push_back(row);
+  }
+
+  /// Start reading the rows of a select statement.
+  ///
+  /// The statement must outlive the cursor, and no other statement may run
+  /// while it is open.
+  void open_select(parser::SqlStatementSelect &statement,
+                   SqlSelectCursor &cursor, SqlError &error) {
+    cursor.close();
+    // fetch file, opening it if needed
+    std::string table_name(statement.table_name.get_ptr(),
+                           statement.table_name.size());
+    SqlTableFile *table = this->get_table(table_name, error);
+    if (!error.is_ok())
+      return;
+    table->invalidate_if_modified(error);
+    if (!error.is_ok())
+      return;
+
+    if (statement.join_type == parser::SqlJoinType::None) {
+      const parser::SqlWhereClause *where_clause =
+          statement.has_where_clause ? &statement.where_clause : nullptr;
+      cursor.m_table_cursor.open(table, statement.column_names, where_clause,
+                                 error);
+      if (!error.is_ok())
+        return;
+      cursor.m_columns = cursor.m_table_cursor.columns();
+    } else {
+      // fetch joined file, opening it if needed
+      std::string joined_table_name(statement.joined_table_name.get_ptr(),
+                                    statement.joined_table_name.size());
+      SqlTableFile *joined_table = this->get_table(joined_table_name, error);
+      if (!error.is_ok())
+        return;
+      joined_table->invalidate_if_modified(error);
       if (!error.is_ok())
         return;
 
       // get column indexes
-      int first_column_index = table_it->second.get_index_of_column_name(
+      int first_column_index = table->get_index_of_column_name(
           statement.primary_join_column_name);
       assert(first_column_index != -1);
       int second_column_index =
-          joined_table_it->second.get_index_of_column_name(
+          joined_table->get_index_of_column_name(
               statement.secondary_join_column_name);
       assert(second_column_index != -1);
 
-      // build column name header
-      for (size_t i = 0; i < table_it->second.get_columns().size(); i++) {
-        result.columns.push(table_it->second.get_columns()[i]);
+      // each table keeps the columns selected from it and its join column,
+      // so the joined rows only hold those.
+      parser::SqlJoinType join_type = statement.join_type;
+      SqlJoinInput first_input{table, (size_t)first_column_index, nullptr,
+                               SmallVec<COLUMN_MAX, size_t>()};
+      SqlJoinInput second_input{joined_table, (size_t)second_column_index,
+                                nullptr, SmallVec<COLUMN_MAX, size_t>()};
+      // the position of each selected column among the kept columns of its
+      // table
+      SmallVec<COLUMN_MAX, size_t> positions;
+      SmallVec<COLUMN_MAX, bool> secondaries;
+      if (statement.column_names.size() == 0) {
+        for (size_t i = 0; i < table->get_columns().size(); i++) {
+          first_input.columns.push(i);
+          cursor.m_columns.push(table->get_columns()[i]);
+        }
+        for (size_t i = 0; i < joined_table->get_columns().size(); i++) {
+          second_input.columns.push(i);
+          cursor.m_columns.push(joined_table->get_columns()[i]);
+        }
+      } else {
+        for (size_t i = 0; i < statement.column_names.size(); i++) {
+          bool secondary = false;
+          int column = this->find_join_column(
+              *table, *joined_table, statement.column_tables[i],
+              statement.column_names[i], secondary);
+          if (column == -1) {
+            error.set_missing();
+            return;
+          }
+
+          SqlJoinInput &input = secondary ? second_input : first_input;
+          positions.push(keep_join_column(input, column));
+          secondaries.push(secondary);
+          cursor.m_columns.push(input.table->get_columns()[column]);
+        }
       }
-      for (size_t i = 0; i < joined_table_it->second.get_columns().size();
-           i++) {
-        result.columns.push(joined_table_it->second.get_columns()[i]);
+      keep_join_column(first_input, first_column_index);
+      keep_join_column(second_input, second_column_index);
+
+      // filter the table of the where clause before joining. left rows
+      // padded with nulls never match it, so a left outer join filtered on
+      // the joined table is an inner join.
+      if (statement.has_where_clause) {
+        bool secondary = false;
+        int column = this->find_join_column(
+            *table, *joined_table, statement.where_table,
+            statement.where_clause.column_name, secondary);
+        if (column == -1) {
+          error.set_missing();
+          return;
+        }
+
+        SqlJoinInput &input = secondary ? second_input : first_input;
+        cursor.m_predicate.compile(statement.where_clause, column,
+                                   input.table->get_columns()[column].type);
+        input.predicate = &cursor.m_predicate;
+        if (secondary)
+          join_type = parser::SqlJoinType::Inner;
       }
 
-      // join nested loop
-      for (size_t first_result_index = 0;
-           first_result_index < first_result.rows.size();
-           first_result_index++) {
-        bool left_matched = false;
-        for (size_t second_result_index = 0;
-             second_result_index < second_result.rows.size();
-             second_result_index++) {
-
-          // if eq, copy row. append joined columns to first table columns.
-          bool join_match =
-              first_result.rows[first_result_index][first_column_index] ==
-              second_result.rows[second_result_index][second_column_index];
-          if (join_match)
-
-            if (join_match) {
-              left_matched = true;
-
-              SmallVec<COLUMN_MAX, SqlValue> row;
-              for (size_t i = 0;
-                   i < first_result.rows[first_result_index].size(); i++) {
-                row.push(first_result.rows[first_result_index][i]);
-              }
-              for (size_t i = 0;
-                   i < second_result.rows[second_result_index].size(); i++) {
-                row.push(second_result.rows[second_result_index][i]);
-              }
-
-              result.rows.push_back(row);
-            }
-        }
+      const parser::SqlType &first_type =
+          table->get_columns()[first_column_index].type;
+      const parser::SqlType &second_type =
+          joined_table->get_columns()[second_column_index].type;
+      uint64_t first_rows = table->get_num_values();
+      uint64_t second_rows = joined_table->get_num_values();
+      uint64_t num_rows = first_rows + second_rows;
+      bool sorted = table->primary_key_column() == first_column_index &&
+                    table->is_sorted() &&
+                    joined_table->primary_key_column() ==
+                        second_column_index &&
+                    joined_table->is_sorted();
+
+      // the rows of the smaller table are looked up in an index of the
+      // larger one, if it has one. values must encode like the index keys,
+      // as for a sort merge join. a left outer join needs the second table
+      // indexed.
+      bool index_first = false;
+      bool index_second = false;
+      if (can_sort_merge_join(first_type, second_type)) {
+        index_first = join_type == parser::SqlJoinType::Inner &&
+                      second_rows < first_rows &&
+                      table->has_index(first_column_index);
+        index_second = first_rows <= second_rows &&
+                       joined_table->has_index(second_column_index);
+      }
 
-        // if the left row didn't match, add it anyways and pad with nulls if
-        // this is a left outer join
-        if (statement.join_type == parser::SqlJoinType::LeftOuter &&
-            !left_matched) {
-          SmallVec<COLUMN_MAX, SqlValue> row;
-          for (size_t i = 0; i < first_result.rows[first_result_index].size();
-               i++) {
-            row.push(first_result.rows[first_result_index][i]);
-          }
+      if (index_first || index_second) {
+        cursor.m_join_cursor.open_index_nested_loop(
+            first_input, second_input, join_type, index_first, error);
+      } else if (can_sort_merge_join(first_type, second_type) &&
+                 (sorted ||
+                  num_rows * sizeof(SmallVec<COLUMN_MAX, SqlValue>) >
+                      this->m_join_memory_size)) {
+        // tables too large to hold in memory, or both in join key order,
+        // are joined by merging their sorted join values.
+        std::string file_prefix =
+            this->m_name + "/join-" + std::to_string(getpid()) + "-";
+        cursor.m_join_cursor.open_sort_merge(first_input, second_input,
+                                             join_type,
+                                             this->m_join_memory_size,
+                                             file_prefix, error);
+      } else {
+        // hash the smaller table, then probe it with the other
+        cursor.m_join_cursor.open_hash(first_input, second_input, join_type,
+                                       error);
+      }
+      if (!error.is_ok())
+        return;
 
-          while (row.size() != result.columns.size()) {
-            row.push(SqlValue());
-          }
-          result.rows.push_back(row);
-        }
+      cursor.m_joined = true;
+
+      // joined rows are put in select order as they are read, if they are
+      // not in order already
+      size_t first_width = first_input.columns.size();
+      for (size_t i = 0; i < positions.size(); i++) {
+        if (secondaries[i])
+          positions[i] += first_width;
       }
+      bool in_order = positions.size() == 0 ||
+                      positions.size() ==
+                          first_width + second_input.columns.size();
+      for (size_t i = 0; in_order && i < positions.size(); i++)
+        in_order = positions[i] == i;
+      if (!in_order)
+        cursor.m_positions = positions;
     }
   }
 
   /// Run an alter statement
   void run_alter_statement(const parser::SqlStatementAlter &statement,
                            SqlError &error) {
-    // Locate index of name
-    size_t index =
-        this->m_index.index_of_table_name(statement.table_name, error);
+    // fetch file, opening it if needed
+    std::string table_name(statement.table_name.get_ptr(),
+                           statement.table_name.size());
+    SqlTableFile *table = this->get_table(table_name, error);
     if (!error.is_ok())
       return;
-    if (index == -1) {
-      error.set_missing();
+    table->invalidate_if_modified(error);
+    if (!error.is_ok())
       return;
-    }
 
-    std::string table_name(statement.table_name.get_ptr(),
-                           statement.table_name.size());
-    auto table_it = this->tables.find(table_name);
-    if (table_it == this->tables.end()) {
-      panic("alter table present in index, missing in map");
-      error.set_missing();
+    // apply the log while the records match the columns
+    this->checkpoint(error);
+    if (!error.is_ok())
       return;
-    }
-    table_it->second.add_column(statement.column, error);
+
+    table->add_column(statement.column, error);
+    if (!error.is_ok())
+      return;
+
+    // persist
+    table->flush(error);
     if (!error.is_ok())
       return;
   }
@@ -383,60 +687,98 @@ public:
   /// Run an insert statement
   void run_insert_statement(const parser::SqlStatementInsert &statement,
                             SqlError &error) {
-    // Locate index of name
-    size_t index =
-        this->m_index.index_of_table_name(statement.table_name, error);
+    // fetch file, opening it if needed
+    std::string table_name(statement.table_name.get_ptr(),
+                           statement.table_name.size());
+    SqlTableFile *table = this->get_table(table_name, error);
     if (!error.is_ok())
       return;
-    if (index == -1) {
-      error.set_missing();
-      return;
-    }
 
-    std::string table_name(statement.table_name.get_ptr(),
-                           statement.table_name.size());
-    auto table_it = this->tables.find(table_name);
-    if (table_it == this->tables.end()) {
-      panic("alter table present in index, missing in map");
-      error.set_missing();
+    // the log lock keeps other processes from taking the same row id
+    this->m_wal.lock(error);
+    if (!error.is_ok())
       return;
-    }
 
-    // get # of records
-    uint8_t num_values = table_it->second.get_num_values();
+    this->insert_row(statement, *table, error);
 
-    // insert record
-    table_it->second.insert(num_values, statement.values, error);
+    SqlError unlock_error;
+    this->m_wal.unlock(unlock_error);
+    if (error.is_ok())
+      error = unlock_error;
     if (!error.is_ok())
       return;
 
-    // increase # of values
-    table_it->second.update_num_values(num_values + 1, error);
+    // persist
+    this->persist(statement.table_name, *table, error);
     if (!error.is_ok())
       return;
   }
 
-  /// Run an update statement
-  void run_update_statement(const parser::SqlStatementUpdate &statement,
-                            size_t &num_modified, SqlError &error) {
-    // Locate index of name
-    size_t index =
-        this->m_index.index_of_table_name(statement.table_name, error);
+  /// Insert the row of an insert statement, and write it back.
+  ///
+  /// The log lock must be held, so the table is read again and the row id
+  /// picked from what other processes wrote.
+  void insert_row(const parser::SqlStatementInsert &statement,
+                  SqlTableFile &table, SqlError &error) {
+    table.invalidate_if_modified(error);
     if (!error.is_ok())
       return;
-    if (index == -1) {
-      error.set_missing();
+
+    // every value must be stored in its column as the column type
+    SmallVec<COLUMN_MAX, SqlValue> row = statement.values;
+    table.convert_row(row, error);
+    if (!error.is_ok())
       return;
+
+    // a primary key must be given, and be unique
+    int primary_key = table.primary_key_column();
+    if (primary_key != -1) {
+      if ((size_t)primary_key >= row.size() ||
+          row[primary_key].type() == SqlValueType::Null) {
+        error.set_missing();
+        return;
+      }
+
+      uint64_t key_row_id = 0;
+      if (table.find_primary_key(row[primary_key], key_row_id, error)) {
+        error.set_already_exists();
+        return;
+      }
+      if (!error.is_ok())
+        return;
     }
 
+    // log the record, it goes into the slot of a deleted row if there is one,
+    // unless it keeps a primary key table sorted.
+    uint64_t row_id = table.next_row_id(row, error);
+    if (!error.is_ok())
+      return;
+    this->m_wal.log_row(SqlWalRecordType::INSERT, statement.table_name, row_id,
+                        row);
+    this->m_wal.commit(error);
+    if (!error.is_ok())
+      return;
+
+    // insert record, then write it back before the lock is released
+    table.put_row(row_id, row, error);
+    if (!error.is_ok())
+      return;
+    table.flush(error);
+  }
+
+  /// Run an update statement
+  void run_update_statement(const parser::SqlStatementUpdate &statement,
+                            size_t &num_modified, SqlError &error) {
+    // fetch file, opening it if needed
     std::string table_name(statement.table_name.get_ptr(),
                            statement.table_name.size());
-    auto table_it = this->tables.find(table_name);
-    if (table_it == this->tables.end()) {
-      panic("alter table present in index, missing in map");
-      error.set_missing();
+    SqlTableFile *table = this->get_table(table_name, error);
+    if (!error.is_ok())
+      return;
+
+    table->invalidate_if_modified(error);
+    if (!error.is_ok())
       return;
-    }
 
     // check if in txn
     if (this->m_in_transaction) {
@@ -463,39 +805,101 @@ public:
     }
 
     // update
-    table_it->second.update_rows(statement, this->m_in_transaction,
-                                 num_modified, error);
+    std::vector<BufferedRow> updated_rows;
+    table->update_rows(statement, updated_rows, error);
     if (!error.is_ok()) {
       if (this->m_abort_transaction)
         this->m_abort_transaction = true;
       return;
     }
+
+    // a primary key stays unique, so at most one row can get a new key
+    int primary_key = table->primary_key_column();
+    if (primary_key != -1 && !updated_rows.empty() &&
+        table->get_columns()[primary_key].name == statement.column_name) {
+      // the value is checked as stored, after it is converted
+      const SqlValue &key = updated_rows[0].row[primary_key];
+      if (key.type() == SqlValueType::Null) {
+        error.set_missing();
+        return;
+      }
+
+      uint64_t key_row_id = 0;
+      bool found = table->find_primary_key(key, key_row_id, error);
+      if (!error.is_ok())
+        return;
+      if (updated_rows.size() > 1 ||
+          (found && key_row_id != updated_rows[0].row_index)) {
+        error.set_already_exists();
+        return;
+      }
+
+      // the row may leave its place in key order
+      if (!found) {
+        table->set_sorted(false, error);
+        if (!error.is_ok())
+          return;
+      }
+    }
+    num_modified += updated_rows.size();
+
+    // a transaction logs its rows when it commits
+    if (this->m_in_transaction) {
+      table->buffer_rows(updated_rows);
+      return;
+    }
+
+    for (size_t i = 0; i < updated_rows.size(); i++) {
+      this->m_wal.log_row(SqlWalRecordType::UPDATE, statement.table_name,
+                          updated_rows[i].row_index, updated_rows[i].row);
+    }
+    this->m_wal.commit(error);
+    if (!error.is_ok())
+      return;
+
+    table->write_rows(updated_rows, error);
+    if (!error.is_ok())
+      return;
+
+    // persist
+    this->persist(statement.table_name, *table, error);
+    if (!error.is_ok())
+      return;
   }
 
   /// Run a delete statement
   void run_delete_statement(const parser::SqlStatementDelete &statement,
                             size_t &num_modified, SqlError &error) {
-    // Locate index of name
-    size_t index =
-        this->m_index.index_of_table_name(statement.table_name, error);
+    // fetch file, opening it if needed
+    std::string table_name(statement.table_name.get_ptr(),
+                           statement.table_name.size());
+    SqlTableFile *table = this->get_table(table_name, error);
     if (!error.is_ok())
       return;
-    if (index == -1) {
-      error.set_missing();
-      return;
-    }
 
-    std::string table_name(statement.table_name.get_ptr(),
-                           statement.table_name.size());
-    auto table_it = this->tables.find(table_name);
-    if (table_it == this->tables.end()) {
-      panic("alter table present in index, missing in map");
-      error.set_missing();
+    table->invalidate_if_modified(error);
+    if (!error.is_ok())
       return;
-    }
 
     // delete
-    table_it->second.delete_rows(statement, num_modified, error);
+    std::vector<uint64_t> deleted_rows;
+    table->delete_rows(statement, deleted_rows, error);
+    if (!error.is_ok())
+      return;
+    num_modified += deleted_rows.size();
+
+    for (size_t i = 0; i < deleted_rows.size(); i++)
+      this->m_wal.log_delete(statement.table_name, deleted_rows[i]);
+    this->m_wal.commit(error);
+    if (!error.is_ok())
+      return;
+
+    table->delete_row_ids(deleted_rows, error);
+    if (!error.is_ok())
+      return;
+
+    // persist
+    this->persist(statement.table_name, *table, error);
     if (!error.is_ok())
       return;
   }
@@ -510,6 +914,23 @@ public:
     if (this->m_abort_transaction)
       error.set_file_already_opened();
 
+    // log every table's rows, then make them durable together.
+    if (!this->m_abort_transaction) {
+      for (size_t i = 0; i < this->m_locks.size(); i++) {
+        SmallString<TABLE_NAME_MAX_LENGTH> table_name(
+            this->m_locks[i].c_str(), this->m_locks[i].size());
+        const std::vector<BufferedRow> &rows =
+            this->tables.find(this->m_locks[i])->second.buffered_rows();
+        for (size_t j = 0; j < rows.size(); j++) {
+          this->m_wal.log_row(SqlWalRecordType::UPDATE, table_name,
+                              rows[j].row_index, rows[j].row);
+        }
+      }
+      this->m_wal.commit(error);
+      if (!error.is_ok())
+        this->m_abort_transaction = true;
+    }
+
     for (size_t i = 0; i < this->m_locks.size(); i++) {
       if (!this->m_abort_transaction) {
         this->tables.find(this->m_locks[i])->second.commit(error);
@@ -523,21 +944,378 @@ public:
       }
     }
 
+    this->m_locks.clear();
     this->m_abort_transaction = false;
+
+    if (error.is_ok() && this->m_wal.size() >= WAL_CHECKPOINT_SIZE)
+      this->checkpoint(error);
   }
 
   /// Close this db
-  void close(SqlError &error) { this->m_index.close(error); }
+  void close(SqlError &error) {
+    for (auto table_it = this->tables.begin(); table_it != this->tables.end();
+         table_it++) {
+      table_it->second.close(error);
+      if (!error.is_ok())
+        return;
+    }
+    this->tables.clear();
+    this->m_table_lru.clear();
+    this->m_table_lru_positions.clear();
+
+    this->m_index.close(error);
+    if (!error.is_ok())
+      return;
+    this->m_wal.close(error);
+  }
 
 protected:
 private:
+  /// Find a column of a join by name, in the table it refers to.
+  ///
+  /// An unqualified name is looked up in the main table first. Sets
+  /// `secondary` if the column is of the joined table. Returns -1 if the
+  /// table has no such column.
+  static int find_join_column(SqlTableFile &table, SqlTableFile &joined_table,
+                              parser::SqlJoinTable join_table,
+                              const SmallString<COLUMN_NAME_MAX_LENGTH> &name,
+                              bool &secondary) {
+    secondary = false;
+    if (join_table != parser::SqlJoinTable::Secondary) {
+      int column = table.get_index_of_column_name(name);
+      if (column != -1 || join_table == parser::SqlJoinTable::Primary)
+        return column;
+    }
+
+    secondary = true;
+    return joined_table.get_index_of_column_name(name);
+  }
+
+  /// Apply every logged record to its table.
+  ///
+  /// The log lock must be held.
+  void apply_wal(SqlError &error) {
+    std::vector<SqlWalRecord> records;
+    this->m_wal.read_records(records, error);
+    if (!error.is_ok())
+      return;
+
+    // only the last record of a row matters
+    std::unordered_map<std::string, std::map<uint64_t, const SqlWalRecord *>>
+        last_records;
+    for (size_t i = 0; i < records.size(); i++) {
+      std::string table_name(records[i].table_name.get_ptr(),
+                             records[i].table_name.size());
+      last_records[table_name][records[i].row_id] = &records[i];
+    }
+
+    for (auto records_it = last_records.begin();
+         records_it != last_records.end(); records_it++) {
+      // the table may be gone
+      if (this->m_index.index_of_table_name(
+              records_it->second.begin()->second->table_name) == -1)
+        continue;
+
+      // tables that are not open are opened just for this, so the checkpoint
+      // never closes a table a statement is using.
+      // open tables are read again, so the log lands on top of what other
+      // processes wrote.
+      SqlTableFile uncached_table(this->table_file_name(records_it->first),
+                                  this->m_buffer_pool);
+      SqlTableFile *table = nullptr;
+      auto table_it = this->tables.find(records_it->first);
+      if (table_it != this->tables.end()) {
+        table = &table_it->second;
+        table->reload(error);
+      } else {
+        table = &uncached_table;
+        this->open_table(records_it->first, *table, error);
+      }
+      if (!error.is_ok())
+        return;
+
+      // apply each table in one batch, in row id order.
+      std::vector<BufferedRow> rows;
+      std::vector<uint64_t> deleted_rows;
+      for (auto record_it = records_it->second.begin();
+           record_it != records_it->second.end(); record_it++) {
+        const SqlWalRecord &record = *record_it->second;
+        if (record.type != SqlWalRecordType::DELETE) {
+          rows.push_back(BufferedRow{record.row_id, record.row});
+        } else if (record.row_id < table->get_num_values() &&
+                   !table->is_row_deleted(record.row_id)) {
+          deleted_rows.push_back(record.row_id);
+        }
+      }
+
+      table->put_rows(rows, error);
+      if (!error.is_ok())
+        return;
+      table->delete_row_ids(deleted_rows, error);
+      if (!error.is_ok())
+        return;
+      table->sync(error);
+      if (!error.is_ok())
+        return;
+    }
+  }
+
+  /// Get the file name of a table
+  std::string table_file_name(const std::string &table_name) const {
+    return this->m_name + "/" + table_name + ".table";
+  }
+
+  /// Get the file name of an index
+  std::string index_file_name(const std::string &table_name,
+                              const std::string &index_name) const {
+    return this->m_name + "/" + table_name + "." + index_name + ".index";
+  }
+
+  /// Get the file name of the primary key index of a table
+  std::string primary_key_file_name(const std::string &table_name) const {
+    return this->m_name + "/" + table_name + ".primary-key";
+  }
+
+  /// Remove the primary key index of a table, if it has one.
+  void remove_primary_key_file(const std::string &table_name,
+                               SqlError &error) {
+    std::string file_name = this->primary_key_file_name(table_name);
+    struct stat file_stat = {0};
+    if (stat(file_name.c_str(), &file_stat) != 0)
+      return;
+
+    SqlFile file(file_name, this->m_buffer_pool);
+    file.remove_file(error);
+  }
+
+  /// Open a table file, with the indexes of its columns.
+  void open_table(const std::string &table_name, SqlTableFile &table,
+                  SqlError &error) {
+    bool create = false;
+    table.open(create, error);
+    if (!error.is_ok())
+      return;
+
+    // the primary key index has no name, so no statement can drop it
+    int primary_key = table.primary_key_column();
+    if (primary_key != -1) {
+      SqlBTreeFile tree(this->primary_key_file_name(table_name),
+                        this->m_buffer_pool);
+      tree.open(create, table.get_columns()[primary_key].type, error);
+      if (!error.is_ok())
+        return;
+      table.attach_index("", primary_key, std::move(tree));
+    }
+
+    const std::unordered_map<std::string, SqlIndexEntry> &indexes =
+        this->m_index.get_indexes();
+    for (auto index_it = indexes.begin(); index_it != indexes.end();
+         index_it++) {
+      if (index_it->second.table_name != table_name)
+        continue;
+
+      int column = table.get_index_of_column_name(index_it->second.column_name);
+      if (column == -1) {
+        error.set_invalid_file();
+        return;
+      }
+
+      std::string file_name =
+          this->index_file_name(table_name, index_it->first);
+      const parser::SqlType &key_type = table.get_columns()[column].type;
+      switch (index_it->second.kind) {
+      case SqlIndexSlotKind::HASH_INDEX: {
+        SqlHashFile hash(file_name, this->m_buffer_pool);
+        hash.open(create, key_type, error);
+        if (!error.is_ok())
+          return;
+        table.attach_index(index_it->first, column, std::move(hash));
+        break;
+      }
+      default: {
+        SqlBTreeFile tree(file_name, this->m_buffer_pool);
+        tree.open(create, key_type, error);
+        if (!error.is_ok())
+          return;
+        table.attach_index(index_it->first, column, std::move(tree));
+        break;
+      }
+      }
+    }
+  }
+
+  /// Get a table, opening it if it is not open.
+  ///
+  /// Sets a missing error if the table is not in the index.
+  SqlTableFile *get_table(const std::string &table_name, SqlError &error) {
+    auto table_it = this->tables.find(table_name);
+    if (table_it != this->tables.end()) {
+      // mark as most recently used
+      this->m_table_lru.splice(this->m_table_lru.begin(), this->m_table_lru,
+                               this->m_table_lru_positions[table_name]);
+      return &table_it->second;
+    }
+
+    SmallString<TABLE_NAME_MAX_LENGTH> name(table_name.c_str(),
+                                            table_name.size());
+    if (this->m_index.index_of_table_name(name) == -1) {
+      error.set_missing();
+      return nullptr;
+    }
+
+    SqlTableFile table_file(this->table_file_name(table_name),
+                            this->m_buffer_pool);
+    this->open_table(table_name, table_file, error);
+    if (!error.is_ok())
+      return nullptr;
+
+    return this->cache_table(table_name, std::move(table_file), error);
+  }
+
+  /// Keep an open table, closing the least recently used tables past the
+  /// cache size.
+  ///
+  /// Tables locked by a transaction hold its rows, so they stay open.
+  SqlTableFile *cache_table(const std::string &table_name,
+                            SqlTableFile &&table_file, SqlError &error) {
+    SqlTableFile *table =
+        &this->tables.insert({table_name, std::move(table_file)})
+             .first->second;
+    this->m_table_lru.push_front(table_name);
+    this->m_table_lru_positions[table_name] = this->m_table_lru.begin();
+
+    auto lru_it = this->m_table_lru.end();
+    while (this->tables.size() > this->m_table_cache_size &&
+           lru_it != this->m_table_lru.begin()) {
+      lru_it--;
+      bool locked = std::find(this->m_locks.begin(), this->m_locks.end(),
+                              *lru_it) != this->m_locks.end();
+      if (locked || *lru_it == table_name)
+        continue;
+
+      std::string evicted_name = *lru_it;
+      lru_it++;
+      this->uncache_table(evicted_name, error);
+      if (!error.is_ok())
+        return nullptr;
+    }
+
+    return table;
+  }
+
+  /// Close a table if it is open.
+  void uncache_table(const std::string &table_name, SqlError &error) {
+    auto table_it = this->tables.find(table_name);
+    if (table_it == this->tables.end())
+      return;
+
+    table_it->second.close(error);
+    if (!error.is_ok())
+      return;
+    this->tables.erase(table_it);
+
+    auto position_it = this->m_table_lru_positions.find(table_name);
+    this->m_table_lru.erase(position_it->second);
+    this->m_table_lru_positions.erase(position_it);
+  }
+
+  /// Write back a table after a logged change, checkpointing if the log is
+  /// big.
+  ///
+  /// The log makes the change durable, so the table is not synced. A primary
+  /// key table with rows out of order is sorted before the checkpoint, so
+  /// the sort is paid for once per checkpoint at most. The sort moves rows,
+  /// so it takes the table's lock, and waits for the next checkpoint if
+  /// another session holds it.
+  void persist(const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+               SqlTableFile &table, SqlError &error) {
+    table.flush(error);
+    if (!error.is_ok())
+      return;
+
+    if (this->m_wal.size() < WAL_CHECKPOINT_SIZE)
+      return;
+
+    // rows held for a transaction keep their ids
+    if (!table.is_sorted() && table.buffered_rows().empty()) {
+      std::string lock_file_path = this->m_name + "/" +
+                                   std::string(table_name.get_ptr(),
+                                               table_name.size()) +
+                                   ".lock";
+      int lock_fd =
+          ::open(lock_file_path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+      if (lock_fd != -1) {
+        ::close(lock_fd);
+        this->sort_table(table_name, table, error);
+        if (unlink(lock_file_path.c_str()) != 0 && error.is_ok())
+          error.set_io();
+        if (!error.is_ok())
+          return;
+      } else if (errno != EEXIST) {
+        error.set_io();
+        return;
+      }
+    }
+
+    this->checkpoint(error);
+  }
+
+  /// Sort the rows of a primary key table by key.
+  ///
+  /// The moves are logged like updates, so a crash part way through is
+  /// finished by the log.
+  void sort_table(const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+                  SqlTableFile &table, SqlError &error) {
+    std::vector<BufferedRow> moved_rows;
+    std::vector<uint64_t> deleted_rows;
+    table.sort_rows(moved_rows, deleted_rows, error);
+    if (!error.is_ok())
+      return;
+
+    for (size_t i = 0; i < moved_rows.size(); i++) {
+      this->m_wal.log_row(SqlWalRecordType::UPDATE, table_name,
+                          moved_rows[i].row_index, moved_rows[i].row);
+    }
+    for (size_t i = 0; i < deleted_rows.size(); i++)
+      this->m_wal.log_delete(table_name, deleted_rows[i]);
+    this->m_wal.commit(error);
+    if (!error.is_ok())
+      return;
+
+    table.put_rows(moved_rows, error);
+    if (!error.is_ok())
+      return;
+    table.delete_row_ids(deleted_rows, error);
+    if (!error.is_ok())
+      return;
+    table.set_sorted(true, error);
+    if (!error.is_ok())
+      return;
+
+    table.flush(error);
+  }
+
   std::string m_name;
 
+  /// The buffer pool shared by the files, or nullptr if unbuffered
+  SqlBufferPool *m_buffer_pool;
   SqlIndexFile m_index;
+  /// The log of row changes
+  SqlWriteAheadLog m_wal;
+  /// The max # of tables that stay open
+  size_t m_table_cache_size;
+  /// The # of bytes a join may hold in memory
+  size_t m_join_memory_size;
   bool m_in_transaction;
   bool m_abort_transaction;
   std::vector<std::string> m_locks;
+  /// The open tables
   std::unordered_map<std::string, SqlTableFile> tables;
+  /// The names of the open tables, most recently used first
+  std::list<std::string> m_table_lru;
+  /// The position of each open table in the lru list
+  std::unordered_map<std::string, std::list<std::string>::iterator>
+      m_table_lru_positions;
 };
 } // namespace basic_sql
 #endif
\ No newline at end of file
@@ -33,6 +33,8 @@ enum class SqlErrorType {
   Io,
   /// Invalid File
   InvalidFile,
+  /// A value does not have the type of its column
+  TypeMismatch,
 };
 
 /// fmt a sql error type
@@ -71,6 +73,8 @@ public:
   void set_io() { this->m_type = SqlErrorType::Io; }
   /// Set invalid file error
   void set_invalid_file() { this->m_type = SqlErrorType::InvalidFile; }
+  /// Set type mismatch error
+  void set_type_mismatch() { this->m_type = SqlErrorType::TypeMismatch; }
 
 private:
   SqlErrorType m_type;
@@ -0,0 +1,104 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_EXTERNAL_SORT_H_
+#define _SQL_EXTERNAL_SORT_H_
+
+#include "SqlError.h"
+#include "SqlFile.h"
+#include <string>
+#include <vector>
+
+namespace basic_sql {
+/// The least # of bytes of records an external sort holds in memory
+static const size_t SQL_EXTERNAL_SORT_MIN_MEMORY = 64 * 1024;
+
+/// A sorted run of records in a file, read back a block at a time
+struct SqlSortRun {
+  SqlFile file;
+  /// The # of bytes of records in the file
+  uint64_t size;
+  /// The file offset of the block in `buffer`
+  uint64_t position;
+  /// The current block of records
+  std::vector<uint8_t> buffer;
+  /// The offset of the current record in `buffer`
+  size_t offset;
+};
+
+/// Sorts fixed size records by their bytes, as `memcmp` orders them
+///
+/// Records are held in memory up to a limit. Past it, they are sorted into
+/// runs that are written to files, and the runs are merged as the records
+/// are read back. The files are removed when the sort is done with.
+class SqlExternalSort {
+public:
+  /// Make a sort of `record_size` byte records, holding at most about
+  /// `memory_size` bytes of them in memory.
+  ///
+  /// Run files are named `file_prefix` followed by the run #.
+  SqlExternalSort(std::string file_prefix, size_t record_size,
+                  size_t memory_size);
+  SqlExternalSort(const SqlExternalSort &other) = delete;
+  SqlExternalSort &operator=(SqlExternalSort &other) = delete;
+
+  /// Remove the run files, ignoring errors.
+  ~SqlExternalSort();
+
+  /// Add a record.
+  ///
+  /// Records cannot be added after `finish`.
+  void add(const uint8_t *record, SqlError &error);
+
+  /// Sort the records, so they can be read back with `next`.
+  void finish(SqlError &error);
+
+  /// Get the next record in order, or nullptr once every record was read.
+  ///
+  /// The record is only good until the next call.
+  const uint8_t *next(SqlError &error);
+
+  /// Get the # of runs written to files
+  size_t num_runs() const;
+
+  /// Remove the run files.
+  void remove_files(SqlError &error);
+
+private:
+  /// Sort the records in memory.
+  void sort_records();
+
+  /// Sort the records in memory, then write them out as a new run.
+  void spill_run(SqlError &error);
+
+  /// Read the block of a run that holds `position`.
+  void read_block(SqlSortRun &run, uint64_t position, SqlError &error);
+
+  /// Returns true if the current record of run `lhs` sorts after the
+  /// current record of run `rhs`.
+  bool run_after(size_t lhs, size_t rhs) const;
+
+  /// The prefix of the run file names
+  std::string m_file_prefix;
+  /// The size of a record
+  size_t m_record_size;
+  /// The # of records held in memory before a run is written
+  size_t m_max_records;
+  /// The # of bytes of a run read at once while merging
+  size_t m_block_size;
+  /// Records in memory, back to back
+  std::vector<uint8_t> m_records;
+  /// The # of records in `m_records` already read by `next`
+  size_t m_next_record;
+  /// The runs written to files
+  std::vector<SqlSortRun> m_runs;
+  /// A min heap of the runs that have records left, by current record
+  std::vector<size_t> m_heap;
+  /// The last record `next` returned from a run
+  std::vector<uint8_t> m_current;
+  /// Set once `finish` was called
+  bool m_finished;
+};
+} // namespace basic_sql
+
+#endif
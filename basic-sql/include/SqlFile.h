@@ -6,17 +6,28 @@
 
 #include "SqlError.h"
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <sys/uio.h>
+#include <vector>
 
 namespace basic_sql {
+class SqlBufferPool;
+
 /// An interface to a file
+///
+/// All I/O is positional, with pread/pwrite on a raw fd. `seek` only moves a
+/// cursor used by `read` and `write`, so `read_at` and `read_vectored` never
+/// depend on shared file state.
 class SqlFile {
 public:
   /// Initializes the file with a name.
   ///
   /// This does not open the file.
+  /// If a buffer pool is given, reads and writes go through it.
   SqlFile() = delete;
-  SqlFile(std::string name);
+  SqlFile(std::string name, SqlBufferPool *buffer_pool = nullptr);
   SqlFile(SqlFile &other) = delete;
   SqlFile &operator=(const SqlFile &other) = delete;
   SqlFile(SqlFile &&other) noexcept;
@@ -25,6 +36,8 @@ public:
   ~SqlFile();
 
   /// Open the file.
+  ///
+  /// The flags are fopen-style: "r", "r+", "w" or "w+", optionally with a "b".
   void open(const char *flags, SqlError &error);
 
   /// Return `true` if this file is closed.
@@ -39,20 +52,95 @@ public:
   /// Read bytes from a file to a ptr
   void read(uint8_t *ptr, size_t len, SqlError &error);
 
-  /// Seek the file. Uses absolute positioning.
-  void seek(long int offset, SqlError &error);
+  /// Write bytes at an offset, without moving the position.
+  void write_at(uint64_t offset, const uint8_t *ptr, size_t len,
+                SqlError &error);
+
+  /// Read bytes at an offset, without moving the position.
+  ///
+  /// Like fread, reading past the end is an error.
+  void read_at(uint64_t offset, uint8_t *ptr, size_t len, SqlError &error);
+
+  /// Read into several buffers starting at an offset, with as few syscalls as
+  /// possible.
+  ///
+  /// This bypasses the buffer pool. Bytes past the end of the file read as 0.
+  void read_vectored(uint64_t offset, const struct iovec *iov,
+                     size_t iov_count, SqlError &error);
+
+  /// Write several buffers starting at an offset, with as few syscalls as
+  /// possible.
+  ///
+  /// This bypasses the buffer pool.
+  void write_vectored(uint64_t offset, const struct iovec *iov,
+                      size_t iov_count, SqlError &error);
+
+  /// Seek the file. Uses absolute, 64-bit positioning.
+  void seek(uint64_t offset, SqlError &error);
 
   /// Get the current postion
-  void position(size_t &position, SqlError &error);
+  void position(uint64_t &position, SqlError &error);
 
   /// Get the name of the file
   const std::string &name() const;
 
   /// Flush the file
-  void flush(SqlError &error) {
-    // TODO: Return error
-    assert(fflush(this->m_file) == 0);
-  }
+  ///
+  /// This writes back dirty pages in the buffer pool.
+  void flush(SqlError &error);
+
+  /// Flush the file, then wait until its data is on disk.
+  void sync(SqlError &error);
+
+  /// Take an exclusive lock on the whole file, shared with other processes.
+  ///
+  /// This blocks until the lock is free. The logical size is read again from
+  /// disk, since another process may have grown the file. This is meant for
+  /// unbuffered files.
+  void lock(SqlError &error);
+
+  /// Release the lock taken by `lock`.
+  void unlock(SqlError &error);
+
+  /// Cut the file down to `size` bytes.
+  ///
+  /// This is meant for unbuffered files.
+  void truncate(uint64_t size, SqlError &error);
+
+  /// Get the logical size of the file
+  uint64_t size() const;
+
+  /// Drop cached pages if the file was changed on disk by someone else.
+  ///
+  /// This does nothing if there is no buffer pool, or if there are unflushed
+  /// writes. Returns true if the file changed.
+  bool invalidate_if_modified(SqlError &error);
+
+  /// Map the whole file into memory for reading.
+  ///
+  /// Pending writes are flushed first, so the mapping sees them.
+  /// Returns nullptr if the file cannot be mapped; use `read` instead then.
+  /// The mapping stays usable until the next write.
+  const uint8_t *map(SqlError &error);
+
+  /// Get the mapped file, or nullptr if it is not mapped or was written to
+  /// since it was mapped.
+  const uint8_t *mapped_data() const;
+
+  /// Get the # of mapped bytes
+  uint64_t mapped_size() const;
+
+  /// Read a whole page from the file, bypassing the buffer pool.
+  ///
+  /// Bytes past the end of the file read as 0.
+  void read_page(uint64_t page, uint8_t *buffer, SqlError &error);
+
+  /// Write a run of consecutive pages to the file, bypassing the buffer pool.
+  ///
+  /// The run is written with one vectored write where possible.
+  /// The file is not extended past its logical size.
+  void write_pages(uint64_t first_page, const uint8_t *const *buffers,
+                   size_t count, SqlError &error);
 
   /// Close and remove this file.
   void remove_file(SqlError &error) {
@@ -64,18 +152,63 @@ public:
   }
 
   /// write a byte n times
+  ///
+  /// the bytes are written in blocks, not one at a time.
   void write_byte_n(uint8_t byte, size_t n, SqlError &error) {
-    for (size_t i = 0; i < n; i++) {
-      this->write(&byte, 1, error);
+    uint8_t block[512];
+    memset(block, byte, n < sizeof(block) ? n : sizeof(block));
+    while (n != 0) {
+      size_t len = n < sizeof(block) ? n : sizeof(block);
+      this->write(block, len, error);
       if (!error.is_ok())
         return;
+      n -= len;
     }
   }
 
 private:
-  FILE *m_file;
+  /// Remember the size and modification time of the file on disk.
+  void record_disk_state(SqlError &error);
+
+  /// Drop the mapping, if any.
+  void unmap();
+
+  /// Read up to `len` bytes at an offset, stopping early only at the end of
+  /// the file.
+  ///
+  /// Returns the # of bytes read.
+  size_t pread_full(uint64_t offset, uint8_t *ptr, size_t len,
+                    SqlError &error);
+
+  /// Skip `len` transferred bytes of a list of iovecs, starting at `index`.
+  static void advance_iovecs(std::vector<struct iovec> &iov, size_t &index,
+                             size_t len);
+
+  /// The file descriptor, or -1 if closed
+  int m_fd;
   std::string m_name;
+
+  /// The buffer pool, or nullptr if unbuffered
+  SqlBufferPool *m_buffer_pool;
+  /// The id of this file in the buffer pool
+  uint32_t m_buffer_pool_file_id;
+  /// The cursor used by `read` and `write`
+  uint64_t m_position;
+  /// The logical size, including unflushed pages in the buffer pool
+  uint64_t m_size;
+
+  /// The size of the file on disk when last checked
+  uint64_t m_disk_size;
+  /// The modification time of the file on disk when last checked, in ns
+  int64_t m_disk_mtime;
+
+  /// The read-only mapping of the file, or nullptr
+  uint8_t *m_map;
+  /// The # of mapped bytes
+  uint64_t m_map_size;
+  /// False if the file was written to since it was mapped
+  bool m_map_valid;
 };
 
 } // namespace basic_sql
-#endif
\ No newline at end of file
+#endif
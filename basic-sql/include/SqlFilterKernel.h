@@ -0,0 +1,46 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_FILTER_KERNEL_H_
+#define _SQL_FILTER_KERNEL_H_
+
+#include "SqlToken.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace basic_sql {
+/// The instructions a filter kernel uses
+enum class SqlFilterKernel {
+  /// One value at a time
+  Scalar,
+  /// 4 values at a time, with SSE4.2
+  Sse42,
+  /// 8 values at a time, with AVX2
+  Avx2,
+};
+
+/// Get the fastest filter kernel the cpu supports.
+///
+/// The cpu is only checked the first time.
+SqlFilterKernel best_filter_kernel();
+
+/// Set bit i of `bitmap` if packed INT i compares to a target, and clear it
+/// otherwise.
+///
+/// Values compare as unsigned, on the left of the operator. `bitmap` must
+/// hold a bit for every value.
+void match_ints(SqlFilterKernel kernel, const uint8_t *values,
+                size_t num_values, tokenizer::SqlOperator op, uint32_t target,
+                uint64_t *bitmap);
+
+/// Set bit i of `bitmap` if packed FLOAT i compares to a target, and clear
+/// it otherwise.
+///
+/// Values are on the left of the operator. NaN is only not equal. `bitmap`
+/// must hold a bit for every value.
+void match_floats(SqlFilterKernel kernel, const uint8_t *values,
+                  size_t num_values, tokenizer::SqlOperator op, float target,
+                  uint64_t *bitmap);
+} // namespace basic_sql
+
+#endif
@@ -0,0 +1,198 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_HASH_FILE_H_
+#define _SQL_HASH_FILE_H_
+
+#include "Limits.h"
+#include "SqlFile.h"
+#include "SqlStatement.h"
+#include <string>
+#include <vector>
+
+namespace basic_sql {
+/// hash file magic #
+static const char *SQL_HASH_FILE_MAGIC = "hash-idx";
+/// hash file magic # length
+static const size_t SQL_HASH_FILE_MAGIC_SIZE = 8;
+/// the offset to the key type field
+///
+/// a u8 `tokenizer::SqlType`, then a u8 type size.
+static const size_t SQL_HASH_FILE_KEY_TYPE_OFFSET = SQL_HASH_FILE_MAGIC_SIZE;
+/// the offset to the level field
+///
+/// this is a u64. the table has at least 2^level buckets.
+static const size_t SQL_HASH_FILE_LEVEL_OFFSET = 16;
+/// the offset to the split field
+///
+/// this is a u64, the next bucket to split. buckets below it were split in
+/// this level, so there are 2^level + split buckets.
+static const size_t SQL_HASH_FILE_SPLIT_OFFSET = SQL_HASH_FILE_LEVEL_OFFSET + 8;
+/// the offset to the num_entries field
+///
+/// this is a u64 count of every key in the table.
+static const size_t SQL_HASH_FILE_NUM_ENTRIES_OFFSET =
+    SQL_HASH_FILE_SPLIT_OFFSET + 8;
+/// the offset to the num_pages field
+///
+/// num_pages is a u64 counting every page in the file, including the header.
+static const size_t SQL_HASH_FILE_NUM_PAGES_OFFSET =
+    SQL_HASH_FILE_NUM_ENTRIES_OFFSET + 8;
+/// the offset to the first free page field
+///
+/// this is a u64 page number, or 0 if there is no free page. free pages are
+/// chained through their overflow field.
+static const size_t SQL_HASH_FILE_FREE_PAGE_OFFSET =
+    SQL_HASH_FILE_NUM_PAGES_OFFSET + 8;
+/// the offset to the bucket group table
+///
+/// a u64 page number per group of buckets. group 0 is bucket 0, group g is
+/// buckets [2^(g-1), 2^g). the buckets of a group have consecutive pages.
+static const size_t SQL_HASH_FILE_GROUPS_OFFSET =
+    SQL_HASH_FILE_FREE_PAGE_OFFSET + 8;
+/// the max # of bucket groups
+static const size_t SQL_HASH_FILE_MAX_GROUPS = 48;
+/// the size of the header fields in page 0
+static const size_t SQL_HASH_FILE_HEADER_SIZE =
+    SQL_HASH_FILE_GROUPS_OFFSET + (SQL_HASH_FILE_MAX_GROUPS * 8);
+/// the size of the header of a bucket page
+///
+/// a u16 entry count, 6 reserved bytes, then the u64 page number of the next
+/// page of the bucket (0 if none).
+static const size_t SQL_HASH_FILE_PAGE_HEADER_SIZE = 2 + 6 + 8;
+/// the # of keys per bucket page, in 1/4ths, past which a bucket is split
+static const size_t SQL_HASH_FILE_SPLIT_LOAD = 3;
+
+/// A linear hash table of (column value, row id) keys, stored in a file
+///
+/// Keys are encoded column values. Equal values hash alike, the way
+/// `SqlValue` compares values of the column type. Each bucket is a page with
+/// a chain of overflow pages. Once the table is 3/4 full, the next bucket in
+/// order is split in two, so the table grows one bucket at a time and a probe
+/// reads about one page. Removing keys never shrinks the table.
+class SqlHashFile {
+public:
+  /// Make a new unopened file
+  ///
+  /// If a buffer pool is given, the file is read and written through it.
+  SqlHashFile(std::string name, SqlBufferPool *buffer_pool = nullptr);
+  SqlHashFile(const SqlHashFile &other) = delete;
+  SqlHashFile &operator=(SqlHashFile &other) = delete;
+  SqlHashFile(SqlHashFile &&other) noexcept;
+  SqlHashFile &operator=(SqlHashFile &&other);
+
+  /// Open the file.
+  ///
+  /// A new file is an empty table of keys of the given type. An existing file
+  /// keeps the type it was created with.
+  void open(bool create, const parser::SqlType &key_type, SqlError &error);
+
+  /// Add keys to a new table.
+  ///
+  /// `keys` holds an encoded value for each row in `row_ids`.
+  void bulk_load(const std::vector<uint8_t> &keys,
+                 const std::vector<uint64_t> &row_ids, SqlError &error);
+
+  /// Add a key. Adding a key that is already there does nothing.
+  void insert(const uint8_t *key, uint64_t row_id, SqlError &error);
+
+  /// Remove a key. Removing a key that is not there does nothing.
+  void remove(const uint8_t *key, uint64_t row_id, SqlError &error);
+
+  /// Find the rows whose value equals an encoded value.
+  ///
+  /// Row ids are appended in no particular order.
+  void find(const uint8_t *key, std::vector<uint64_t> &row_ids,
+            SqlError &error);
+
+  /// Get the type of the keys
+  const parser::SqlType &key_type() const;
+
+  /// Returns true if this is closed
+  bool is_closed() const;
+
+  /// Close this file
+  void close(SqlError &error);
+
+  /// Write back buffered pages to the file
+  void flush(SqlError &error);
+
+  /// Write back buffered pages, then wait until the file is on disk.
+  void sync(SqlError &error);
+
+  /// Drop cached pages if another process changed the file, then read the
+  /// header again.
+  void invalidate_if_modified(SqlError &error);
+
+  /// remove the file and close this file.
+  void remove_file(SqlError &error);
+
+  /// Get the file name
+  const std::string &file_name() const;
+
+private:
+  /// Hash an encoded value
+  uint64_t hash(const uint8_t *key) const;
+
+  /// Returns true if two encoded values are equal
+  bool values_equal(const uint8_t *lhs, const uint8_t *rhs) const;
+
+  /// Get the bucket of a hash
+  uint64_t bucket_of(uint64_t hash) const;
+
+  /// Get the first page of a bucket
+  uint64_t bucket_page(uint64_t bucket) const;
+
+  /// Get the # of entries that fit in a page
+  size_t page_capacity() const;
+
+  /// Get the size of an entry
+  ///
+  /// a key and a u64 row id.
+  size_t entry_size() const;
+
+  /// Split the next bucket, moving about half of its keys to a new bucket.
+  void split_bucket(SqlError &error);
+
+  /// Replace the keys of a bucket.
+  ///
+  /// The pages of its chain are reused, extra pages are freed.
+  void write_bucket(uint64_t first_page, const std::vector<uint8_t> &entries,
+                    SqlError &error);
+
+  /// Get a zeroed page, reusing a free page before growing the file.
+  uint64_t take_page(SqlError &error);
+
+  /// Read a page.
+  void read_page(uint64_t page, uint8_t *data, SqlError &error);
+
+  /// Write a page.
+  void write_page(uint64_t page, const uint8_t *data, SqlError &error);
+
+  /// Write the header fields
+  void write_header(SqlError &error);
+
+  /// Read the header fields
+  void read_header(SqlError &error);
+
+  SqlFile m_file;
+  /// The type of the keys
+  parser::SqlType m_key_type;
+  /// The size of an encoded key
+  size_t m_key_size;
+  /// The table has at least 2^level buckets
+  uint64_t m_level;
+  /// The next bucket to split
+  uint64_t m_split;
+  /// The # of keys in the table
+  uint64_t m_num_entries;
+  /// The # of pages in the file
+  uint64_t m_num_pages;
+  /// The first free page, or 0 if none
+  uint64_t m_free_page;
+  /// The first page of each bucket group
+  uint64_t m_groups[SQL_HASH_FILE_MAX_GROUPS];
+};
+} // namespace basic_sql
+
+#endif
@@ -5,57 +5,132 @@
 #define SQL_INDEX_FILE
 
 #include "Limits.h"
-#include "SerDe.h"
 #include "SqlFile.h"
 #include "Util.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace basic_sql {
 /// index file magic #
-static const char *SQL_INDEX_FILE_MAGIC = "index-db";
+static const char *SQL_INDEX_FILE_MAGIC = "catlg-db";
 /// index file magic # length
 static const size_t SQL_INDEX_FILE_MAGIC_SIZE = 8;
+/// Magic of the format before slots, which held a u8 table count
+static const char *SQL_INDEX_FILE_OLD_MAGIC = "index-db";
+/// the size of a table name slot in the old format
+///
+/// a u8 name length, then the name padded to the max length. every slot
+/// below the table count is live.
+static const size_t SQL_INDEX_FILE_OLD_SLOT_SIZE = 1 + TABLE_NAME_MAX_LENGTH;
+/// the offset to the # of slots field
+///
+/// this is a u32. slots past it are not part of the index.
+static const size_t SQL_INDEX_FILE_NUM_SLOTS_OFFSET = SQL_INDEX_FILE_MAGIC_SIZE;
+/// the size of the index file header
+static const size_t SQL_INDEX_FILE_HEADER_SIZE =
+    SQL_INDEX_FILE_NUM_SLOTS_OFFSET + 4;
+/// the size of a name field in a slot
+///
+/// a u8 length, then the name padded to the max length.
+static const size_t SQL_INDEX_FILE_NAME_SIZE = 1 + TABLE_NAME_MAX_LENGTH;
+/// the size of a slot
+///
+/// a u8 `SqlIndexSlotKind`, then the name. index slots also have the name of
+/// their table and column, table slots leave those zeroed.
+static const size_t SQL_INDEX_FILE_SLOT_SIZE = 1 + (3 * SQL_INDEX_FILE_NAME_SIZE);
+
+/// What a slot of the index file holds
+enum class SqlIndexSlotKind {
+  /// A removed entry, reused by the next one added
+  FREE = 0,
+  /// A table
+  TABLE = 1,
+  /// A b+tree index of a table column
+  BTREE_INDEX = 2,
+  /// A hash index of a table column
+  HASH_INDEX = 3,
+};
+
+/// A secondary index of a table column
+struct SqlIndexEntry {
+  /// The kind of index
+  SqlIndexSlotKind kind;
+  /// The indexed table
+  std::string table_name;
+  /// The indexed column
+  SmallString<COLUMN_NAME_MAX_LENGTH> column_name;
+  /// The slot in the index file
+  uint32_t slot;
+};
 
-/// An index of tables
+/// An index of tables, and the secondary indexes on them
+///
+/// The whole index is loaded into memory on open, so looking up a table does
+/// no I/O. On disk, every entry has a slot. New entries are appended, or reuse
+/// the slot of a removed entry, and removing an entry only clears its kind, so
+/// no change rewrites more than one slot and the slot count.
 class SqlIndexFile {
 public:
   /// Make a new sql file.
-  SqlIndexFile(std::string name);
+  ///
+  /// If a buffer pool is given, the file is read and written through it.
+  SqlIndexFile(std::string name, SqlBufferPool *buffer_pool = nullptr);
   SqlIndexFile(const SqlIndexFile &other) = delete;
   SqlIndexFile &operator=(SqlIndexFile &other) = delete;
   SqlIndexFile(SqlIndexFile &&other) noexcept;
   SqlIndexFile &operator=(SqlIndexFile &&other);
 
-  /// Open the index file
+  /// Open the index file, loading every entry.
   void open(bool create, SqlError &error);
 
-  /// Seek to a table name index.
-  void seek_to_table_name_index(size_t index, SqlError &error);
-
-  /// Add the # of tables in the index.
-  uint8_t get_num_tables();
+  /// Get the # of tables in the index.
+  uint32_t get_num_tables() const;
 
   /// Get the index of a table name.
   ///
   /// Returns the index, or -1 if not found.
-  /// If an error occured, the result is also -1;
-  int index_of_table_name(const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
-                          SqlError &error);
+  int64_t index_of_table_name(
+      const SmallString<TABLE_NAME_MAX_LENGTH> &table_name) const;
 
-  /// Get the table name at the index.
-  void get_table_name(size_t index,
-                      SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+  /// Get the names of every table, keyed to their index.
+  const std::unordered_map<std::string, uint32_t> &get_table_names() const;
+
+  /// Add a table name to the index.
+  ///
+  /// The name must not be in the index yet.
+  void add_table_name(const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
                       SqlError &error);
 
-  /// Insert the table name at the given index, overwriting it.
-  void insert_table_name(size_t index,
-                         const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+  /// Remove a table name from the index.
+  ///
+  /// The name must be in the index.
+  void remove_table_name(const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
                          SqlError &error);
 
-  /// Remove the table at the index.
-  void remove(size_t i, SqlError &error);
+  /// Get a secondary index by name.
+  ///
+  /// Returns nullptr if not found.
+  const SqlIndexEntry *
+  find_index(const SmallString<TABLE_NAME_MAX_LENGTH> &index_name) const;
+
+  /// Get every secondary index, keyed by name.
+  const std::unordered_map<std::string, SqlIndexEntry> &get_indexes() const;
 
-  /// Update num_tables
-  void update_num_tables(uint8_t new_num_tables, SqlError &error);
+  /// Add a secondary index on a table column.
+  ///
+  /// The name must not be an index yet.
+  void add_index(const SmallString<TABLE_NAME_MAX_LENGTH> &index_name,
+                 SqlIndexSlotKind kind,
+                 const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+                 const SmallString<COLUMN_NAME_MAX_LENGTH> &column_name,
+                 SqlError &error);
+
+  /// Remove a secondary index.
+  ///
+  /// The name must be an index.
+  void remove_index(const SmallString<TABLE_NAME_MAX_LENGTH> &index_name,
+                    SqlError &error);
 
   /// Returns true if this is closed.
   bool is_closed() const;
@@ -69,10 +144,36 @@ public:
   /// remove the table file and close this file.
   void remove_file(SqlError &error);
 
+  /// Flush this file
+  void flush(SqlError &error);
+
 private:
+  /// Rewrite an index in the format before slots in this format, then open
+  /// it.
+  void convert_old_format(SqlError &error);
+
+  /// Write an entry to a free slot, appending one if there is none.
+  ///
+  /// Returns the slot.
+  uint32_t write_slot(SqlIndexSlotKind kind,
+                      const SmallString<TABLE_NAME_MAX_LENGTH> &name,
+                      const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+                      const SmallString<COLUMN_NAME_MAX_LENGTH> &column_name,
+                      SqlError &error);
+
+  /// Mark a slot free.
+  void free_slot(uint32_t index, SqlError &error);
+
   SqlFile m_file;
-  uint8_t num_tables;
+  /// The # of slots in the file, live or not
+  uint32_t m_num_slots;
+  /// The slot of every table name
+  std::unordered_map<std::string, uint32_t> m_tables;
+  /// Every secondary index, by name
+  std::unordered_map<std::string, SqlIndexEntry> m_indexes;
+  /// Slots of removed entries, which new entries reuse
+  std::vector<uint32_t> m_free_slots;
 };
 } // namespace basic_sql
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,192 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_JOIN_H_
+#define _SQL_JOIN_H_
+
+#include "SqlExternalSort.h"
+#include "SqlStatement.h"
+#include "SqlTableFile.h"
+#include <memory>
+#include <unordered_map>
+
+namespace basic_sql {
+/// The # of rows a join reads the join values of at once
+static const size_t SQL_JOIN_SCAN_ROWS = 4096;
+
+/// A table read by a join, with the filters and projections done before
+/// joining
+struct SqlJoinInput {
+  /// The table
+  SqlTableFile *table;
+  /// The join column
+  size_t column;
+  /// Only rows that match this are joined, if it is not null
+  const SqlPredicate *predicate;
+  /// The columns kept in joined rows, in order. The join column must be one.
+  SmallVec<COLUMN_MAX, size_t> columns;
+};
+
+/// Keep a column of a join input, if it is not kept already.
+///
+/// Returns its position among the kept columns.
+size_t keep_join_column(SqlJoinInput &input, size_t column);
+
+/// Hash a value, so values that compare equal hash alike.
+///
+/// INT values hash like the FLOAT they compare equal to.
+uint64_t hash_join_key(const SqlValue &value);
+
+/// Returns true if columns of two types can be joined by sorting their
+/// values.
+///
+/// Their values must sort in an order that agrees with `SqlValue` equality,
+/// so INT and FLOAT columns are only joined with columns of the same type.
+bool can_sort_merge_join(const parser::SqlType &left_type,
+                         const parser::SqlType &right_type);
+
+/// How a join cursor finds the rows that match
+enum class SqlJoinMethod {
+  /// Hash one table, then probe it with the rows of the other
+  Hash,
+  /// Sort the join values of both tables, then merge them
+  SortMerge,
+  /// Look up the join value of every row of one table in an index of the
+  /// other
+  IndexNestedLoop,
+};
+
+/// Joins two tables where a column of each is equal, one joined row at a
+/// time
+///
+/// Joined rows are the kept columns of the left row, then of the right row.
+/// A left outer join pads left rows without a match with nulls. Matches are
+/// found as pairs of row ids, a batch at a time, and rows are only read as
+/// they are returned. The tables must not be written to while the cursor is
+/// open.
+class SqlJoinCursor {
+public:
+  /// Make a cursor that is not open
+  SqlJoinCursor();
+  SqlJoinCursor(const SqlJoinCursor &other) = delete;
+  SqlJoinCursor &operator=(SqlJoinCursor &other) = delete;
+
+  /// Start joining with a hash table.
+  ///
+  /// The table with fewer rows is hashed. If that is the right one, left
+  /// rows probe it as they are read. Otherwise every match is found first.
+  /// Rows come out in nested loop order: by left row, then by right row.
+  void open_hash(const SqlJoinInput &left, const SqlJoinInput &right,
+                 parser::SqlJoinType join_type, SqlError &error);
+
+  /// Start joining by sorting the join values of both tables and merging
+  /// them.
+  ///
+  /// Only the join values and row ids of rows that match the where clauses
+  /// are sorted. Past `memory_size` bytes, sorted runs are written to files
+  /// named after `file_prefix`. Rows come out in join value order, then by
+  /// left row and right row. The columns must pass `can_sort_merge_join`.
+  void open_sort_merge(const SqlJoinInput &left, const SqlJoinInput &right,
+                       parser::SqlJoinType join_type, size_t memory_size,
+                       const std::string &file_prefix, SqlError &error);
+
+  /// Start joining by looking up join values in an index.
+  ///
+  /// Right rows are looked up in an index of the left table if `index_left`
+  /// is set, and every match is found first. Otherwise left rows are looked
+  /// up in an index of the right table as they are read, which a left outer
+  /// join needs. Rows come out like those of `open_hash`. The columns must
+  /// pass `can_sort_merge_join`, so values encode like the index keys.
+  void open_index_nested_loop(const SqlJoinInput &left,
+                              const SqlJoinInput &right,
+                              parser::SqlJoinType join_type, bool index_left,
+                              SqlError &error);
+
+  /// Get the next joined row.
+  ///
+  /// Returns false once every row was joined.
+  bool next(SmallVec<COLUMN_MAX, SqlValue> &row, SqlError &error);
+
+  /// Stop joining, dropping any held matches and sort runs.
+  void close();
+
+private:
+  /// Set up the inputs of a join
+  void open_inputs(const SqlJoinInput &left, const SqlJoinInput &right,
+                   parser::SqlJoinType join_type, SqlJoinMethod method);
+
+  /// Find the next batch of matches.
+  void find_matches(SqlError &error);
+
+  /// Hash the join values of the rows of a join input.
+  void build_hash_table(const SqlJoinInput &input, SqlError &error);
+
+  /// Find the next batch of matches by probing the hashed right rows with
+  /// left rows.
+  void probe_hash_table(SqlError &error);
+
+  /// Find every match by probing the hashed left rows with right rows.
+  void probe_hash_table_all(SqlError &error);
+
+  /// Find the next batch of matches by merging the sorted join values.
+  void merge_sorted(SqlError &error);
+
+  /// Find the next batch of matches by looking up left rows in an index of
+  /// the right table.
+  void look_up_index(SqlError &error);
+
+  /// Find every match by looking up right rows in an index of the left
+  /// table.
+  void look_up_index_all(SqlError &error);
+
+  /// The left table
+  SqlJoinInput m_left;
+  /// The right table
+  SqlJoinInput m_right;
+  /// The type of join
+  parser::SqlJoinType m_join_type;
+  /// How matches are found
+  SqlJoinMethod m_method;
+  /// Set if every match was already found, or there are no more
+  bool m_finished;
+  /// The next row of the streamed table to read
+  uint64_t m_next_row;
+
+  /// The left and right row of each match in the batch. A left row without
+  /// a match is paired with UINT64_MAX.
+  std::vector<std::pair<uint64_t, uint64_t>> m_matches;
+  /// The # of matches of the batch already returned
+  size_t m_next_match;
+  /// The id of the left row read last, or UINT64_MAX
+  uint64_t m_left_id;
+  /// The kept columns of the left row read last
+  SmallVec<COLUMN_MAX, SqlValue> m_left_row;
+
+  /// The join value of each hashed row
+  std::vector<SqlValue> m_hash_values;
+  /// The id of each hashed row
+  std::vector<uint64_t> m_hash_rows;
+  /// The hashed rows of each hash, in order. Equal hashes are only
+  /// candidates, since INT and FLOAT equality is not transitive.
+  std::unordered_map<uint64_t, std::vector<size_t>> m_hash_table;
+
+  /// The sorted join values of the left rows
+  std::unique_ptr<SqlExternalSort> m_left_sort;
+  /// The sorted join values of the right rows
+  std::unique_ptr<SqlExternalSort> m_right_sort;
+  /// The next left sort record, or nullptr
+  const uint8_t *m_left_record;
+  /// The next right sort record, or nullptr
+  const uint8_t *m_right_record;
+  /// The size of the flag and key of a sort record
+  size_t m_value_size;
+  /// The flag and key of the join value being merged
+  std::vector<uint8_t> m_value;
+  /// Set once a join value is being merged
+  bool m_has_value;
+  /// The right rows of the join value being merged
+  std::vector<uint64_t> m_value_rows;
+};
+} // namespace basic_sql
+
+#endif
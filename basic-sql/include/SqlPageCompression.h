@@ -0,0 +1,94 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_PAGE_COMPRESSION_H_
+#define _SQL_PAGE_COMPRESSION_H_
+
+#include "Limits.h"
+#include "SmallString.h"
+#include "SmallVec.h"
+#include "SqlColumn.h"
+#include "SqlPredicate.h"
+#include "SqlStatement.h"
+#include "SqlValue.h"
+#include <cstdint>
+#include <vector>
+
+namespace basic_sql {
+/// The encoding of a column in a compressed page
+enum class SqlColumnEncoding {
+  /// Every value, back to back
+  PLAIN = 0,
+  /// A dictionary of distinct values, then a 1 or 2 byte code per row
+  DICTIONARY = 1,
+  /// Runs of equal values
+  RUN_LENGTH = 2,
+  /// INT only. A base value, then each value minus the base, bit packed
+  FRAME_OF_REFERENCE = 3,
+};
+
+/// The size of the header of a compressed page
+///
+/// a u32 row count, a u8 column count and 3 reserved bytes.
+static const size_t SQL_COMPRESSED_PAGE_HEADER_SIZE = 4 + 1 + 3;
+/// The size of a column entry in a compressed page header
+///
+/// a u8 encoding, 3 reserved bytes and the u32 page offset of the column.
+static const size_t SQL_COMPRESSED_PAGE_COLUMN_HEADER_SIZE = 1 + 3 + 4;
+/// The max # of rows in a compressed page
+static const size_t SQL_COMPRESSED_PAGE_MAX_ROWS = 65535;
+
+/// Try to compress rows into a page.
+///
+/// `column_values[j]` holds the encoded values of column j for all
+/// `num_rows` rows, back to back, as `encode_sql_value` writes them.
+/// The encoding of each column is picked to make it as small as possible.
+/// Returns false if the rows do not fit in one page.
+bool compress_page(const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns,
+                   const std::vector<std::vector<uint8_t>> &column_values,
+                   size_t num_rows, uint8_t *page);
+
+/// A read-only view of a compressed page
+class SqlCompressedPage {
+public:
+  /// Make a view of the page at `data`.
+  ///
+  /// the page must outlive the view.
+  SqlCompressedPage(const uint8_t *data);
+
+  /// Get the # of rows
+  uint32_t num_rows() const;
+
+  /// Get the encoding of a column
+  SqlColumnEncoding encoding(size_t column) const;
+
+  /// Decode a single value
+  ///
+  /// Returns false if the value is corrupt.
+  bool decode_value(size_t column, const parser::SqlType &type, size_t row,
+                    SqlValue &value) const;
+
+  /// Copy out the value of a row, encoded as `encode_sql_value` writes it.
+  void copy_value(size_t column, const parser::SqlType &type, size_t row,
+                  uint8_t *data) const;
+
+  /// Clear `matches[i]` for the rows i that do not match a predicate on
+  /// its column.
+  ///
+  /// Dictionary and run length columns test each distinct value once, and
+  /// frame of reference columns compare integers without decoding them.
+  void match(const SqlPredicate &predicate,
+             std::vector<uint8_t> &matches) const;
+
+private:
+  /// Get a ptr to the data of a column
+  const uint8_t *column_data(size_t column) const;
+
+  /// Get a ptr to the encoded value of a row in a column
+  const uint8_t *value_data(size_t column, const parser::SqlType &type,
+                            size_t row) const;
+
+  const uint8_t *m_data;
+};
+} // namespace basic_sql
+#endif
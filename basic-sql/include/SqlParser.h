@@ -81,6 +81,11 @@ private:
   const tokenizer::SqlToken *peek();
   /// Read the next token, marking it as read.
   const tokenizer::SqlToken *read();
+  /// Returns true if the next token is the identifier `word`, ignoring case.
+  ///
+  /// Words that only have a meaning in one clause, like USING, are not
+  /// keywords, so they can still name tables and columns.
+  bool peek_word(const char *word);
   /// Read the next keyword, marking it as read.
   void read_keyword(const tokenizer::SqlKeyword **keyword,
                     SqlParserError &error);
@@ -305,6 +310,79 @@ private:
     column_name.append(column_identifier->value.get_ptr(),
                        column_identifier->value.size());
   }
+
+  /// Read a column name, optionally qualified by a table alias.
+  ///
+  /// `table_alias` is left empty if there is none.
+  void
+  read_qualified_column_name(SmallString<TABLE_NAME_MAX_LENGTH> &table_alias,
+                             SmallString<COLUMN_NAME_MAX_LENGTH> &column_name,
+                             SqlParserError &error) {
+    const tokenizer::SqlToken *token = this->peek();
+    if (token != nullptr &&
+        token->token_type() == tokenizer::SqlTokenType::IDENTIFIER &&
+        this->position + 1 < this->tokens.size() &&
+        this->tokens[this->position + 1].token_type() ==
+            tokenizer::SqlTokenType::PERIOD) {
+      this->read_table_name(table_alias, error);
+      if (!error.is_ok())
+        return;
+
+      // consume .
+      this->read();
+    }
+
+    this->read_column_name(column_name, error);
+  }
+
+  /// Read the condition of a where clause on a join, like `T.a1 = 1`.
+  ///
+  /// `table_alias` is left empty if the column is not qualified.
+  void read_join_condition(SmallString<TABLE_NAME_MAX_LENGTH> &table_alias,
+                           SqlWhereClause &clause, SqlParserError &error) {
+    SmallString<COLUMN_NAME_MAX_LENGTH> column_name;
+    this->read_qualified_column_name(table_alias, column_name, error);
+    if (!error.is_ok())
+      return;
+
+    const tokenizer::SqlOperator *op = nullptr;
+    this->read_operator(&op, error);
+    if (!error.is_ok())
+      return;
+
+    SqlValue value;
+    this->read_sql_value(value, error);
+    if (!error.is_ok())
+      return;
+
+    clause.column_name = column_name;
+    clause.op = *op;
+    clause.value = value;
+  }
+
+  /// Read an optional PRIMARY KEY column constraint.
+  ///
+  /// Sets `primary_key` to the index of the column if there is one. A table
+  /// has at most one primary key. PRIMARY and KEY are not keywords, so they
+  /// can still name tables and columns.
+  void read_primary_key(size_t column_index, int &primary_key,
+                        SqlParserError &error) {
+    if (!this->peek_word("PRIMARY"))
+      return;
+    this->read();
+
+    const tokenizer::SqlIdentifier *key_identifier = nullptr;
+    this->read_identifier(&key_identifier, error);
+    if (!error.is_ok())
+      return;
+    if (!key_identifier->value.case_insensitive_compare("KEY") ||
+        primary_key != -1) {
+      error.set_unexpected_token(tokenizer::SqlTokenType::IDENTIFIER);
+      return;
+    }
+
+    primary_key = column_index;
+  }
 };
 } // namespace parser
 } // namespace basic_sql
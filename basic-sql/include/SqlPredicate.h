@@ -0,0 +1,85 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_PREDICATE_H_
+#define _SQL_PREDICATE_H_
+
+#include "SqlBatch.h"
+#include "SqlStatement.h"
+#include <vector>
+
+namespace basic_sql {
+/// How a predicate compares values, picked by the type of its column and the
+/// type of its where clause value
+enum class SqlPredicateKind {
+  /// Every value matches
+  All,
+  /// No value matches
+  None,
+  /// INT values are compared to an INT
+  Int,
+  /// INT values are compared to a FLOAT, as the FLOATs they convert to
+  IntFloat,
+  /// FLOAT values are compared to a FLOAT, or the FLOAT an INT converts to
+  Float,
+  /// CHAR or VARCHAR values are compared to a string
+  String,
+};
+
+/// A where clause compiled for a column of a table
+///
+/// The column is found and the comparison is picked once, when the predicate
+/// is compiled. Values are then tested encoded, by loops specialized for the
+/// column type and the operator, and compare the way `SqlValue` compares
+/// them decoded.
+class SqlPredicate {
+public:
+  /// Make a predicate that matches every value
+  SqlPredicate();
+
+  /// Compile a where clause on a column of a type.
+  void compile(const parser::SqlWhereClause &where_clause, size_t column,
+               const parser::SqlType &type);
+
+  /// Compile a where clause on the column it names.
+  ///
+  /// Returns false if there is no such column, and the predicate then
+  /// matches nothing.
+  bool compile(const parser::SqlWhereClause &where_clause,
+               const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns);
+
+  /// Get the comparison
+  SqlPredicateKind kind() const;
+
+  /// Get the column, or -1 if there is none
+  size_t column() const;
+
+  /// Get the type of the column
+  const parser::SqlType &type() const;
+
+  /// Get the where clause
+  const parser::SqlWhereClause &where_clause() const;
+
+  /// Keep only the selected rows of a batch whose value matches.
+  ///
+  /// The column must be read, unless every or no value matches.
+  void filter(SqlBatch &batch) const;
+
+  /// Clear `matches[i]` for the encoded values i that do not match.
+  ///
+  /// Values are back to back, each `sql_type_width` bytes.
+  void match(const uint8_t *values, std::vector<uint8_t> &matches) const;
+
+private:
+  /// The comparison
+  SqlPredicateKind m_kind;
+  /// The column
+  size_t m_column;
+  /// The type of the column
+  parser::SqlType m_type;
+  /// The where clause
+  parser::SqlWhereClause m_where_clause;
+};
+} // namespace basic_sql
+
+#endif
@@ -0,0 +1,54 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_SELECT_CURSOR_H_
+#define _SQL_SELECT_CURSOR_H_
+
+#include "SqlJoin.h"
+#include "SqlTableCursor.h"
+
+namespace basic_sql {
+class SqlDatabase;
+
+/// Reads the rows of a select statement one at a time
+///
+/// A database opens it. The statement and the tables must outlive it, and
+/// the tables must not be written to while it is open.
+class SqlSelectCursor {
+public:
+  /// Make a cursor that is not open
+  SqlSelectCursor();
+  SqlSelectCursor(const SqlSelectCursor &other) = delete;
+  SqlSelectCursor &operator=(SqlSelectCursor &other) = delete;
+
+  /// Get the next row.
+  ///
+  /// Returns false once every row was read.
+  bool next(SmallVec<COLUMN_MAX, SqlValue> &row, SqlError &error);
+
+  /// Get the selected columns
+  const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns() const;
+
+  /// Stop reading
+  void close();
+
+private:
+  friend class SqlDatabase;
+
+  /// The selected columns
+  SmallVec<COLUMN_MAX, parser::SqlColumn> m_columns;
+  /// Set if rows come from a join
+  bool m_joined;
+  /// The rows of a select without a join
+  SqlTableCursor m_table_cursor;
+  /// The rows of a select with a join
+  SqlJoinCursor m_join_cursor;
+  /// The compiled where clause of the table a join filters
+  SqlPredicate m_predicate;
+  /// The position of each selected column in a joined row, empty if joined
+  /// rows are already in order
+  SmallVec<COLUMN_MAX, size_t> m_positions;
+};
+} // namespace basic_sql
+
+#endif
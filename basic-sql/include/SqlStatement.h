@@ -22,6 +22,16 @@ enum class SqlJoinType {
   LeftOuter,
 };
 
+/// the table of a join a column name refers to
+enum class SqlJoinTable {
+  /// the name was not qualified, so it is looked up in either table
+  Either,
+  /// the main table
+  Primary,
+  /// the joined table
+  Secondary,
+};
+
 /// a where clause
 struct SqlWhereClause {
   /// the column name
@@ -30,23 +40,6 @@ struct SqlWhereClause {
   tokenizer::SqlOperator op;
   /// the value
   SqlValue value;
-
-  /// check if a value matches this clause.
-  ///
-  /// This does not validate the column name
-  bool value_matches(const SqlValue &other) const {
-    switch (this->op) {
-    case tokenizer::SqlOperator::Equals:
-      return other == this->value;
-    case tokenizer::SqlOperator::GreaterThan:
-      return other > this->value;
-    case tokenizer::SqlOperator::NotEqual:
-      return other != this->value;
-    default:
-      panic("unknown op in `bool value_matches(const SqlValue &other)`");
-      return false;
-    }
-  }
 };
 
 /// A create database statement
@@ -67,6 +60,14 @@ struct SqlStatementUseDatabase {
   SmallString<DATABASE_MAX_NAME_SIZE> database_name;
 };
 
+/// How the rows of a table are laid out in its pages
+enum class SqlTableLayout {
+  /// Each row is stored contiguously
+  ROW = 0,
+  /// Each column is stored contiguously within a page (PAX)
+  COLUMNAR = 1,
+};
+
 /// A create table statement
 struct SqlStatementCreateTable {
   /// The table name
@@ -74,6 +75,12 @@ struct SqlStatementCreateTable {
 
   /// The columns in the table
   SmallVec<COLUMN_MAX, SqlColumn> columns;
+
+  /// The storage layout
+  SqlTableLayout layout;
+
+  /// The index of the primary key column, or -1 if there is none
+  int primary_key;
 };
 
 /// A drop table statement
@@ -82,6 +89,32 @@ struct SqlStatementDropTable {
   SmallString<TABLE_NAME_MAX_LENGTH> table_name;
 };
 
+/// How an index stores its keys
+enum class SqlIndexType {
+  /// A b+tree, for `=` and `>`
+  BTREE = 0,
+  /// A hash table, for `=` only
+  HASH = 1,
+};
+
+/// A create index statement
+struct SqlStatementCreateIndex {
+  /// The index name
+  SmallString<TABLE_NAME_MAX_LENGTH> index_name;
+  /// The indexed table
+  SmallString<TABLE_NAME_MAX_LENGTH> table_name;
+  /// The indexed column
+  SmallString<COLUMN_NAME_MAX_LENGTH> column_name;
+  /// How the index stores its keys
+  SqlIndexType type;
+};
+
+/// A drop index statement
+struct SqlStatementDropIndex {
+  /// The index name
+  SmallString<TABLE_NAME_MAX_LENGTH> index_name;
+};
+
 /// A select statement
 struct SqlStatementSelect {
   /// The table name
@@ -90,6 +123,8 @@ struct SqlStatementSelect {
   ///
   /// This is empty if the user requested all columns
   SmallVec<COLUMN_MAX, SmallString<COLUMN_NAME_MAX_LENGTH>> column_names;
+  /// The table of each column name of a join
+  SmallVec<COLUMN_MAX, SqlJoinTable> column_tables;
   /// True if the where clause is valid
   bool has_where_clause;
   /// The where clause
@@ -108,6 +143,9 @@ struct SqlStatementSelect {
 
   /// The joined table's joined column name
   SmallString<COLUMN_NAME_MAX_LENGTH> secondary_join_column_name;
+
+  /// The table of the where clause column of a join
+  SqlJoinTable where_table;
 };
 
 /// An alter statement
@@ -171,6 +209,8 @@ enum class SqlStatementType {
   DELETE,
   BEGIN_TRANSACTION,
   COMMIT_TRANSACTION,
+  CREATE_INDEX,
+  DROP_INDEX,
 };
 
 /// A sql statement
@@ -200,6 +240,10 @@ public:
   SqlStatement(SqlStatementBeginTransaction begin_transaction);
   /// Make a sql statement from a commit transaction statement
   SqlStatement(SqlStatementCommitTransaction commit_transaction);
+  /// Make a sql statement from a create index statement
+  SqlStatement(SqlStatementCreateIndex create_index);
+  /// Make a sql statement from a drop index statement
+  SqlStatement(SqlStatementDropIndex drop_index);
   /// Copy constructor
   SqlStatement(const SqlStatement &other);
   /// Get the statement type
@@ -244,6 +288,14 @@ public:
   ///
   /// This must contain an delete statement
   SqlStatementDelete &get_delete();
+  /// Get the create index statement
+  ///
+  /// This must contain a create index statement
+  SqlStatementCreateIndex &create_index();
+  /// Get the drop index statement
+  ///
+  /// This must contain a drop index statement
+  SqlStatementDropIndex &drop_index();
 
 protected:
 private:
@@ -261,6 +313,8 @@ private:
     SqlStatementDelete m_delete;
     SqlStatementBeginTransaction m_begin_transaction;
     SqlStatementCommitTransaction m_commit_transaction;
+    SqlStatementCreateIndex m_create_index;
+    SqlStatementDropIndex m_drop_index;
   };
 };
 } // namespace parser
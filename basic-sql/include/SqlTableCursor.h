@@ -0,0 +1,110 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_TABLE_CURSOR_H_
+#define _SQL_TABLE_CURSOR_H_
+
+#include "SqlTableFile.h"
+
+namespace basic_sql {
+/// Reads the rows of a table that match a where clause one at a time,
+/// keeping some of their columns
+///
+/// Rows come out in row order, as they are found, or in key order for a
+/// primary key table with rows out of order. An index of the where clause
+/// column is used if there is one, otherwise row groups the zones rule out
+/// are skipped. Rows are read and filtered a batch at a time, and at most one
+/// compressed page is held at a time. The table
+/// must not be written to while the cursor is open.
+class SqlTableCursor {
+public:
+  /// Make a cursor that is not open
+  SqlTableCursor();
+  SqlTableCursor(const SqlTableCursor &other) = delete;
+  SqlTableCursor &operator=(SqlTableCursor &other) = delete;
+
+  /// Start reading the rows of a table that match a where clause.
+  ///
+  /// Every column is kept if no column names are given. The where clause is
+  /// ignored if it is null.
+  void open(SqlTableFile *table,
+            const SmallVec<COLUMN_MAX, SmallString<COLUMN_NAME_MAX_LENGTH>>
+                &column_names,
+            const parser::SqlWhereClause *where_clause, SqlError &error);
+
+  /// Get the next row.
+  ///
+  /// Returns false once every row was read.
+  bool next(SmallVec<COLUMN_MAX, SqlValue> &row, SqlError &error);
+
+  /// Get the id of the row `next` returned last
+  uint64_t row_id() const;
+
+  /// Get the kept columns
+  const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns() const;
+
+  /// Stop reading, dropping any held page.
+  void close();
+
+private:
+  /// Keep the selected columns of a table row.
+  void project(const SmallVec<COLUMN_MAX, SqlValue> &table_row,
+               SmallVec<COLUMN_MAX, SqlValue> &row) const;
+
+  /// Read the next batch of rows, selecting those that match the where
+  /// clause.
+  void read_batch(SqlError &error);
+
+  /// Read a compressed page from a row on, marking the rows that may match.
+  void read_page(uint64_t row_index, size_t entry, size_t slot,
+                 SqlError &error);
+
+  /// The table, or nullptr if the cursor is not open
+  SqlTableFile *m_table;
+  /// The kept columns
+  SmallVec<COLUMN_MAX, parser::SqlColumn> m_columns;
+  /// The index of each kept column, empty if every column is kept
+  SmallVec<COLUMN_MAX, int> m_column_indexes;
+  /// The columns read from each row
+  uint32_t m_column_mask;
+  /// The compiled where clause, which matches every row if there is none
+  SqlPredicate m_predicate;
+
+  /// Set if only the rows an index found are visited
+  bool m_indexed;
+  /// The rows an index found
+  std::vector<uint64_t> m_indexed_rows;
+  /// The # of found rows already visited
+  size_t m_next_indexed;
+
+  /// The next row to scan
+  uint64_t m_next_row;
+  /// Set if row groups the zones rule out are skipped
+  bool m_use_zones;
+  /// The end of the row group whose zone was checked last
+  uint64_t m_zone_end;
+
+  /// A copy of the compressed page being read
+  std::vector<uint8_t> m_page;
+  /// Set for the slots of the page that may match
+  std::vector<uint8_t> m_matches;
+  /// The next slot of the page to read
+  size_t m_page_slot;
+  /// The end of the slots of the page to read
+  size_t m_page_end_slot;
+  /// The id of the row in slot 0 of the page
+  uint64_t m_page_first_row;
+
+  /// The batch of rows being read
+  SqlBatch m_batch;
+  /// The ids of the rows of the next batch
+  std::vector<uint64_t> m_batch_rows;
+  /// The # of selected rows of the batch already returned
+  size_t m_batch_next;
+
+  /// The id of the row `next` returned last
+  uint64_t m_row_id;
+};
+} // namespace basic_sql
+
+#endif
@@ -5,9 +5,16 @@
 #define _SQL_TABLE_H_
 
 #include "SerDe.h"
+#include "SqlBTreeFile.h"
+#include "SqlBatch.h"
 #include "SqlFile.h"
+#include "SqlHashFile.h"
+#include "SqlPageCompression.h"
+#include "SqlPredicate.h"
 #include "SqlStatement.h"
+#include "SqlZoneMap.h"
 #include "Util.h"
+#include <set>
 #include <vector>
 
 namespace basic_sql {
@@ -23,10 +30,46 @@ struct QueryRowsResult {
   std::vector<SmallVec<COLUMN_MAX, SqlValue>> rows;
 };
 
+/// A secondary index of a table column, kept in step with its rows
+struct SqlTableIndex {
+  /// Make an index stored in a b+tree
+  SqlTableIndex(std::string name, size_t column, SqlBTreeFile &&tree);
+  /// Make an index stored in a hash table
+  SqlTableIndex(std::string name, size_t column, SqlHashFile &&hash);
+
+  /// Add a key
+  void insert(const uint8_t *key, uint64_t row_id, SqlError &error);
+  /// Remove a key
+  void remove(const uint8_t *key, uint64_t row_id, SqlError &error);
+  /// Close the index file
+  void close(SqlError &error);
+  /// Write back buffered pages to the index file
+  void flush(SqlError &error);
+  /// Write back buffered pages, then wait until the index file is on disk.
+  void sync(SqlError &error);
+  /// Drop cached pages if another process changed the index file.
+  void invalidate_if_modified(SqlError &error);
+  /// remove the index file and close it.
+  void remove_file(SqlError &error);
+
+  /// The index name
+  std::string name;
+  /// The indexed column
+  size_t column;
+  /// How the keys are stored. only the matching file is open.
+  parser::SqlIndexType type;
+  SqlBTreeFile tree;
+  SqlHashFile hash;
+};
+
 /// Magic
-static const char *SQL_TABLE_FILE_MAGIC = "table";
+static const char *SQL_TABLE_FILE_MAGIC = "ptable";
 /// Magic len
-static const uint8_t SQL_TABLE_FILE_MAGIC_SIZE = 5;
+static const uint8_t SQL_TABLE_FILE_MAGIC_SIZE = 6;
+/// Magic of the format before pages, where rows followed the header
+static const char *SQL_TABLE_FILE_OLD_MAGIC = "table";
+/// Old magic len
+static const uint8_t SQL_TABLE_FILE_OLD_MAGIC_SIZE = 5;
 /// size of column data.
 ///
 /// the size of column data is 1 for the name length, COLUMN_NAME_MAX_LENGTH
@@ -38,18 +81,91 @@ static const size_t SQL_TABLE_FILE_COLUMN_DATA_ELEMENT_SIZE =
 /// the column data starts after the num_columns field
 static const size_t SQL_TABLE_FILE_COLUMN_OFFSET =
     SQL_TABLE_FILE_MAGIC_SIZE + 1;
-/// the offset to the values data
+/// the offset to the u8 num_values field in the old format.
+///
+/// old rows follow it, each COLUMN_MAX * MAX_TYPE_SIZE bytes with every value
+/// in a MAX_TYPE_SIZE slot.
+static const size_t SQL_TABLE_FILE_OLD_VALUES_OFFSET =
+    SQL_TABLE_FILE_OLD_MAGIC_SIZE + 1 +
+    (COLUMN_MAX * SQL_TABLE_FILE_COLUMN_DATA_ELEMENT_SIZE);
+/// the offset to the num_values field
 ///
-/// size of column data field plus size of num_values
+/// num_values is a u64 after the column data
 static const size_t SQL_TABLE_FILE_VALUES_OFFSET =
     SQL_TABLE_FILE_COLUMN_OFFSET +
     (COLUMN_MAX * SQL_TABLE_FILE_COLUMN_DATA_ELEMENT_SIZE);
+/// the offset to the num_pages field
+///
+/// num_pages is a u64 counting every page in the file, including the header.
+static const size_t SQL_TABLE_FILE_NUM_PAGES_OFFSET =
+    SQL_TABLE_FILE_VALUES_OFFSET + 8;
+/// the offset to the first page directory page field
+///
+/// this is a u64 page number, or 0 if there are no data pages yet.
+static const size_t SQL_TABLE_FILE_DIRECTORY_OFFSET =
+    SQL_TABLE_FILE_NUM_PAGES_OFFSET + 8;
+/// the offset to the layout field
+///
+/// this is a u8 `parser::SqlTableLayout`. files from before this field have a
+/// 0 here, which is the row layout.
+static const size_t SQL_TABLE_FILE_LAYOUT_OFFSET =
+    SQL_TABLE_FILE_DIRECTORY_OFFSET + 8;
+/// the offset to the first tombstone page field
+///
+/// this is a u64 page number, or 0 if no row was deleted yet. files from
+/// before this field have a 0 here.
+static const size_t SQL_TABLE_FILE_TOMBSTONE_OFFSET =
+    SQL_TABLE_FILE_LAYOUT_OFFSET + 1;
+/// the offset to the primary key field
+///
+/// this is a u8, the index of the primary key column plus 1, or 0 if there is
+/// no primary key. files from before this field have a 0 here.
+static const size_t SQL_TABLE_FILE_PRIMARY_KEY_OFFSET =
+    SQL_TABLE_FILE_TOMBSTONE_OFFSET + 8;
+/// the offset to the sorted field
+///
+/// this is a u8 set if the live rows of a primary key table are in key
+/// order. it is a hint, the rows are only sorted again when it is clear.
+static const size_t SQL_TABLE_FILE_SORTED_OFFSET =
+    SQL_TABLE_FILE_PRIMARY_KEY_OFFSET + 1;
+/// the size of the header fields in page 0
+static const size_t SQL_TABLE_FILE_HEADER_SIZE =
+    SQL_TABLE_FILE_SORTED_OFFSET + 1;
+/// the size of the header of a page directory page
+///
+/// a u64 page number of the next directory page (0 if none), a u32 entry
+/// count, and 4 reserved bytes.
+static const size_t SQL_TABLE_FILE_DIRECTORY_HEADER_SIZE = 8 + 4 + 4;
+/// the # of data page entries in a page directory page
+///
+/// each entry is a u64 for a data page, see
+/// `SQL_TABLE_FILE_DIRECTORY_PAGE_BITS`.
+static const size_t SQL_TABLE_FILE_DIRECTORY_ENTRIES_PER_PAGE =
+    (STORAGE_PAGE_SIZE - SQL_TABLE_FILE_DIRECTORY_HEADER_SIZE) / 8;
+/// the # of low bits of a page directory entry that hold the page number
+///
+/// the high bits hold the # of rows in a compressed data page, or 0 if the
+/// page is not compressed. files from before compressed pages have a 0 there.
+static const size_t SQL_TABLE_FILE_DIRECTORY_PAGE_BITS = 40;
+/// the size of the header of a tombstone page
+///
+/// a u64 page number of the next tombstone page (0 if none).
+static const size_t SQL_TABLE_FILE_TOMBSTONE_HEADER_SIZE = 8;
+/// the # of rows a tombstone page has a bit for
+///
+/// bit i of a tombstone page is set if its i-th row was deleted.
+static const size_t SQL_TABLE_FILE_TOMBSTONES_PER_PAGE =
+    (STORAGE_PAGE_SIZE - SQL_TABLE_FILE_TOMBSTONE_HEADER_SIZE) * 8;
+
+class SqlTableCursor;
 
 /// A SQl table file
 class SqlTableFile {
 public:
   /// Create a new unopened file
-  SqlTableFile(std::string name);
+  ///
+  /// If a buffer pool is given, the file is read and written through it.
+  SqlTableFile(std::string name, SqlBufferPool *buffer_pool = nullptr);
   SqlTableFile(const SqlTableFile &other) = delete;
   SqlTableFile &operator=(SqlTableFile &other) = delete;
   SqlTableFile(SqlTableFile &&other) noexcept;
@@ -57,6 +173,13 @@ public:
 
   /// Open the table file
   void open(bool create, SqlError &error) {
+    this->open(create, parser::SqlTableLayout::ROW, error);
+  }
+
+  /// Open the table file, creating it with the given layout.
+  ///
+  /// An existing file keeps the layout it was created with.
+  void open(bool create, parser::SqlTableLayout layout, SqlError &error) {
     // flags setup
     const char *flags = create ? "w+b" : "r+b";
 
@@ -81,7 +204,46 @@ public:
         return;
 
       // write # of values
-      this->m_file.write((const uint8_t *)&this->num_values, 1, error);
+      this->m_file.write((const uint8_t *)&this->num_values, 8, error);
+      if (!error.is_ok())
+        return;
+
+      // write # of pages, the header page is the only page.
+      this->m_num_pages = 1;
+      this->m_file.write((const uint8_t *)&this->m_num_pages, 8, error);
+      if (!error.is_ok())
+        return;
+
+      // write the first directory page, there is none yet.
+      uint64_t first_directory_page = 0;
+      this->m_file.write((const uint8_t *)&first_directory_page, 8, error);
+      if (!error.is_ok())
+        return;
+
+      // write layout
+      this->m_layout = layout;
+      uint8_t layout_id = (uint8_t)layout;
+      this->m_file.write(&layout_id, 1, error);
+      if (!error.is_ok())
+        return;
+
+      // write the first tombstone page, there is none yet.
+      uint64_t first_tombstone_page = 0;
+      this->m_file.write((const uint8_t *)&first_tombstone_page, 8, error);
+      if (!error.is_ok())
+        return;
+
+      // write the primary key, there is none yet. no rows are out of order.
+      this->m_primary_key = -1;
+      this->m_sorted = true;
+      uint8_t key_fields[2] = {0, 1};
+      this->m_file.write(key_fields, 2, error);
+      if (!error.is_ok())
+        return;
+
+      // pad the rest of the header page
+      this->m_file.write_byte_n(
+          0, STORAGE_PAGE_SIZE - SQL_TABLE_FILE_HEADER_SIZE, error);
       if (!error.is_ok())
         return;
     } else {
@@ -92,6 +254,13 @@ public:
       if (!error.is_ok())
         return;
 
+      // tables in the old format are rewritten in this one
+      if (memcmp(buffer, SQL_TABLE_FILE_OLD_MAGIC,
+                 SQL_TABLE_FILE_OLD_MAGIC_SIZE) == 0) {
+        this->convert_old_format(error);
+        return;
+      }
+
       // validate magic
       for (size_t i = 0; i < SQL_TABLE_FILE_MAGIC_SIZE; i++) {
         if (buffer[i] != SQL_TABLE_FILE_MAGIC[i]) {
@@ -104,6 +273,10 @@ public:
       this->m_file.read(&this->num_columns, 1, error);
       if (!error.is_ok())
         return;
+      if (this->num_columns > COLUMN_MAX) {
+        error.set_invalid_file();
+        return;
+      }
 
       // load column data
       for (int i = 0; i < this->num_columns; i++) {
@@ -121,9 +294,10 @@ public:
           name : column_name,
           type,
         };
-        // TODO: Do i check for size above? can i remove the assert/error?
+        // the # of columns was checked above
         assert(this->columns.push(column));
       }
+      this->update_row_layout();
 
       // read num_values
       // seek to field
@@ -131,101 +305,123 @@ public:
       if (!error.is_ok())
         return;
       // read
-      this->m_file.read(&this->num_values, 1, error);
+      this->m_file.read((uint8_t *)&this->num_values, 8, error);
       if (!error.is_ok())
         return;
-    }
-  }
 
-  /// update rows
-  void update_rows(const parser::SqlStatementUpdate &statement,
-                   bool in_transaction, size_t &num_modified, SqlError &error) {
-    for (size_t row_index = 0; row_index < this->num_values; row_index++) {
-      // seek to values
-      this->seek_to_value_index(row_index, error);
+      // read num_pages
+      this->m_file.read((uint8_t *)&this->m_num_pages, 8, error);
       if (!error.is_ok())
         return;
 
-      SmallVec<COLUMN_MAX, SqlValue> row;
-      size_t column_index = -1;
-      size_t update_index = -1;
-
-      // read sql values
-      for (size_t j = 0; j < this->columns.size(); j++) {
-        // read sql value
-        SqlValue value;
-        read_sql_value(value, this->columns[j].type.type, this->m_file, error);
-        if (!error.is_ok())
-          return;
+      // read first directory page
+      uint64_t first_directory_page = 0;
+      this->m_file.read((uint8_t *)&first_directory_page, 8, error);
+      if (!error.is_ok())
+        return;
 
-        // append to row
-        row.push(value);
+      // read layout
+      uint8_t layout_id = 0;
+      this->m_file.read(&layout_id, 1, error);
+      if (!error.is_ok())
+        return;
+      if (layout_id > (uint8_t)parser::SqlTableLayout::COLUMNAR) {
+        error.set_invalid_file();
+        return;
+      }
+      this->m_layout = (parser::SqlTableLayout)layout_id;
 
-        // find where clause column index
-        if (this->columns[j].name == statement.where_clause.column_name) {
-          column_index = j;
-        }
+      // read first tombstone page
+      uint64_t first_tombstone_page = 0;
+      this->m_file.read((uint8_t *)&first_tombstone_page, 8, error);
+      if (!error.is_ok())
+        return;
 
-        // find statement column index
-        if (this->columns[j].name == statement.column_name) {
-          update_index = j;
-        }
+      // read primary key and sorted
+      uint8_t key_fields[2] = {0, 0};
+      this->m_file.read(key_fields, 2, error);
+      if (!error.is_ok())
+        return;
+      if (key_fields[0] > this->num_columns) {
+        error.set_invalid_file();
+        return;
       }
+      this->m_primary_key = (int)key_fields[0] - 1;
+      this->m_sorted = key_fields[1] != 0;
 
-      // update row
-      if (column_index != -1 &&
-          statement.where_clause.value_matches(row[column_index])) {
-        // TODO: ensure types match
-        row[update_index] = statement.value;
-
-        if (in_transaction) {
-          this->m_buffered_rows.push_back(BufferedRow{row_index, row});
-        } else {
-          this->insert(row_index, row, error);
-          if (!error.is_ok())
-            return;
-        }
+      // load the page directory
+      this->load_page_directory(first_directory_page, error);
+      if (!error.is_ok())
+        return;
 
-        num_modified += 1;
-      }
+      // load the tombstones
+      this->load_tombstones(first_tombstone_page, error);
+      if (!error.is_ok())
+        return;
     }
   }
 
-  /// delete rows
-  void delete_rows(const parser::SqlStatementDelete &statement,
-                   size_t &num_deleted, SqlError &error) {
-    for (size_t row_index = 0; row_index < this->num_values; row_index++) {
-      // seek to values
-      this->seek_to_value_index(row_index, error);
-      if (!error.is_ok())
-        return;
+  /// Convert the values of a row to the types of their columns.
+  ///
+  /// An INT becomes the FLOAT it converts to in a FLOAT column. Sets a type
+  /// mismatch error if a value cannot be stored in its column.
+  void convert_row(SmallVec<COLUMN_MAX, SqlValue> &row,
+                   SqlError &error) const;
+
+  /// Find the rows an update changes, with their new values.
+  ///
+  /// Nothing is written, so the changes can be logged first. Pass the rows to
+  /// `write_rows`, or to `buffer_rows` in a transaction.
+  void update_rows(const parser::SqlStatementUpdate &statement,
+                   std::vector<BufferedRow> &updated_rows, SqlError &error) {
+    // find statement column index, and give the value its type
+    int update_index = this->get_index_of_column_name(statement.column_name);
+    if (update_index == -1) {
+      error.set_missing();
+      return;
+    }
+    SqlValue value = statement.value;
+    if (!convert_sql_value(value, this->columns[update_index].type)) {
+      error.set_type_mismatch();
+      return;
+    }
+
+    // compile the where clause once, binding its column
+    SqlPredicate predicate;
+    if (!predicate.compile(statement.where_clause, this->columns))
+      return;
+
+    std::vector<uint64_t> matching_rows;
+    this->find_matching_rows(predicate, matching_rows, error);
+    if (!error.is_ok())
+      return;
 
+    for (size_t i = 0; i < matching_rows.size(); i++) {
       SmallVec<COLUMN_MAX, SqlValue> row;
-      size_t column_index = -1;
 
       // get row
-      this->get_row(row_index, row, error);
+      this->get_row(matching_rows[i], row, error);
       if (!error.is_ok())
         return;
 
-      // find where clause column index
-      for (size_t j = 0; j < this->columns.size(); j++) {
-        if (this->columns[j].name == statement.where_clause.column_name) {
-          column_index = j;
-        }
-      }
+      // update row
+      row[update_index] = value;
+      updated_rows.push_back(BufferedRow{matching_rows[i], row});
+    }
+  }
 
-      // delete row
-      if (column_index != -1 &&
-          statement.where_clause.value_matches(row[column_index])) {
-        this->remove_row(row_index, error);
-        if (!error.is_ok())
-          return;
+  /// Find the ids of the rows a delete removes.
+  ///
+  /// Nothing is written, so the changes can be logged first. Pass the ids to
+  /// `delete_row_ids`.
+  void delete_rows(const parser::SqlStatementDelete &statement,
+                   std::vector<uint64_t> &deleted_rows, SqlError &error) {
+    // compile the where clause once, binding its column
+    SqlPredicate predicate;
+    if (!predicate.compile(statement.where_clause, this->columns))
+      return;
 
-        num_deleted += 1;
-        row_index -= 1;
-      }
-    }
+    this->find_matching_rows(predicate, deleted_rows, error);
   }
 
   /// insert a value at the given index.
@@ -234,50 +430,165 @@ public:
   /// record.
   void insert(size_t index, const SmallVec<COLUMN_MAX, SqlValue> &data,
               SqlError &error) {
-    // seek to index
-    this->seek_to_value_index(index, error);
+    assert(index <= this->num_values);
+
+    // rows are stored densely, so every value must fit its column.
+    this->check_row(data, error);
     if (!error.is_ok())
       return;
 
-    // write sql values
-    for (size_t i = 0; i < data.size(); i++) {
-      write_sql_value(data[i], this->m_file, error);
-      if (!error.is_ok())
-        return;
+    // grow the table by a data page if the index is past the last page.
+    // columnar tables compress the last page first, which may free it up.
+    if (index >= this->row_capacity()) {
+      if (this->m_layout == parser::SqlTableLayout::COLUMNAR &&
+          !this->m_page_directory.empty()) {
+        this->seal_last_page(error);
+        if (!error.is_ok())
+          return;
+      }
+
+      if (index >= this->row_capacity()) {
+        this->allocate_data_page(error);
+        if (!error.is_ok())
+          return;
+      }
     }
 
-    // pad remaining empty columns
-    for (size_t j = data.size() * MAX_TYPE_SIZE; j < COLUMN_MAX * MAX_TYPE_SIZE;
-         j++) {
-      uint8_t data = 0;
-      this->m_file.write(&data, 1, error);
+    // encode the row, padding included.
+    uint8_t buffer[ROW_MAX_SIZE];
+    size_t row_size = encode_row(data, this->columns, buffer);
+    assert(row_size == this->m_row_size);
+    if (index < this->num_values)
+      this->m_zone_map.mark_stale(index);
+    this->add_zone_values(index, buffer);
+
+    // write it in one go
+    if (this->m_layout == parser::SqlTableLayout::ROW) {
+      uint64_t position =
+          this->row_position(index, this->m_row_size, this->m_rows_per_page);
+      this->m_file.write_at(position, buffer, row_size, error);
+      return;
+    }
+
+    // columnar, compressed pages are rewritten whole.
+    size_t entry = 0;
+    size_t slot = 0;
+    this->locate_row(index, entry, slot);
+    if (this->m_page_row_counts[entry] != 0) {
+      this->update_compressed_row(entry, slot, buffer, error);
+      return;
+    }
+
+    // scatter the values to their columns
+    for (size_t j = 0; j < this->columns.size(); j++) {
+      uint64_t position = this->value_position(entry, slot, j);
+      this->m_file.write_at(position, buffer + this->m_column_offsets[j],
+                            sql_type_width(this->columns[j].type), error);
       if (!error.is_ok())
         return;
     }
   }
 
-  /// Remove a row at a given index
+  /// Overwrite rows, in order.
   ///
-  /// the index cannot exceed num_values
-  void remove_row(size_t index, SqlError &error) {
-    if (this->num_values != 0) {
-      SmallVec<COLUMN_MAX, SqlValue> row;
+  /// Runs of rows in the same compressed page rewrite it once.
+  void write_rows(const std::vector<BufferedRow> &rows, SqlError &error);
 
-      // get last entry
-      this->get_row(this->num_values - 1, row, error);
-      if (!error.is_ok())
-        return;
+  /// Get the id the next new row gets.
+  ///
+  /// This is the lowest deleted row, or the end of the table.
+  uint64_t next_row_id() const {
+    if (!this->m_free_rows.empty())
+      return *this->m_free_rows.begin();
+    return this->num_values;
+  }
 
-      // overwrite entry
-      this->insert(index, row, error);
-      if (!error.is_ok())
-        return;
-    }
+  /// Get the id a new row gets.
+  ///
+  /// Rows of a primary key table are appended while their keys arrive in
+  /// order, so the table stays sorted. A row whose key does not go last is
+  /// placed like any other row, and the table is marked unsorted.
+  uint64_t next_row_id(const SmallVec<COLUMN_MAX, SqlValue> &row,
+                       SqlError &error);
 
-    // shrink num_values
-    this->update_num_values(this->num_values - 1, error);
-    if (!error.is_ok())
-      return;
+  /// Get the index of the primary key column, or -1 if there is none.
+  int primary_key_column() const { return this->m_primary_key; }
+
+  /// Make a column the primary key.
+  ///
+  /// This must be done before any row is added. The caller must attach an
+  /// index of the column, so keys can be checked for uniqueness.
+  void set_primary_key(size_t column, SqlError &error);
+
+  /// Returns false if a primary key table has rows out of key order.
+  bool is_sorted() const { return this->m_primary_key == -1 || this->m_sorted; }
+
+  /// Set whether the rows are in key order.
+  void set_sorted(bool sorted, SqlError &error);
+
+  /// Find the live row with a primary key value.
+  ///
+  /// Returns false if there is none.
+  bool find_primary_key(const SqlValue &value, uint64_t &row_id,
+                        SqlError &error);
+
+  /// Returns true if a column has an index.
+  bool has_index(size_t column) const;
+
+  /// Find the live rows whose value of a column equals a value, with an index
+  /// of the column.
+  ///
+  /// Returns false if no index can answer, so every row must be scanned.
+  /// Found row ids are appended to `row_ids` in order.
+  bool find_equal_rows(size_t column, const SqlValue &value,
+                       std::vector<uint64_t> &row_ids, SqlError &error);
+
+  /// Find the writes that sort a primary key table.
+  ///
+  /// The i-th live row in key order goes to row i, so the rows end up
+  /// contiguous and in key order. Rows already in place are skipped, and the
+  /// live rows past the new end are deleted. Nothing is written, so the
+  /// changes can be logged first. Pass them to `put_rows` and
+  /// `delete_row_ids`.
+  void sort_rows(std::vector<BufferedRow> &moved_rows,
+                 std::vector<uint64_t> &deleted_rows, SqlError &error);
+
+  /// Write a row by id, making it live.
+  ///
+  /// An id past the end grows the table, and any rows skipped over are
+  /// deleted. Writing the same row twice is harmless, so log replay uses this.
+  void put_row(uint64_t id, const SmallVec<COLUMN_MAX, SqlValue> &data,
+               SqlError &error) {
+    std::vector<BufferedRow> rows(1, BufferedRow{id, data});
+    this->put_rows(rows, error);
+  }
+
+  /// Write rows by id, like `put_row`.
+  ///
+  /// `rows` must be sorted by id. Rows in the same compressed page rewrite it
+  /// once.
+  void put_rows(const std::vector<BufferedRow> &rows, SqlError &error);
+
+  /// Remove a row at a given index
+  ///
+  /// the index must be less than num_values. The row is only marked deleted,
+  /// no other row moves.
+  void remove_row(size_t index, SqlError &error) {
+    std::vector<uint64_t> rows(1, index);
+    this->delete_row_ids(rows, error);
+  }
+
+  /// Mark rows deleted, by id.
+  ///
+  /// Their slots are reused by later inserts. Deleted rows at the end of the
+  /// table are trimmed off.
+  void delete_row_ids(const std::vector<uint64_t> &rows, SqlError &error);
+
+  /// Returns true if the row at the given index was deleted.
+  bool is_row_deleted(uint64_t index) const {
+    if (index / 8 >= this->m_tombstones.size())
+      return false;
+    return (this->m_tombstones[index / 8] >> (index % 8)) & 1;
   }
 
   /// Get a row at a given index
@@ -285,38 +596,34 @@ public:
   /// the index cannot exceed num_values
   void get_row(size_t index, SmallVec<COLUMN_MAX, SqlValue> &row,
                SqlError &error) {
-    // seek to index
-    this->seek_to_value_index(index, error);
-    if (!error.is_ok())
-      return;
-
-    // read sql values
-    for (size_t j = 0; j < this->columns.size(); j++) {
-      // read sql value
-      SqlValue value;
-      read_sql_value(value, this->columns[j].type.type, this->m_file, error);
-      if (!error.is_ok())
-        return;
-
-      // append to row
-      row.push(value);
-    }
+    uint32_t column_mask = ((uint32_t)1 << this->columns.size()) - 1;
+    this->get_row_columns(index, column_mask, row, error);
   }
 
-  /// Seek to a value by index
+  /// Get some columns of a row at a given index
   ///
-  /// the index cannot exceed num_values, and writing to num_values makes a new
-  /// record.
-  void seek_to_value_index(size_t index, SqlError &error) {
-    assert(index <= this->num_values);
+  /// bit j of `column_mask` selects column j. the row gets a value for every
+  /// column, but columns that are not selected are left null and are not
+  /// read.
+  void get_row_columns(size_t index, uint32_t column_mask,
+                       SmallVec<COLUMN_MAX, SqlValue> &row, SqlError &error);
 
-    // size of values offset plus size of num_values
-    size_t position =
-        SQL_TABLE_FILE_VALUES_OFFSET + 1 + (index * MAX_TYPE_SIZE * COLUMN_MAX);
-    this->m_file.seek(position, error);
-    if (!error.is_ok())
-      return;
-  }
+  /// Read some columns of a batch of live rows, and select them all.
+  ///
+  /// bit j of `column_mask` selects column j. The encoded values of each
+  /// page are copied a column at a time. At most `SQL_BATCH_SIZE` rows are
+  /// read.
+  void read_batch(const uint64_t *row_ids, size_t num_rows,
+                  uint32_t column_mask, SqlBatch &batch, SqlError &error);
+
+  /// Find the live rows of a list that match a predicate on a column of this
+  /// table.
+  ///
+  /// Rows are read and filtered a batch at a time. Found row ids are
+  /// appended to `row_ids`, in the order of the list.
+  void filter_rows(const SqlPredicate &predicate,
+                   const std::vector<uint64_t> &candidates,
+                   std::vector<uint64_t> &row_ids, SqlError &error);
 
   /// Get the index of a column name.
   ///
@@ -331,16 +638,22 @@ public:
     return -1;
   }
 
+  /// Hold rows until the transaction commits
+  void buffer_rows(const std::vector<BufferedRow> &rows) {
+    this->m_buffered_rows.insert(this->m_buffered_rows.end(), rows.begin(),
+                                 rows.end());
+  }
+
+  /// Get the rows held for the transaction
+  const std::vector<BufferedRow> &buffered_rows() const {
+    return this->m_buffered_rows;
+  }
+
   /// Commit buffered values
   void commit(SqlError &error) {
-    for (size_t i = 0; i < this->m_buffered_rows.size(); i++) {
-      // seek to values
-      this->seek_to_value_index(this->m_buffered_rows[i].row_index, error);
-      this->insert(this->m_buffered_rows[i].row_index,
-                   this->m_buffered_rows[i].row, error);
-      if (!error.is_ok())
-        return;
-    }
+    this->write_rows(this->m_buffered_rows, error);
+    if (!error.is_ok())
+      return;
 
     this->clear_buffered_rows();
     this->m_file.flush(error);
@@ -350,10 +663,10 @@ public:
   void clear_buffered_rows() { this->m_buffered_rows.clear(); }
 
   /// Update the num_values field
-  void update_num_values(uint8_t new_num_values, SqlError &error);
+  void update_num_values(uint64_t new_num_values, SqlError &error);
 
   /// get the number of values
-  uint8_t get_num_values();
+  uint64_t get_num_values();
 
   /// Add a column.
   void add_column(const parser::SqlColumn &column, SqlError &error);
@@ -377,6 +690,37 @@ public:
   /// Get the columns
   const SmallVec<COLUMN_MAX, parser::SqlColumn> &get_columns() const;
 
+  /// Fill a new b+tree with the keys of a column, from every live row.
+  void build_index(size_t column, SqlBTreeFile &tree, SqlError &error);
+
+  /// Fill a new hash table with the keys of a column, from every live row.
+  void build_index(size_t column, SqlHashFile &hash, SqlError &error);
+
+  /// Keep an open index of a column in step with the rows from now on.
+  ///
+  /// Queries on the column use it.
+  void attach_index(const std::string &name, size_t column,
+                    SqlBTreeFile &&tree);
+
+  /// Keep an open hash index of a column in step with the rows from now on.
+  ///
+  /// `=` queries on the column use it.
+  void attach_index(const std::string &name, size_t column,
+                    SqlHashFile &&hash);
+
+  /// Read the encoded value of a column from the live rows in a range.
+  ///
+  /// Each value is appended to `keys`, padded to the width of the column,
+  /// and its row to `row_ids`. Rows that do not match `predicate` are
+  /// skipped, if it is not null.
+  void read_column_keys(size_t column, uint64_t first_row, uint64_t end_row,
+                        const SqlPredicate *predicate,
+                        std::vector<uint8_t> &keys,
+                        std::vector<uint64_t> &row_ids, SqlError &error);
+
+  /// Stop using an index and remove its file.
+  void remove_index(const std::string &name, SqlError &error);
+
   /// remove the table file and close this file.
   void remove_file(SqlError &error);
 
@@ -386,16 +730,258 @@ public:
   /// Close this file
   void close(SqlError &error);
 
+  /// Write back buffered pages to the file
+  void flush(SqlError &error);
+
+  /// Write back buffered pages, then wait until the file is on disk.
+  void sync(SqlError &error);
+
+  /// Read the file again, picking up changes by other processes.
+  ///
+  /// Pages are written back first. Rows held for a transaction are kept.
+  void reload(SqlError &error);
+
+  /// Read the file again if another process changed it.
+  void invalidate_if_modified(SqlError &error);
+
   /// Get the file name
   const std::string &file_name() const;
 
 private:
+  /// Cursors scan the pages directly
+  friend class SqlTableCursor;
+
+  /// Rewrite a table in the format before pages in this format, then open it.
+  ///
+  /// The magic has already been read.
+  void convert_old_format(SqlError &error);
+
+  /// Find the candidate rows of a where clause with an index of its column.
+  ///
+  /// Returns false if no index can answer it, so every row must be scanned.
+  /// Candidates are sorted, but may be deleted or stale, so they must be
+  /// checked against the where clause again.
+  bool find_indexed_rows(const parser::SqlWhereClause &where_clause,
+                         size_t column_index, std::vector<uint64_t> &row_ids,
+                         SqlError &error);
+
+  /// Put row ids in primary key order, with the primary key's b+tree.
+  ///
+  /// If `all_rows` is set, `row_ids` gets every row in the tree. Otherwise
+  /// it must be sorted, and only its rows are kept. Rows may still be
+  /// deleted, so they must be checked again.
+  void primary_key_order(bool all_rows, std::vector<uint64_t> &row_ids,
+                         SqlError &error);
+
+  /// Find the ids of the live rows that match a predicate on a column.
+  ///
+  /// Only the rows an index finds are visited, if there is one. Otherwise
+  /// row groups the zones rule out are skipped. Rows are read and filtered a
+  /// batch at a time.
+  void find_matching_rows(const SqlPredicate &predicate,
+                          std::vector<uint64_t> &row_ids, SqlError &error);
+
+  /// Get the first row from `row_index` on whose zone may match a where
+  /// clause on a column.
+  ///
+  /// The zones of the column are built on first use. Returns num_values if
+  /// no later row can match.
+  uint64_t next_zone_row(const parser::SqlWhereClause &where_clause,
+                         size_t column_index, uint64_t row_index,
+                         SqlError &error);
+
+  /// Returns false if no row in the zone of a row can match a where clause
+  /// on a column.
+  ///
+  /// The zones of the column must be built. A stale zone is built again
+  /// first.
+  bool zone_may_match(const parser::SqlWhereClause &where_clause,
+                      size_t column_index, uint64_t row_index,
+                      SqlError &error);
+
+  /// Build the zones of a column from every live row.
+  void build_zones(size_t column, SqlError &error);
+
+  /// Add the values of a column in a range of live rows to their zones.
+  void add_zone_rows(size_t column, uint64_t first_row, uint64_t end_row,
+                     SqlError &error);
+
+  /// Widen the zones of a row for its encoded values.
+  void add_zone_values(uint64_t row_index, const uint8_t *data);
+
+  /// Update the indexes for rows about to be written.
+  ///
+  /// The old keys of existing rows are read, so this must run before the
+  /// rows are written.
+  void update_indexes(const std::vector<BufferedRow> &rows, SqlError &error);
+
+  /// Remove the keys of live rows about to be deleted from the indexes.
+  void remove_index_keys(const std::vector<uint64_t> &rows, SqlError &error);
+
+  /// Load the page directory, starting at the given directory page.
+  void load_page_directory(uint64_t first_directory_page, SqlError &error);
+
+  /// Load the tombstone bitmap, starting at the given tombstone page.
+  ///
+  /// Deleted rows are collected into the free row set.
+  void load_tombstones(uint64_t first_tombstone_page, SqlError &error);
+
+  /// Set or clear the tombstone bit of rows, then write the changed bytes.
+  ///
+  /// `rows` must be sorted. Tombstone pages are chained as needed.
+  void write_tombstones(const std::vector<uint64_t> &rows, bool deleted,
+                        SqlError &error);
+
+  /// Drop deleted rows from the end of the table.
+  ///
+  /// Row ids do not change, num_values just shrinks so the slots are reused
+  /// by appends instead of through the free row set.
+  void trim_deleted_rows(SqlError &error);
+
+  /// Allocate a zeroed page at the end of the file.
+  ///
+  /// Returns the new page number.
+  uint64_t allocate_page(SqlError &error);
+
+  /// Get a page for data, reusing a free page before growing the file.
+  uint64_t take_page(SqlError &error);
+
+  /// Allocate a new data page and append it to the page directory.
+  void allocate_data_page(SqlError &error);
+
+  /// Write the page directory entries from the given one on.
+  ///
+  /// Directory pages are chained as needed.
+  void write_page_directory(size_t first_entry, SqlError &error);
+
+  /// Recompute the row size and rows per page from the columns.
+  void update_row_layout();
+
+  /// Check that every value of a row has the type of its column, and fits it.
+  ///
+  /// Sets a type mismatch or limit reached error otherwise.
+  void check_row(const SmallVec<COLUMN_MAX, SqlValue> &data,
+                 SqlError &error) const;
+
+  /// Recompute the first row of every data page.
+  void update_page_first_rows();
+
+  /// Get the # of rows a data page holds.
+  size_t page_num_rows(size_t entry) const;
+
+  /// Get the # of rows all data pages hold.
+  uint64_t row_capacity() const;
+
+  /// Find the data page directory entry of a row, and its slot in the page.
+  void locate_row(size_t index, size_t &entry, size_t &slot) const;
+
+  /// Get the contents of a data page.
+  ///
+  /// Returns a ptr into the mapping if it is still good, otherwise the page
+  /// is read into `buffer`.
+  const uint8_t *page_data(size_t entry, uint8_t *buffer, SqlError &error);
+
+  /// Read the data pages of some directory entries back to back into
+  /// `pages`, bypassing the buffer pool.
+  ///
+  /// Pages next to each other in the file are read with one vectored read.
+  void read_pages(const std::vector<size_t> &entries,
+                  std::vector<uint8_t> &pages, SqlError &error);
+
+  /// Read every row of a compressed page, one vector of values per column.
+  void read_compressed_rows(size_t entry,
+                            std::vector<std::vector<uint8_t>> &column_values,
+                            SqlError &error);
+
+  /// Write rows to a data page, compressed.
+  ///
+  /// If they do not fit, they are split over new pages after it. The caller
+  /// must write the page directory.
+  void
+  store_compressed_rows(size_t entry,
+                        const std::vector<std::vector<uint8_t>> &column_values,
+                        size_t num_rows, SqlError &error);
+
+  /// Overwrite a row in a compressed page with an encoded row.
+  void update_compressed_row(size_t entry, size_t slot, const uint8_t *data,
+                             SqlError &error);
+
+  /// Compress the last data page, which must be full.
+  ///
+  /// Its rows are merged into the page before it if they fit, which frees
+  /// the last page for new rows.
+  void seal_last_page(SqlError &error);
+
+  /// Get the file position of a row for a given row layout.
+  ///
+  /// This is only meaningful for the row layout.
+  uint64_t row_position(size_t index, size_t row_size,
+                        size_t rows_per_page) const;
+
+  /// Get the file position of a value in an uncompressed columnar page.
+  uint64_t value_position(size_t entry, size_t slot, size_t column) const;
+
+  /// Move every row from an old row layout to the current one.
+  ///
+  /// This is only for the row layout. The current layout must have the old
+  /// columns as a prefix.
+  void relayout_rows(size_t old_row_size, size_t old_rows_per_page,
+                     SqlError &error);
+
+  /// Write rows again from the first data page, with the current layout.
+  ///
+  /// The old data pages are reused as the rows need them.
+  void rebuild_rows(const std::vector<SmallVec<COLUMN_MAX, SqlValue>> &rows,
+                    SqlError &error);
+
   SqlFile m_file;
   uint8_t num_columns;
-  uint8_t num_values;
+  uint64_t num_values;
   SmallVec<COLUMN_MAX, parser::SqlColumn> columns;
 
+  /// How rows are laid out in data pages
+  parser::SqlTableLayout m_layout;
+  /// The index of the primary key column, or -1 if there is none
+  int m_primary_key;
+  /// Set if the live rows are in primary key order
+  bool m_sorted;
+  /// The offset of each column in an encoded row
+  SmallVec<COLUMN_MAX, size_t> m_column_offsets;
+  /// The size of a row in bytes, the sum of the column widths.
+  size_t m_row_size;
+  /// The # of rows in a data page
+  size_t m_rows_per_page;
+
+  /// The # of pages in the file
+  uint64_t m_num_pages;
+  /// The page numbers of the page directory pages, in chain order
+  std::vector<uint64_t> m_directory_pages;
+  /// The page numbers of the data pages, in row order
+  std::vector<uint64_t> m_page_directory;
+  /// The # of rows in each compressed data page, 0 if it is not compressed
+  std::vector<uint32_t> m_page_row_counts;
+  /// The index of the first row of each data page
+  std::vector<uint64_t> m_page_first_rows;
+  /// Data pages that left the directory, reused before growing the file
+  std::vector<uint64_t> m_free_pages;
+
+  /// The page numbers of the tombstone pages, in chain order
+  std::vector<uint64_t> m_tombstone_pages;
+  /// A bit per row, set if the row was deleted
+  std::vector<uint8_t> m_tombstones;
+  /// The ids of deleted rows, reused lowest first by inserts
+  std::set<uint64_t> m_free_rows;
+
   std::vector<BufferedRow> m_buffered_rows;
+
+  /// The indexes of columns of this table
+  std::vector<SqlTableIndex> m_indexes;
+
+  /// The min, max and Bloom filter of columns per data page worth of rows,
+  /// built as filtered scans need them.
+  ///
+  /// This is only kept in memory, so it starts over when the file is read.
+  SqlZoneMap m_zone_map;
 };
 } // namespace basic_sql
 #endif
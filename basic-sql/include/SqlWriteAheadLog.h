@@ -0,0 +1,134 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_WRITE_AHEAD_LOG_H_
+#define _SQL_WRITE_AHEAD_LOG_H_
+
+#include "Limits.h"
+#include "SmallString.h"
+#include "SmallVec.h"
+#include "SqlError.h"
+#include "SqlFile.h"
+#include "SqlValue.h"
+#include <cstdint>
+#include <vector>
+
+namespace basic_sql {
+/// wal file magic #
+static const char *SQL_WAL_FILE_MAGIC = "walog-db";
+/// wal file magic # length
+static const size_t SQL_WAL_FILE_MAGIC_SIZE = 8;
+/// the offset to the synced end field
+///
+/// this is a u64 file offset. every record before it is known to be on disk.
+static const size_t SQL_WAL_FILE_SYNCED_END_OFFSET = SQL_WAL_FILE_MAGIC_SIZE;
+/// the size of the wal file header
+static const size_t SQL_WAL_FILE_HEADER_SIZE = SQL_WAL_FILE_SYNCED_END_OFFSET + 8;
+/// the size of the header of a wal record
+///
+/// a u32 body size and a u32 checksum of the body.
+static const size_t SQL_WAL_RECORD_HEADER_SIZE = 4 + 4;
+
+/// The kind of change a wal record holds
+enum class SqlWalRecordType {
+  /// A new row
+  INSERT = 1,
+  /// New values for an existing row
+  UPDATE = 2,
+  /// A deleted row
+  DELETE = 3,
+};
+
+/// A row change read back from the log
+struct SqlWalRecord {
+  /// The kind of change
+  SqlWalRecordType type;
+  /// The table of the row
+  SmallString<TABLE_NAME_MAX_LENGTH> table_name;
+  /// The id of the row
+  uint64_t row_id;
+  /// The new values of the row. This is empty for deletes.
+  SmallVec<COLUMN_MAX, SqlValue> row;
+};
+
+/// A redo log of row changes, shared by every process using a db.
+///
+/// Changes are logged in memory, then appended and made durable together by
+/// `commit`. A commit whose records were already synced by another process
+/// skips its own sync, so concurrent commits share one fdatasync.
+class SqlWriteAheadLog {
+public:
+  /// Make a new log for the file at `name`.
+  ///
+  /// This does not open the file.
+  SqlWriteAheadLog(std::string name);
+  SqlWriteAheadLog(const SqlWriteAheadLog &other) = delete;
+  SqlWriteAheadLog &operator=(SqlWriteAheadLog &other) = delete;
+  SqlWriteAheadLog(SqlWriteAheadLog &&other) noexcept;
+  SqlWriteAheadLog &operator=(SqlWriteAheadLog &&other);
+
+  /// Open the log file
+  void open(bool create, SqlError &error);
+
+  /// Log a new row, or new values for a row.
+  void log_row(SqlWalRecordType type,
+               const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+               uint64_t row_id, const SmallVec<COLUMN_MAX, SqlValue> &row);
+
+  /// Log a deleted row.
+  void log_delete(const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+                  uint64_t row_id);
+
+  /// Append the logged records to the file, and wait until they are on disk.
+  void commit(SqlError &error);
+
+  /// Drop the logged records that were not committed.
+  void discard();
+
+  /// Take the log lock, which keeps other processes from appending.
+  ///
+  /// The lock may be taken again while it is held, it is released by the
+  /// matching last `unlock`.
+  void lock(SqlError &error);
+
+  /// Release the log lock.
+  void unlock(SqlError &error);
+
+  /// Read every committed record, in order.
+  ///
+  /// The log lock must be held. Reading stops at the first torn record.
+  void read_records(std::vector<SqlWalRecord> &records, SqlError &error);
+
+  /// Drop every record, after they were applied to the tables.
+  ///
+  /// The log lock must be held.
+  void reset(SqlError &error);
+
+  /// Get the # of bytes of committed records
+  uint64_t size() const;
+
+  /// Returns true if this is closed.
+  bool is_closed() const;
+
+  /// Close this file
+  void close(SqlError &error);
+
+  /// Get the file name
+  const std::string &file_name() const;
+
+  /// remove the log file and close this file.
+  void remove_file(SqlError &error);
+
+private:
+  /// Wait until the file is on disk up to `end`, unless another process
+  /// already synced past it.
+  void sync_to(uint64_t end, SqlError &error);
+
+  SqlFile m_file;
+  /// Encoded records that were not committed yet
+  std::vector<uint8_t> m_pending;
+  /// The # of times the log lock is held
+  size_t m_lock_depth;
+};
+} // namespace basic_sql
+#endif
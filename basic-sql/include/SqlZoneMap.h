@@ -0,0 +1,101 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#ifndef _SQL_ZONE_MAP_H_
+#define _SQL_ZONE_MAP_H_
+
+#include "SqlStatement.h"
+#include <vector>
+
+namespace basic_sql {
+/// the # of Bloom filter bits per row of a group
+static const size_t SQL_ZONE_BLOOM_BITS_PER_ROW = 8;
+/// the # of Bloom filter bits set per value
+static const size_t SQL_ZONE_BLOOM_HASHES = 3;
+
+/// The smallest and largest zone key of a column in a group of rows
+///
+/// A group without rows has a min above its max.
+struct SqlZone {
+  uint64_t min;
+  uint64_t max;
+  /// The # of values overwritten or deleted since the group was built
+  uint32_t stale;
+};
+
+/// The min, max and a Bloom filter of the values of columns, per group of
+/// rows
+///
+/// Values are kept as u64 keys in the order `SqlValue` compares them. INT
+/// and FLOAT keys are exact. CHAR and VARCHAR keys are the first 8 bytes, so
+/// strings that share them have the same key. The Bloom filter of a group
+/// answers `=` for values within its range.
+///
+/// Values are only ever added, so an overwritten or deleted value may keep a
+/// group in range, but a group ruled out has no row that can match. Groups
+/// with many such values are stale, and should be built again.
+class SqlZoneMap {
+public:
+  /// Make a zone map without columns
+  SqlZoneMap();
+
+  /// Forget the zones of every column
+  void clear();
+
+  /// Returns true if the zones of a column were started.
+  bool has_column(size_t column) const;
+
+  /// Start the zones of a column, with groups of `group_rows` rows.
+  ///
+  /// Every group of the first `num_rows` rows starts empty, their values
+  /// must be added after. Columns with another group size are forgotten.
+  void start_column(size_t column, size_t group_rows, uint64_t num_rows);
+
+  /// Empty the zone of the group of a row, so it can be built again.
+  ///
+  /// The column zones must be started.
+  void clear_group(size_t column, uint64_t row);
+
+  /// Add an encoded value of a column to the zone of a row.
+  ///
+  /// Does nothing if the zones of the column were not started.
+  void add_value(size_t column, const parser::SqlType &type, uint64_t row,
+                 const uint8_t *data);
+
+  /// Note that the values of a row are about to be overwritten or deleted.
+  void mark_stale(uint64_t row);
+
+  /// Returns true if the group of a row had over half of its values
+  /// overwritten or deleted since it was built.
+  ///
+  /// The column zones must be started.
+  bool is_stale(size_t column, uint64_t row) const;
+
+  /// Returns false if no row in the group of `row` can match a where clause
+  /// on a column.
+  ///
+  /// The column zones must be started.
+  bool may_match(size_t column, const parser::SqlType &type, uint64_t row,
+                 const parser::SqlWhereClause &where_clause) const;
+
+  /// Get the first row of the group after the group of a row
+  uint64_t next_group(uint64_t row) const;
+
+private:
+  /// Get the zone of the group of a row, adding empty groups up to it.
+  SqlZone &group_zone(size_t column, uint64_t row);
+
+  /// The # of rows in a group
+  size_t m_group_rows;
+  /// The # of u64 words in the Bloom filter of a group
+  size_t m_bloom_words;
+  /// The zones of each group, per column
+  std::vector<std::vector<SqlZone>> m_zones;
+  /// The Bloom filter words of each group, back to back, per column
+  std::vector<std::vector<uint64_t>> m_blooms;
+  /// Set for the columns whose zones were started
+  std::vector<bool> m_started;
+};
+} // namespace basic_sql
+
+#endif
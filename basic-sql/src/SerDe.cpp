@@ -97,17 +97,78 @@ void write_sql_type(const parser::SqlType &type, SqlFile &file,
     return;
 }
 
-/// write a sql value to a file
-void write_sql_value(const SqlValue &value, SqlFile &file, SqlError &error) {
-  SqlValueType value_type = value.type();
+/// Get the # of bytes a value of the given sql type takes up on disk.
+///
+/// INT and FLOAT are 4 bytes, CHAR(n) and VARCHAR(n) are a length byte plus
+/// n bytes.
+size_t sql_type_width(const parser::SqlType &type) {
+  switch (type.type) {
+  case tokenizer::SqlType::INT:
+  case tokenizer::SqlType::FLOAT:
+    return 4;
+  case tokenizer::SqlType::VARCHAR:
+  case tokenizer::SqlType::CHAR:
+    return 1 + type.size;
+  default:
+    panic("unknown `tokenizer::SqlType` in `sql_type_width`");
+    return 0;
+  }
+}
+
+/// Get the # of bytes a value takes up on disk, excluding padding.
+size_t sql_value_encoded_size(const SqlValue &value) {
+  switch (value.type()) {
+  case SqlValueType::Float:
+  case SqlValueType::Integer:
+    return 4;
+  case SqlValueType::String:
+    return 1 + value.get_string().size();
+  default:
+    panic("unknown `SqlValue` in `sql_value_encoded_size`");
+    return 0;
+  }
+}
+
+/// Convert a value to the type of a column.
+///
+/// An INT becomes the FLOAT it converts to in a FLOAT column. Returns false
+/// if a value of its type cannot be stored in the column.
+bool convert_sql_value(SqlValue &value, const parser::SqlType &type) {
+  if (type.type == tokenizer::SqlType::FLOAT &&
+      value.type() == SqlValueType::Integer)
+    value.set_float((float)value.get_integer());
+  return sql_value_has_type(value, type);
+}
+
+/// Returns true if a value can be stored in a column of a type as it is.
+bool sql_value_has_type(const SqlValue &value, const parser::SqlType &type) {
+  switch (type.type) {
+  case tokenizer::SqlType::INT:
+    return value.type() == SqlValueType::Integer;
+  case tokenizer::SqlType::FLOAT:
+    return value.type() == SqlValueType::Float;
+  case tokenizer::SqlType::CHAR:
+  case tokenizer::SqlType::VARCHAR:
+    return value.type() == SqlValueType::String;
+  default:
+    panic("unknown type in `basic_sql::sql_value_has_type`");
+    return false;
+  }
+}
+
+/// encode a sql value into memory, padding it to the width of the given type.
+///
+/// the value must fit in the type's width.
+void encode_sql_value(const SqlValue &value, const parser::SqlType &type,
+                      uint8_t *data) {
+  size_t width = sql_type_width(type);
+  assert(sql_value_encoded_size(value) <= width);
 
   size_t written = 0;
-  switch (value_type) {
+  switch (value.type()) {
   case SqlValueType::Float: {
     // TODO: endian
-    file.write((const uint8_t *)&value.get_float(), sizeof(float), error);
-    if (!error.is_ok())
-      return;
+    memcpy(data, &value.get_float(), sizeof(float));
     written = sizeof(float);
     break;
   }
@@ -115,104 +176,181 @@ void write_sql_value(const SqlValue &value, SqlFile &file, SqlError &error) {
     const SmallString<MAX_TYPE_SIZE> &string_data = value.get_string();
     size_t string_data_size = string_data.size();
 
-    // write size
-    uint8_t size = string_data_size;
-    file.write((const uint8_t *)&size, 1, error);
-    if (!error.is_ok())
-      return;
-
-    // write string
-    file.write((const uint8_t *)string_data.get_ptr(), string_data_size, error);
-    if (!error.is_ok())
-      return;
+    // write size, then string
+    data[0] = string_data_size;
+    memcpy(data + 1, string_data.get_ptr(), string_data_size);
     written = string_data_size + 1;
-
     break;
   }
   case SqlValueType::Integer: {
     // TODO: endian
     // size of int on file is 4
-    file.write((const uint8_t *)&value.get_integer(), 4, error);
-    if (!error.is_ok())
-      return;
+    memcpy(data, &value.get_integer(), 4);
     written = 4;
     break;
   }
   default:
-    panic("unknown `SqlValue` in `write_sql_value`");
+    panic("unknown `SqlValue` in `encode_sql_value`");
   }
 
-  // TODO: I really should reserve MAX_TYPE_SIZE + 1 since string needs 1 extra
-  // for length storage
-  //
   // pad empty data
-  file.write_byte_n(0, MAX_TYPE_SIZE - written, error);
+  memset(data + written, 0, width - written);
+}
+
+/// Get the # of bytes a row of the given columns takes up on disk.
+size_t sql_row_width(const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns) {
+  size_t width = 0;
+  for (size_t i = 0; i < columns.size(); i++)
+    width += sql_type_width(columns[i].type);
+
+  return width;
+}
+
+/// encode a row into a contiguous buffer.
+///
+/// columns without a value are zeroed. `data` must hold the row width of the
+/// columns. Returns the row width.
+size_t encode_row(const SmallVec<COLUMN_MAX, SqlValue> &row,
+                  const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns,
+                  uint8_t *data) {
+  assert(row.size() <= columns.size());
+
+  size_t offset = 0;
+  for (size_t i = 0; i < columns.size(); i++) {
+    size_t width = sql_type_width(columns[i].type);
+    if (i < row.size()) {
+      encode_sql_value(row[i], columns[i].type, data + offset);
+    } else {
+      memset(data + offset, 0, width);
+    }
+    offset += width;
+  }
+
+  return offset;
+}
+
+/// decode a row of the given columns from a contiguous buffer.
+///
+/// the values are appended to `row`. Returns false if a value is corrupt.
+bool decode_row(SmallVec<COLUMN_MAX, SqlValue> &row,
+                const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns,
+                const uint8_t *data) {
+  for (size_t i = 0; i < columns.size(); i++) {
+    SqlValue value;
+    if (!decode_sql_value(value, columns[i].type, data))
+      return false;
+    row.push(value);
+    data += sql_type_width(columns[i].type);
+  }
+  return true;
+}
+
+/// write a sql value to a file, padding it to the width of the given type.
+///
+/// the value must fit in the type's width.
+void write_sql_value(const SqlValue &value, const parser::SqlType &type,
+                     SqlFile &file, SqlError &error) {
+  // encode the whole slot, padding included, and write it in one go.
+  uint8_t buffer[1 + MAX_TYPE_SIZE];
+  size_t width = sql_type_width(type);
+  assert(width <= sizeof(buffer));
+  encode_sql_value(value, type, buffer);
+
+  file.write(buffer, width, error);
   if (!error.is_ok())
     return;
 }
 
-/// read a sql value from a file
-void read_sql_value(SqlValue &sql_value, tokenizer::SqlType expected_type,
-                    SqlFile &file, SqlError &error) {
-  size_t read = 0;
-  switch (expected_type) {
+/// decode a sql value of the given type from memory.
+///
+/// `data` must hold the full width of the type. Returns false if the value is
+/// corrupt, as a string longer than the type.
+bool decode_sql_value(SqlValue &sql_value, const parser::SqlType &type,
+                      const uint8_t *data) {
+  switch (type.type) {
   case tokenizer::SqlType::FLOAT: {
     // read float
     float value = 0.0;
-    file.read((uint8_t *)&value, 4, error);
-    if (!error.is_ok())
-      return;
-
+    memcpy(&value, data, 4);
     sql_value.set_float(value);
-
-    read = 4;
     break;
   }
   case tokenizer::SqlType::VARCHAR:
   case tokenizer::SqlType::CHAR: {
-    // read string size
-    uint8_t size = 0;
-    file.read((uint8_t *)&size, 1, error);
-    if (!error.is_ok())
-      return;
+    // read string size, which only corrupt data makes too long
+    uint8_t size = data[0];
+    if (size >= sql_type_width(type))
+      return false;
 
     // read string body
-    SmallString<MAX_TYPE_SIZE> value;
-    file.read((uint8_t *)value.get_ptr(), size, error);
-    if (!error.is_ok())
-      return;
-    value.unsafe_set_size(size);
-
-    // TODO: do in place, avoid copy
-    sql_value.set_string(value.get_ptr(), value.size());
-
-    read = 1 + size;
+    sql_value.set_string((const char *)data + 1, size);
     break;
   }
   case tokenizer::SqlType::INT: {
     // read int
-    int value = 0;
-    file.read((uint8_t *)&value, 4, error);
-    if (!error.is_ok())
-      return;
-
+    uint32_t value = 0;
+    memcpy(&value, data, 4);
     sql_value.set_integer(value);
+    break;
+  }
+  default:
+    panic("unknown type in `basic_sql::decode_sql_value`");
+    break;
+  }
+  return true;
+}
 
-    read = 4;
+/// hash an encoded sql value of the given type.
+///
+/// equal values hash alike, the way `SqlValue` compares values of the type.
+uint64_t hash_sql_value(const parser::SqlType &type, const uint8_t *data) {
+  uint8_t zero_float[4] = {0};
+  size_t len = 4;
+  switch (type.type) {
+  case tokenizer::SqlType::INT:
+    break;
+  case tokenizer::SqlType::FLOAT: {
+    // -0 equals 0
+    float value = 0;
+    memcpy(&value, data, 4);
+    if (value == 0)
+      data = zero_float;
     break;
   }
+  case tokenizer::SqlType::CHAR:
+  case tokenizer::SqlType::VARCHAR:
+    len = 1 + data[0];
+    break;
   default:
-    panic("unknown type in `basic_sql::read_sql_value`");
+    panic("unknown `tokenizer::SqlType` in `hash_sql_value`");
     break;
   }
 
-  // read empty data
-  for (size_t i = read; i < MAX_TYPE_SIZE; i++) {
-    uint8_t temp = 0;
-    file.read(&temp, 1, error);
-    if (!error.is_ok())
-      return;
+  // FNV-1a, then mixed so the low bits are spread well
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
   }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/// read a sql value from a file, consuming the width of the given type.
+void read_sql_value(SqlValue &sql_value, const parser::SqlType &type,
+                    SqlFile &file, SqlError &error) {
+  // read the whole slot, padding included, in one go.
+  uint8_t buffer[1 + MAX_TYPE_SIZE];
+  size_t width = sql_type_width(type);
+  assert(width <= sizeof(buffer));
+  file.read(buffer, width, error);
+  if (!error.is_ok())
+    return;
+
+  if (!decode_sql_value(sql_value, type, buffer))
+    error.set_invalid_file();
 }
 
 } // namespace basic_sql
\ No newline at end of file
@@ -0,0 +1,641 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlBTreeFile.h"
+#include "SerDe.h"
+#include <algorithm>
+
+namespace basic_sql {
+/// Returns true if a node is a leaf
+static bool node_is_leaf(const uint8_t *node) { return node[0] != 0; }
+
+/// Get the # of entries in a node
+static uint16_t node_count(const uint8_t *node) {
+  uint16_t count = 0;
+  memcpy(&count, node + 2, 2);
+  return count;
+}
+
+/// Set the # of entries in a node
+static void set_node_count(uint8_t *node, uint16_t count) {
+  memcpy(node + 2, &count, 2);
+}
+
+/// Get the link of a node
+static uint64_t node_link(const uint8_t *node) {
+  uint64_t link = 0;
+  memcpy(&link, node + 8, 8);
+  return link;
+}
+
+/// Set the link of a node
+static void set_node_link(uint8_t *node, uint64_t link) {
+  memcpy(node + 8, &link, 8);
+}
+
+/// Make a new unopened file
+SqlBTreeFile::SqlBTreeFile(std::string name, SqlBufferPool *buffer_pool)
+    : m_file(name, buffer_pool), m_key_type{tokenizer::SqlType::INT, 1},
+      m_key_size(4), m_root(0), m_num_pages(0) {}
+SqlBTreeFile::SqlBTreeFile(SqlBTreeFile &&other) noexcept
+    : m_file(std::move(other.m_file)), m_key_type(other.m_key_type),
+      m_key_size(other.m_key_size), m_root(other.m_root),
+      m_num_pages(other.m_num_pages) {}
+SqlBTreeFile &SqlBTreeFile::operator=(SqlBTreeFile &&other) {
+  SqlError error;
+  this->close(error);
+  this->m_file = std::move(other.m_file);
+  this->m_key_type = other.m_key_type;
+  this->m_key_size = other.m_key_size;
+  this->m_root = other.m_root;
+  this->m_num_pages = other.m_num_pages;
+  return *this;
+}
+
+/// Open the file.
+///
+/// A new file is an empty tree of keys of the given type. An existing file
+/// keeps the type it was created with.
+void SqlBTreeFile::open(bool create, const parser::SqlType &key_type,
+                        SqlError &error) {
+  // flags setup
+  const char *flags = create ? "w+b" : "r+b";
+
+  this->m_file.open(flags, error);
+  if (!error.is_ok())
+    return;
+
+  if (!create) {
+    this->read_header(error);
+    return;
+  }
+
+  // the header page, then an empty leaf as the root
+  this->m_key_type = key_type;
+  this->m_key_size = sql_type_width(key_type);
+  uint8_t page[STORAGE_PAGE_SIZE] = {0};
+  memcpy(page, SQL_BTREE_FILE_MAGIC, SQL_BTREE_FILE_MAGIC_SIZE);
+  page[SQL_BTREE_FILE_KEY_TYPE_OFFSET] = (uint8_t)key_type.type;
+  page[SQL_BTREE_FILE_KEY_TYPE_OFFSET + 1] = (uint8_t)key_type.size;
+  this->write_page(0, page, error);
+  if (!error.is_ok())
+    return;
+  this->m_num_pages = 1;
+
+  this->m_root = this->allocate_page(error);
+  if (!error.is_ok())
+    return;
+  memset(page, 0, STORAGE_PAGE_SIZE);
+  page[0] = 1;
+  this->write_page(this->m_root, page, error);
+  if (!error.is_ok())
+    return;
+
+  this->write_header(error);
+}
+
+/// Replace the contents of a new tree with keys.
+void SqlBTreeFile::bulk_load(const std::vector<uint8_t> &keys,
+                             const std::vector<uint64_t> &row_ids,
+                             SqlError &error) {
+  size_t num_keys = row_ids.size();
+  if (num_keys == 0)
+    return;
+
+  // sort the keys
+  std::vector<size_t> order(num_keys);
+  for (size_t i = 0; i < num_keys; i++)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+    return this->compare(keys.data() + (lhs * this->m_key_size), row_ids[lhs],
+                         keys.data() + (rhs * this->m_key_size),
+                         row_ids[rhs]) < 0;
+  });
+
+  // the empty root leaf is dropped, pages are handed out from it on.
+  this->m_num_pages = 1;
+
+  // fill the leaves, each links to the one allocated after it
+  std::vector<uint64_t> level_pages;
+  std::vector<size_t> level_first_keys;
+  size_t leaf_capacity = this->leaf_capacity();
+  size_t leaf_entry_size = this->entry_size(true);
+  for (size_t first = 0; first < num_keys; first += leaf_capacity) {
+    size_t count = std::min(leaf_capacity, num_keys - first);
+    uint64_t page = this->allocate_page(error);
+    if (!error.is_ok())
+      return;
+
+    uint8_t node[STORAGE_PAGE_SIZE] = {0};
+    node[0] = 1;
+    set_node_count(node, count);
+    set_node_link(node, first + count < num_keys ? page + 1 : 0);
+    for (size_t i = 0; i < count; i++) {
+      uint8_t *entry =
+          node + SQL_BTREE_FILE_NODE_HEADER_SIZE + (i * leaf_entry_size);
+      size_t key_index = order[first + i];
+      memcpy(entry, keys.data() + (key_index * this->m_key_size),
+             this->m_key_size);
+      memcpy(entry + this->m_key_size, &row_ids[key_index], 8);
+    }
+    this->write_page(page, node, error);
+    if (!error.is_ok())
+      return;
+
+    level_pages.push_back(page);
+    level_first_keys.push_back(first);
+  }
+
+  // build internal levels until one node is left. the first key of each
+  // child separates it from the one before.
+  size_t fanout = this->internal_capacity() + 1;
+  size_t internal_entry_size = this->entry_size(false);
+  while (level_pages.size() > 1) {
+    std::vector<uint64_t> parent_pages;
+    std::vector<size_t> parent_first_keys;
+    for (size_t first = 0; first < level_pages.size(); first += fanout) {
+      size_t num_children = std::min(fanout, level_pages.size() - first);
+      uint64_t page = this->allocate_page(error);
+      if (!error.is_ok())
+        return;
+
+      uint8_t node[STORAGE_PAGE_SIZE] = {0};
+      set_node_count(node, num_children - 1);
+      set_node_link(node, level_pages[first]);
+      for (size_t i = 1; i < num_children; i++) {
+        uint8_t *entry = node + SQL_BTREE_FILE_NODE_HEADER_SIZE +
+                         ((i - 1) * internal_entry_size);
+        size_t key_index = order[level_first_keys[first + i]];
+        memcpy(entry, keys.data() + (key_index * this->m_key_size),
+               this->m_key_size);
+        memcpy(entry + this->m_key_size, &row_ids[key_index], 8);
+        memcpy(entry + this->m_key_size + 8, &level_pages[first + i], 8);
+      }
+      this->write_page(page, node, error);
+      if (!error.is_ok())
+        return;
+
+      parent_pages.push_back(page);
+      parent_first_keys.push_back(level_first_keys[first]);
+    }
+    level_pages = parent_pages;
+    level_first_keys = parent_first_keys;
+  }
+
+  this->m_root = level_pages[0];
+  this->write_header(error);
+}
+
+/// Add a key. Adding a key that is already there does nothing.
+void SqlBTreeFile::insert(const uint8_t *key, uint64_t row_id,
+                          SqlError &error) {
+  Split split;
+  bool did_split = this->insert_into(this->m_root, key, row_id, split, error);
+  if (!error.is_ok() || !did_split)
+    return;
+
+  // the root split, grow the tree by a level
+  uint64_t page = this->allocate_page(error);
+  if (!error.is_ok())
+    return;
+
+  uint8_t node[STORAGE_PAGE_SIZE] = {0};
+  set_node_count(node, 1);
+  set_node_link(node, this->m_root);
+  uint8_t *entry = node + SQL_BTREE_FILE_NODE_HEADER_SIZE;
+  memcpy(entry, split.key.data(), this->m_key_size);
+  memcpy(entry + this->m_key_size, &split.row_id, 8);
+  memcpy(entry + this->m_key_size + 8, &split.page, 8);
+  this->write_page(page, node, error);
+  if (!error.is_ok())
+    return;
+
+  this->m_root = page;
+  this->write_header(error);
+}
+
+/// Remove a key. Removing a key that is not there does nothing.
+void SqlBTreeFile::remove(const uint8_t *key, uint64_t row_id,
+                          SqlError &error) {
+  uint64_t page = this->find_leaf(key, row_id, error);
+  if (!error.is_ok())
+    return;
+
+  uint8_t node[STORAGE_PAGE_SIZE];
+  this->read_page(page, node, error);
+  if (!error.is_ok())
+    return;
+
+  uint16_t count = node_count(node);
+  size_t index = this->lower_bound(node, key, row_id);
+  size_t entry_size = this->entry_size(true);
+  uint8_t *entry = node + SQL_BTREE_FILE_NODE_HEADER_SIZE + (index * entry_size);
+  if (index == count || this->compare(entry, read_u64(entry + this->m_key_size),
+                                      key, row_id) != 0)
+    return;
+
+  memmove(entry, entry + entry_size, (count - index - 1) * entry_size);
+  set_node_count(node, count - 1);
+  this->write_page(page, node, error);
+}
+
+/// Find the rows whose value matches an encoded value.
+///
+/// Only `=` and `>` are supported. Row ids are appended in key order.
+void SqlBTreeFile::find(tokenizer::SqlOperator op, const uint8_t *key,
+                        std::vector<uint64_t> &row_ids, SqlError &error) {
+  assert(op == tokenizer::SqlOperator::Equals ||
+         op == tokenizer::SqlOperator::GreaterThan);
+
+  // start at the first key of the value, or past the last one
+  uint64_t start_row_id =
+      op == tokenizer::SqlOperator::Equals ? 0 : UINT64_MAX;
+  uint64_t page = this->find_leaf(key, start_row_id, error);
+  if (!error.is_ok())
+    return;
+
+  uint8_t node[STORAGE_PAGE_SIZE];
+  this->read_page(page, node, error);
+  if (!error.is_ok())
+    return;
+  size_t index = this->lower_bound(node, key, start_row_id);
+  size_t entry_size = this->entry_size(true);
+
+  // walk the leaves in key order
+  while (true) {
+    uint16_t count = node_count(node);
+    for (; index < count; index++) {
+      const uint8_t *entry =
+          node + SQL_BTREE_FILE_NODE_HEADER_SIZE + (index * entry_size);
+      int cmp = this->compare(entry, 0, key, 0);
+      if (op == tokenizer::SqlOperator::Equals && cmp != 0)
+        return;
+      if (cmp == 0 && op == tokenizer::SqlOperator::GreaterThan)
+        continue;
+      row_ids.push_back(read_u64(entry + this->m_key_size));
+    }
+
+    page = node_link(node);
+    if (page == 0)
+      return;
+    this->read_page(page, node, error);
+    if (!error.is_ok())
+      return;
+    index = 0;
+  }
+}
+
+/// Get the row id of every key, in key order.
+void SqlBTreeFile::scan(std::vector<uint64_t> &row_ids, SqlError &error) {
+  // the link of an internal node is its first child, which leads to the
+  // first leaf.
+  uint8_t node[STORAGE_PAGE_SIZE];
+  this->read_page(this->m_root, node, error);
+  if (!error.is_ok())
+    return;
+  while (!node_is_leaf(node)) {
+    this->read_page(node_link(node), node, error);
+    if (!error.is_ok())
+      return;
+  }
+
+  // walk the leaves in key order
+  size_t entry_size = this->entry_size(true);
+  while (true) {
+    uint16_t count = node_count(node);
+    for (size_t index = 0; index < count; index++) {
+      const uint8_t *entry =
+          node + SQL_BTREE_FILE_NODE_HEADER_SIZE + (index * entry_size);
+      row_ids.push_back(read_u64(entry + this->m_key_size));
+    }
+
+    uint64_t page = node_link(node);
+    if (page == 0)
+      return;
+    this->read_page(page, node, error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Get the type of the keys
+const parser::SqlType &SqlBTreeFile::key_type() const {
+  return this->m_key_type;
+}
+
+/// Returns true if this is closed
+bool SqlBTreeFile::is_closed() const { return this->m_file.is_closed(); }
+
+/// Close this file
+void SqlBTreeFile::close(SqlError &error) { this->m_file.close(error); }
+
+/// Write back buffered pages to the file
+void SqlBTreeFile::flush(SqlError &error) { this->m_file.flush(error); }
+
+/// Write back buffered pages, then wait until the file is on disk.
+void SqlBTreeFile::sync(SqlError &error) { this->m_file.sync(error); }
+
+/// Drop cached pages if another process changed the file, then read the
+/// header again.
+void SqlBTreeFile::invalidate_if_modified(SqlError &error) {
+  this->m_file.invalidate_if_modified(error);
+  if (!error.is_ok())
+    return;
+
+  this->read_header(error);
+}
+
+/// remove the file and close this file.
+void SqlBTreeFile::remove_file(SqlError &error) {
+  this->m_file.remove_file(error);
+}
+
+/// Get the file name
+const std::string &SqlBTreeFile::file_name() const {
+  return this->m_file.name();
+}
+
+/// Compare a stored key to a key. Returns <0, 0 or >0 like memcmp.
+///
+/// Values compare like `SqlValue`s of the key type, ties are broken by row
+/// id.
+int SqlBTreeFile::compare(const uint8_t *lhs, uint64_t lhs_row_id,
+                          const uint8_t *rhs, uint64_t rhs_row_id) const {
+  int cmp = 0;
+  switch (this->m_key_type.type) {
+  case tokenizer::SqlType::INT: {
+    uint32_t lhs_value = 0;
+    uint32_t rhs_value = 0;
+    memcpy(&lhs_value, lhs, 4);
+    memcpy(&rhs_value, rhs, 4);
+    cmp = (lhs_value > rhs_value) - (lhs_value < rhs_value);
+    break;
+  }
+  case tokenizer::SqlType::FLOAT: {
+    float lhs_value = 0;
+    float rhs_value = 0;
+    memcpy(&lhs_value, lhs, 4);
+    memcpy(&rhs_value, rhs, 4);
+    cmp = (lhs_value > rhs_value) - (lhs_value < rhs_value);
+    break;
+  }
+  case tokenizer::SqlType::CHAR:
+  case tokenizer::SqlType::VARCHAR: {
+    // bytewise, a prefix sorts first
+    size_t len = std::min(lhs[0], rhs[0]);
+    cmp = memcmp(lhs + 1, rhs + 1, len);
+    if (cmp == 0)
+      cmp = (lhs[0] > rhs[0]) - (lhs[0] < rhs[0]);
+    break;
+  }
+  default:
+    panic("unknown `tokenizer::SqlType` in `SqlBTreeFile::compare`");
+    break;
+  }
+  if (cmp != 0)
+    return cmp;
+
+  return (lhs_row_id > rhs_row_id) - (lhs_row_id < rhs_row_id);
+}
+
+/// Get the # of entries that fit in a leaf
+size_t SqlBTreeFile::leaf_capacity() const {
+  return (STORAGE_PAGE_SIZE - SQL_BTREE_FILE_NODE_HEADER_SIZE) /
+         this->entry_size(true);
+}
+
+/// Get the # of entries that fit in an internal node
+size_t SqlBTreeFile::internal_capacity() const {
+  return (STORAGE_PAGE_SIZE - SQL_BTREE_FILE_NODE_HEADER_SIZE) /
+         this->entry_size(false);
+}
+
+/// Get the size of an entry of a leaf, or of an internal node
+///
+/// a leaf entry is a key and a u64 row id, an internal entry adds a u64 child
+/// page.
+size_t SqlBTreeFile::entry_size(bool is_leaf) const {
+  return this->m_key_size + 8 + (is_leaf ? 0 : 8);
+}
+
+/// Find the first entry of a node not less than a key.
+size_t SqlBTreeFile::lower_bound(const uint8_t *node, const uint8_t *key,
+                                 uint64_t row_id) const {
+  size_t entry_size = this->entry_size(node_is_leaf(node));
+  const uint8_t *entries = node + SQL_BTREE_FILE_NODE_HEADER_SIZE;
+
+  size_t low = 0;
+  size_t high = node_count(node);
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    const uint8_t *entry = entries + (mid * entry_size);
+    if (this->compare(entry, read_u64(entry + this->m_key_size), key,
+                      row_id) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+/// Find the child of an internal node that leads to a key.
+///
+/// This is the child of the last entry not greater than the key, or the first
+/// child if there is none.
+uint64_t SqlBTreeFile::child_for(const uint8_t *node, const uint8_t *key,
+                                 uint64_t row_id) const {
+  size_t entry_size = this->entry_size(false);
+  const uint8_t *entries = node + SQL_BTREE_FILE_NODE_HEADER_SIZE;
+
+  size_t index = this->lower_bound(node, key, row_id);
+  if (index < node_count(node)) {
+    const uint8_t *entry = entries + (index * entry_size);
+    if (this->compare(entry, read_u64(entry + this->m_key_size), key,
+                      row_id) == 0)
+      index++;
+  }
+  if (index == 0)
+    return node_link(node);
+
+  return read_u64(entries + ((index - 1) * entry_size) + this->m_key_size + 8);
+}
+
+/// Find the leaf that holds a key, or would.
+uint64_t SqlBTreeFile::find_leaf(const uint8_t *key, uint64_t row_id,
+                                 SqlError &error) {
+  uint64_t page = this->m_root;
+  uint8_t node[STORAGE_PAGE_SIZE];
+  while (true) {
+    this->read_page(page, node, error);
+    if (!error.is_ok())
+      return 0;
+    if (node_is_leaf(node))
+      return page;
+    page = this->child_for(node, key, row_id);
+  }
+}
+
+/// Insert a key below a node.
+///
+/// Returns true and fills `split` if the node was split.
+bool SqlBTreeFile::insert_into(uint64_t page, const uint8_t *key,
+                               uint64_t row_id, Split &split,
+                               SqlError &error) {
+  uint8_t node[STORAGE_PAGE_SIZE];
+  this->read_page(page, node, error);
+  if (!error.is_ok())
+    return false;
+
+  bool is_leaf = node_is_leaf(node);
+  size_t entry_size = this->entry_size(is_leaf);
+  uint16_t count = node_count(node);
+  uint8_t *entries = node + SQL_BTREE_FILE_NODE_HEADER_SIZE;
+
+  // make the new entry, and find where it goes
+  uint8_t new_entry[MAX_TYPE_SIZE + 1 + 16];
+  size_t index = this->lower_bound(node, key, row_id);
+  if (is_leaf) {
+    if (index < count &&
+        this->compare(entries + (index * entry_size),
+                      read_u64(entries + (index * entry_size) +
+                               this->m_key_size),
+                      key, row_id) == 0)
+      return false;
+
+    memcpy(new_entry, key, this->m_key_size);
+    memcpy(new_entry + this->m_key_size, &row_id, 8);
+  } else {
+    Split child_split;
+    uint64_t child = this->child_for(node, key, row_id);
+    bool child_did_split =
+        this->insert_into(child, key, row_id, child_split, error);
+    if (!error.is_ok() || !child_did_split)
+      return false;
+
+    // the new child follows the split one
+    memcpy(new_entry, child_split.key.data(), this->m_key_size);
+    memcpy(new_entry + this->m_key_size, &child_split.row_id, 8);
+    memcpy(new_entry + this->m_key_size + 8, &child_split.page, 8);
+    index = this->lower_bound(node, child_split.key.data(),
+                              child_split.row_id);
+  }
+
+  size_t capacity =
+      is_leaf ? this->leaf_capacity() : this->internal_capacity();
+  if (count < capacity) {
+    uint8_t *entry = entries + (index * entry_size);
+    memmove(entry + entry_size, entry, (count - index) * entry_size);
+    memcpy(entry, new_entry, entry_size);
+    set_node_count(node, count + 1);
+    this->write_page(page, node, error);
+    return false;
+  }
+
+  // full, split the entries in half
+  std::vector<uint8_t> all_entries((count + 1) * entry_size);
+  memcpy(all_entries.data(), entries, index * entry_size);
+  memcpy(all_entries.data() + (index * entry_size), new_entry, entry_size);
+  memcpy(all_entries.data() + ((index + 1) * entry_size),
+         entries + (index * entry_size), (count - index) * entry_size);
+  size_t total = count + 1;
+  size_t left_count = total / 2;
+
+  uint64_t new_page = this->allocate_page(error);
+  if (!error.is_ok())
+    return false;
+
+  uint8_t new_node[STORAGE_PAGE_SIZE] = {0};
+  const uint8_t *middle = all_entries.data() + (left_count * entry_size);
+  split.key.assign(middle, middle + this->m_key_size);
+  split.row_id = read_u64(middle + this->m_key_size);
+  split.page = new_page;
+  if (is_leaf) {
+    // the leaves stay chained in key order
+    new_node[0] = 1;
+    set_node_count(new_node, total - left_count);
+    set_node_link(new_node, node_link(node));
+    memcpy(new_node + SQL_BTREE_FILE_NODE_HEADER_SIZE, middle,
+           (total - left_count) * entry_size);
+    set_node_link(node, new_page);
+  } else {
+    // the middle entry moves up, its child is the first of the new node
+    set_node_count(new_node, total - left_count - 1);
+    set_node_link(new_node, read_u64(middle + this->m_key_size + 8));
+    memcpy(new_node + SQL_BTREE_FILE_NODE_HEADER_SIZE, middle + entry_size,
+           (total - left_count - 1) * entry_size);
+  }
+  set_node_count(node, left_count);
+  memcpy(entries, all_entries.data(), left_count * entry_size);
+
+  this->write_page(new_page, new_node, error);
+  if (!error.is_ok())
+    return false;
+  this->write_page(page, node, error);
+  if (!error.is_ok())
+    return false;
+
+  return true;
+}
+
+/// Allocate a zeroed page at the end of the file.
+///
+/// Returns the new page number.
+uint64_t SqlBTreeFile::allocate_page(SqlError &error) {
+  uint64_t page = this->m_num_pages;
+  uint8_t data[STORAGE_PAGE_SIZE] = {0};
+  this->write_page(page, data, error);
+  if (!error.is_ok())
+    return 0;
+
+  this->m_num_pages++;
+  this->write_header(error);
+  if (!error.is_ok())
+    return 0;
+
+  return page;
+}
+
+/// Read a page.
+void SqlBTreeFile::read_page(uint64_t page, uint8_t *data, SqlError &error) {
+  this->m_file.read_at(page * STORAGE_PAGE_SIZE, data, STORAGE_PAGE_SIZE,
+                       error);
+}
+
+/// Write a page.
+void SqlBTreeFile::write_page(uint64_t page, const uint8_t *data,
+                              SqlError &error) {
+  this->m_file.write_at(page * STORAGE_PAGE_SIZE, data, STORAGE_PAGE_SIZE,
+                        error);
+}
+
+/// Write the root and num_pages fields
+void SqlBTreeFile::write_header(SqlError &error) {
+  uint8_t fields[16];
+  memcpy(fields, &this->m_root, 8);
+  memcpy(fields + 8, &this->m_num_pages, 8);
+  this->m_file.write_at(SQL_BTREE_FILE_ROOT_OFFSET, fields, 16, error);
+}
+
+/// Read the header fields
+void SqlBTreeFile::read_header(SqlError &error) {
+  uint8_t header[SQL_BTREE_FILE_HEADER_SIZE];
+  this->m_file.read_at(0, header, SQL_BTREE_FILE_HEADER_SIZE, error);
+  if (!error.is_ok())
+    return;
+
+  if (memcmp(header, SQL_BTREE_FILE_MAGIC, SQL_BTREE_FILE_MAGIC_SIZE) != 0 ||
+      header[SQL_BTREE_FILE_KEY_TYPE_OFFSET] >
+          (uint8_t)tokenizer::SqlType::CHAR) {
+    error.set_invalid_file();
+    return;
+  }
+  this->m_key_type.type =
+      (tokenizer::SqlType)header[SQL_BTREE_FILE_KEY_TYPE_OFFSET];
+  this->m_key_type.size = header[SQL_BTREE_FILE_KEY_TYPE_OFFSET + 1];
+  this->m_key_size = sql_type_width(this->m_key_type);
+  this->m_root = read_u64(header + SQL_BTREE_FILE_ROOT_OFFSET);
+  this->m_num_pages = read_u64(header + SQL_BTREE_FILE_NUM_PAGES_OFFSET);
+}
+} // namespace basic_sql
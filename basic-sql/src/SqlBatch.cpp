@@ -0,0 +1,32 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlBatch.h"
+#include "SerDe.h"
+
+namespace basic_sql {
+/// Select every row of a batch
+void select_all(SqlBatch &batch) {
+  batch.selection.resize(batch.row_ids.size());
+  for (size_t i = 0; i < batch.selection.size(); i++)
+    batch.selection[i] = i;
+}
+
+/// Decode a row of a batch.
+bool decode_batch_row(const SqlBatch &batch,
+                      const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns,
+                      uint32_t column_mask, size_t position,
+                      SmallVec<COLUMN_MAX, SqlValue> &row) {
+  for (size_t j = 0; j < columns.size(); j++) {
+    SqlValue value;
+    if ((column_mask & ((uint32_t)1 << j)) != 0) {
+      size_t width = sql_type_width(columns[j].type);
+      if (!decode_sql_value(value, columns[j].type,
+                            batch.columns[j].data() + (position * width)))
+        return false;
+    }
+    row.push(value);
+  }
+  return true;
+}
+} // namespace basic_sql
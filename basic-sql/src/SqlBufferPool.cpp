@@ -0,0 +1,260 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlBufferPool.h"
+#include "SqlFile.h"
+#include <algorithm>
+#include <cassert>
+
+namespace basic_sql {
+/// Make a buffer pool that holds at most `budget` bytes of pages.
+///
+/// The pool always holds at least 1 page.
+SqlBufferPool::SqlBufferPool(size_t budget)
+    : m_capacity(budget / STORAGE_PAGE_SIZE), m_clock_hand(0),
+      m_next_file_id(1), m_stats{0, 0, 0, 0} {
+  if (this->m_capacity == 0)
+    this->m_capacity = 1;
+}
+
+/// Register a file with the pool, returning its id.
+///
+/// Ids of unregistered files are given out again.
+uint32_t SqlBufferPool::register_file(SqlFile *file) {
+  // ids only need to be unique among open files, and must fit in 24 bits.
+  uint32_t file_id = 0;
+  if (!this->m_free_file_ids.empty()) {
+    file_id = this->m_free_file_ids.back();
+    this->m_free_file_ids.pop_back();
+  } else {
+    file_id = this->m_next_file_id;
+    this->m_next_file_id++;
+    assert(file_id < ((uint32_t)1 << 24));
+  }
+  this->m_files[file_id] = file;
+  return file_id;
+}
+
+/// Point a registered file id at a new file object, after a move.
+void SqlBufferPool::rebind_file(uint32_t file_id, SqlFile *file) {
+  auto file_it = this->m_files.find(file_id);
+  assert(file_it != this->m_files.end());
+  file_it->second = file;
+}
+
+/// Drop the pages of a file without writing them back, and forget it.
+void SqlBufferPool::unregister_file(uint32_t file_id) {
+  this->drop_file_pages(file_id);
+  this->m_files.erase(file_id);
+
+  // no page is keyed by the id anymore, so it can be used again
+  this->m_free_file_ids.push_back(file_id);
+}
+
+/// Get a page of a file, reading it on a miss.
+///
+/// The returned ptr is valid until the next call into the pool.
+/// If `for_write` is true, the page is marked dirty.
+uint8_t *SqlBufferPool::fetch_page(uint32_t file_id, uint64_t page,
+                                   bool for_write, SqlError &error) {
+  // hit
+  auto page_it = this->m_page_table.find(page_key(file_id, page));
+  if (page_it != this->m_page_table.end()) {
+    SqlBufferPoolFrame &frame = this->m_frames[page_it->second];
+    frame.referenced = true;
+    if (for_write)
+      this->set_dirty(page_it->second);
+    this->m_stats.hits++;
+    return frame.data.get();
+  }
+
+  // miss
+  this->m_stats.misses++;
+  auto file_it = this->m_files.find(file_id);
+  assert(file_it != this->m_files.end());
+
+  size_t frame_index = this->allocate_frame(error);
+  if (!error.is_ok())
+    return nullptr;
+  SqlBufferPoolFrame &frame = this->m_frames[frame_index];
+
+  file_it->second->read_page(page, frame.data.get(), error);
+  if (!error.is_ok())
+    return nullptr;
+
+  frame.file_id = file_id;
+  frame.page = page;
+  frame.referenced = true;
+  if (for_write)
+    this->set_dirty(frame_index);
+  this->m_page_table[page_key(file_id, page)] = frame_index;
+
+  return frame.data.get();
+}
+
+/// Write back every dirty page of a file.
+///
+/// Runs of consecutive dirty pages are written with one vectored write.
+void SqlBufferPool::flush_file(uint32_t file_id, SqlError &error) {
+  auto dirty_it = this->m_dirty_frames.find(file_id);
+  if (dirty_it == this->m_dirty_frames.end() || dirty_it->second.empty())
+    return;
+
+  // sort the dirty frames in page order. frames are cleaned as they are
+  // written, which changes the list, so sort a copy.
+  std::vector<SqlBufferPoolFrame *> dirty_frames;
+  for (size_t i = 0; i < dirty_it->second.size(); i++)
+    dirty_frames.push_back(&this->m_frames[dirty_it->second[i]]);
+  std::sort(dirty_frames.begin(), dirty_frames.end(),
+            [](const SqlBufferPoolFrame *a, const SqlBufferPoolFrame *b) {
+              return a->page < b->page;
+            });
+
+  auto file_it = this->m_files.find(file_id);
+  assert(file_it != this->m_files.end());
+
+  size_t run_start = 0;
+  std::vector<const uint8_t *> buffers;
+  while (run_start < dirty_frames.size()) {
+    // extend the run while pages are consecutive
+    size_t run_end = run_start + 1;
+    while (run_end < dirty_frames.size() &&
+           dirty_frames[run_end]->page == dirty_frames[run_end - 1]->page + 1)
+      run_end++;
+
+    buffers.clear();
+    for (size_t i = run_start; i < run_end; i++)
+      buffers.push_back(dirty_frames[i]->data.get());
+    file_it->second->write_pages(dirty_frames[run_start]->page,
+                                 buffers.data(), buffers.size(), error);
+    if (!error.is_ok())
+      return;
+
+    for (size_t i = run_start; i < run_end; i++)
+      this->clear_dirty(dirty_frames[i] - this->m_frames.data());
+    this->m_stats.write_backs += run_end - run_start;
+
+    run_start = run_end;
+  }
+}
+
+/// Drop every page of a file without writing it back.
+void SqlBufferPool::drop_file_pages(uint32_t file_id) {
+  this->m_dirty_frames.erase(file_id);
+
+  for (size_t i = 0; i < this->m_frames.size(); i++) {
+    SqlBufferPoolFrame &frame = this->m_frames[i];
+    if (frame.file_id == file_id) {
+      this->m_page_table.erase(page_key(frame.file_id, frame.page));
+      frame.file_id = 0;
+      frame.dirty = false;
+      frame.referenced = false;
+    }
+  }
+}
+
+/// Returns true if the file has dirty pages in the pool.
+bool SqlBufferPool::has_dirty_pages(uint32_t file_id) const {
+  auto dirty_it = this->m_dirty_frames.find(file_id);
+  return dirty_it != this->m_dirty_frames.end() && !dirty_it->second.empty();
+}
+
+/// Get the max # of pages in the pool
+size_t SqlBufferPool::capacity() const { return this->m_capacity; }
+
+/// Get the counters
+const SqlBufferPoolStats &SqlBufferPool::stats() const {
+  return this->m_stats;
+}
+
+/// Find a frame for a new page, evicting one if the pool is full.
+///
+/// Returns the frame index.
+size_t SqlBufferPool::allocate_frame(SqlError &error) {
+  // grow until the budget is used up
+  if (this->m_frames.size() < this->m_capacity) {
+    SqlBufferPoolFrame frame{0, 0, false, false, 0,
+                             std::unique_ptr<uint8_t[]>(
+                                 new uint8_t[STORAGE_PAGE_SIZE])};
+    this->m_frames.push_back(std::move(frame));
+    return this->m_frames.size() - 1;
+  }
+
+  // CLOCK: sweep, clearing reference bits, until an unreferenced frame is
+  // found. free frames are never referenced, so they are picked first time.
+  while (true) {
+    size_t frame_index = this->m_clock_hand;
+    this->m_clock_hand = (this->m_clock_hand + 1) % this->m_frames.size();
+
+    SqlBufferPoolFrame &frame = this->m_frames[frame_index];
+    if (frame.referenced) {
+      frame.referenced = false;
+      continue;
+    }
+
+    if (frame.file_id != 0) {
+      this->write_back(frame_index, error);
+      if (!error.is_ok())
+        return 0;
+      this->m_page_table.erase(page_key(frame.file_id, frame.page));
+      frame.file_id = 0;
+      this->m_stats.evictions++;
+    }
+
+    return frame_index;
+  }
+}
+
+/// Write back a frame if it is dirty.
+void SqlBufferPool::write_back(size_t frame_index, SqlError &error) {
+  SqlBufferPoolFrame &frame = this->m_frames[frame_index];
+  if (!frame.dirty)
+    return;
+
+  auto file_it = this->m_files.find(frame.file_id);
+  assert(file_it != this->m_files.end());
+  const uint8_t *data = frame.data.get();
+  file_it->second->write_pages(frame.page, &data, 1, error);
+  if (!error.is_ok())
+    return;
+
+  this->clear_dirty(frame_index);
+  this->m_stats.write_backs++;
+}
+
+/// Mark a frame dirty, listing it with the dirty frames of its file.
+void SqlBufferPool::set_dirty(size_t frame_index) {
+  SqlBufferPoolFrame &frame = this->m_frames[frame_index];
+  if (frame.dirty)
+    return;
+
+  std::vector<size_t> &dirty_frames = this->m_dirty_frames[frame.file_id];
+  frame.dirty = true;
+  frame.dirty_index = dirty_frames.size();
+  dirty_frames.push_back(frame_index);
+}
+
+/// Mark a frame clean, removing it from the dirty frames of its file.
+///
+/// The last dirty frame of the file takes its place in the list.
+void SqlBufferPool::clear_dirty(size_t frame_index) {
+  SqlBufferPoolFrame &frame = this->m_frames[frame_index];
+  if (!frame.dirty)
+    return;
+
+  std::vector<size_t> &dirty_frames = this->m_dirty_frames[frame.file_id];
+  size_t last_index = dirty_frames.back();
+  dirty_frames[frame.dirty_index] = last_index;
+  this->m_frames[last_index].dirty_index = frame.dirty_index;
+  dirty_frames.pop_back();
+  frame.dirty = false;
+}
+
+/// Make a map key for a page
+///
+/// Page numbers use the low 40 bits, file ids the high 24.
+uint64_t SqlBufferPool::page_key(uint32_t file_id, uint64_t page) {
+  assert(page < ((uint64_t)1 << 40));
+  return ((uint64_t)file_id << 40) | page;
+}
+} // namespace basic_sql
@@ -37,6 +37,12 @@ std::ostream &operator<<(std::ostream &os, const SqlErrorType &t) {
   case SqlErrorType::Io:
     os << "Io";
     break;
+  case SqlErrorType::InvalidFile:
+    os << "InvalidFile";
+    break;
+  case SqlErrorType::TypeMismatch:
+    os << "TypeMismatch";
+    break;
   default:
     std::cout << "Unknown SqlErrorType (" << (int)t
               << ") in `std::ostream "
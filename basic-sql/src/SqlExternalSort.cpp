@@ -0,0 +1,195 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlExternalSort.h"
+#include <algorithm>
+#include <cstring>
+
+namespace basic_sql {
+/// Make a sort of `record_size` byte records, holding at most about
+/// `memory_size` bytes of them in memory.
+///
+/// Run files are named `file_prefix` followed by the run #.
+SqlExternalSort::SqlExternalSort(std::string file_prefix, size_t record_size,
+                                 size_t memory_size)
+    : m_file_prefix(file_prefix), m_record_size(record_size),
+      m_max_records(
+          std::max(memory_size, SQL_EXTERNAL_SORT_MIN_MEMORY) / record_size),
+      m_block_size(0), m_next_record(0), m_current(record_size),
+      m_finished(false) {}
+
+/// Remove the run files, ignoring errors.
+SqlExternalSort::~SqlExternalSort() {
+  SqlError error;
+  this->remove_files(error);
+}
+
+/// Add a record.
+///
+/// Records cannot be added after `finish`.
+void SqlExternalSort::add(const uint8_t *record, SqlError &error) {
+  assert(!this->m_finished);
+  if (this->m_records.size() / this->m_record_size >= this->m_max_records) {
+    this->spill_run(error);
+    if (!error.is_ok())
+      return;
+  }
+
+  this->m_records.insert(this->m_records.end(), record,
+                         record + this->m_record_size);
+}
+
+/// Sort the records, so they can be read back with `next`.
+void SqlExternalSort::finish(SqlError &error) {
+  assert(!this->m_finished);
+  this->m_finished = true;
+
+  // everything fit in memory
+  if (this->m_runs.empty()) {
+    this->sort_records();
+    return;
+  }
+
+  if (!this->m_records.empty()) {
+    this->spill_run(error);
+    if (!error.is_ok())
+      return;
+  }
+  std::vector<uint8_t>().swap(this->m_records);
+
+  // split the memory between the runs, a block of records each
+  size_t block_records =
+      std::max<size_t>(1, this->m_max_records / this->m_runs.size());
+  this->m_block_size = block_records * this->m_record_size;
+  for (size_t i = 0; i < this->m_runs.size(); i++) {
+    this->read_block(this->m_runs[i], 0, error);
+    if (!error.is_ok())
+      return;
+    this->m_heap.push_back(i);
+  }
+
+  auto after = [this](size_t lhs, size_t rhs) {
+    return this->run_after(lhs, rhs);
+  };
+  std::make_heap(this->m_heap.begin(), this->m_heap.end(), after);
+}
+
+/// Get the next record in order, or nullptr once every record was read.
+///
+/// The record is only good until the next call.
+const uint8_t *SqlExternalSort::next(SqlError &error) {
+  assert(this->m_finished);
+  if (this->m_runs.empty()) {
+    size_t offset = this->m_next_record * this->m_record_size;
+    if (offset >= this->m_records.size())
+      return nullptr;
+    this->m_next_record += 1;
+    return this->m_records.data() + offset;
+  }
+
+  if (this->m_heap.empty())
+    return nullptr;
+
+  // take the least current record, then move its run along
+  auto after = [this](size_t lhs, size_t rhs) {
+    return this->run_after(lhs, rhs);
+  };
+  std::pop_heap(this->m_heap.begin(), this->m_heap.end(), after);
+  SqlSortRun &run = this->m_runs[this->m_heap.back()];
+  memcpy(this->m_current.data(), run.buffer.data() + run.offset,
+         this->m_record_size);
+
+  run.offset += this->m_record_size;
+  uint64_t position = run.position + run.offset;
+  if (position >= run.size) {
+    this->m_heap.pop_back();
+  } else {
+    if (run.offset >= run.buffer.size()) {
+      this->read_block(run, position, error);
+      if (!error.is_ok())
+        return nullptr;
+    }
+    std::push_heap(this->m_heap.begin(), this->m_heap.end(), after);
+  }
+
+  return this->m_current.data();
+}
+
+/// Get the # of runs written to files
+size_t SqlExternalSort::num_runs() const { return this->m_runs.size(); }
+
+/// Remove the run files.
+void SqlExternalSort::remove_files(SqlError &error) {
+  for (size_t i = 0; i < this->m_runs.size(); i++) {
+    this->m_runs[i].file.remove_file(error);
+    if (!error.is_ok())
+      return;
+  }
+  this->m_runs.clear();
+  this->m_heap.clear();
+}
+
+/// Sort the records in memory.
+void SqlExternalSort::sort_records() {
+  size_t record_size = this->m_record_size;
+  size_t num_records = this->m_records.size() / record_size;
+  const uint8_t *records = this->m_records.data();
+
+  // sort the offsets, then move the records once
+  std::vector<size_t> order(num_records);
+  for (size_t i = 0; i < num_records; i++)
+    order[i] = i * record_size;
+  std::sort(order.begin(), order.end(),
+            [records, record_size](size_t lhs, size_t rhs) {
+              return memcmp(records + lhs, records + rhs, record_size) < 0;
+            });
+
+  std::vector<uint8_t> sorted(this->m_records.size());
+  for (size_t i = 0; i < num_records; i++)
+    memcpy(sorted.data() + (i * record_size), records + order[i], record_size);
+  this->m_records.swap(sorted);
+}
+
+/// Sort the records in memory, then write them out as a new run.
+void SqlExternalSort::spill_run(SqlError &error) {
+  this->sort_records();
+
+  SqlSortRun run{
+      SqlFile(this->m_file_prefix + std::to_string(this->m_runs.size())),
+      this->m_records.size(),
+      0,
+      std::vector<uint8_t>(),
+      0,
+  };
+  run.file.open("w+b", error);
+  if (!error.is_ok())
+    return;
+  this->m_runs.push_back(std::move(run));
+
+  this->m_runs.back().file.write(this->m_records.data(),
+                                 this->m_records.size(), error);
+  if (!error.is_ok())
+    return;
+  this->m_records.clear();
+}
+
+/// Read the block of a run that holds `position`.
+void SqlExternalSort::read_block(SqlSortRun &run, uint64_t position,
+                                 SqlError &error) {
+  run.position = position;
+  run.offset = 0;
+  size_t len = std::min<uint64_t>(this->m_block_size, run.size - position);
+  run.buffer.resize(len);
+  run.file.read_at(position, run.buffer.data(), len, error);
+}
+
+/// Returns true if the current record of run `lhs` sorts after the current
+/// record of run `rhs`.
+bool SqlExternalSort::run_after(size_t lhs, size_t rhs) const {
+  const SqlSortRun &lhs_run = this->m_runs[lhs];
+  const SqlSortRun &rhs_run = this->m_runs[rhs];
+  return memcmp(lhs_run.buffer.data() + lhs_run.offset,
+                rhs_run.buffer.data() + rhs_run.offset,
+                this->m_record_size) > 0;
+}
+} // namespace basic_sql
@@ -1,21 +1,67 @@
 #include "SqlFile.h"
+#include "Limits.h"
+#include "SqlBufferPool.h"
+#include "Util.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace basic_sql {
-SqlFile::SqlFile(std::string name) : m_file(nullptr), m_name(name) {}
+SqlFile::SqlFile(std::string name, SqlBufferPool *buffer_pool)
+    : m_fd(-1), m_name(name), m_buffer_pool(buffer_pool),
+      m_buffer_pool_file_id(0), m_position(0), m_size(0), m_disk_size(0),
+      m_disk_mtime(0), m_map(nullptr), m_map_size(0), m_map_valid(false) {}
 SqlFile::SqlFile(SqlFile &&other) noexcept
-    : m_file(other.m_file), m_name(other.m_name) {
-  other.m_file = nullptr;
+    : m_fd(other.m_fd), m_name(other.m_name),
+      m_buffer_pool(other.m_buffer_pool),
+      m_buffer_pool_file_id(other.m_buffer_pool_file_id),
+      m_position(other.m_position), m_size(other.m_size),
+      m_disk_size(other.m_disk_size), m_disk_mtime(other.m_disk_mtime),
+      m_map(other.m_map), m_map_size(other.m_map_size),
+      m_map_valid(other.m_map_valid) {
+  other.m_fd = -1;
+  other.m_buffer_pool_file_id = 0;
+  other.m_map = nullptr;
+  other.m_map_size = 0;
+  other.m_map_valid = false;
+
+  // the pool writes back through the file, so point it here.
+  if (this->m_buffer_pool_file_id != 0)
+    this->m_buffer_pool->rebind_file(this->m_buffer_pool_file_id, this);
 }
 SqlFile &SqlFile::operator=(SqlFile &&other) {
   SqlError error;
   this->close(error);
 
   // Moved
-  this->m_file = other.m_file;
-  other.m_file = nullptr;
+  this->m_fd = other.m_fd;
+  other.m_fd = -1;
+  this->m_buffer_pool_file_id = other.m_buffer_pool_file_id;
+  other.m_buffer_pool_file_id = 0;
+  this->m_map = other.m_map;
+  this->m_map_size = other.m_map_size;
+  this->m_map_valid = other.m_map_valid;
+  other.m_map = nullptr;
+  other.m_map_size = 0;
+  other.m_map_valid = false;
 
   // Copied, not moved
   this->m_name = other.m_name;
+  this->m_buffer_pool = other.m_buffer_pool;
+  this->m_position = other.m_position;
+  this->m_size = other.m_size;
+  this->m_disk_size = other.m_disk_size;
+  this->m_disk_mtime = other.m_disk_mtime;
+
+  // the pool writes back through the file, so point it here.
+  if (this->m_buffer_pool_file_id != 0)
+    this->m_buffer_pool->rebind_file(this->m_buffer_pool_file_id, this);
 
   return *this;
 }
@@ -25,91 +71,518 @@ SqlFile::~SqlFile() {
   this->close(error);
 }
 /// Open the file.
+///
+/// The flags are fopen-style: "r", "r+", "w" or "w+", optionally with a "b".
 void SqlFile::open(const char *flags, SqlError &error) {
-  if (this->m_file != nullptr) {
+  if (this->m_fd != -1) {
     error.set_file_already_opened();
     return;
   }
 
-  FILE *file = fopen(this->m_name.c_str(), flags);
-  if (file == nullptr) {
+  // translate to open(2) flags
+  int open_flags = 0;
+  std::string mode(flags);
+  mode.erase(std::remove(mode.begin(), mode.end(), 'b'), mode.end());
+  if (mode == "r") {
+    open_flags = O_RDONLY;
+  } else if (mode == "r+") {
+    open_flags = O_RDWR;
+  } else if (mode == "w") {
+    open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+  } else if (mode == "w+") {
+    open_flags = O_RDWR | O_CREAT | O_TRUNC;
+  } else {
+    panic("unknown flags in `SqlFile::open`");
+  }
+
+  int fd = ::open(this->m_name.c_str(), open_flags | O_CLOEXEC, 0644);
+  if (fd == -1) {
     error.set_bad_file_open();
     return;
   }
 
-  this->m_file = file;
+  this->m_fd = fd;
+  this->m_position = 0;
+
+  this->record_disk_state(error);
+  if (!error.is_ok())
+    return;
+  this->m_size = this->m_disk_size;
+
+  if (this->m_buffer_pool != nullptr)
+    this->m_buffer_pool_file_id = this->m_buffer_pool->register_file(this);
 }
 /// Return `true` if this file is closed.
-bool SqlFile::is_closed() const { return this->m_file == nullptr; }
+bool SqlFile::is_closed() const { return this->m_fd == -1; }
 /// Close a file.
 void SqlFile::close(SqlError &error) {
   if (!this->is_closed()) {
-    int code = fclose(this->m_file);
-    this->m_file = nullptr;
+    this->unmap();
+
+    // write back cached pages before the handle goes away
+    if (this->m_buffer_pool_file_id != 0) {
+      this->m_buffer_pool->flush_file(this->m_buffer_pool_file_id, error);
+      this->m_buffer_pool->unregister_file(this->m_buffer_pool_file_id);
+      this->m_buffer_pool_file_id = 0;
+    }
 
-    // Returns 0 on success, EOF on failure.
+    int code = ::close(this->m_fd);
+    this->m_fd = -1;
+
+    // Returns 0 on success, -1 on failure.
     if (code != 0)
       error.set_bad_file_close();
   }
 }
 void SqlFile::write(const uint8_t *ptr, size_t len, SqlError &error) {
+  this->write_at(this->m_position, ptr, len, error);
+  if (!error.is_ok())
+    return;
+  this->m_position += len;
+}
+/// Read bytes from a file to a ptr
+void SqlFile::read(uint8_t *ptr, size_t len, SqlError &error) {
+  this->read_at(this->m_position, ptr, len, error);
+  if (!error.is_ok())
+    return;
+  this->m_position += len;
+}
+/// Write bytes at an offset, without moving the position.
+void SqlFile::write_at(uint64_t offset, const uint8_t *ptr, size_t len,
+                       SqlError &error) {
   // check if closed
   if (this->is_closed()) {
     error.set_file_closed();
     return;
   }
+  this->m_map_valid = false;
 
-  // write
-  size_t written = fwrite(ptr, 1, len, this->m_file);
-  if (written != len) {
-    error.set_io();
+  // write through the buffer pool, page by page
+  if (this->m_buffer_pool != nullptr) {
+    while (len != 0) {
+      uint64_t page = offset / STORAGE_PAGE_SIZE;
+      size_t page_offset = offset % STORAGE_PAGE_SIZE;
+      size_t chunk_len = STORAGE_PAGE_SIZE - page_offset;
+      if (chunk_len > len)
+        chunk_len = len;
+
+      uint8_t *data = this->m_buffer_pool->fetch_page(
+          this->m_buffer_pool_file_id, page, true, error);
+      if (!error.is_ok())
+        return;
+      memcpy(data + page_offset, ptr, chunk_len);
+
+      ptr += chunk_len;
+      len -= chunk_len;
+      offset += chunk_len;
+      if (offset > this->m_size)
+        this->m_size = offset;
+    }
     return;
   }
+
+  // write
+  while (len != 0) {
+    ssize_t written = pwrite(this->m_fd, ptr, len, (off_t)offset);
+    if (written == -1 && errno == EINTR)
+      continue;
+    if (written <= 0) {
+      error.set_io();
+      return;
+    }
+
+    ptr += written;
+    len -= written;
+    offset += written;
+  }
+  if (offset > this->m_size)
+    this->m_size = offset;
 }
-/// Read bytes from a file to a ptr
-void SqlFile::read(uint8_t *ptr, size_t len, SqlError &error) {
+/// Read bytes at an offset, without moving the position.
+///
+/// Like fread, reading past the end is an error.
+void SqlFile::read_at(uint64_t offset, uint8_t *ptr, size_t len,
+                      SqlError &error) {
   // check if closed
   if (this->is_closed()) {
     error.set_file_closed();
     return;
   }
 
+  // read through the buffer pool, page by page
+  if (this->m_buffer_pool != nullptr) {
+    if (offset + len > this->m_size) {
+      error.set_io();
+      return;
+    }
+
+    while (len != 0) {
+      uint64_t page = offset / STORAGE_PAGE_SIZE;
+      size_t page_offset = offset % STORAGE_PAGE_SIZE;
+      size_t chunk_len = STORAGE_PAGE_SIZE - page_offset;
+      if (chunk_len > len)
+        chunk_len = len;
+
+      const uint8_t *data = this->m_buffer_pool->fetch_page(
+          this->m_buffer_pool_file_id, page, false, error);
+      if (!error.is_ok())
+        return;
+      memcpy(ptr, data + page_offset, chunk_len);
+
+      ptr += chunk_len;
+      len -= chunk_len;
+      offset += chunk_len;
+    }
+    return;
+  }
+
   // read
-  size_t read = fread(ptr, 1, len, this->m_file);
+  size_t read = this->pread_full(offset, ptr, len, error);
+  if (!error.is_ok())
+    return;
   if (read != len) {
     error.set_io();
     return;
   }
 }
-/// Seek the file. Uses absolute positioning.
-void SqlFile::seek(long int offset, SqlError &error) {
+/// Read into several buffers starting at an offset, with as few syscalls as
+/// possible.
+///
+/// This bypasses the buffer pool. Bytes past the end of the file read as 0.
+void SqlFile::read_vectored(uint64_t offset, const struct iovec *iov,
+                            size_t iov_count, SqlError &error) {
+  if (this->is_closed()) {
+    error.set_file_closed();
+    return;
+  }
+
+  // copy, so short reads can be resumed
+  std::vector<struct iovec> remaining(iov, iov + iov_count);
+  size_t index = 0;
+  while (index < remaining.size()) {
+    size_t count = std::min(remaining.size() - index, (size_t)IOV_MAX);
+    ssize_t read =
+        preadv(this->m_fd, remaining.data() + index, count, (off_t)offset);
+    if (read == -1 && errno == EINTR)
+      continue;
+    if (read == -1) {
+      error.set_io();
+      return;
+    }
+
+    // zero what is past the end
+    if (read == 0) {
+      for (; index < remaining.size(); index++)
+        memset(remaining[index].iov_base, 0, remaining[index].iov_len);
+      return;
+    }
+
+    offset += read;
+    advance_iovecs(remaining, index, read);
+  }
+}
+/// Write several buffers starting at an offset, with as few syscalls as
+/// possible.
+///
+/// This bypasses the buffer pool.
+void SqlFile::write_vectored(uint64_t offset, const struct iovec *iov,
+                             size_t iov_count, SqlError &error) {
+  if (this->is_closed()) {
+    error.set_file_closed();
+    return;
+  }
+
+  // copy, so short writes can be resumed
+  std::vector<struct iovec> remaining(iov, iov + iov_count);
+  size_t index = 0;
+  while (index < remaining.size()) {
+    size_t count = std::min(remaining.size() - index, (size_t)IOV_MAX);
+    ssize_t written =
+        pwritev(this->m_fd, remaining.data() + index, count, (off_t)offset);
+    if (written == -1 && errno == EINTR)
+      continue;
+    if (written <= 0) {
+      error.set_io();
+      return;
+    }
+
+    offset += written;
+    advance_iovecs(remaining, index, written);
+  }
+}
+/// Seek the file. Uses absolute, 64-bit positioning.
+void SqlFile::seek(uint64_t offset, SqlError &error) {
   // check if closed
   if (this->is_closed()) {
     error.set_file_closed();
     return;
   }
 
-  // seek
-  int error_code = fseek(this->m_file, offset, SEEK_SET);
-  if (error_code != 0) {
+  // reads and writes are positional, so this only moves our own cursor.
+  this->m_position = offset;
+}
+/// Get the current postion
+void SqlFile::position(uint64_t &position, SqlError &error) {
+  if (this->is_closed()) {
+    error.set_file_closed();
+    return;
+  }
+
+  position = this->m_position;
+}
+/// Get the name of the file
+const std::string &SqlFile::name() const { return m_name; }
+/// Flush the file
+///
+/// This writes back dirty pages in the buffer pool.
+void SqlFile::flush(SqlError &error) {
+  if (this->is_closed()) {
+    error.set_file_closed();
+    return;
+  }
+
+  if (this->m_buffer_pool_file_id != 0) {
+    this->m_buffer_pool->flush_file(this->m_buffer_pool_file_id, error);
+    if (!error.is_ok())
+      return;
+
+    // our own writes are not a reason to drop the cache
+    this->record_disk_state(error);
+  }
+}
+/// Flush the file, then wait until its data is on disk.
+void SqlFile::sync(SqlError &error) {
+  this->flush(error);
+  if (!error.is_ok())
+    return;
+
+  int code = 0;
+  do {
+    code = fdatasync(this->m_fd);
+  } while (code == -1 && errno == EINTR);
+  if (code != 0)
+    error.set_io();
+}
+/// Take an exclusive lock on the whole file, shared with other processes.
+///
+/// This blocks until the lock is free. The logical size is read again from
+/// disk, since another process may have grown the file. This is meant for
+/// unbuffered files.
+void SqlFile::lock(SqlError &error) {
+  if (this->is_closed()) {
+    error.set_file_closed();
+    return;
+  }
+  assert(this->m_buffer_pool == nullptr);
+
+  int code = 0;
+  do {
+    code = flock(this->m_fd, LOCK_EX);
+  } while (code == -1 && errno == EINTR);
+  if (code != 0) {
     error.set_io();
     return;
   }
+
+  this->record_disk_state(error);
+  if (!error.is_ok())
+    return;
+  this->m_size = this->m_disk_size;
+  this->m_map_valid = false;
 }
-/// Get the current postion
-void SqlFile::position(size_t &position, SqlError &error) {
+/// Release the lock taken by `lock`.
+void SqlFile::unlock(SqlError &error) {
+  if (this->is_closed()) {
+    error.set_file_closed();
+    return;
+  }
+
+  if (flock(this->m_fd, LOCK_UN) != 0)
+    error.set_io();
+}
+/// Cut the file down to `size` bytes.
+///
+/// This is meant for unbuffered files.
+void SqlFile::truncate(uint64_t size, SqlError &error) {
   if (this->is_closed()) {
     error.set_file_closed();
     return;
   }
+  assert(this->m_buffer_pool == nullptr);
+  this->unmap();
 
-  long int cur_pos = ftell(this->m_file);
-  if (cur_pos == -1) {
+  if (ftruncate(this->m_fd, (off_t)size) != 0) {
     error.set_io();
     return;
   }
-  position = cur_pos;
+  this->m_size = size;
 }
-/// Get the name of the file
-const std::string &SqlFile::name() const { return m_name; }
-} // namespace basic_sql
\ No newline at end of file
+/// Get the logical size of the file
+uint64_t SqlFile::size() const { return this->m_size; }
+/// Drop cached pages if the file was changed on disk by someone else.
+///
+/// This does nothing if there is no buffer pool, or if there are unflushed
+/// writes. Returns true if the file changed.
+bool SqlFile::invalidate_if_modified(SqlError &error) {
+  if (this->m_buffer_pool_file_id == 0)
+    return false;
+  if (this->m_buffer_pool->has_dirty_pages(this->m_buffer_pool_file_id))
+    return false;
+
+  uint64_t old_disk_size = this->m_disk_size;
+  int64_t old_disk_mtime = this->m_disk_mtime;
+  this->record_disk_state(error);
+  if (!error.is_ok())
+    return false;
+
+  if (old_disk_size == this->m_disk_size &&
+      old_disk_mtime == this->m_disk_mtime)
+    return false;
+
+  this->m_buffer_pool->drop_file_pages(this->m_buffer_pool_file_id);
+  this->m_size = this->m_disk_size;
+  this->m_map_valid = false;
+  return true;
+}
+/// Map the whole file into memory for reading.
+///
+/// Pending writes are flushed first, so the mapping sees them.
+/// Returns nullptr if the file cannot be mapped; use `read` instead then.
+/// The mapping stays usable until the next write.
+const uint8_t *SqlFile::map(SqlError &error) {
+  if (this->is_closed()) {
+    error.set_file_closed();
+    return nullptr;
+  }
+  if (this->m_map_valid)
+    return this->m_map;
+
+  this->flush(error);
+  if (!error.is_ok())
+    return nullptr;
+
+  struct stat file_stat;
+  if (fstat(this->m_fd, &file_stat) != 0) {
+    error.set_io();
+    return nullptr;
+  }
+  uint64_t size = file_stat.st_size;
+
+  // a shared mapping sees writes to the file, so it only goes stale when the
+  // file changes size.
+  if (this->m_map == nullptr || this->m_map_size != size) {
+    this->unmap();
+
+    // mmap rejects empty mappings
+    if (size == 0)
+      return nullptr;
+
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, this->m_fd, 0);
+    if (data == MAP_FAILED)
+      return nullptr;
+
+    this->m_map = (uint8_t *)data;
+    this->m_map_size = size;
+  }
+
+  this->m_map_valid = true;
+  return this->m_map;
+}
+/// Get the mapped file, or nullptr if it is not mapped or was written to
+/// since it was mapped.
+const uint8_t *SqlFile::mapped_data() const {
+  return this->m_map_valid ? this->m_map : nullptr;
+}
+/// Get the # of mapped bytes
+uint64_t SqlFile::mapped_size() const { return this->m_map_size; }
+/// Read a whole page from the file, bypassing the buffer pool.
+///
+/// Bytes past the end of the file read as 0.
+void SqlFile::read_page(uint64_t page, uint8_t *buffer, SqlError &error) {
+  size_t read = this->pread_full(page * STORAGE_PAGE_SIZE, buffer,
+                                 STORAGE_PAGE_SIZE, error);
+  if (!error.is_ok())
+    return;
+  memset(buffer + read, 0, STORAGE_PAGE_SIZE - read);
+}
+/// Write a run of consecutive pages to the file, bypassing the buffer pool.
+///
+/// The run is written with one vectored write where possible.
+/// The file is not extended past its logical size.
+void SqlFile::write_pages(uint64_t first_page, const uint8_t *const *buffers,
+                          size_t count, SqlError &error) {
+  uint64_t start = first_page * STORAGE_PAGE_SIZE;
+  std::vector<struct iovec> iov;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t page_start = start + (i * STORAGE_PAGE_SIZE);
+    if (page_start >= this->m_size)
+      break;
+    size_t len = STORAGE_PAGE_SIZE;
+    if (this->m_size - page_start < len)
+      len = this->m_size - page_start;
+
+    iov.push_back(iovec{(void *)buffers[i], len});
+  }
+  if (iov.empty())
+    return;
+
+  this->write_vectored(start, iov.data(), iov.size(), error);
+}
+/// Read up to `len` bytes at an offset, stopping early only at the end of the
+/// file.
+///
+/// Returns the # of bytes read.
+size_t SqlFile::pread_full(uint64_t offset, uint8_t *ptr, size_t len,
+                           SqlError &error) {
+  size_t total = 0;
+  while (total < len) {
+    ssize_t read =
+        pread(this->m_fd, ptr + total, len - total, (off_t)(offset + total));
+    if (read == -1 && errno == EINTR)
+      continue;
+    if (read == -1) {
+      error.set_io();
+      return total;
+    }
+    if (read == 0)
+      break;
+
+    total += read;
+  }
+
+  return total;
+}
+/// Skip `len` transferred bytes of a list of iovecs, starting at `index`.
+void SqlFile::advance_iovecs(std::vector<struct iovec> &iov, size_t &index,
+                             size_t len) {
+  while (index < iov.size() && len >= iov[index].iov_len) {
+    len -= iov[index].iov_len;
+    index++;
+  }
+  if (index < iov.size()) {
+    iov[index].iov_base = (uint8_t *)iov[index].iov_base + len;
+    iov[index].iov_len -= len;
+  }
+}
+/// Remember the size and modification time of the file on disk.
+void SqlFile::record_disk_state(SqlError &error) {
+  struct stat file_stat;
+  if (fstat(this->m_fd, &file_stat) != 0) {
+    error.set_io();
+    return;
+  }
+
+  this->m_disk_size = file_stat.st_size;
+  this->m_disk_mtime = ((int64_t)file_stat.st_mtim.tv_sec * 1000000000) +
+                       file_stat.st_mtim.tv_nsec;
+}
+/// Drop the mapping, if any.
+void SqlFile::unmap() {
+  if (this->m_map != nullptr)
+    munmap(this->m_map, this->m_map_size);
+
+  this->m_map = nullptr;
+  this->m_map_size = 0;
+  this->m_map_valid = false;
+}
+} // namespace basic_sql
@@ -0,0 +1,304 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlFilterKernel.h"
+#include "Util.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SQL_FILTER_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace basic_sql {
+/// Read a packed value
+template <typename T> static T read_packed(const uint8_t *values, size_t i) {
+  T value;
+  memcpy(&value, values + (i * sizeof(T)), sizeof(T));
+  return value;
+}
+
+/// Compare a value to a target, with the value on the left
+template <tokenizer::SqlOperator OP, typename T>
+static bool compare(T value, T target) {
+  switch (OP) {
+  case tokenizer::SqlOperator::Equals:
+    return value == target;
+  case tokenizer::SqlOperator::GreaterThan:
+    return value > target;
+  case tokenizer::SqlOperator::NotEqual:
+  default:
+    return !(value == target);
+  }
+}
+
+/// Set the bits of values from `first` on, one value at a time.
+///
+/// `first` must start a bitmap word, or the bits before it in its word must
+/// already be set.
+template <tokenizer::SqlOperator OP, typename T>
+static void match_scalar(const uint8_t *values, size_t first,
+                         size_t num_values, T target, uint64_t *bitmap) {
+  // build each word in a register, since the values may alias the bitmap
+  uint64_t word = 0;
+  size_t i = first;
+  for (; i < num_values; i++) {
+    word |= (uint64_t)compare<OP>(read_packed<T>(values, i), target)
+            << (i % 64);
+    if (i % 64 == 63) {
+      bitmap[i / 64] |= word;
+      word = 0;
+    }
+  }
+  if (i % 64 != 0)
+    bitmap[i / 64] |= word;
+}
+
+#ifdef SQL_FILTER_KERNEL_X86
+/// Set the bits of packed INTs 4 at a time, returning the # done.
+template <tokenizer::SqlOperator OP>
+__attribute__((target("sse4.2"))) static size_t
+match_ints_sse42(const uint8_t *values, size_t num_values, uint32_t target,
+                 uint64_t *bitmap) {
+  // flipping the sign bit makes a signed compare an unsigned one
+  __m128i bias = _mm_set1_epi32((int)0x80000000);
+  __m128i target_vector = _mm_set1_epi32((int)target);
+  __m128i biased_target = _mm_xor_si128(target_vector, bias);
+
+  uint64_t word = 0;
+  size_t i = 0;
+  for (; i + 4 <= num_values; i += 4) {
+    __m128i value =
+        _mm_loadu_si128((const __m128i *)(values + (i * sizeof(uint32_t))));
+    __m128i match;
+    if (OP == tokenizer::SqlOperator::GreaterThan)
+      match = _mm_cmpgt_epi32(_mm_xor_si128(value, bias), biased_target);
+    else
+      match = _mm_cmpeq_epi32(value, target_vector);
+    uint64_t mask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(match));
+    if (OP == tokenizer::SqlOperator::NotEqual)
+      mask ^= 0xf;
+
+    word |= mask << (i % 64);
+    if ((i + 4) % 64 == 0) {
+      bitmap[i / 64] = word;
+      word = 0;
+    }
+  }
+  if (i % 64 != 0)
+    bitmap[i / 64] = word;
+  return i;
+}
+
+/// Set the bits of packed INTs 8 at a time, returning the # done.
+template <tokenizer::SqlOperator OP>
+__attribute__((target("avx2"))) static size_t
+match_ints_avx2(const uint8_t *values, size_t num_values, uint32_t target,
+                uint64_t *bitmap) {
+  // flipping the sign bit makes a signed compare an unsigned one
+  __m256i bias = _mm256_set1_epi32((int)0x80000000);
+  __m256i target_vector = _mm256_set1_epi32((int)target);
+  __m256i biased_target = _mm256_xor_si256(target_vector, bias);
+
+  uint64_t word = 0;
+  size_t i = 0;
+  for (; i + 8 <= num_values; i += 8) {
+    __m256i value = _mm256_loadu_si256(
+        (const __m256i *)(values + (i * sizeof(uint32_t))));
+    __m256i match;
+    if (OP == tokenizer::SqlOperator::GreaterThan)
+      match = _mm256_cmpgt_epi32(_mm256_xor_si256(value, bias), biased_target);
+    else
+      match = _mm256_cmpeq_epi32(value, target_vector);
+    uint64_t mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(match));
+    if (OP == tokenizer::SqlOperator::NotEqual)
+      mask ^= 0xff;
+
+    word |= mask << (i % 64);
+    if ((i + 8) % 64 == 0) {
+      bitmap[i / 64] = word;
+      word = 0;
+    }
+  }
+  if (i % 64 != 0)
+    bitmap[i / 64] = word;
+  return i;
+}
+
+/// Set the bits of packed FLOATs 4 at a time, returning the # done.
+template <tokenizer::SqlOperator OP>
+__attribute__((target("sse4.2"))) static size_t
+match_floats_sse42(const uint8_t *values, size_t num_values, float target,
+                   uint64_t *bitmap) {
+  __m128 target_vector = _mm_set1_ps(target);
+
+  uint64_t word = 0;
+  size_t i = 0;
+  for (; i + 4 <= num_values; i += 4) {
+    __m128 value = _mm_loadu_ps((const float *)(values + (i * sizeof(float))));
+    __m128 match;
+    if (OP == tokenizer::SqlOperator::Equals)
+      match = _mm_cmpeq_ps(value, target_vector);
+    else if (OP == tokenizer::SqlOperator::GreaterThan)
+      match = _mm_cmpgt_ps(value, target_vector);
+    else
+      match = _mm_cmpneq_ps(value, target_vector);
+    uint64_t mask = (uint32_t)_mm_movemask_ps(match);
+
+    word |= mask << (i % 64);
+    if ((i + 4) % 64 == 0) {
+      bitmap[i / 64] = word;
+      word = 0;
+    }
+  }
+  if (i % 64 != 0)
+    bitmap[i / 64] = word;
+  return i;
+}
+
+/// Set the bits of packed FLOATs 8 at a time, returning the # done.
+template <tokenizer::SqlOperator OP>
+__attribute__((target("avx2"))) static size_t
+match_floats_avx2(const uint8_t *values, size_t num_values, float target,
+                  uint64_t *bitmap) {
+  __m256 target_vector = _mm256_set1_ps(target);
+
+  uint64_t word = 0;
+  size_t i = 0;
+  for (; i + 8 <= num_values; i += 8) {
+    __m256 value =
+        _mm256_loadu_ps((const float *)(values + (i * sizeof(float))));
+    __m256 match;
+    if (OP == tokenizer::SqlOperator::Equals)
+      match = _mm256_cmp_ps(value, target_vector, _CMP_EQ_OQ);
+    else if (OP == tokenizer::SqlOperator::GreaterThan)
+      match = _mm256_cmp_ps(value, target_vector, _CMP_GT_OQ);
+    else
+      match = _mm256_cmp_ps(value, target_vector, _CMP_NEQ_UQ);
+    uint64_t mask = (uint32_t)_mm256_movemask_ps(match);
+
+    word |= mask << (i % 64);
+    if ((i + 8) % 64 == 0) {
+      bitmap[i / 64] = word;
+      word = 0;
+    }
+  }
+  if (i % 64 != 0)
+    bitmap[i / 64] = word;
+  return i;
+}
+#endif
+
+/// Set the bits of packed INTs with an operator known at compile time.
+template <tokenizer::SqlOperator OP>
+static void match_ints_op(SqlFilterKernel kernel, const uint8_t *values,
+                          size_t num_values, uint32_t target,
+                          uint64_t *bitmap) {
+  // the vector loops leave the tail to the scalar one
+  size_t done = 0;
+  switch (kernel) {
+  case SqlFilterKernel::Scalar:
+    break;
+#ifdef SQL_FILTER_KERNEL_X86
+  case SqlFilterKernel::Sse42:
+    done = match_ints_sse42<OP>(values, num_values, target, bitmap);
+    break;
+  case SqlFilterKernel::Avx2:
+    done = match_ints_avx2<OP>(values, num_values, target, bitmap);
+    break;
+#endif
+  default:
+    panic("unsupported `SqlFilterKernel` in `match_ints`");
+    break;
+  }
+  match_scalar<OP, uint32_t>(values, done, num_values, target, bitmap);
+}
+
+/// Set the bits of packed FLOATs with an operator known at compile time.
+template <tokenizer::SqlOperator OP>
+static void match_floats_op(SqlFilterKernel kernel, const uint8_t *values,
+                            size_t num_values, float target,
+                            uint64_t *bitmap) {
+  // the vector loops leave the tail to the scalar one
+  size_t done = 0;
+  switch (kernel) {
+  case SqlFilterKernel::Scalar:
+    break;
+#ifdef SQL_FILTER_KERNEL_X86
+  case SqlFilterKernel::Sse42:
+    done = match_floats_sse42<OP>(values, num_values, target, bitmap);
+    break;
+  case SqlFilterKernel::Avx2:
+    done = match_floats_avx2<OP>(values, num_values, target, bitmap);
+    break;
+#endif
+  default:
+    panic("unsupported `SqlFilterKernel` in `match_floats`");
+    break;
+  }
+  match_scalar<OP, float>(values, done, num_values, target, bitmap);
+}
+
+/// Get the fastest filter kernel the cpu supports.
+SqlFilterKernel best_filter_kernel() {
+#ifdef SQL_FILTER_KERNEL_X86
+  static const SqlFilterKernel kernel =
+      __builtin_cpu_supports("avx2")     ? SqlFilterKernel::Avx2
+      : __builtin_cpu_supports("sse4.2") ? SqlFilterKernel::Sse42
+                                         : SqlFilterKernel::Scalar;
+  return kernel;
+#else
+  return SqlFilterKernel::Scalar;
+#endif
+}
+
+/// Set bit i of `bitmap` if packed INT i compares to a target, and clear it
+/// otherwise.
+void match_ints(SqlFilterKernel kernel, const uint8_t *values,
+                size_t num_values, tokenizer::SqlOperator op, uint32_t target,
+                uint64_t *bitmap) {
+  memset(bitmap, 0, ((num_values + 63) / 64) * sizeof(uint64_t));
+  switch (op) {
+  case tokenizer::SqlOperator::Equals:
+    match_ints_op<tokenizer::SqlOperator::Equals>(kernel, values, num_values,
+                                                  target, bitmap);
+    break;
+  case tokenizer::SqlOperator::GreaterThan:
+    match_ints_op<tokenizer::SqlOperator::GreaterThan>(
+        kernel, values, num_values, target, bitmap);
+    break;
+  case tokenizer::SqlOperator::NotEqual:
+    match_ints_op<tokenizer::SqlOperator::NotEqual>(
+        kernel, values, num_values, target, bitmap);
+    break;
+  default:
+    panic("unknown op in `match_ints`");
+    break;
+  }
+}
+
+/// Set bit i of `bitmap` if packed FLOAT i compares to a target, and clear
+/// it otherwise.
+void match_floats(SqlFilterKernel kernel, const uint8_t *values,
+                  size_t num_values, tokenizer::SqlOperator op, float target,
+                  uint64_t *bitmap) {
+  memset(bitmap, 0, ((num_values + 63) / 64) * sizeof(uint64_t));
+  switch (op) {
+  case tokenizer::SqlOperator::Equals:
+    match_floats_op<tokenizer::SqlOperator::Equals>(
+        kernel, values, num_values, target, bitmap);
+    break;
+  case tokenizer::SqlOperator::GreaterThan:
+    match_floats_op<tokenizer::SqlOperator::GreaterThan>(
+        kernel, values, num_values, target, bitmap);
+    break;
+  case tokenizer::SqlOperator::NotEqual:
+    match_floats_op<tokenizer::SqlOperator::NotEqual>(
+        kernel, values, num_values, target, bitmap);
+    break;
+  default:
+    panic("unknown op in `match_floats`");
+    break;
+  }
+}
+} // namespace basic_sql
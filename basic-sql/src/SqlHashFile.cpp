@@ -0,0 +1,549 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlHashFile.h"
+#include "SerDe.h"
+#include <algorithm>
+
+namespace basic_sql {
+/// Get the # of entries in a page
+static uint16_t page_count(const uint8_t *page) {
+  uint16_t count = 0;
+  memcpy(&count, page, 2);
+  return count;
+}
+
+/// Set the # of entries in a page
+static void set_page_count(uint8_t *page, uint16_t count) {
+  memcpy(page, &count, 2);
+}
+
+/// Get the next page of a bucket
+static uint64_t page_next(const uint8_t *page) {
+  uint64_t next = 0;
+  memcpy(&next, page + 8, 8);
+  return next;
+}
+
+/// Set the next page of a bucket
+static void set_page_next(uint8_t *page, uint64_t next) {
+  memcpy(page + 8, &next, 8);
+}
+
+/// Make a new unopened file
+SqlHashFile::SqlHashFile(std::string name, SqlBufferPool *buffer_pool)
+    : m_file(name, buffer_pool), m_key_type{tokenizer::SqlType::INT, 1},
+      m_key_size(4), m_level(0), m_split(0), m_num_entries(0),
+      m_num_pages(0), m_free_page(0), m_groups{0} {}
+SqlHashFile::SqlHashFile(SqlHashFile &&other) noexcept
+    : m_file(std::move(other.m_file)), m_key_type(other.m_key_type),
+      m_key_size(other.m_key_size), m_level(other.m_level),
+      m_split(other.m_split), m_num_entries(other.m_num_entries),
+      m_num_pages(other.m_num_pages), m_free_page(other.m_free_page) {
+  memcpy(this->m_groups, other.m_groups, sizeof(this->m_groups));
+}
+SqlHashFile &SqlHashFile::operator=(SqlHashFile &&other) {
+  SqlError error;
+  this->close(error);
+  this->m_file = std::move(other.m_file);
+  this->m_key_type = other.m_key_type;
+  this->m_key_size = other.m_key_size;
+  this->m_level = other.m_level;
+  this->m_split = other.m_split;
+  this->m_num_entries = other.m_num_entries;
+  this->m_num_pages = other.m_num_pages;
+  this->m_free_page = other.m_free_page;
+  memcpy(this->m_groups, other.m_groups, sizeof(this->m_groups));
+  return *this;
+}
+
+/// Open the file.
+///
+/// A new file is an empty table of keys of the given type. An existing file
+/// keeps the type it was created with.
+void SqlHashFile::open(bool create, const parser::SqlType &key_type,
+                       SqlError &error) {
+  // flags setup
+  const char *flags = create ? "w+b" : "r+b";
+
+  this->m_file.open(flags, error);
+  if (!error.is_ok())
+    return;
+
+  if (!create) {
+    this->read_header(error);
+    return;
+  }
+
+  // the header page, then one empty bucket
+  this->m_key_type = key_type;
+  this->m_key_size = sql_type_width(key_type);
+  uint8_t page[STORAGE_PAGE_SIZE] = {0};
+  memcpy(page, SQL_HASH_FILE_MAGIC, SQL_HASH_FILE_MAGIC_SIZE);
+  page[SQL_HASH_FILE_KEY_TYPE_OFFSET] = (uint8_t)key_type.type;
+  page[SQL_HASH_FILE_KEY_TYPE_OFFSET + 1] = (uint8_t)key_type.size;
+  this->write_page(0, page, error);
+  if (!error.is_ok())
+    return;
+
+  this->m_level = 0;
+  this->m_split = 0;
+  this->m_num_entries = 0;
+  this->m_num_pages = 1;
+  this->m_free_page = 0;
+  memset(this->m_groups, 0, sizeof(this->m_groups));
+  this->m_groups[0] = this->take_page(error);
+  if (!error.is_ok())
+    return;
+
+  this->write_header(error);
+}
+
+/// Add keys to a new table.
+void SqlHashFile::bulk_load(const std::vector<uint8_t> &keys,
+                            const std::vector<uint64_t> &row_ids,
+                            SqlError &error) {
+  // the table is empty, so it can grow by whole levels without moving keys.
+  uint64_t capacity = this->page_capacity();
+  while (this->m_level + 2 < SQL_HASH_FILE_MAX_GROUPS &&
+         (capacity << this->m_level) * SQL_HASH_FILE_SPLIT_LOAD / 4 <
+             row_ids.size()) {
+    uint64_t group_size = (uint64_t)1 << this->m_level;
+    uint64_t group_page = this->m_num_pages;
+    for (uint64_t i = 0; i < group_size; i++) {
+      this->take_page(error);
+      if (!error.is_ok())
+        return;
+    }
+    this->m_groups[this->m_level + 1] = group_page;
+    this->m_level++;
+  }
+  this->write_header(error);
+  if (!error.is_ok())
+    return;
+
+  for (size_t i = 0; i < row_ids.size(); i++) {
+    this->insert(keys.data() + (i * this->m_key_size), row_ids[i], error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Add a key. Adding a key that is already there does nothing.
+void SqlHashFile::insert(const uint8_t *key, uint64_t row_id,
+                         SqlError &error) {
+  size_t entry_size = this->entry_size();
+  size_t capacity = this->page_capacity();
+
+  // look through the bucket for the key, and for room
+  uint64_t page = this->bucket_page(this->bucket_of(this->hash(key)));
+  uint64_t free_page = 0;
+  uint8_t data[STORAGE_PAGE_SIZE];
+  while (true) {
+    this->read_page(page, data, error);
+    if (!error.is_ok())
+      return;
+
+    uint16_t count = page_count(data);
+    for (size_t i = 0; i < count; i++) {
+      const uint8_t *entry =
+          data + SQL_HASH_FILE_PAGE_HEADER_SIZE + (i * entry_size);
+      if (read_u64(entry + this->m_key_size) == row_id &&
+          this->values_equal(entry, key))
+        return;
+    }
+    if (free_page == 0 && count < capacity)
+      free_page = page;
+
+    if (page_next(data) == 0)
+      break;
+    page = page_next(data);
+  }
+
+  // chain a page to the bucket if it is full
+  if (free_page == 0) {
+    free_page = this->take_page(error);
+    if (!error.is_ok())
+      return;
+    set_page_next(data, free_page);
+    this->write_page(page, data, error);
+    if (!error.is_ok())
+      return;
+  }
+
+  this->read_page(free_page, data, error);
+  if (!error.is_ok())
+    return;
+  uint16_t count = page_count(data);
+  uint8_t *entry = data + SQL_HASH_FILE_PAGE_HEADER_SIZE + (count * entry_size);
+  memcpy(entry, key, this->m_key_size);
+  memcpy(entry + this->m_key_size, &row_id, 8);
+  set_page_count(data, count + 1);
+  this->write_page(free_page, data, error);
+  if (!error.is_ok())
+    return;
+
+  this->m_num_entries++;
+  uint64_t num_buckets = ((uint64_t)1 << this->m_level) + this->m_split;
+  if (this->m_num_entries * 4 >
+          num_buckets * capacity * SQL_HASH_FILE_SPLIT_LOAD &&
+      this->m_level + 2 < SQL_HASH_FILE_MAX_GROUPS) {
+    this->split_bucket(error);
+    if (!error.is_ok())
+      return;
+  }
+
+  this->write_header(error);
+}
+
+/// Remove a key. Removing a key that is not there does nothing.
+void SqlHashFile::remove(const uint8_t *key, uint64_t row_id,
+                         SqlError &error) {
+  size_t entry_size = this->entry_size();
+  uint64_t page = this->bucket_page(this->bucket_of(this->hash(key)));
+  uint8_t data[STORAGE_PAGE_SIZE];
+  while (page != 0) {
+    this->read_page(page, data, error);
+    if (!error.is_ok())
+      return;
+
+    uint16_t count = page_count(data);
+    uint8_t *entries = data + SQL_HASH_FILE_PAGE_HEADER_SIZE;
+    for (size_t i = 0; i < count; i++) {
+      uint8_t *entry = entries + (i * entry_size);
+      if (read_u64(entry + this->m_key_size) != row_id ||
+          !this->values_equal(entry, key))
+        continue;
+
+      // order does not matter, so the last entry fills the gap
+      memmove(entry, entries + ((count - 1) * entry_size), entry_size);
+      set_page_count(data, count - 1);
+      this->write_page(page, data, error);
+      if (!error.is_ok())
+        return;
+
+      this->m_num_entries--;
+      this->write_header(error);
+      return;
+    }
+
+    page = page_next(data);
+  }
+}
+
+/// Find the rows whose value equals an encoded value.
+void SqlHashFile::find(const uint8_t *key, std::vector<uint64_t> &row_ids,
+                       SqlError &error) {
+  size_t entry_size = this->entry_size();
+  uint64_t page = this->bucket_page(this->bucket_of(this->hash(key)));
+  uint8_t data[STORAGE_PAGE_SIZE];
+  while (page != 0) {
+    this->read_page(page, data, error);
+    if (!error.is_ok())
+      return;
+
+    uint16_t count = page_count(data);
+    for (size_t i = 0; i < count; i++) {
+      const uint8_t *entry =
+          data + SQL_HASH_FILE_PAGE_HEADER_SIZE + (i * entry_size);
+      if (this->values_equal(entry, key))
+        row_ids.push_back(read_u64(entry + this->m_key_size));
+    }
+
+    page = page_next(data);
+  }
+}
+
+/// Get the type of the keys
+const parser::SqlType &SqlHashFile::key_type() const {
+  return this->m_key_type;
+}
+
+/// Returns true if this is closed
+bool SqlHashFile::is_closed() const { return this->m_file.is_closed(); }
+
+/// Close this file
+void SqlHashFile::close(SqlError &error) { this->m_file.close(error); }
+
+/// Write back buffered pages to the file
+void SqlHashFile::flush(SqlError &error) { this->m_file.flush(error); }
+
+/// Write back buffered pages, then wait until the file is on disk.
+void SqlHashFile::sync(SqlError &error) { this->m_file.sync(error); }
+
+/// Drop cached pages if another process changed the file, then read the
+/// header again.
+void SqlHashFile::invalidate_if_modified(SqlError &error) {
+  this->m_file.invalidate_if_modified(error);
+  if (!error.is_ok())
+    return;
+
+  this->read_header(error);
+}
+
+/// remove the file and close this file.
+void SqlHashFile::remove_file(SqlError &error) {
+  this->m_file.remove_file(error);
+}
+
+/// Get the file name
+const std::string &SqlHashFile::file_name() const {
+  return this->m_file.name();
+}
+
+/// Hash an encoded value
+///
+/// Only the bytes that make up the value are hashed, and 0 and -0 hash
+/// alike, so values that compare equal hash equal.
+uint64_t SqlHashFile::hash(const uint8_t *key) const {
+  return hash_sql_value(this->m_key_type, key);
+}
+
+/// Returns true if two encoded values are equal
+bool SqlHashFile::values_equal(const uint8_t *lhs, const uint8_t *rhs) const {
+  switch (this->m_key_type.type) {
+  case tokenizer::SqlType::INT:
+    return memcmp(lhs, rhs, 4) == 0;
+  case tokenizer::SqlType::FLOAT: {
+    float lhs_value = 0;
+    float rhs_value = 0;
+    memcpy(&lhs_value, lhs, 4);
+    memcpy(&rhs_value, rhs, 4);
+    return lhs_value == rhs_value;
+  }
+  case tokenizer::SqlType::CHAR:
+  case tokenizer::SqlType::VARCHAR:
+    return lhs[0] == rhs[0] && memcmp(lhs + 1, rhs + 1, lhs[0]) == 0;
+  default:
+    panic("unknown `tokenizer::SqlType` in `SqlHashFile::values_equal`");
+    return false;
+  }
+}
+
+/// Get the bucket of a hash
+///
+/// buckets below the split pointer were split, so they use one more bit.
+uint64_t SqlHashFile::bucket_of(uint64_t hash) const {
+  uint64_t bucket = hash & ((((uint64_t)1) << this->m_level) - 1);
+  if (bucket < this->m_split)
+    bucket = hash & ((((uint64_t)1) << (this->m_level + 1)) - 1);
+  return bucket;
+}
+
+/// Get the first page of a bucket
+uint64_t SqlHashFile::bucket_page(uint64_t bucket) const {
+  if (bucket == 0)
+    return this->m_groups[0];
+
+  // group g holds buckets [2^(g-1), 2^g)
+  size_t group = 64 - __builtin_clzll(bucket);
+  uint64_t group_first = ((uint64_t)1) << (group - 1);
+  return this->m_groups[group] + (bucket - group_first);
+}
+
+/// Get the # of entries that fit in a page
+size_t SqlHashFile::page_capacity() const {
+  return (STORAGE_PAGE_SIZE - SQL_HASH_FILE_PAGE_HEADER_SIZE) /
+         this->entry_size();
+}
+
+/// Get the size of an entry
+///
+/// a key and a u64 row id.
+size_t SqlHashFile::entry_size() const { return this->m_key_size + 8; }
+
+/// Split the next bucket, moving about half of its keys to a new bucket.
+void SqlHashFile::split_bucket(SqlError &error) {
+  uint64_t group_size = ((uint64_t)1) << this->m_level;
+
+  // the first split of a level makes room for every bucket of the next one
+  if (this->m_split == 0) {
+    uint64_t group_page = this->m_num_pages;
+    for (uint64_t i = 0; i < group_size; i++) {
+      // take_page reuses free pages, but the group must be contiguous.
+      uint8_t data[STORAGE_PAGE_SIZE] = {0};
+      this->write_page(this->m_num_pages, data, error);
+      if (!error.is_ok())
+        return;
+      this->m_num_pages++;
+    }
+    this->m_groups[this->m_level + 1] = group_page;
+  }
+
+  // read every key of the bucket
+  uint64_t bucket = this->m_split;
+  uint64_t new_bucket = bucket + group_size;
+  size_t entry_size = this->entry_size();
+  std::vector<uint8_t> stay_entries;
+  std::vector<uint8_t> move_entries;
+  uint64_t page = this->bucket_page(bucket);
+  uint8_t data[STORAGE_PAGE_SIZE];
+  while (page != 0) {
+    this->read_page(page, data, error);
+    if (!error.is_ok())
+      return;
+
+    uint16_t count = page_count(data);
+    for (size_t i = 0; i < count; i++) {
+      const uint8_t *entry =
+          data + SQL_HASH_FILE_PAGE_HEADER_SIZE + (i * entry_size);
+      uint64_t hash = this->hash(entry);
+      std::vector<uint8_t> &entries =
+          (hash & ((group_size << 1) - 1)) == bucket ? stay_entries
+                                                     : move_entries;
+      entries.insert(entries.end(), entry, entry + entry_size);
+    }
+
+    page = page_next(data);
+  }
+
+  this->write_bucket(this->bucket_page(bucket), stay_entries, error);
+  if (!error.is_ok())
+    return;
+  this->write_bucket(this->bucket_page(new_bucket), move_entries, error);
+  if (!error.is_ok())
+    return;
+
+  this->m_split++;
+  if (this->m_split == group_size) {
+    this->m_level++;
+    this->m_split = 0;
+  }
+}
+
+/// Replace the keys of a bucket.
+///
+/// The pages of its chain are reused, extra pages are freed.
+void SqlHashFile::write_bucket(uint64_t first_page,
+                               const std::vector<uint8_t> &entries,
+                               SqlError &error) {
+  size_t entry_size = this->entry_size();
+  size_t capacity = this->page_capacity();
+  size_t num_entries = entries.size() / entry_size;
+
+  uint64_t page = first_page;
+  size_t written = 0;
+  uint8_t data[STORAGE_PAGE_SIZE];
+  while (true) {
+    this->read_page(page, data, error);
+    if (!error.is_ok())
+      return;
+    uint64_t next = page_next(data);
+
+    size_t count = std::min(capacity, num_entries - written);
+    set_page_count(data, count);
+    memcpy(data + SQL_HASH_FILE_PAGE_HEADER_SIZE,
+           entries.data() + (written * entry_size), count * entry_size);
+    written += count;
+
+    if (written == num_entries) {
+      set_page_next(data, 0);
+      this->write_page(page, data, error);
+      if (!error.is_ok())
+        return;
+
+      // free the rest of the chain
+      while (next != 0) {
+        this->read_page(next, data, error);
+        if (!error.is_ok())
+          return;
+        uint64_t after = page_next(data);
+        set_page_count(data, 0);
+        set_page_next(data, this->m_free_page);
+        this->write_page(next, data, error);
+        if (!error.is_ok())
+          return;
+        this->m_free_page = next;
+        next = after;
+      }
+      return;
+    }
+
+    if (next == 0) {
+      next = this->take_page(error);
+      if (!error.is_ok())
+        return;
+    }
+    set_page_next(data, next);
+    this->write_page(page, data, error);
+    if (!error.is_ok())
+      return;
+    page = next;
+  }
+}
+
+/// Get a zeroed page, reusing a free page before growing the file.
+uint64_t SqlHashFile::take_page(SqlError &error) {
+  uint8_t data[STORAGE_PAGE_SIZE] = {0};
+  uint64_t page = this->m_free_page;
+  if (page != 0) {
+    this->read_page(page, data, error);
+    if (!error.is_ok())
+      return 0;
+    this->m_free_page = page_next(data);
+    memset(data, 0, STORAGE_PAGE_SIZE);
+  } else {
+    page = this->m_num_pages;
+    this->m_num_pages++;
+  }
+
+  this->write_page(page, data, error);
+  if (!error.is_ok())
+    return 0;
+
+  return page;
+}
+
+/// Read a page.
+void SqlHashFile::read_page(uint64_t page, uint8_t *data, SqlError &error) {
+  this->m_file.read_at(page * STORAGE_PAGE_SIZE, data, STORAGE_PAGE_SIZE,
+                       error);
+}
+
+/// Write a page.
+void SqlHashFile::write_page(uint64_t page, const uint8_t *data,
+                             SqlError &error) {
+  this->m_file.write_at(page * STORAGE_PAGE_SIZE, data, STORAGE_PAGE_SIZE,
+                        error);
+}
+
+/// Write the header fields
+void SqlHashFile::write_header(SqlError &error) {
+  uint8_t fields[SQL_HASH_FILE_HEADER_SIZE - SQL_HASH_FILE_LEVEL_OFFSET];
+  uint8_t *field = fields;
+  memcpy(field, &this->m_level, 8);
+  memcpy(field + 8, &this->m_split, 8);
+  memcpy(field + 16, &this->m_num_entries, 8);
+  memcpy(field + 24, &this->m_num_pages, 8);
+  memcpy(field + 32, &this->m_free_page, 8);
+  memcpy(field + 40, this->m_groups, sizeof(this->m_groups));
+  this->m_file.write_at(SQL_HASH_FILE_LEVEL_OFFSET, fields, sizeof(fields),
+                        error);
+}
+
+/// Read the header fields
+void SqlHashFile::read_header(SqlError &error) {
+  uint8_t header[SQL_HASH_FILE_HEADER_SIZE];
+  this->m_file.read_at(0, header, SQL_HASH_FILE_HEADER_SIZE, error);
+  if (!error.is_ok())
+    return;
+
+  if (memcmp(header, SQL_HASH_FILE_MAGIC, SQL_HASH_FILE_MAGIC_SIZE) != 0 ||
+      header[SQL_HASH_FILE_KEY_TYPE_OFFSET] >
+          (uint8_t)tokenizer::SqlType::CHAR) {
+    error.set_invalid_file();
+    return;
+  }
+  this->m_key_type.type =
+      (tokenizer::SqlType)header[SQL_HASH_FILE_KEY_TYPE_OFFSET];
+  this->m_key_type.size = header[SQL_HASH_FILE_KEY_TYPE_OFFSET + 1];
+  this->m_key_size = sql_type_width(this->m_key_type);
+  this->m_level = read_u64(header + SQL_HASH_FILE_LEVEL_OFFSET);
+  this->m_split = read_u64(header + SQL_HASH_FILE_SPLIT_OFFSET);
+  this->m_num_entries = read_u64(header + SQL_HASH_FILE_NUM_ENTRIES_OFFSET);
+  this->m_num_pages = read_u64(header + SQL_HASH_FILE_NUM_PAGES_OFFSET);
+  this->m_free_page = read_u64(header + SQL_HASH_FILE_FREE_PAGE_OFFSET);
+  memcpy(this->m_groups, header + SQL_HASH_FILE_GROUPS_OFFSET,
+         sizeof(this->m_groups));
+}
+} // namespace basic_sql
@@ -5,158 +5,343 @@
 
 namespace basic_sql {
 /// Make a new sql file.
-SqlIndexFile::SqlIndexFile(std::string name) : m_file(name), num_tables(0) {}
+SqlIndexFile::SqlIndexFile(std::string name, SqlBufferPool *buffer_pool)
+    : m_file(name, buffer_pool), m_num_slots(0) {}
 SqlIndexFile::SqlIndexFile(SqlIndexFile &&other) noexcept
-    : m_file(std::move(other.m_file)), num_tables(other.num_tables) {}
+    : m_file(std::move(other.m_file)), m_num_slots(other.m_num_slots),
+      m_tables(std::move(other.m_tables)),
+      m_indexes(std::move(other.m_indexes)),
+      m_free_slots(std::move(other.m_free_slots)) {}
 SqlIndexFile &SqlIndexFile::operator=(SqlIndexFile &&other) {
   SqlError error;
   this->close(error);
   this->m_file = std::move(other.m_file);
-  this->num_tables = other.num_tables;
+  this->m_num_slots = other.m_num_slots;
+  this->m_tables = std::move(other.m_tables);
+  this->m_indexes = std::move(other.m_indexes);
+  this->m_free_slots = std::move(other.m_free_slots);
   return *this;
 }
 
-/// Open the index file
+/// Read a name field of a slot.
+///
+/// Returns false if the length is out of range.
+static bool read_slot_name(const uint8_t *field, std::string &name) {
+  uint8_t len = field[0];
+  if (len > TABLE_NAME_MAX_LENGTH)
+    return false;
+  name.assign((const char *)field + 1, len);
+  return true;
+}
+
+/// Open the index file, loading every entry.
 void SqlIndexFile::open(bool create, SqlError &error) {
   // flags setup
   const char *flags = create ? "w+b" : "r+b";
 
   // open file
   this->m_file.open(flags, error);
+  if (!error.is_ok())
+    return;
+
+  this->m_num_slots = 0;
+  this->m_tables.clear();
+  this->m_indexes.clear();
+  this->m_free_slots.clear();
 
+  uint8_t header[SQL_INDEX_FILE_HEADER_SIZE] = {0};
   if (create) {
-    // if creating, setup magic and num_tables
+    // if creating, setup magic and num_slots
+    memcpy(header, SQL_INDEX_FILE_MAGIC, SQL_INDEX_FILE_MAGIC_SIZE);
+    this->m_file.write_at(0, header, SQL_INDEX_FILE_HEADER_SIZE, error);
+    return;
+  }
 
-    // write magic
-    this->m_file.write((const uint8_t *)SQL_INDEX_FILE_MAGIC,
-                       SQL_INDEX_FILE_MAGIC_SIZE, error);
-    if (!error.is_ok())
+  // otherwise, validate magic and load entries
+  this->m_file.read_at(0, header, SQL_INDEX_FILE_MAGIC_SIZE, error);
+  if (!error.is_ok())
+    return;
+
+  // indexes in the old format are rewritten in this one
+  if (memcmp(header, SQL_INDEX_FILE_OLD_MAGIC, SQL_INDEX_FILE_MAGIC_SIZE) ==
+      0) {
+    this->convert_old_format(error);
+    return;
+  }
+
+  if (memcmp(header, SQL_INDEX_FILE_MAGIC, SQL_INDEX_FILE_MAGIC_SIZE) != 0) {
+    error.set_invalid_file();
+    return;
+  }
+  this->m_file.read_at(SQL_INDEX_FILE_NUM_SLOTS_OFFSET,
+                       (uint8_t *)&this->m_num_slots, 4, error);
+  if (!error.is_ok())
+    return;
+
+  // read every slot at once
+  std::vector<uint8_t> slots(this->m_num_slots * SQL_INDEX_FILE_SLOT_SIZE);
+  this->m_file.read_at(SQL_INDEX_FILE_HEADER_SIZE, slots.data(), slots.size(),
+                       error);
+  if (!error.is_ok())
+    return;
+
+  for (uint32_t i = 0; i < this->m_num_slots; i++) {
+    const uint8_t *slot = slots.data() + i * SQL_INDEX_FILE_SLOT_SIZE;
+    SqlIndexSlotKind kind = (SqlIndexSlotKind)slot[0];
+
+    std::string name;
+    std::string table_name;
+    std::string column_name;
+    if (!read_slot_name(slot + 1, name) ||
+        !read_slot_name(slot + 1 + SQL_INDEX_FILE_NAME_SIZE, table_name) ||
+        !read_slot_name(slot + 1 + 2 * SQL_INDEX_FILE_NAME_SIZE,
+                        column_name)) {
+      error.set_invalid_file();
       return;
+    }
 
-    // write num_tables
-    this->m_file.write((const uint8_t *)&this->num_tables, 1, error);
-    if (!error.is_ok())
+    switch (kind) {
+    case SqlIndexSlotKind::FREE:
+      this->m_free_slots.push_back(i);
+      break;
+    case SqlIndexSlotKind::TABLE:
+      this->m_tables.insert({name, i});
+      break;
+    case SqlIndexSlotKind::BTREE_INDEX:
+    case SqlIndexSlotKind::HASH_INDEX:
+      this->m_indexes.insert(
+          {name, SqlIndexEntry{kind, table_name,
+                               SmallString<COLUMN_NAME_MAX_LENGTH>(
+                                   column_name.c_str(), column_name.size()),
+                               i}});
+      break;
+    default:
+      error.set_invalid_file();
       return;
-  } else {
-    // otherwise, validate magic and load tables
+    }
+  }
+}
 
-    // prep buffer for magic
-    char buffer[SQL_INDEX_FILE_MAGIC_SIZE] = {0};
+/// Rewrite an index in the format before slots in this format, then open it.
+///
+/// The names are written to a new file first, which then replaces the old
+/// one, so a crash leaves either index whole.
+void SqlIndexFile::convert_old_format(SqlError &error) {
+  uint8_t old_num_tables = 0;
+  this->m_file.read_at(SQL_INDEX_FILE_MAGIC_SIZE, &old_num_tables, 1, error);
+  if (!error.is_ok())
+    return;
 
-    // read magic
-    this->m_file.read((uint8_t *)buffer, SQL_INDEX_FILE_MAGIC_SIZE, error);
-    if (!error.is_ok())
-      return;
+  std::vector<uint8_t> old_slots(old_num_tables *
+                                 SQL_INDEX_FILE_OLD_SLOT_SIZE);
+  this->m_file.read_at(SQL_INDEX_FILE_MAGIC_SIZE + 1, old_slots.data(),
+                       old_slots.size(), error);
+  if (!error.is_ok())
+    return;
 
-    // validate magic
-    for (size_t i = 0; i < SQL_INDEX_FILE_MAGIC_SIZE; i++) {
-      if (SQL_INDEX_FILE_MAGIC[i] != buffer[i]) {
-        error.set_invalid_file();
-        return;
-      }
+  std::string converted_name = this->file_name() + ".convert";
+  SqlIndexFile converted(converted_name);
+  converted.open(true, error);
+  if (!error.is_ok())
+    return;
+  for (uint8_t i = 0; i < old_num_tables; i++) {
+    const uint8_t *slot = old_slots.data() + i * SQL_INDEX_FILE_OLD_SLOT_SIZE;
+    if (slot[0] > TABLE_NAME_MAX_LENGTH) {
+      error.set_invalid_file();
+      return;
     }
+    SmallString<TABLE_NAME_MAX_LENGTH> table_name((const char *)slot + 1,
+                                                  slot[0]);
 
-    // read num_tables
-    this->m_file.read(&this->num_tables, 1, error);
+    // a name in there twice is only kept once
+    if (converted.index_of_table_name(table_name) != -1)
+      continue;
+    converted.add_table_name(table_name, error);
     if (!error.is_ok())
       return;
   }
-}
+  converted.close(error);
+  if (!error.is_ok())
+    return;
 
-/// Seek to a table name index
-void SqlIndexFile::seek_to_table_name_index(size_t index, SqlError &error) {
-  // 1 is the size of the # of tables field
-  size_t header_size = SQL_INDEX_FILE_MAGIC_SIZE + 1;
-  // 1 is the size of the length field.
-  size_t body_offset = (1 + TABLE_NAME_MAX_LENGTH) * index;
-  this->m_file.seek(header_size + body_offset, error);
+  // replace the old file
+  this->m_file.close(error);
+  if (!error.is_ok())
+    return;
+  if (rename(converted_name.c_str(), this->file_name().c_str()) != 0) {
+    error.set_io();
+    return;
+  }
+  this->open(false, error);
 }
 
 /// Get the # of tables in the index.
-uint8_t SqlIndexFile::get_num_tables() { return this->num_tables; }
+uint32_t SqlIndexFile::get_num_tables() const { return this->m_tables.size(); }
 
 /// Get the index of a table name.
 ///
 /// Returns the index, or -1 if not found.
-/// If an error occured, the result is also -1.
-int SqlIndexFile::index_of_table_name(
-    const SmallString<TABLE_NAME_MAX_LENGTH> &table_name, SqlError &error) {
-  SmallString<TABLE_NAME_MAX_LENGTH> temp_name;
-  for (size_t i = 0; i < this->num_tables; i++) {
-    this->get_table_name(i, temp_name, error);
-    if (!error.is_ok())
-      return -1;
-    if (table_name == temp_name)
-      return i;
-  }
+int64_t SqlIndexFile::index_of_table_name(
+    const SmallString<TABLE_NAME_MAX_LENGTH> &table_name) const {
+  auto table_it = this->m_tables.find(
+      std::string(table_name.get_ptr(), table_name.size()));
+  if (table_it == this->m_tables.end())
+    return -1;
 
-  return -1;
+  return table_it->second;
 }
 
-/// Get the table name at the index.
-void SqlIndexFile::get_table_name(
-    size_t index, SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
-    SqlError &error) {
-  // seek to position
-  this->seek_to_table_name_index(index, error);
-  if (!error.is_ok())
-    return;
+/// Get the names of every table, keyed to their index.
+const std::unordered_map<std::string, uint32_t> &
+SqlIndexFile::get_table_names() const {
+  return this->m_tables;
+}
 
-  // read small string
-  read_small_string_from_file(table_name, this->m_file, error);
+/// Add a table name to the index.
+///
+/// The name must not be in the index yet.
+void SqlIndexFile::add_table_name(
+    const SmallString<TABLE_NAME_MAX_LENGTH> &table_name, SqlError &error) {
+  assert(this->index_of_table_name(table_name) == -1);
+
+  uint32_t slot = this->write_slot(
+      SqlIndexSlotKind::TABLE, table_name, SmallString<TABLE_NAME_MAX_LENGTH>(),
+      SmallString<COLUMN_NAME_MAX_LENGTH>(), error);
   if (!error.is_ok())
     return;
+
+  this->m_tables.insert(
+      {std::string(table_name.get_ptr(), table_name.size()), slot});
 }
 
-/// Insert the table name at the given index, overwriting it.
-void SqlIndexFile::insert_table_name(
-    size_t index, const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
-    SqlError &error) {
-  // seek to position
-  this->seek_to_table_name_index(index, error);
+/// Remove a table name from the index.
+///
+/// This function will abort if the name is not in the index.
+void SqlIndexFile::remove_table_name(
+    const SmallString<TABLE_NAME_MAX_LENGTH> &table_name, SqlError &error) {
+  auto table_it = this->m_tables.find(
+      std::string(table_name.get_ptr(), table_name.size()));
+  assert(table_it != this->m_tables.end());
+
+  this->free_slot(table_it->second, error);
   if (!error.is_ok())
     return;
 
-  // write name
-  write_small_string_to_file(table_name, this->m_file, error);
+  this->m_tables.erase(table_it);
+}
+
+/// Get a secondary index by name.
+///
+/// Returns nullptr if not found.
+const SqlIndexEntry *SqlIndexFile::find_index(
+    const SmallString<TABLE_NAME_MAX_LENGTH> &index_name) const {
+  auto index_it = this->m_indexes.find(
+      std::string(index_name.get_ptr(), index_name.size()));
+  if (index_it == this->m_indexes.end())
+    return nullptr;
+
+  return &index_it->second;
+}
+
+/// Get every secondary index, keyed by name.
+const std::unordered_map<std::string, SqlIndexEntry> &
+SqlIndexFile::get_indexes() const {
+  return this->m_indexes;
+}
+
+/// Add a secondary index on a table column.
+///
+/// The name must not be an index yet.
+void SqlIndexFile::add_index(
+    const SmallString<TABLE_NAME_MAX_LENGTH> &index_name, SqlIndexSlotKind kind,
+    const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+    const SmallString<COLUMN_NAME_MAX_LENGTH> &column_name, SqlError &error) {
+  assert(this->find_index(index_name) == nullptr);
+
+  uint32_t slot =
+      this->write_slot(kind, index_name, table_name, column_name, error);
   if (!error.is_ok())
     return;
+
+  this->m_indexes.insert(
+      {std::string(index_name.get_ptr(), index_name.size()),
+       SqlIndexEntry{kind,
+                     std::string(table_name.get_ptr(), table_name.size()),
+                     column_name, slot}});
 }
 
-/// Remove the table at the index.
+/// Remove a secondary index.
 ///
-/// This function will abort if i >= num_tables.
-void SqlIndexFile::remove(size_t i, SqlError &error) {
-  assert(i < this->num_tables);
+/// This function will abort if the name is not an index.
+void SqlIndexFile::remove_index(
+    const SmallString<TABLE_NAME_MAX_LENGTH> &index_name, SqlError &error) {
+  auto index_it = this->m_indexes.find(
+      std::string(index_name.get_ptr(), index_name.size()));
+  assert(index_it != this->m_indexes.end());
 
-  // Get last name
-  SmallString<TABLE_NAME_MAX_LENGTH> last_name;
-  this->get_table_name(this->num_tables - 1, last_name, error);
+  this->free_slot(index_it->second.slot, error);
   if (!error.is_ok())
     return;
 
-  // Overwrite
-  this->insert_table_name(i, last_name, error);
+  this->m_indexes.erase(index_it);
+}
 
-  // Update num tables
-  this->update_num_tables(this->num_tables - 1, error);
+/// Write a name field of a slot.
+template <size_t N>
+static void write_slot_name(uint8_t *field, const SmallString<N> &name) {
+  field[0] = name.size();
+  memcpy(field + 1, name.get_ptr(), name.size());
 }
 
-/// Update num_tables
-void SqlIndexFile::update_num_tables(uint8_t new_num_tables, SqlError &error) {
-  // seek
-  // the num_tables field is right after the magic
-  this->m_file.seek(SQL_INDEX_FILE_MAGIC_SIZE, error);
+/// Write an entry to a free slot, appending one if there is none.
+///
+/// Returns the slot.
+uint32_t SqlIndexFile::write_slot(
+    SqlIndexSlotKind kind, const SmallString<TABLE_NAME_MAX_LENGTH> &name,
+    const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+    const SmallString<COLUMN_NAME_MAX_LENGTH> &column_name, SqlError &error) {
+  uint8_t slot[SQL_INDEX_FILE_SLOT_SIZE] = {0};
+  slot[0] = (uint8_t)kind;
+  write_slot_name(slot + 1, name);
+  write_slot_name(slot + 1 + SQL_INDEX_FILE_NAME_SIZE, table_name);
+  write_slot_name(slot + 1 + 2 * SQL_INDEX_FILE_NAME_SIZE, column_name);
+
+  // reuse a free slot, or append one
+  bool append = this->m_free_slots.empty();
+  uint32_t index = append ? this->m_num_slots : this->m_free_slots.back();
+
+  this->m_file.write_at(SQL_INDEX_FILE_HEADER_SIZE +
+                            index * SQL_INDEX_FILE_SLOT_SIZE,
+                        slot, SQL_INDEX_FILE_SLOT_SIZE, error);
   if (!error.is_ok())
-    return;
+    return 0;
+
+  // the slot is only part of the index once the count covers it
+  if (append) {
+    uint32_t new_num_slots = this->m_num_slots + 1;
+    this->m_file.write_at(SQL_INDEX_FILE_NUM_SLOTS_OFFSET,
+                          (const uint8_t *)&new_num_slots, 4, error);
+    if (!error.is_ok())
+      return 0;
+    this->m_num_slots = new_num_slots;
+  } else {
+    this->m_free_slots.pop_back();
+  }
 
-  // update the field with new data
-  this->m_file.write(&new_num_tables, 1, error);
+  return index;
+}
+
+/// Mark a slot free.
+void SqlIndexFile::free_slot(uint32_t index, SqlError &error) {
+  // only the kind changes
+  uint8_t kind = (uint8_t)SqlIndexSlotKind::FREE;
+  this->m_file.write_at(SQL_INDEX_FILE_HEADER_SIZE +
+                            index * SQL_INDEX_FILE_SLOT_SIZE,
+                        &kind, 1, error);
   if (!error.is_ok())
     return;
 
-  // only update memory value if past operations persisted to disk.
-  this->num_tables = new_num_tables;
+  this->m_free_slots.push_back(index);
 }
 
 /// Returns true if this is closed.
@@ -177,4 +362,7 @@ void SqlIndexFile::remove_file(SqlError &error) {
     return;
 }
 
-} // namespace basic_sql
\ No newline at end of file
+/// Flush this file
+void SqlIndexFile::flush(SqlError &error) { this->m_file.flush(error); }
+
+} // namespace basic_sql
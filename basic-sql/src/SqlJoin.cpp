@@ -0,0 +1,630 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlJoin.h"
+#include "SerDe.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace basic_sql {
+/// Mix the bits of a hash, so the low bits are spread well
+static uint64_t mix_hash(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/// Hash a value, so values that compare equal hash alike.
+///
+/// INT values hash like the FLOAT they compare equal to.
+uint64_t hash_join_key(const SqlValue &value) {
+  float float_value = 0;
+  switch (value.type()) {
+  case SqlValueType::Integer:
+    float_value = (float)value.get_integer();
+    break;
+  case SqlValueType::Float:
+    float_value = value.get_float();
+    break;
+  case SqlValueType::String: {
+    // FNV-1a
+    const SmallString<MAX_TYPE_SIZE> &string = value.get_string();
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < string.size(); i++) {
+      hash ^= (uint8_t)string.get_ptr()[i];
+      hash *= 1099511628211ull;
+    }
+    return mix_hash(hash);
+  }
+  default:
+    return 0;
+  }
+
+  // -0 equals 0
+  if (float_value == 0)
+    float_value = 0;
+  uint32_t bits = 0;
+  memcpy(&bits, &float_value, 4);
+  return mix_hash(bits);
+}
+
+/// Keep a column of a join input, if it is not kept already.
+///
+/// Returns its position among the kept columns.
+size_t keep_join_column(SqlJoinInput &input, size_t column) {
+  for (size_t i = 0; i < input.columns.size(); i++) {
+    if (input.columns[i] == column)
+      return i;
+  }
+  input.columns.push(column);
+  return input.columns.size() - 1;
+}
+
+/// Read the kept columns of a row of a join input.
+static void get_kept_row(const SqlJoinInput &input, uint64_t row_id,
+                         SmallVec<COLUMN_MAX, SqlValue> &row,
+                         SqlError &error) {
+  uint32_t column_mask = 0;
+  for (size_t i = 0; i < input.columns.size(); i++)
+    column_mask |= (uint32_t)1 << input.columns[i];
+
+  SmallVec<COLUMN_MAX, SqlValue> table_row;
+  input.table->get_row_columns(row_id, column_mask, table_row, error);
+  if (!error.is_ok())
+    return;
+  for (size_t i = 0; i < input.columns.size(); i++)
+    row.push(table_row[input.columns[i]]);
+}
+
+/// Returns true if a type holds strings
+static bool is_string_type(const parser::SqlType &type) {
+  return type.type == tokenizer::SqlType::CHAR ||
+         type.type == tokenizer::SqlType::VARCHAR;
+}
+
+/// Write a u64 in big endian, so it sorts bytewise
+static void write_u64_be(uint64_t value, uint8_t *data) {
+  for (size_t i = 0; i < 8; i++)
+    data[i] = (uint8_t)(value >> (56 - (i * 8)));
+}
+
+/// Read a big endian u64
+static uint64_t read_u64_be(const uint8_t *data) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < 8; i++)
+    value = (value << 8) | data[i];
+  return value;
+}
+
+/// Write the sort record of an encoded value of a type and its row.
+///
+/// A record is a flag byte, a `key_size` byte key, and the big endian row
+/// id, so records sort bytewise by value then row. The flag is set for
+/// values that equal nothing, which sort last.
+static void encode_sort_record(const parser::SqlType &type, size_t key_size,
+                               const uint8_t *value, uint64_t row_id,
+                               uint8_t *record) {
+  record[0] = 0;
+  uint8_t *key = record + 1;
+  switch (type.type) {
+  case tokenizer::SqlType::INT: {
+    uint32_t int_value = 0;
+    memcpy(&int_value, value, 4);
+    for (size_t i = 0; i < 4; i++)
+      key[i] = (uint8_t)(int_value >> (24 - (i * 8)));
+    break;
+  }
+  case tokenizer::SqlType::FLOAT: {
+    float float_value = 0;
+    memcpy(&float_value, value, 4);
+    if (float_value != float_value) {
+      record[0] = 1;
+      memset(key, 0, 4);
+      break;
+    }
+
+    // -0 equals 0. flip negative floats, so they sort below the others
+    if (float_value == 0)
+      float_value = 0;
+    uint32_t bits = 0;
+    memcpy(&bits, &float_value, 4);
+    bits = (bits & 0x80000000) != 0 ? ~bits : bits | 0x80000000;
+    for (size_t i = 0; i < 4; i++)
+      key[i] = (uint8_t)(bits >> (24 - (i * 8)));
+    break;
+  }
+  case tokenizer::SqlType::CHAR:
+  case tokenizer::SqlType::VARCHAR: {
+    // the bytes, zero padded, then the length, so a prefix sorts first
+    uint8_t len = value[0];
+    memcpy(key, value + 1, len);
+    memset(key + len, 0, key_size - 1 - len);
+    key[key_size - 1] = len;
+    break;
+  }
+  default:
+    panic("unknown `tokenizer::SqlType` in `encode_sort_record`");
+    break;
+  }
+
+  write_u64_be(row_id, key + key_size);
+}
+
+/// Add a sort record for the join value of every row of a join input that
+/// matches its where clause.
+static void add_sort_records(const SqlJoinInput &input, size_t key_size,
+                             SqlExternalSort &sort, SqlError &error) {
+  const parser::SqlType &type = input.table->get_columns()[input.column].type;
+  size_t width = sql_type_width(type);
+  uint64_t num_rows = input.table->get_num_values();
+
+  std::vector<uint8_t> keys;
+  std::vector<uint64_t> row_ids;
+  std::vector<uint8_t> record(1 + key_size + 8);
+  for (uint64_t first_row = 0; first_row < num_rows;
+       first_row += SQL_JOIN_SCAN_ROWS) {
+    keys.clear();
+    row_ids.clear();
+    input.table->read_column_keys(
+        input.column, first_row,
+        std::min<uint64_t>(first_row + SQL_JOIN_SCAN_ROWS, num_rows),
+        input.predicate, keys, row_ids, error);
+    if (!error.is_ok())
+      return;
+
+    for (size_t i = 0; i < row_ids.size(); i++) {
+      encode_sort_record(type, key_size, keys.data() + (i * width),
+                         row_ids[i], record.data());
+      sort.add(record.data(), error);
+      if (!error.is_ok())
+        return;
+    }
+  }
+
+  sort.finish(error);
+}
+
+/// Returns true if columns of two types can be joined by sorting their
+/// values.
+///
+/// Their values must sort in an order that agrees with `SqlValue` equality,
+/// so INT and FLOAT columns are only joined with columns of the same type.
+bool can_sort_merge_join(const parser::SqlType &left_type,
+                         const parser::SqlType &right_type) {
+  if (is_string_type(left_type))
+    return is_string_type(right_type);
+  return left_type.type == right_type.type;
+}
+
+/// Read the join values of a batch of rows of a join input that match its
+/// where clause, from `first_row` on.
+static void read_join_values(const SqlJoinInput &input, uint64_t first_row,
+                             std::vector<SqlValue> &values,
+                             std::vector<uint64_t> &row_ids,
+                             SqlError &error) {
+  const parser::SqlType &type = input.table->get_columns()[input.column].type;
+  size_t width = sql_type_width(type);
+  uint64_t end_row = std::min<uint64_t>(first_row + SQL_JOIN_SCAN_ROWS,
+                                        input.table->get_num_values());
+
+  std::vector<uint8_t> keys;
+  row_ids.clear();
+  input.table->read_column_keys(input.column, first_row, end_row,
+                                input.predicate, keys, row_ids, error);
+  if (!error.is_ok())
+    return;
+
+  values.resize(row_ids.size());
+  for (size_t i = 0; i < row_ids.size(); i++) {
+    if (!decode_sql_value(values[i], type, keys.data() + (i * width))) {
+      error.set_invalid_file();
+      return;
+    }
+  }
+}
+
+/// Find the rows of a join input equal to a value with an index, keeping
+/// those that match its where clause.
+static void find_indexed_rows(const SqlJoinInput &input,
+                              const SqlValue &value,
+                              std::vector<uint64_t> &row_ids,
+                              SqlError &error) {
+  row_ids.clear();
+  bool indexed = input.table->find_equal_rows(input.column, value, row_ids,
+                                              error);
+  if (!error.is_ok())
+    return;
+  assert(indexed);
+
+  if (input.predicate == nullptr)
+    return;
+  std::vector<uint64_t> found_rows;
+  found_rows.swap(row_ids);
+  input.table->filter_rows(*input.predicate, found_rows, row_ids, error);
+}
+
+/// Make a cursor that is not open
+SqlJoinCursor::SqlJoinCursor()
+    : m_left{nullptr, 0, nullptr, SmallVec<COLUMN_MAX, size_t>()},
+      m_right{nullptr, 0, nullptr, SmallVec<COLUMN_MAX, size_t>()},
+      m_join_type(parser::SqlJoinType::None),
+      m_method(SqlJoinMethod::Hash), m_finished(true), m_next_row(0),
+      m_next_match(0), m_left_id(UINT64_MAX), m_left_record(nullptr),
+      m_right_record(nullptr), m_value_size(0), m_has_value(false) {}
+
+/// Start joining with a hash table.
+///
+/// The table with fewer rows is hashed. If that is the right one, left rows
+/// probe it as they are read. Otherwise every match is found first.
+void SqlJoinCursor::open_hash(const SqlJoinInput &left,
+                              const SqlJoinInput &right,
+                              parser::SqlJoinType join_type,
+                              SqlError &error) {
+  this->open_inputs(left, right, join_type, SqlJoinMethod::Hash);
+  bool build_left =
+      left.table->get_num_values() < right.table->get_num_values();
+  this->build_hash_table(build_left ? left : right, error);
+  if (!error.is_ok())
+    return;
+  if (build_left)
+    this->probe_hash_table_all(error);
+}
+
+/// Start joining by sorting the join values of both tables and merging them.
+void SqlJoinCursor::open_sort_merge(const SqlJoinInput &left,
+                                    const SqlJoinInput &right,
+                                    parser::SqlJoinType join_type,
+                                    size_t memory_size,
+                                    const std::string &file_prefix,
+                                    SqlError &error) {
+  this->open_inputs(left, right, join_type, SqlJoinMethod::SortMerge);
+  const parser::SqlType &left_type =
+      left.table->get_columns()[left.column].type;
+  const parser::SqlType &right_type =
+      right.table->get_columns()[right.column].type;
+  assert(can_sort_merge_join(left_type, right_type));
+
+  // strings of both columns are padded to the longer one
+  size_t key_size = 4;
+  if (is_string_type(left_type)) {
+    key_size =
+        std::max(sql_type_width(left_type), sql_type_width(right_type));
+  }
+  size_t record_size = 1 + key_size + 8;
+  this->m_value_size = 1 + key_size;
+  this->m_value.resize(this->m_value_size);
+
+  this->m_left_sort.reset(new SqlExternalSort(file_prefix + "left-",
+                                              record_size, memory_size / 2));
+  add_sort_records(left, key_size, *this->m_left_sort, error);
+  if (!error.is_ok())
+    return;
+  this->m_right_sort.reset(new SqlExternalSort(
+      file_prefix + "right-", record_size, memory_size / 2));
+  add_sort_records(right, key_size, *this->m_right_sort, error);
+  if (!error.is_ok())
+    return;
+
+  this->m_left_record = this->m_left_sort->next(error);
+  if (!error.is_ok())
+    return;
+  this->m_right_record = this->m_right_sort->next(error);
+}
+
+/// Start joining by looking up join values in an index.
+void SqlJoinCursor::open_index_nested_loop(const SqlJoinInput &left,
+                                           const SqlJoinInput &right,
+                                           parser::SqlJoinType join_type,
+                                           bool index_left,
+                                           SqlError &error) {
+  assert(!index_left || join_type != parser::SqlJoinType::LeftOuter);
+  this->open_inputs(left, right, join_type, SqlJoinMethod::IndexNestedLoop);
+  if (index_left)
+    this->look_up_index_all(error);
+}
+
+/// Get the next joined row.
+///
+/// Returns false once every row was joined.
+bool SqlJoinCursor::next(SmallVec<COLUMN_MAX, SqlValue> &row,
+                         SqlError &error) {
+  while (this->m_next_match == this->m_matches.size()) {
+    if (this->m_finished)
+      return false;
+    this->m_matches.clear();
+    this->m_next_match = 0;
+    this->find_matches(error);
+    if (!error.is_ok())
+      return false;
+  }
+
+  std::pair<uint64_t, uint64_t> match = this->m_matches[this->m_next_match];
+  this->m_next_match += 1;
+
+  // a left row is often joined with many right rows in a row
+  if (match.first != this->m_left_id) {
+    this->m_left_row = SmallVec<COLUMN_MAX, SqlValue>();
+    get_kept_row(this->m_left, match.first, this->m_left_row, error);
+    if (!error.is_ok())
+      return false;
+    this->m_left_id = match.first;
+  }
+
+  row = this->m_left_row;
+  if (match.second == UINT64_MAX) {
+    for (size_t k = 0; k < this->m_right.columns.size(); k++)
+      row.push(SqlValue());
+    return true;
+  }
+
+  SmallVec<COLUMN_MAX, SqlValue> right_row;
+  get_kept_row(this->m_right, match.second, right_row, error);
+  if (!error.is_ok())
+    return false;
+  for (size_t k = 0; k < right_row.size(); k++)
+    row.push(right_row[k]);
+  return true;
+}
+
+/// Stop joining, dropping any held matches and sort runs.
+void SqlJoinCursor::close() {
+  this->m_left.table = nullptr;
+  this->m_right.table = nullptr;
+  this->m_finished = true;
+  this->m_next_row = 0;
+  std::vector<std::pair<uint64_t, uint64_t>>().swap(this->m_matches);
+  this->m_next_match = 0;
+  this->m_left_id = UINT64_MAX;
+  this->m_left_row = SmallVec<COLUMN_MAX, SqlValue>();
+  std::vector<SqlValue>().swap(this->m_hash_values);
+  std::vector<uint64_t>().swap(this->m_hash_rows);
+  std::unordered_map<uint64_t, std::vector<size_t>>().swap(
+      this->m_hash_table);
+  this->m_left_sort.reset();
+  this->m_right_sort.reset();
+  this->m_left_record = nullptr;
+  this->m_right_record = nullptr;
+  this->m_value_size = 0;
+  this->m_value.clear();
+  this->m_has_value = false;
+  this->m_value_rows.clear();
+}
+
+/// Set up the inputs of a join
+void SqlJoinCursor::open_inputs(const SqlJoinInput &left,
+                                const SqlJoinInput &right,
+                                parser::SqlJoinType join_type,
+                                SqlJoinMethod method) {
+  this->close();
+  this->m_left = left;
+  this->m_right = right;
+  this->m_join_type = join_type;
+  this->m_method = method;
+  this->m_finished = false;
+}
+
+/// Find the next batch of matches.
+void SqlJoinCursor::find_matches(SqlError &error) {
+  switch (this->m_method) {
+  case SqlJoinMethod::Hash:
+    this->probe_hash_table(error);
+    break;
+  case SqlJoinMethod::SortMerge:
+    this->merge_sorted(error);
+    break;
+  case SqlJoinMethod::IndexNestedLoop:
+    this->look_up_index(error);
+    break;
+  default:
+    panic("unknown `SqlJoinMethod` in `SqlJoinCursor::find_matches`");
+    break;
+  }
+}
+
+/// Hash the join values of the rows of a join input.
+void SqlJoinCursor::build_hash_table(const SqlJoinInput &input,
+                                     SqlError &error) {
+  uint64_t num_rows = input.table->get_num_values();
+  std::vector<SqlValue> values;
+  std::vector<uint64_t> row_ids;
+  for (uint64_t first_row = 0; first_row < num_rows;
+       first_row += SQL_JOIN_SCAN_ROWS) {
+    read_join_values(input, first_row, values, row_ids, error);
+    if (!error.is_ok())
+      return;
+
+    for (size_t i = 0; i < row_ids.size(); i++) {
+      this->m_hash_table[hash_join_key(values[i])].push_back(
+          this->m_hash_rows.size());
+      this->m_hash_values.push_back(values[i]);
+      this->m_hash_rows.push_back(row_ids[i]);
+    }
+  }
+}
+
+/// Find the next batch of matches by probing the hashed right rows with left
+/// rows.
+void SqlJoinCursor::probe_hash_table(SqlError &error) {
+  std::vector<SqlValue> values;
+  std::vector<uint64_t> row_ids;
+  read_join_values(this->m_left, this->m_next_row, values, row_ids, error);
+  if (!error.is_ok())
+    return;
+  this->m_next_row += SQL_JOIN_SCAN_ROWS;
+  this->m_finished = this->m_next_row >= this->m_left.table->get_num_values();
+
+  for (size_t i = 0; i < row_ids.size(); i++) {
+    bool matched = false;
+    auto entry = this->m_hash_table.find(hash_join_key(values[i]));
+    if (entry != this->m_hash_table.end()) {
+      const std::vector<size_t> &candidates = entry->second;
+      for (size_t j = 0; j < candidates.size(); j++) {
+        if (!(this->m_hash_values[candidates[j]] == values[i]))
+          continue;
+        this->m_matches.push_back(
+            std::make_pair(row_ids[i], this->m_hash_rows[candidates[j]]));
+        matched = true;
+      }
+    }
+
+    if (!matched && this->m_join_type == parser::SqlJoinType::LeftOuter)
+      this->m_matches.push_back(std::make_pair(row_ids[i], UINT64_MAX));
+  }
+}
+
+/// Find every match by probing the hashed left rows with right rows.
+///
+/// Only the row ids of the matches are held.
+void SqlJoinCursor::probe_hash_table_all(SqlError &error) {
+  // the right row of each match, grouped by hashed row
+  std::vector<size_t> match_counts(this->m_hash_rows.size() + 1, 0);
+  std::vector<std::pair<size_t, uint64_t>> matches;
+  uint64_t num_rows = this->m_right.table->get_num_values();
+  std::vector<SqlValue> values;
+  std::vector<uint64_t> row_ids;
+  for (uint64_t first_row = 0; first_row < num_rows;
+       first_row += SQL_JOIN_SCAN_ROWS) {
+    read_join_values(this->m_right, first_row, values, row_ids, error);
+    if (!error.is_ok())
+      return;
+
+    for (size_t i = 0; i < row_ids.size(); i++) {
+      auto entry = this->m_hash_table.find(hash_join_key(values[i]));
+      if (entry == this->m_hash_table.end())
+        continue;
+
+      const std::vector<size_t> &candidates = entry->second;
+      for (size_t j = 0; j < candidates.size(); j++) {
+        if (!(this->m_hash_values[candidates[j]] == values[i]))
+          continue;
+        matches.push_back(std::make_pair(candidates[j], row_ids[i]));
+        match_counts[candidates[j] + 1] += 1;
+      }
+    }
+  }
+
+  // probing visits right rows in order, and hashed rows are in left row
+  // order, so a stable placement by hashed row gives nested loop order.
+  for (size_t i = 1; i < match_counts.size(); i++)
+    match_counts[i] += match_counts[i - 1];
+  std::vector<uint64_t> right_rows(matches.size());
+  std::vector<size_t> next_slots(match_counts.begin(), match_counts.end() - 1);
+  for (size_t i = 0; i < matches.size(); i++)
+    right_rows[next_slots[matches[i].first]++] = matches[i].second;
+
+  for (size_t i = 0; i < this->m_hash_rows.size(); i++) {
+    uint64_t left_row = this->m_hash_rows[i];
+    if (match_counts[i] == match_counts[i + 1] &&
+        this->m_join_type == parser::SqlJoinType::LeftOuter)
+      this->m_matches.push_back(std::make_pair(left_row, UINT64_MAX));
+    for (size_t j = match_counts[i]; j < match_counts[i + 1]; j++)
+      this->m_matches.push_back(std::make_pair(left_row, right_rows[j]));
+  }
+  this->m_finished = true;
+}
+
+/// Find the next batch of matches by merging the sorted join values.
+///
+/// The right rows of the join value being merged are held, so every left
+/// row of the value can be paired with them.
+void SqlJoinCursor::merge_sorted(SqlError &error) {
+  size_t value_size = this->m_value_size;
+  while (this->m_matches.size() < SQL_JOIN_SCAN_ROWS) {
+    if (this->m_left_record == nullptr) {
+      this->m_finished = true;
+      return;
+    }
+
+    // skip the right rows with lower values, then read the equal ones
+    if (!this->m_has_value || memcmp(this->m_left_record,
+                                     this->m_value.data(), value_size) != 0) {
+      memcpy(this->m_value.data(), this->m_left_record, value_size);
+      this->m_has_value = true;
+      this->m_value_rows.clear();
+      while (this->m_value[0] == 0 && this->m_right_record != nullptr &&
+             memcmp(this->m_right_record, this->m_value.data(),
+                    value_size) <= 0) {
+        if (memcmp(this->m_right_record, this->m_value.data(),
+                   value_size) == 0) {
+          this->m_value_rows.push_back(
+              read_u64_be(this->m_right_record + value_size));
+        }
+
+        this->m_right_record = this->m_right_sort->next(error);
+        if (!error.is_ok())
+          return;
+      }
+    }
+
+    // pair them with the left row
+    uint64_t left_row = read_u64_be(this->m_left_record + value_size);
+    if (this->m_value_rows.empty() &&
+        this->m_join_type == parser::SqlJoinType::LeftOuter)
+      this->m_matches.push_back(std::make_pair(left_row, UINT64_MAX));
+    for (size_t i = 0; i < this->m_value_rows.size(); i++) {
+      this->m_matches.push_back(
+          std::make_pair(left_row, this->m_value_rows[i]));
+    }
+
+    this->m_left_record = this->m_left_sort->next(error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Find the next batch of matches by looking up left rows in an index of the
+/// right table.
+void SqlJoinCursor::look_up_index(SqlError &error) {
+  std::vector<SqlValue> values;
+  std::vector<uint64_t> row_ids;
+  read_join_values(this->m_left, this->m_next_row, values, row_ids, error);
+  if (!error.is_ok())
+    return;
+  this->m_next_row += SQL_JOIN_SCAN_ROWS;
+  this->m_finished = this->m_next_row >= this->m_left.table->get_num_values();
+
+  std::vector<uint64_t> right_rows;
+  for (size_t i = 0; i < row_ids.size(); i++) {
+    find_indexed_rows(this->m_right, values[i], right_rows, error);
+    if (!error.is_ok())
+      return;
+
+    if (right_rows.empty() &&
+        this->m_join_type == parser::SqlJoinType::LeftOuter)
+      this->m_matches.push_back(std::make_pair(row_ids[i], UINT64_MAX));
+    for (size_t j = 0; j < right_rows.size(); j++)
+      this->m_matches.push_back(std::make_pair(row_ids[i], right_rows[j]));
+  }
+}
+
+/// Find every match by looking up right rows in an index of the left table.
+///
+/// Only the row ids of the matches are held.
+void SqlJoinCursor::look_up_index_all(SqlError &error) {
+  uint64_t num_rows = this->m_right.table->get_num_values();
+  std::vector<SqlValue> values;
+  std::vector<uint64_t> row_ids;
+  std::vector<uint64_t> left_rows;
+  for (uint64_t first_row = 0; first_row < num_rows;
+       first_row += SQL_JOIN_SCAN_ROWS) {
+    read_join_values(this->m_right, first_row, values, row_ids, error);
+    if (!error.is_ok())
+      return;
+
+    for (size_t i = 0; i < row_ids.size(); i++) {
+      find_indexed_rows(this->m_left, values[i], left_rows, error);
+      if (!error.is_ok())
+        return;
+      for (size_t j = 0; j < left_rows.size(); j++)
+        this->m_matches.push_back(std::make_pair(left_rows[j], row_ids[i]));
+    }
+  }
+
+  // right rows are visited in order, so sorting by left row gives nested
+  // loop order
+  std::sort(this->m_matches.begin(), this->m_matches.end());
+  this->m_finished = true;
+}
+} // namespace basic_sql
@@ -0,0 +1,428 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlPageCompression.h"
+#include "SerDe.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+namespace basic_sql {
+/// Get the # of bits needed to store a value
+static uint8_t bit_width(uint32_t value) {
+  uint8_t width = 0;
+  while (value != 0) {
+    width++;
+    value >>= 1;
+  }
+  return width;
+}
+
+/// Get the # of bytes of a bit packed array
+static size_t packed_size(size_t num_values, uint8_t width) {
+  return ((num_values * width) + 7) / 8;
+}
+
+/// Read a value from a bit packed array
+static uint32_t unpack(const uint8_t *packed, size_t num_values,
+                       uint8_t width, size_t index) {
+  if (width == 0)
+    return 0;
+
+  // copy the bytes holding the value, without reading past the array.
+  size_t bit = index * width;
+  size_t byte = bit / 8;
+  size_t len = std::min((size_t)5, packed_size(num_values, width) - byte);
+  uint64_t bits = 0;
+  memcpy(&bits, packed + byte, len);
+
+  return (uint32_t)((bits >> (bit % 8)) & ((((uint64_t)1) << width) - 1));
+}
+
+/// Encode a column with the plain encoding
+static void encode_plain(const std::vector<uint8_t> &values,
+                         std::vector<uint8_t> &out) {
+  out = values;
+}
+
+/// Encode a column with the dictionary encoding.
+///
+/// Returns false if there are too many distinct values.
+static bool encode_dictionary(const std::vector<uint8_t> &values,
+                              size_t width, size_t num_rows,
+                              std::vector<uint8_t> &out) {
+  std::unordered_map<std::string, uint16_t> codes;
+  std::vector<uint16_t> row_codes;
+  std::vector<uint8_t> entries;
+  row_codes.reserve(num_rows);
+  for (size_t i = 0; i < num_rows; i++) {
+    std::string key((const char *)values.data() + (i * width), width);
+    auto code_it = codes.find(key);
+    if (code_it == codes.end()) {
+      if (codes.size() == UINT16_MAX)
+        return false;
+      uint16_t code = codes.size();
+      code_it = codes.insert({key, code}).first;
+      entries.insert(entries.end(), key.begin(), key.end());
+    }
+    row_codes.push_back(code_it->second);
+  }
+
+  uint8_t code_size = codes.size() <= 256 ? 1 : 2;
+  out.clear();
+  push_u16(out, codes.size());
+  out.push_back(code_size);
+  out.push_back(0);
+  out.insert(out.end(), entries.begin(), entries.end());
+  for (size_t i = 0; i < num_rows; i++) {
+    if (code_size == 1) {
+      out.push_back(row_codes[i]);
+    } else {
+      push_u16(out, row_codes[i]);
+    }
+  }
+
+  return true;
+}
+
+/// Encode a column with the run length encoding
+static void encode_run_length(const std::vector<uint8_t> &values,
+                              size_t width, size_t num_rows,
+                              std::vector<uint8_t> &out) {
+  std::vector<uint32_t> run_ends;
+  std::vector<uint8_t> run_values;
+  for (size_t i = 0; i < num_rows; i++) {
+    const uint8_t *value = values.data() + (i * width);
+    if (i == 0 || memcmp(value, value - width, width) != 0) {
+      run_ends.push_back(i + 1);
+      run_values.insert(run_values.end(), value, value + width);
+    } else {
+      run_ends.back() = i + 1;
+    }
+  }
+
+  out.clear();
+  push_u32(out, run_ends.size());
+  for (size_t i = 0; i < run_ends.size(); i++)
+    push_u32(out, run_ends[i]);
+  out.insert(out.end(), run_values.begin(), run_values.end());
+}
+
+/// Encode an INT column with the frame of reference encoding
+static void encode_frame_of_reference(const std::vector<uint8_t> &values,
+                                      size_t num_rows,
+                                      std::vector<uint8_t> &out) {
+  uint32_t min = UINT32_MAX;
+  uint32_t max = 0;
+  for (size_t i = 0; i < num_rows; i++) {
+    uint32_t value = read_u32(values.data() + (i * 4));
+    min = std::min(min, value);
+    max = std::max(max, value);
+  }
+  if (num_rows == 0)
+    min = max;
+  uint8_t width = bit_width(max - min);
+
+  out.clear();
+  push_u32(out, min);
+  out.push_back(width);
+  out.insert(out.end(), 3, 0);
+
+  // pack little end first
+  uint64_t bits = 0;
+  size_t num_bits = 0;
+  for (size_t i = 0; i < num_rows; i++) {
+    uint32_t delta = read_u32(values.data() + (i * 4)) - min;
+    bits |= (uint64_t)delta << num_bits;
+    num_bits += width;
+    while (num_bits >= 8) {
+      out.push_back(bits & 0xff);
+      bits >>= 8;
+      num_bits -= 8;
+    }
+  }
+  if (num_bits != 0)
+    out.push_back(bits & 0xff);
+}
+
+/// Try to compress rows into a page.
+///
+/// `column_values[j]` holds the encoded values of column j for all
+/// `num_rows` rows, back to back, as `encode_sql_value` writes them.
+/// The encoding of each column is picked to make it as small as possible.
+/// Returns false if the rows do not fit in one page.
+bool compress_page(const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns,
+                   const std::vector<std::vector<uint8_t>> &column_values,
+                   size_t num_rows, uint8_t *page) {
+  assert(num_rows <= SQL_COMPRESSED_PAGE_MAX_ROWS);
+  assert(column_values.size() == columns.size());
+
+  size_t offset = SQL_COMPRESSED_PAGE_HEADER_SIZE +
+                  (columns.size() * SQL_COMPRESSED_PAGE_COLUMN_HEADER_SIZE);
+  if (offset > STORAGE_PAGE_SIZE)
+    return false;
+
+  std::vector<uint8_t> best;
+  std::vector<uint8_t> candidate;
+  for (size_t j = 0; j < columns.size(); j++) {
+    size_t width = sql_type_width(columns[j].type);
+    const std::vector<uint8_t> &values = column_values[j];
+    assert(values.size() == num_rows * width);
+
+    // try every encoding that applies, keep the smallest
+    SqlColumnEncoding encoding = SqlColumnEncoding::PLAIN;
+    encode_plain(values, best);
+
+    if (encode_dictionary(values, width, num_rows, candidate) &&
+        candidate.size() < best.size()) {
+      encoding = SqlColumnEncoding::DICTIONARY;
+      best.swap(candidate);
+    }
+
+    encode_run_length(values, width, num_rows, candidate);
+    if (candidate.size() < best.size()) {
+      encoding = SqlColumnEncoding::RUN_LENGTH;
+      best.swap(candidate);
+    }
+
+    if (columns[j].type.type == tokenizer::SqlType::INT) {
+      encode_frame_of_reference(values, num_rows, candidate);
+      if (candidate.size() < best.size()) {
+        encoding = SqlColumnEncoding::FRAME_OF_REFERENCE;
+        best.swap(candidate);
+      }
+    }
+
+    if (offset + best.size() > STORAGE_PAGE_SIZE)
+      return false;
+
+    // write column header, then data
+    uint8_t *column_header = page + SQL_COMPRESSED_PAGE_HEADER_SIZE +
+                             (j * SQL_COMPRESSED_PAGE_COLUMN_HEADER_SIZE);
+    memset(column_header, 0, SQL_COMPRESSED_PAGE_COLUMN_HEADER_SIZE);
+    column_header[0] = (uint8_t)encoding;
+    uint32_t column_offset = offset;
+    memcpy(column_header + 4, &column_offset, 4);
+    memcpy(page + offset, best.data(), best.size());
+    offset += best.size();
+  }
+
+  // write header
+  uint32_t page_num_rows = num_rows;
+  memcpy(page, &page_num_rows, 4);
+  page[4] = columns.size();
+  memset(page + 5, 0, 3);
+
+  // zero the unused end
+  memset(page + offset, 0, STORAGE_PAGE_SIZE - offset);
+
+  return true;
+}
+
+/// Make a view of the page at `data`.
+///
+/// the page must outlive the view.
+SqlCompressedPage::SqlCompressedPage(const uint8_t *data) : m_data(data) {}
+
+/// Get the # of rows
+uint32_t SqlCompressedPage::num_rows() const { return read_u32(this->m_data); }
+
+/// Get the encoding of a column
+SqlColumnEncoding SqlCompressedPage::encoding(size_t column) const {
+  assert(column < this->m_data[4]);
+  return (SqlColumnEncoding)(
+      this->m_data[SQL_COMPRESSED_PAGE_HEADER_SIZE +
+                   (column * SQL_COMPRESSED_PAGE_COLUMN_HEADER_SIZE)]);
+}
+
+/// Decode a single value
+///
+/// Returns false if the value is corrupt.
+bool SqlCompressedPage::decode_value(size_t column,
+                                     const parser::SqlType &type, size_t row,
+                                     SqlValue &value) const {
+  assert(row < this->num_rows());
+
+  if (this->encoding(column) == SqlColumnEncoding::FRAME_OF_REFERENCE) {
+    const uint8_t *data = this->column_data(column);
+    uint32_t base = read_u32(data);
+    uint8_t width = data[4];
+    value.set_integer(base + unpack(data + 8, this->num_rows(), width, row));
+    return true;
+  }
+
+  return decode_sql_value(value, type, this->value_data(column, type, row));
+}
+
+/// Copy out the value of a row, encoded as `encode_sql_value` writes it.
+void SqlCompressedPage::copy_value(size_t column, const parser::SqlType &type,
+                                   size_t row, uint8_t *data) const {
+  // frame of reference values are INTs, which always decode
+  if (this->encoding(column) == SqlColumnEncoding::FRAME_OF_REFERENCE) {
+    SqlValue value;
+    this->decode_value(column, type, row, value);
+    encode_sql_value(value, type, data);
+    return;
+  }
+
+  memcpy(data, this->value_data(column, type, row), sql_type_width(type));
+}
+
+/// Clear `matches[i]` for the rows i that do not match a predicate on its
+/// column.
+///
+/// Dictionary and run length columns test each distinct value once, and
+/// frame of reference columns compare integers without decoding them.
+void SqlCompressedPage::match(const SqlPredicate &predicate,
+                              std::vector<uint8_t> &matches) const {
+  assert(matches.size() <= this->num_rows());
+  // the column is not read if every or no value matches
+  switch (predicate.kind()) {
+  case SqlPredicateKind::All:
+    return;
+  case SqlPredicateKind::None:
+    std::fill(matches.begin(), matches.end(), 0);
+    return;
+  default:
+    break;
+  }
+
+  size_t column = predicate.column();
+  const parser::SqlType &type = predicate.type();
+  const parser::SqlWhereClause &where_clause = predicate.where_clause();
+  const uint8_t *data = this->column_data(column);
+  size_t width = sql_type_width(type);
+
+  switch (this->encoding(column)) {
+  case SqlColumnEncoding::DICTIONARY: {
+    // test each dictionary entry once
+    uint16_t num_entries = read_u16(data);
+    uint8_t code_size = data[2];
+    const uint8_t *entries = data + 4;
+    const uint8_t *codes = entries + (num_entries * width);
+
+    std::vector<uint8_t> entry_matches(num_entries, 1);
+    predicate.match(entries, entry_matches);
+
+    for (size_t i = 0; i < matches.size(); i++) {
+      uint16_t code =
+          code_size == 1 ? codes[i] : read_u16(codes + (i * code_size));
+      matches[i] = matches[i] && entry_matches[code];
+    }
+    break;
+  }
+  case SqlColumnEncoding::RUN_LENGTH: {
+    // test each run once
+    uint32_t num_runs = read_u32(data);
+    const uint8_t *run_ends = data + 4;
+    const uint8_t *run_values = run_ends + (num_runs * 4);
+
+    std::vector<uint8_t> run_matches(num_runs, 1);
+    predicate.match(run_values, run_matches);
+
+    size_t row = 0;
+    for (size_t i = 0; i < num_runs && row < matches.size(); i++) {
+      size_t run_end = std::min((size_t)read_u32(run_ends + (i * 4)),
+                                matches.size());
+      for (; row < run_end; row++)
+        matches[row] = matches[row] && run_matches[i];
+    }
+    break;
+  }
+  case SqlColumnEncoding::FRAME_OF_REFERENCE: {
+    // (in)equality against an int compares the packed deltas directly.
+    bool is_equality =
+        where_clause.op == tokenizer::SqlOperator::Equals ||
+        where_clause.op == tokenizer::SqlOperator::NotEqual;
+    if (is_equality && where_clause.value.type() == SqlValueType::Integer) {
+      uint32_t base = read_u32(data);
+      uint8_t width = data[4];
+      uint32_t target = where_clause.value.get_integer();
+      bool negate = where_clause.op == tokenizer::SqlOperator::NotEqual;
+
+      // a target outside the frame never matches
+      uint64_t max_delta = (((uint64_t)1) << width) - 1;
+      if (target < base || (uint64_t)(target - base) > max_delta) {
+        for (size_t i = 0; i < matches.size(); i++)
+          matches[i] = matches[i] && negate;
+        break;
+      }
+
+      uint32_t target_delta = target - base;
+      for (size_t i = 0; i < matches.size(); i++) {
+        bool equal =
+            unpack(data + 8, this->num_rows(), width, i) == target_delta;
+        matches[i] = matches[i] && (equal != negate);
+      }
+      break;
+    }
+
+    // otherwise, decode the rows that may match
+    std::vector<uint8_t> values(matches.size() * width);
+    for (size_t i = 0; i < matches.size(); i++) {
+      if (matches[i])
+        this->copy_value(column, type, i, values.data() + (i * width));
+    }
+    predicate.match(values.data(), matches);
+    break;
+  }
+  case SqlColumnEncoding::PLAIN:
+  default:
+    predicate.match(data, matches);
+    break;
+  }
+}
+
+/// Get a ptr to the data of a column
+const uint8_t *SqlCompressedPage::column_data(size_t column) const {
+  assert(column < this->m_data[4]);
+  uint32_t offset = read_u32(this->m_data + SQL_COMPRESSED_PAGE_HEADER_SIZE +
+                             (column * SQL_COMPRESSED_PAGE_COLUMN_HEADER_SIZE) +
+                             4);
+  return this->m_data + offset;
+}
+
+/// Get a ptr to the encoded value of a row in a column
+const uint8_t *SqlCompressedPage::value_data(size_t column,
+                                             const parser::SqlType &type,
+                                             size_t row) const {
+  const uint8_t *data = this->column_data(column);
+  size_t width = sql_type_width(type);
+
+  switch (this->encoding(column)) {
+  case SqlColumnEncoding::PLAIN:
+    return data + (row * width);
+  case SqlColumnEncoding::DICTIONARY: {
+    uint16_t num_entries = read_u16(data);
+    uint8_t code_size = data[2];
+    const uint8_t *entries = data + 4;
+    const uint8_t *codes = entries + (num_entries * width);
+    uint16_t code =
+        code_size == 1 ? codes[row] : read_u16(codes + (row * code_size));
+    return entries + (code * width);
+  }
+  case SqlColumnEncoding::RUN_LENGTH: {
+    // find the first run that ends after the row
+    uint32_t num_runs = read_u32(data);
+    const uint8_t *run_ends = data + 4;
+    const uint8_t *run_values = run_ends + (num_runs * 4);
+    size_t low = 0;
+    size_t high = num_runs;
+    while (low < high) {
+      size_t mid = (low + high) / 2;
+      if (read_u32(run_ends + (mid * 4)) <= row) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    assert(low < num_runs);
+    return run_values + (low * width);
+  }
+  default:
+    panic("unknown encoding in `SqlCompressedPage::value_data`");
+    return nullptr;
+  }
+}
+} // namespace basic_sql
@@ -32,6 +32,29 @@ bool SqlParserError::is_ok() const {
   return this->m_error_type == SqlParserErrorType::Ok;
 }
 
+/// Get the table of a select that a column name alias refers to.
+///
+/// A table can be named by its alias or its name. An empty alias refers to
+/// either table. Returns false if the alias names neither table.
+static bool
+get_join_table(const SmallString<TABLE_NAME_MAX_LENGTH> &alias,
+               const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+               const SmallString<TABLE_NAME_MAX_LENGTH> &table_name_alias,
+               const SmallString<TABLE_NAME_MAX_LENGTH> &joined_table_name,
+               const SmallString<TABLE_NAME_MAX_LENGTH> &joined_table_alias,
+               SqlJoinTable &join_table) {
+  if (alias.size() == 0) {
+    join_table = SqlJoinTable::Either;
+  } else if (alias == table_name_alias || alias == table_name) {
+    join_table = SqlJoinTable::Primary;
+  } else if (alias == joined_table_alias || alias == joined_table_name) {
+    join_table = SqlJoinTable::Secondary;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 // TODO: maybe just proivde the token buffer, and a utility func to tokenize
 // the string and feed it
 // TODO: Consider parser reuse
@@ -71,6 +94,74 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
       // consume token
       this->read();
 
+      // CREATE INDEX <identifier> ON <table> (<column>) [USING BTREE|HASH];
+      // INDEX is not a keyword, so it can still name tables and columns.
+      if (this->peek_word("INDEX")) {
+        this->read();
+
+        // read index name
+        SmallString<TABLE_NAME_MAX_LENGTH> index_name;
+        this->read_table_name(index_name, error);
+        if (!error.is_ok())
+          return;
+
+        // read ON
+        const tokenizer::SqlKeyword *on_keyword = nullptr;
+        this->read_keyword(&on_keyword, error);
+        if (!error.is_ok())
+          return;
+        if (*on_keyword != tokenizer::SqlKeyword::ON) {
+          error.set_unexpected_token(tokenizer::SqlTokenType::KEYWORD);
+          return;
+        }
+
+        // read table name
+        SmallString<TABLE_NAME_MAX_LENGTH> table_name;
+        this->read_table_name(table_name, error);
+        if (!error.is_ok())
+          return;
+
+        // read (<column>)
+        this->read_left_parenthesis(error);
+        if (!error.is_ok())
+          return;
+        SmallString<COLUMN_NAME_MAX_LENGTH> column_name;
+        this->read_column_name(column_name, error);
+        if (!error.is_ok())
+          return;
+        this->read_right_parenthesis(error);
+        if (!error.is_ok())
+          return;
+
+        // read optional USING BTREE|HASH
+        SqlIndexType index_type = SqlIndexType::BTREE;
+        if (this->peek_word("USING")) {
+          this->read();
+
+          const tokenizer::SqlIdentifier *type_identifier = nullptr;
+          this->read_identifier(&type_identifier, error);
+          if (!error.is_ok())
+            return;
+          if (type_identifier->value.case_insensitive_compare("BTREE")) {
+            index_type = SqlIndexType::BTREE;
+          } else if (type_identifier->value.case_insensitive_compare("HASH")) {
+            index_type = SqlIndexType::HASH;
+          } else {
+            error.set_unexpected_token(tokenizer::SqlTokenType::IDENTIFIER);
+            return;
+          }
+        }
+
+        // read ;
+        this->read_semicolon(error);
+        if (!error.is_ok())
+          return;
+
+        statements.push_back(SqlStatement(SqlStatementCreateIndex{
+            index_name, table_name, column_name, index_type}));
+        break;
+      }
+
       const tokenizer::SqlKeyword *keyword = nullptr;
       this->read_keyword(&keyword, error);
       if (!error.is_ok())
@@ -102,7 +193,7 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
       }
 
       case tokenizer::SqlKeyword::TABLE: {
-        // CREATE TABLE <identifier> (a1 int, a2 varchar(20));
+        // CREATE TABLE <identifier> (a1 int PRIMARY KEY, a2 varchar(20));
 
         // read table name
         SmallString<TABLE_NAME_MAX_LENGTH> table_name;
@@ -116,6 +207,7 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
           return;
 
         SmallVec<COLUMN_MAX, SqlColumn> columns;
+        int primary_key = -1;
 
         // Ensure at least 1 column
         {
@@ -129,6 +221,9 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
           }
           SqlType type;
           this->read_type(&type, error);
+          if (!error.is_ok())
+            return;
+          this->read_primary_key(columns.size(), primary_key, error);
           if (!error.is_ok())
             return;
 
@@ -159,6 +254,9 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
           }
           SqlType type;
           this->read_type(&type, error);
+          if (!error.is_ok())
+            return;
+          this->read_primary_key(columns.size(), primary_key, error);
           if (!error.is_ok())
             return;
 
@@ -178,13 +276,33 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
         if (!error.is_ok())
           return;
 
+        // read optional USING ROW|COLUMNAR
+        SqlTableLayout layout = SqlTableLayout::ROW;
+        if (this->peek_word("USING")) {
+          this->read();
+
+          const tokenizer::SqlIdentifier *layout_identifier = nullptr;
+          this->read_identifier(&layout_identifier, error);
+          if (!error.is_ok())
+            return;
+          if (layout_identifier->value.case_insensitive_compare("ROW")) {
+            layout = SqlTableLayout::ROW;
+          } else if (layout_identifier->value.case_insensitive_compare(
+                         "COLUMNAR")) {
+            layout = SqlTableLayout::COLUMNAR;
+          } else {
+            error.set_unexpected_token(tokenizer::SqlTokenType::IDENTIFIER);
+            return;
+          }
+        }
+
         // read ;
         this->read_semicolon(error);
         if (!error.is_ok())
           return;
 
-        statements.push_back(
-            SqlStatement(SqlStatementCreateTable{table_name, columns}));
+        statements.push_back(SqlStatement(SqlStatementCreateTable{
+            table_name, columns, layout, primary_key}));
         break;
       }
 
@@ -200,6 +318,23 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
       // consume token
       this->read();
 
+      // DROP INDEX <identifier>;
+      if (this->peek_word("INDEX")) {
+        this->read();
+
+        // read index name
+        SmallString<TABLE_NAME_MAX_LENGTH> index_name;
+        this->read_table_name(index_name, error);
+        if (!error.is_ok())
+          return;
+        this->read_semicolon(error);
+        if (!error.is_ok())
+          return;
+
+        statements.push_back(SqlStatement(SqlStatementDropIndex{index_name}));
+        break;
+      }
+
       const tokenizer::SqlKeyword *keyword = nullptr;
       this->read_keyword(&keyword, error);
       if (!error.is_ok())
@@ -295,16 +430,19 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
       }
       tokenizer::SqlTokenType peek_token_type = this->peek()->token_type();
       SmallVec<COLUMN_MAX, SmallString<COLUMN_NAME_MAX_LENGTH>> column_names;
+      SmallVec<COLUMN_MAX, SmallString<TABLE_NAME_MAX_LENGTH>> column_aliases;
       if (peek_token_type == tokenizer::SqlTokenType::ASTERISK) {
         // consume asterisk
         this->read();
       } else if (peek_token_type == tokenizer::SqlTokenType::IDENTIFIER) {
         // read column name
+        SmallString<TABLE_NAME_MAX_LENGTH> column_alias;
         SmallString<COLUMN_NAME_MAX_LENGTH> column_name;
-        this->read_column_name(column_name, error);
+        this->read_qualified_column_name(column_alias, column_name, error);
         if (!error.is_ok())
           return;
 
+        column_aliases.push(column_alias);
         column_names.push(column_name);
 
         // peek next type
@@ -319,10 +457,12 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
           this->read();
 
           // read column name
-          this->read_column_name(column_name, error);
+          column_alias.clear();
+          this->read_qualified_column_name(column_alias, column_name, error);
           if (!error.is_ok())
             return;
 
+          column_aliases.push(column_alias);
           column_names.push(column_name);
 
           // peek next token type
@@ -359,6 +499,7 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
       SqlJoinType join_type = SqlJoinType::None;
       SmallString<TABLE_NAME_MAX_LENGTH> joined_table_name;
       SmallString<TABLE_NAME_MAX_LENGTH> joined_table_name_alias;
+      bool comma_join = false;
       if (this->peek()->token_type() == tokenizer::SqlTokenType::COMMA) {
         // consume comma
         this->read();
@@ -375,6 +516,7 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
           return;
 
         join_type = SqlJoinType::Inner;
+        comma_join = true;
       }
 
       if (!this->has_input()) {
@@ -432,9 +574,22 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
         join_type = SqlJoinType::LeftOuter;
       }
 
-      // TODO: for simplicity, temporarily disallow wheres on joins.
+      // find the table of each column name
+      SmallVec<COLUMN_MAX, SqlJoinTable> column_tables;
+      for (size_t i = 0; i < column_aliases.size(); i++) {
+        SqlJoinTable join_table = SqlJoinTable::Either;
+        if (!get_join_table(column_aliases[i], table_name, table_name_alias,
+                            joined_table_name, joined_table_name_alias,
+                            join_table)) {
+          error.set_unexpected_token(tokenizer::SqlTokenType::IDENTIFIER);
+          return;
+        }
+        column_tables.push(join_table);
+      }
+
       bool has_where_clause = false;
       SqlWhereClause where_clause;
+      SqlJoinTable where_table = SqlJoinTable::Either;
 
       SmallString<COLUMN_NAME_MAX_LENGTH> primary_join_column_name;
       SmallString<COLUMN_NAME_MAX_LENGTH> secondary_join_column_name;
@@ -499,6 +654,32 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
         } else {
           panic("Unknown table name while parsing");
         }
+
+        // parse where clause. a comma join used "where" for its join
+        // columns, so its clause follows "and" instead. AND is not a
+        // keyword, so it can still name tables and columns.
+        if (!this->has_input()) {
+          error.set_unexpected_end();
+          return;
+        }
+        if (comma_join ? this->peek_word("AND")
+                       : *this->peek() == tokenizer::SqlToken(
+                                              tokenizer::SqlKeyword::WHERE)) {
+          // consume where or and
+          this->read();
+
+          SmallString<TABLE_NAME_MAX_LENGTH> where_alias;
+          this->read_join_condition(where_alias, where_clause, error);
+          if (!error.is_ok())
+            return;
+          if (!get_join_table(where_alias, table_name, table_name_alias,
+                              joined_table_name, joined_table_name_alias,
+                              where_table)) {
+            error.set_unexpected_token(tokenizer::SqlTokenType::IDENTIFIER);
+            return;
+          }
+          has_where_clause = true;
+        }
       } else {
         // parse where clause
         if (!this->has_input()) {
@@ -521,12 +702,14 @@ void SqlParser::parse_statement(std::vector<SqlStatement> &statements,
 
       SqlStatementSelect select{table_name,
                                 column_names,
+                                column_tables,
                                 has_where_clause,
                                 where_clause,
                                 join_type,
                                 joined_table_name,
                                 primary_join_column_name,
-                                secondary_join_column_name};
+                                secondary_join_column_name,
+                                where_table};
       statements.push_back(SqlStatement(select));
       break;
     }
@@ -830,6 +1013,13 @@ const tokenizer::SqlToken *SqlParser::read() {
     position += 1;
   return token;
 }
+/// Returns true if the next token is the identifier `word`, ignoring case.
+bool SqlParser::peek_word(const char *word) {
+  const tokenizer::SqlToken *token = this->peek();
+  return token != nullptr &&
+         token->token_type() == tokenizer::SqlTokenType::IDENTIFIER &&
+         token->identifier().value.case_insensitive_compare(word);
+}
 /// Read the next keyword, marking it as read.
 void SqlParser::read_keyword(const tokenizer::SqlKeyword **keyword,
                              SqlParserError &error) {
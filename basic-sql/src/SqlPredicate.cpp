@@ -0,0 +1,338 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlPredicate.h"
+#include "SerDe.h"
+#include "SqlFilterKernel.h"
+#include <algorithm>
+#include <cstring>
+
+namespace basic_sql {
+/// Read an encoded number
+template <typename T> static T read_number(const uint8_t *data) {
+  T value;
+  memcpy(&value, data, sizeof(T));
+  return value;
+}
+
+/// Tests an encoded number of type T against a target of type V.
+///
+/// The number is on the left, like `SqlValue`.
+template <tokenizer::SqlOperator OP, typename T, typename V>
+struct SqlNumberMatch {
+  /// The target
+  V target;
+
+  bool operator()(const uint8_t *data) const {
+    T value = read_number<T>(data);
+    switch (OP) {
+    case tokenizer::SqlOperator::Equals:
+      return value == this->target;
+    case tokenizer::SqlOperator::GreaterThan:
+      return value > this->target;
+    case tokenizer::SqlOperator::NotEqual:
+    default:
+      return !(value == this->target);
+    }
+  }
+};
+
+/// Tests an encoded string against a target.
+///
+/// Strings compare bytewise, and a prefix sorts first.
+template <tokenizer::SqlOperator OP> struct SqlStringMatch {
+  /// The target
+  const char *target;
+  /// The size of the target
+  size_t target_size;
+
+  bool operator()(const uint8_t *data) const {
+    size_t size = data[0];
+    switch (OP) {
+    case tokenizer::SqlOperator::Equals:
+      return size == this->target_size &&
+             memcmp(data + 1, this->target, size) == 0;
+    case tokenizer::SqlOperator::GreaterThan: {
+      int cmp =
+          memcmp(data + 1, this->target, std::min(size, this->target_size));
+      return cmp != 0 ? cmp > 0 : size > this->target_size;
+    }
+    case tokenizer::SqlOperator::NotEqual:
+    default:
+      return !(size == this->target_size &&
+               memcmp(data + 1, this->target, size) == 0);
+    }
+  }
+};
+
+/// Tests nothing, matching every value or none
+struct SqlConstantMatch {
+  /// Set if every value matches
+  bool result;
+
+  bool operator()(const uint8_t *) const { return this->result; }
+};
+
+/// Call `apply` with the test for numbers of type T against a target.
+template <typename T, typename V, typename Apply>
+static void apply_number_match(tokenizer::SqlOperator op, V target,
+                               Apply &apply) {
+  switch (op) {
+  case tokenizer::SqlOperator::Equals:
+    apply(SqlNumberMatch<tokenizer::SqlOperator::Equals, T, V>{target});
+    break;
+  case tokenizer::SqlOperator::GreaterThan:
+    apply(SqlNumberMatch<tokenizer::SqlOperator::GreaterThan, T, V>{target});
+    break;
+  case tokenizer::SqlOperator::NotEqual:
+    apply(SqlNumberMatch<tokenizer::SqlOperator::NotEqual, T, V>{target});
+    break;
+  default:
+    panic("unknown op in `apply_number_match`");
+    break;
+  }
+}
+
+/// Call `apply` with the test for strings against a target.
+template <typename Apply>
+static void apply_string_match(tokenizer::SqlOperator op,
+                               const SmallString<MAX_TYPE_SIZE> &target,
+                               Apply &apply) {
+  const char *data = target.get_ptr();
+  size_t size = target.size();
+  switch (op) {
+  case tokenizer::SqlOperator::Equals:
+    apply(SqlStringMatch<tokenizer::SqlOperator::Equals>{data, size});
+    break;
+  case tokenizer::SqlOperator::GreaterThan:
+    apply(SqlStringMatch<tokenizer::SqlOperator::GreaterThan>{data, size});
+    break;
+  case tokenizer::SqlOperator::NotEqual:
+    apply(SqlStringMatch<tokenizer::SqlOperator::NotEqual>{data, size});
+    break;
+  default:
+    panic("unknown op in `apply_string_match`");
+    break;
+  }
+}
+
+/// Get the FLOAT a where clause value compares as
+static float float_target(const SqlValue &value) {
+  if (value.type() == SqlValueType::Integer)
+    return (float)value.get_integer();
+  return value.get_float();
+}
+
+/// Call `apply` with the test for a comparison.
+///
+/// This is the only switch on the comparison, so `apply` runs a loop
+/// specialized for it.
+template <typename Apply>
+static void apply_match(SqlPredicateKind kind,
+                        const parser::SqlWhereClause &where_clause,
+                        Apply &apply) {
+  tokenizer::SqlOperator op = where_clause.op;
+  const SqlValue &target = where_clause.value;
+  switch (kind) {
+  case SqlPredicateKind::All:
+    apply(SqlConstantMatch{true});
+    break;
+  case SqlPredicateKind::None:
+    apply(SqlConstantMatch{false});
+    break;
+  case SqlPredicateKind::Int:
+    apply_number_match<uint32_t>(op, target.get_integer(), apply);
+    break;
+  case SqlPredicateKind::IntFloat:
+    apply_number_match<uint32_t>(op, target.get_float(), apply);
+    break;
+  case SqlPredicateKind::Float:
+    apply_number_match<float>(op, float_target(target), apply);
+    break;
+  case SqlPredicateKind::String:
+    apply_string_match(op, target.get_string(), apply);
+    break;
+  default:
+    panic("unknown `SqlPredicateKind` in `apply_match`");
+    break;
+  }
+}
+
+/// Keeps the selected values that a test accepts.
+///
+/// Every position is written, and only kept ones are counted, so the loop
+/// does not branch on the result.
+struct SqlFilterApply {
+  /// The encoded values
+  const uint8_t *values;
+  /// The width of a value
+  size_t width;
+  /// The selected positions
+  std::vector<uint16_t> &selection;
+
+  template <typename Match> void operator()(Match match) {
+    size_t num_kept = 0;
+    for (size_t i = 0; i < this->selection.size(); i++) {
+      uint16_t position = this->selection[i];
+      this->selection[num_kept] = position;
+      num_kept += match(this->values + (position * this->width));
+    }
+    this->selection.resize(num_kept);
+  }
+};
+
+/// Clears the matches of the values that a test rejects.
+struct SqlMatchApply {
+  /// The encoded values
+  const uint8_t *values;
+  /// The width of a value
+  size_t width;
+  /// Set for each value that may match
+  std::vector<uint8_t> &matches;
+
+  template <typename Match> void operator()(Match match) {
+    for (size_t i = 0; i < this->matches.size(); i++)
+      this->matches[i] &= match(this->values + (i * this->width));
+  }
+};
+
+/// Keep the selected positions whose bit is set
+static void select_bitmap(const uint64_t *bitmap,
+                          std::vector<uint16_t> &selection) {
+  size_t num_kept = 0;
+  for (size_t i = 0; i < selection.size(); i++) {
+    uint16_t position = selection[i];
+    selection[num_kept] = position;
+    num_kept += (bitmap[position / 64] >> (position % 64)) & 1;
+  }
+  selection.resize(num_kept);
+}
+
+/// Make a predicate that matches every value
+SqlPredicate::SqlPredicate()
+    : m_kind(SqlPredicateKind::All), m_column(-1),
+      m_type{tokenizer::SqlType::INT, 1} {}
+
+/// Compile a where clause on a column of a type.
+void SqlPredicate::compile(const parser::SqlWhereClause &where_clause,
+                           size_t column, const parser::SqlType &type) {
+  this->m_column = column;
+  this->m_type = type;
+  this->m_where_clause = where_clause;
+
+  SqlValueType value_type = where_clause.value.type();
+  bool is_number = value_type == SqlValueType::Integer ||
+                   value_type == SqlValueType::Float;
+  switch (type.type) {
+  case tokenizer::SqlType::INT:
+    if (value_type == SqlValueType::Integer) {
+      this->m_kind = SqlPredicateKind::Int;
+      return;
+    }
+    if (value_type == SqlValueType::Float) {
+      this->m_kind = SqlPredicateKind::IntFloat;
+      return;
+    }
+    break;
+  case tokenizer::SqlType::FLOAT:
+    if (is_number) {
+      this->m_kind = SqlPredicateKind::Float;
+      return;
+    }
+    break;
+  case tokenizer::SqlType::CHAR:
+  case tokenizer::SqlType::VARCHAR:
+    if (value_type == SqlValueType::String) {
+      this->m_kind = SqlPredicateKind::String;
+      return;
+    }
+    break;
+  default:
+    panic("unknown `tokenizer::SqlType` in `SqlPredicate::compile`");
+    break;
+  }
+
+  // values of other types are never equal or greater
+  this->m_kind = where_clause.op == tokenizer::SqlOperator::NotEqual
+                     ? SqlPredicateKind::All
+                     : SqlPredicateKind::None;
+}
+
+/// Compile a where clause on the column it names.
+bool SqlPredicate::compile(
+    const parser::SqlWhereClause &where_clause,
+    const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns) {
+  for (size_t j = 0; j < columns.size(); j++) {
+    if (columns[j].name == where_clause.column_name) {
+      this->compile(where_clause, j, columns[j].type);
+      return true;
+    }
+  }
+
+  *this = SqlPredicate();
+  this->m_kind = SqlPredicateKind::None;
+  this->m_where_clause = where_clause;
+  return false;
+}
+
+/// Get the comparison
+SqlPredicateKind SqlPredicate::kind() const { return this->m_kind; }
+
+/// Get the column, or -1 if there is none
+size_t SqlPredicate::column() const { return this->m_column; }
+
+/// Get the type of the column
+const parser::SqlType &SqlPredicate::type() const { return this->m_type; }
+
+/// Get the where clause
+const parser::SqlWhereClause &SqlPredicate::where_clause() const {
+  return this->m_where_clause;
+}
+
+/// Keep only the selected rows of a batch whose value matches.
+void SqlPredicate::filter(SqlBatch &batch) const {
+  switch (this->m_kind) {
+  case SqlPredicateKind::All:
+    return;
+  case SqlPredicateKind::None:
+    batch.selection.clear();
+    return;
+  default:
+    break;
+  }
+
+  // INT and FLOAT values are packed, so every value is compared at once
+  // into a bitmap, several at a time.
+  const std::vector<uint8_t> &values = batch.columns[this->m_column];
+  size_t width = sql_type_width(this->m_type);
+  size_t num_values = values.size() / width;
+  assert(num_values <= SQL_BATCH_SIZE);
+  uint64_t bitmap[SQL_BATCH_SIZE / 64];
+  tokenizer::SqlOperator op = this->m_where_clause.op;
+  const SqlValue &target = this->m_where_clause.value;
+  switch (this->m_kind) {
+  case SqlPredicateKind::Int:
+    match_ints(best_filter_kernel(), values.data(), num_values, op,
+               target.get_integer(), bitmap);
+    select_bitmap(bitmap, batch.selection);
+    return;
+  case SqlPredicateKind::Float:
+    match_floats(best_filter_kernel(), values.data(), num_values, op,
+                 float_target(target), bitmap);
+    select_bitmap(bitmap, batch.selection);
+    return;
+  default:
+    break;
+  }
+
+  SqlFilterApply apply{values.data(), width, batch.selection};
+  apply_match(this->m_kind, this->m_where_clause, apply);
+}
+
+/// Clear `matches[i]` for the encoded values i that do not match.
+void SqlPredicate::match(const uint8_t *values,
+                         std::vector<uint8_t> &matches) const {
+  SqlMatchApply apply{values, sql_type_width(this->m_type), matches};
+  apply_match(this->m_kind, this->m_where_clause, apply);
+}
+} // namespace basic_sql
@@ -0,0 +1,46 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlSelectCursor.h"
+
+namespace basic_sql {
+/// Make a cursor that is not open
+SqlSelectCursor::SqlSelectCursor() : m_joined(false) {}
+
+/// Get the next row.
+///
+/// Returns false once every row was read.
+bool SqlSelectCursor::next(SmallVec<COLUMN_MAX, SqlValue> &row,
+                           SqlError &error) {
+  if (!this->m_joined)
+    return this->m_table_cursor.next(row, error);
+
+  if (this->m_positions.size() == 0)
+    return this->m_join_cursor.next(row, error);
+
+  // put the selected columns in order, dropping unselected join columns
+  SmallVec<COLUMN_MAX, SqlValue> joined_row;
+  if (!this->m_join_cursor.next(joined_row, error))
+    return false;
+  row = SmallVec<COLUMN_MAX, SqlValue>();
+  for (size_t i = 0; i < this->m_positions.size(); i++)
+    row.push(joined_row[this->m_positions[i]]);
+  return true;
+}
+
+/// Get the selected columns
+const SmallVec<COLUMN_MAX, parser::SqlColumn> &
+SqlSelectCursor::columns() const {
+  return this->m_columns;
+}
+
+/// Stop reading
+void SqlSelectCursor::close() {
+  this->m_columns = SmallVec<COLUMN_MAX, parser::SqlColumn>();
+  this->m_joined = false;
+  this->m_table_cursor.close();
+  this->m_join_cursor.close();
+  this->m_predicate = SqlPredicate();
+  this->m_positions = SmallVec<COLUMN_MAX, size_t>();
+}
+} // namespace basic_sql
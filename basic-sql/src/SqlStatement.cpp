@@ -47,6 +47,14 @@ SqlStatement::SqlStatement(SqlStatementBeginTransaction begin_transaction)
 SqlStatement::SqlStatement(SqlStatementCommitTransaction commit_transaction)
     : m_statement_type(SqlStatementType::COMMIT_TRANSACTION),
       m_commit_transaction(commit_transaction) {}
+/// Make a sql statement from a create index statement
+SqlStatement::SqlStatement(SqlStatementCreateIndex create_index)
+    : m_statement_type(SqlStatementType::CREATE_INDEX),
+      m_create_index(create_index) {}
+/// Make a sql statement from a drop index statement
+SqlStatement::SqlStatement(SqlStatementDropIndex drop_index)
+    : m_statement_type(SqlStatementType::DROP_INDEX), m_drop_index(drop_index) {
+}
 /// Copy constructor
 SqlStatement::SqlStatement(const SqlStatement &other) {
   this->m_statement_type = other.m_statement_type;
@@ -87,6 +95,12 @@ SqlStatement::SqlStatement(const SqlStatement &other) {
   case SqlStatementType::COMMIT_TRANSACTION:
     this->m_commit_transaction = other.m_commit_transaction;
     break;
+  case SqlStatementType::CREATE_INDEX:
+    this->m_create_index = other.m_create_index;
+    break;
+  case SqlStatementType::DROP_INDEX:
+    this->m_drop_index = other.m_drop_index;
+    break;
   default:
     panic("unknown sqlstatement type in copy constructor");
   }
@@ -165,5 +179,19 @@ SqlStatementDelete &SqlStatement::get_delete() {
   assert(this->m_statement_type == SqlStatementType::DELETE);
   return this->m_delete;
 }
+/// Get the create index statement
+///
+/// This must contain a create index statement
+SqlStatementCreateIndex &SqlStatement::create_index() {
+  assert(this->m_statement_type == SqlStatementType::CREATE_INDEX);
+  return this->m_create_index;
+}
+/// Get the drop index statement
+///
+/// This must contain a drop index statement
+SqlStatementDropIndex &SqlStatement::drop_index() {
+  assert(this->m_statement_type == SqlStatementType::DROP_INDEX);
+  return this->m_drop_index;
+}
 } // namespace parser
 } // namespace basic_sql
\ No newline at end of file
@@ -0,0 +1,303 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlTableCursor.h"
+#include "SqlPageCompression.h"
+#include <cstring>
+
+namespace basic_sql {
+/// Make a cursor that is not open
+SqlTableCursor::SqlTableCursor()
+    : m_table(nullptr), m_column_mask(0), m_indexed(false),
+      m_next_indexed(0), m_next_row(0), m_use_zones(false), m_zone_end(0),
+      m_page_slot(0), m_page_end_slot(0), m_page_first_row(0),
+      m_batch_next(0), m_row_id(0) {}
+
+/// Start reading the rows of a table that match a where clause.
+///
+/// Every column is kept if no column names are given.
+void SqlTableCursor::open(
+    SqlTableFile *table,
+    const SmallVec<COLUMN_MAX, SmallString<COLUMN_NAME_MAX_LENGTH>>
+        &column_names,
+    const parser::SqlWhereClause *where_clause, SqlError &error) {
+  this->close();
+  this->m_table = table;
+
+  const SmallVec<COLUMN_MAX, parser::SqlColumn> &columns = table->columns;
+  if (column_names.size() == 0) {
+    this->m_columns = columns;
+  } else {
+    for (size_t i = 0; i < column_names.size(); i++) {
+      int index = table->get_index_of_column_name(column_names[i]);
+      assert(index != -1);
+      this->m_column_indexes.push(index);
+      this->m_columns.push(columns[index]);
+    }
+  }
+
+  // a where clause on a missing column matches nothing
+  bool filtered = where_clause != nullptr &&
+                  this->m_predicate.compile(*where_clause, columns);
+
+  // only read the projected and filtered columns
+  if (this->m_column_indexes.size() == 0) {
+    this->m_column_mask = ((uint32_t)1 << columns.size()) - 1;
+  } else {
+    for (size_t i = 0; i < this->m_column_indexes.size(); i++)
+      this->m_column_mask |= (uint32_t)1 << this->m_column_indexes[i];
+  }
+  if (filtered)
+    this->m_column_mask |= (uint32_t)1 << this->m_predicate.column();
+
+  // scan from memory if possible, get_row falls back to reading the file.
+  table->m_file.map(error);
+  if (!error.is_ok())
+    return;
+
+  // only visit the rows an index finds, if there is one
+  this->m_indexed =
+      filtered && table->find_indexed_rows(*where_clause,
+                                           this->m_predicate.column(),
+                                           this->m_indexed_rows, error);
+  if (!error.is_ok())
+    return;
+  this->m_use_zones = filtered;
+
+  // rows put out of key order are only moved at a checkpoint, until then
+  // the primary key's tree gives the order.
+  if (!table->is_sorted() &&
+      (!this->m_indexed || this->m_indexed_rows.size() > 1)) {
+    table->primary_key_order(!this->m_indexed, this->m_indexed_rows, error);
+    if (!error.is_ok())
+      return;
+    this->m_indexed = true;
+  }
+}
+
+/// Get the next row.
+///
+/// Returns false once every row was read.
+bool SqlTableCursor::next(SmallVec<COLUMN_MAX, SqlValue> &row,
+                          SqlError &error) {
+  assert(this->m_table != nullptr);
+  SqlTableFile &table = *this->m_table;
+
+  while (true) {
+    // finish the batch being read first
+    if (this->m_batch_next < this->m_batch.selection.size()) {
+      size_t position = this->m_batch.selection[this->m_batch_next];
+      this->m_batch_next += 1;
+
+      SmallVec<COLUMN_MAX, SqlValue> table_row;
+      if (!decode_batch_row(this->m_batch, table.columns, this->m_column_mask,
+                            position, table_row)) {
+        error.set_invalid_file();
+        return false;
+      }
+      this->project(table_row, row);
+      this->m_row_id = this->m_batch.row_ids[position];
+      return true;
+    }
+
+    // then the compressed page being read
+    while (this->m_page_slot < this->m_page_end_slot) {
+      size_t k = this->m_page_slot;
+      this->m_page_slot += 1;
+      if (!this->m_matches[k])
+        continue;
+
+      SqlCompressedPage page(this->m_page.data());
+      SmallVec<COLUMN_MAX, SqlValue> table_row;
+      for (size_t j = 0; j < table.columns.size(); j++) {
+        SqlValue value;
+        if ((this->m_column_mask & ((uint32_t)1 << j)) != 0 &&
+            !page.decode_value(j, table.columns[j].type, k, value)) {
+          error.set_invalid_file();
+          return false;
+        }
+        table_row.push(value);
+      }
+      this->project(table_row, row);
+      this->m_row_id = this->m_page_first_row + k;
+      return true;
+    }
+
+    if (this->m_indexed) {
+      // the next batch of found rows
+      this->m_batch_rows.clear();
+      while (this->m_next_indexed < this->m_indexed_rows.size() &&
+             this->m_batch_rows.size() < SQL_BATCH_SIZE) {
+        uint64_t row_index = this->m_indexed_rows[this->m_next_indexed];
+        this->m_next_indexed += 1;
+        if (row_index < table.num_values && !table.is_row_deleted(row_index))
+          this->m_batch_rows.push_back(row_index);
+      }
+      if (this->m_batch_rows.empty())
+        return false;
+
+      this->read_batch(error);
+      if (!error.is_ok())
+        return false;
+      continue;
+    }
+
+    uint64_t i = this->m_next_row;
+    if (i >= table.num_values)
+      return false;
+
+    // row groups the zones rule out are skipped
+    if (this->m_use_zones && i >= this->m_zone_end) {
+      uint64_t next_row =
+          table.next_zone_row(this->m_predicate.where_clause(),
+                              this->m_predicate.column(), i, error);
+      if (!error.is_ok())
+        return false;
+      if (next_row != i) {
+        this->m_next_row = next_row;
+        continue;
+      }
+      this->m_zone_end = table.m_zone_map.next_group(i);
+    }
+
+    size_t entry = 0;
+    size_t slot = 0;
+    table.locate_row(i, entry, slot);
+    if (table.m_page_row_counts[entry] != 0) {
+      this->read_page(i, entry, slot, error);
+      if (!error.is_ok())
+        return false;
+      continue;
+    }
+
+    // a batch stays in a row group, and stops at a compressed page
+    uint64_t end_row = std::min<uint64_t>(i + SQL_BATCH_SIZE, table.num_values);
+    if (this->m_use_zones)
+      end_row = std::min(end_row, this->m_zone_end);
+    uint64_t page_end_row =
+        table.m_page_first_rows[entry] + table.page_num_rows(entry);
+    for (size_t next_entry = entry + 1;
+         page_end_row < end_row && table.m_page_row_counts[next_entry] == 0;
+         next_entry++)
+      page_end_row += table.page_num_rows(next_entry);
+    end_row = std::min(end_row, page_end_row);
+
+    this->m_batch_rows.clear();
+    for (uint64_t row_index = i; row_index < end_row; row_index++) {
+      if (!table.is_row_deleted(row_index))
+        this->m_batch_rows.push_back(row_index);
+    }
+    this->m_next_row = end_row;
+
+    this->read_batch(error);
+    if (!error.is_ok())
+      return false;
+  }
+}
+
+/// Get the id of the row `next` returned last
+uint64_t SqlTableCursor::row_id() const { return this->m_row_id; }
+
+/// Get the kept columns
+const SmallVec<COLUMN_MAX, parser::SqlColumn> &
+SqlTableCursor::columns() const {
+  return this->m_columns;
+}
+
+/// Stop reading, dropping any held page.
+void SqlTableCursor::close() {
+  this->m_table = nullptr;
+  this->m_columns = SmallVec<COLUMN_MAX, parser::SqlColumn>();
+  this->m_column_indexes = SmallVec<COLUMN_MAX, int>();
+  this->m_column_mask = 0;
+  this->m_predicate = SqlPredicate();
+  this->m_indexed = false;
+  this->m_indexed_rows.clear();
+  this->m_next_indexed = 0;
+  this->m_next_row = 0;
+  this->m_use_zones = false;
+  this->m_zone_end = 0;
+  std::vector<uint8_t>().swap(this->m_page);
+  std::vector<uint8_t>().swap(this->m_matches);
+  this->m_page_slot = 0;
+  this->m_page_end_slot = 0;
+  this->m_page_first_row = 0;
+  this->m_batch = SqlBatch();
+  std::vector<uint64_t>().swap(this->m_batch_rows);
+  this->m_batch_next = 0;
+  this->m_row_id = 0;
+}
+
+/// Keep the selected columns of a table row.
+void SqlTableCursor::project(const SmallVec<COLUMN_MAX, SqlValue> &table_row,
+                             SmallVec<COLUMN_MAX, SqlValue> &row) const {
+  if (this->m_column_indexes.size() == 0) {
+    row = table_row;
+    return;
+  }
+
+  row = SmallVec<COLUMN_MAX, SqlValue>();
+  for (size_t i = 0; i < this->m_column_indexes.size(); i++)
+    row.push(table_row[this->m_column_indexes[i]]);
+}
+
+/// Read the next batch of rows, selecting those that match the where
+/// clause.
+void SqlTableCursor::read_batch(SqlError &error) {
+  SqlTableFile &table = *this->m_table;
+  table.read_batch(this->m_batch_rows.data(), this->m_batch_rows.size(),
+                   this->m_column_mask, this->m_batch, error);
+  if (!error.is_ok())
+    return;
+  this->m_batch_next = 0;
+  this->m_predicate.filter(this->m_batch);
+}
+
+/// Read a compressed page from a row on, marking the rows that may match.
+///
+/// The page is scanned to the end from this row. Rows are filtered on the
+/// encoded column, so only the rows that match are decoded.
+void SqlTableCursor::read_page(uint64_t row_index, size_t entry, size_t slot,
+                               SqlError &error) {
+  SqlTableFile &table = *this->m_table;
+  size_t end_slot = std::min<uint64_t>(table.m_page_row_counts[entry],
+                                       slot + (table.num_values - row_index));
+
+  // keep a copy, the mapping is not held between rows
+  this->m_page.resize(STORAGE_PAGE_SIZE);
+  const uint8_t *data = table.page_data(entry, this->m_page.data(), error);
+  if (!error.is_ok())
+    return;
+  if (data != this->m_page.data())
+    memcpy(this->m_page.data(), data, STORAGE_PAGE_SIZE);
+  SqlCompressedPage page(this->m_page.data());
+
+  this->m_matches.assign(end_slot, 0);
+  for (size_t k = slot; k < end_slot; k++)
+    this->m_matches[k] = !table.is_row_deleted(row_index + (k - slot));
+  if (this->m_use_zones) {
+    // the page may span more row groups
+    uint64_t end_row = row_index + (end_slot - slot);
+    for (uint64_t row = this->m_zone_end; row < end_row;
+         row = table.m_zone_map.next_group(row)) {
+      bool may_match = table.zone_may_match(this->m_predicate.where_clause(),
+                                            this->m_predicate.column(), row,
+                                            error);
+      if (!error.is_ok())
+        return;
+      if (may_match)
+        continue;
+      uint64_t group_end =
+          std::min(table.m_zone_map.next_group(row), end_row);
+      for (uint64_t k = row; k < group_end; k++)
+        this->m_matches[slot + (k - row_index)] = 0;
+    }
+  }
+  page.match(this->m_predicate, this->m_matches);
+
+  this->m_page_slot = slot;
+  this->m_page_end_slot = end_slot;
+  this->m_page_first_row = row_index - slot;
+  this->m_next_row = row_index + (end_slot - slot);
+}
+} // namespace basic_sql
@@ -2,33 +2,70 @@
 /// Date: 10-17-2021
 
 #include "SqlTableFile.h"
+#include "SqlTableCursor.h"
+#include <algorithm>
 
 namespace basic_sql {
 /// Create a new unopened file
-SqlTableFile::SqlTableFile(std::string name)
-    : m_file(name), num_columns(0), num_values(0) {}
+SqlTableFile::SqlTableFile(std::string name, SqlBufferPool *buffer_pool)
+    : m_file(name, buffer_pool), num_columns(0), num_values(0),
+      m_layout(parser::SqlTableLayout::ROW), m_primary_key(-1),
+      m_sorted(true), m_row_size(0), m_rows_per_page(0), m_num_pages(0) {}
 SqlTableFile::SqlTableFile(SqlTableFile &&other) noexcept
     : m_file(std::move(other.m_file)), num_columns(other.num_columns),
-      columns(other.columns), num_values(other.num_values) {}
+      num_values(other.num_values), columns(other.columns),
+      m_layout(other.m_layout), m_primary_key(other.m_primary_key),
+      m_sorted(other.m_sorted), m_column_offsets(other.m_column_offsets),
+      m_row_size(other.m_row_size),
+      m_rows_per_page(other.m_rows_per_page),
+      m_num_pages(other.m_num_pages),
+      m_directory_pages(std::move(other.m_directory_pages)),
+      m_page_directory(std::move(other.m_page_directory)),
+      m_page_row_counts(std::move(other.m_page_row_counts)),
+      m_page_first_rows(std::move(other.m_page_first_rows)),
+      m_free_pages(std::move(other.m_free_pages)),
+      m_tombstone_pages(std::move(other.m_tombstone_pages)),
+      m_tombstones(std::move(other.m_tombstones)),
+      m_free_rows(std::move(other.m_free_rows)),
+      m_indexes(std::move(other.m_indexes)),
+      m_zone_map(std::move(other.m_zone_map)) {}
 SqlTableFile &SqlTableFile::operator=(SqlTableFile &&other) {
   SqlError error;
   this->close(error);
   this->m_file = std::move(other.m_file);
   this->num_columns = other.num_columns;
-  this->columns = other.columns;
   this->num_values = other.num_values;
+  this->columns = other.columns;
+  this->m_layout = other.m_layout;
+  this->m_primary_key = other.m_primary_key;
+  this->m_sorted = other.m_sorted;
+  this->m_column_offsets = other.m_column_offsets;
+  this->m_row_size = other.m_row_size;
+  this->m_rows_per_page = other.m_rows_per_page;
+  this->m_num_pages = other.m_num_pages;
+  this->m_directory_pages = std::move(other.m_directory_pages);
+  this->m_page_directory = std::move(other.m_page_directory);
+  this->m_page_row_counts = std::move(other.m_page_row_counts);
+  this->m_page_first_rows = std::move(other.m_page_first_rows);
+  this->m_free_pages = std::move(other.m_free_pages);
+  this->m_tombstone_pages = std::move(other.m_tombstone_pages);
+  this->m_tombstones = std::move(other.m_tombstones);
+  this->m_free_rows = std::move(other.m_free_rows);
+  this->m_indexes = std::move(other.m_indexes);
+  this->m_zone_map = std::move(other.m_zone_map);
   return *this;
 }
 
 /// Update the num_values field
-void SqlTableFile::update_num_values(uint8_t new_num_values, SqlError &error) {
+void SqlTableFile::update_num_values(uint64_t new_num_values,
+                                     SqlError &error) {
   // seek to field
   this->m_file.seek(SQL_TABLE_FILE_VALUES_OFFSET, error);
   if (!error.is_ok())
     return;
 
   // write new data
-  this->m_file.write(&new_num_values, 1, error);
+  this->m_file.write((const uint8_t *)&new_num_values, 8, error);
   if (!error.is_ok())
     return;
 
@@ -37,7 +74,179 @@ void SqlTableFile::update_num_values(uint8_t new_num_values, SqlError &error) {
 }
 
 /// get the number of values
-uint8_t SqlTableFile::get_num_values() { return this->num_values; }
+uint64_t SqlTableFile::get_num_values() { return this->num_values; }
+
+/// Get the id a new row gets.
+///
+/// Rows of a primary key table are appended while their keys arrive in order,
+/// so the table stays sorted. A row whose key does not go last is placed like
+/// any other row, and the table is marked unsorted.
+uint64_t SqlTableFile::next_row_id(const SmallVec<COLUMN_MAX, SqlValue> &row,
+                                   SqlError &error) {
+  if (this->m_primary_key == -1 || !this->m_sorted || this->num_values == 0)
+    return this->next_row_id();
+
+  // deleted rows are trimmed off the end, so the last row is live and has the
+  // largest key.
+  size_t column = this->m_primary_key;
+  SmallVec<COLUMN_MAX, SqlValue> last_row;
+  this->get_row_columns(this->num_values - 1, (uint32_t)1 << column, last_row,
+                        error);
+  if (!error.is_ok())
+    return 0;
+  if (row[column] > last_row[column])
+    return this->num_values;
+
+  this->set_sorted(false, error);
+  return this->next_row_id();
+}
+
+/// Make a column the primary key.
+void SqlTableFile::set_primary_key(size_t column, SqlError &error) {
+  uint8_t primary_key = column + 1;
+  this->m_file.write_at(SQL_TABLE_FILE_PRIMARY_KEY_OFFSET, &primary_key, 1,
+                        error);
+  if (!error.is_ok())
+    return;
+
+  this->m_primary_key = column;
+}
+
+/// Set whether the rows are in key order.
+void SqlTableFile::set_sorted(bool sorted, SqlError &error) {
+  if (this->m_sorted == sorted)
+    return;
+
+  uint8_t sorted_field = sorted;
+  this->m_file.write_at(SQL_TABLE_FILE_SORTED_OFFSET, &sorted_field, 1, error);
+  if (!error.is_ok())
+    return;
+
+  this->m_sorted = sorted;
+}
+
+/// Find the live row with a primary key value.
+///
+/// Returns false if there is none.
+bool SqlTableFile::find_primary_key(const SqlValue &value, uint64_t &row_id,
+                                    SqlError &error) {
+  size_t column = this->m_primary_key;
+  parser::SqlWhereClause where_clause{this->columns[column].name,
+                                      tokenizer::SqlOperator::Equals, value};
+  SqlPredicate predicate;
+  predicate.compile(where_clause, column, this->columns[column].type);
+
+  // the key index finds the row, unless the value has another type
+  std::vector<uint64_t> indexed_rows;
+  bool indexed =
+      this->find_indexed_rows(where_clause, column, indexed_rows, error);
+  if (!error.is_ok())
+    return false;
+  uint64_t num_rows = indexed ? indexed_rows.size() : this->num_values;
+
+  std::vector<uint64_t> candidates;
+  std::vector<uint64_t> found_rows;
+  for (uint64_t i = 0; i < num_rows && found_rows.empty();) {
+    uint64_t end = std::min<uint64_t>(i + SQL_BATCH_SIZE, num_rows);
+    candidates.clear();
+    for (; i < end; i++)
+      candidates.push_back(indexed ? indexed_rows[i] : i);
+
+    this->filter_rows(predicate, candidates, found_rows, error);
+    if (!error.is_ok())
+      return false;
+  }
+  if (found_rows.empty())
+    return false;
+
+  row_id = found_rows[0];
+  return true;
+}
+
+/// Returns true if a column has an index.
+bool SqlTableFile::has_index(size_t column) const {
+  for (size_t i = 0; i < this->m_indexes.size(); i++) {
+    if (this->m_indexes[i].column == column)
+      return true;
+  }
+  return false;
+}
+
+/// Find the live rows whose value of a column equals a value, with an index of
+/// the column.
+///
+/// Returns false if no index can answer, so every row must be scanned.
+bool SqlTableFile::find_equal_rows(size_t column, const SqlValue &value,
+                                   std::vector<uint64_t> &row_ids,
+                                   SqlError &error) {
+  // every value of a string column fits its width, so a longer string
+  // matches nothing.
+  const parser::SqlType &type = this->columns[column].type;
+  if ((type.type == tokenizer::SqlType::CHAR ||
+       type.type == tokenizer::SqlType::VARCHAR) &&
+      value.type() == SqlValueType::String &&
+      sql_value_encoded_size(value) > sql_type_width(type))
+    return this->has_index(column);
+
+  parser::SqlWhereClause where_clause{this->columns[column].name,
+                                      tokenizer::SqlOperator::Equals, value};
+  std::vector<uint64_t> indexed_rows;
+  if (!this->find_indexed_rows(where_clause, column, indexed_rows, error))
+    return false;
+
+  // candidates may be stale, so they are checked again
+  SqlPredicate predicate;
+  predicate.compile(where_clause, column, type);
+  this->filter_rows(predicate, indexed_rows, row_ids, error);
+  return error.is_ok();
+}
+
+/// Find the writes that sort a primary key table.
+void SqlTableFile::sort_rows(std::vector<BufferedRow> &moved_rows,
+                             std::vector<uint64_t> &deleted_rows,
+                             SqlError &error) {
+  // scan from memory if possible
+  this->m_file.map(error);
+  if (!error.is_ok())
+    return;
+
+  // the key of every live row
+  size_t column = this->m_primary_key;
+  std::vector<std::pair<SqlValue, uint64_t>> keys;
+  for (uint64_t row_index = 0; row_index < this->num_values; row_index++) {
+    if (this->is_row_deleted(row_index))
+      continue;
+
+    SmallVec<COLUMN_MAX, SqlValue> row;
+    this->get_row_columns(row_index, (uint32_t)1 << column, row, error);
+    if (!error.is_ok())
+      return;
+    keys.push_back({row[column], row_index});
+  }
+  std::sort(keys.begin(), keys.end(),
+            [](const std::pair<SqlValue, uint64_t> &lhs,
+               const std::pair<SqlValue, uint64_t> &rhs) {
+              return rhs.first > lhs.first;
+            });
+
+  // move the rows that are out of place
+  for (uint64_t row_index = 0; row_index < keys.size(); row_index++) {
+    if (keys[row_index].second == row_index)
+      continue;
+
+    SmallVec<COLUMN_MAX, SqlValue> row;
+    this->get_row(keys[row_index].second, row, error);
+    if (!error.is_ok())
+      return;
+    moved_rows.push_back(BufferedRow{row_index, row});
+  }
+
+  for (uint64_t row_index = keys.size(); row_index < this->num_values;
+       row_index++) {
+    if (!this->is_row_deleted(row_index))
+      deleted_rows.push_back(row_index);
+  }
+}
 
 /// Add a column.
 void SqlTableFile::add_column(const parser::SqlColumn &column,
@@ -48,6 +257,20 @@ void SqlTableFile::add_column(const parser::SqlColumn &column,
     return;
   }
 
+  // columnar rows are written again from scratch, read them before the
+  // columns change.
+  std::vector<SmallVec<COLUMN_MAX, SqlValue>> rows;
+  if (this->m_layout == parser::SqlTableLayout::COLUMNAR) {
+    rows.reserve(this->num_values);
+    for (uint64_t index = 0; index < this->num_values; index++) {
+      SmallVec<COLUMN_MAX, SqlValue> row;
+      this->get_row(index, row, error);
+      if (!error.is_ok())
+        return;
+      rows.push_back(row);
+    }
+  }
+
   // seek to position
   this->seek_to_column_index(this->num_columns, error);
   if (!error.is_ok())
@@ -72,6 +295,20 @@ void SqlTableFile::add_column(const parser::SqlColumn &column,
   this->update_num_columns(this->num_columns + 1, error);
   if (!error.is_ok())
     return;
+
+  // widen existing rows to fit the new column
+  size_t old_row_size = this->m_row_size;
+  size_t old_rows_per_page = this->m_rows_per_page;
+  this->update_row_layout();
+  if (this->num_values != 0) {
+    if (this->m_layout == parser::SqlTableLayout::COLUMNAR) {
+      this->rebuild_rows(rows, error);
+    } else {
+      this->relayout_rows(old_row_size, old_rows_per_page, error);
+    }
+    if (!error.is_ok())
+      return;
+  }
 }
 
 /// seek to a column by index.
@@ -114,79 +351,1850 @@ void SqlTableFile::query_rows(
         &column_names,
     const parser::SqlWhereClause *where_clause, QueryRowsResult &result,
     SqlError &error) {
-  SmallVec<COLUMN_MAX, int> column_name_indicies;
+  SqlTableCursor cursor;
+  cursor.open(this, column_names, where_clause, error);
+  if (!error.is_ok())
+    return;
+  result.columns = cursor.columns();
 
-  if (column_names.size() == 0) {
-    result.columns = this->columns;
-  } else {
-    for (size_t i = 0; i < column_names.size(); i++) {
-      int index = this->get_index_of_column_name(column_names[i]);
-      assert(index != -1);
-      column_name_indicies.push(index);
-      result.columns.push(this->columns[index]);
+  SmallVec<COLUMN_MAX, SqlValue> row;
+  while (cursor.next(row, error))
+    result.rows.push_back(row);
+}
+
+/// Write rows by id, like `put_row`.
+///
+/// `rows` must be sorted by id. Rows in the same compressed page rewrite it
+/// once.
+void SqlTableFile::put_rows(const std::vector<BufferedRow> &rows,
+                            SqlError &error) {
+  // overwrite the rows that exist, bringing back deleted ones
+  size_t num_existing = 0;
+  while (num_existing < rows.size() &&
+         rows[num_existing].row_index < this->num_values)
+    num_existing++;
+  std::vector<BufferedRow> existing_rows(rows.begin(),
+                                         rows.begin() + num_existing);
+  this->write_rows(existing_rows, error);
+  if (!error.is_ok())
+    return;
+
+  std::vector<BufferedRow> new_rows(rows.begin() + num_existing, rows.end());
+  this->update_indexes(new_rows, error);
+  if (!error.is_ok())
+    return;
+
+  std::vector<uint64_t> revived_rows;
+  for (size_t i = 0; i < num_existing; i++) {
+    if (this->is_row_deleted(rows[i].row_index))
+      revived_rows.push_back(rows[i].row_index);
+  }
+  this->write_tombstones(revived_rows, false, error);
+  if (!error.is_ok())
+    return;
+  for (size_t i = 0; i < revived_rows.size(); i++)
+    this->m_free_rows.erase(revived_rows[i]);
+
+  // append the rest, one row at a time so every page gets allocated.
+  std::vector<uint64_t> skipped_rows;
+  for (size_t i = num_existing; i < rows.size(); i++) {
+    while (this->num_values <= rows[i].row_index) {
+      if (this->num_values == rows[i].row_index) {
+        this->insert(this->num_values, rows[i].row, error);
+      } else {
+        skipped_rows.push_back(this->num_values);
+        this->insert(this->num_values, SmallVec<COLUMN_MAX, SqlValue>(),
+                     error);
+      }
+      if (!error.is_ok())
+        return;
+      this->update_num_values(this->num_values + 1, error);
+      if (!error.is_ok())
+        return;
+    }
+  }
+
+  // rows skipped over are deleted
+  this->write_tombstones(skipped_rows, true, error);
+  if (!error.is_ok())
+    return;
+  this->m_free_rows.insert(skipped_rows.begin(), skipped_rows.end());
+}
+
+/// Mark rows deleted, by id.
+///
+/// Their slots are reused by later inserts. Deleted rows at the end of the
+/// table are trimmed off.
+void SqlTableFile::delete_row_ids(const std::vector<uint64_t> &rows,
+                                  SqlError &error) {
+  if (rows.empty())
+    return;
+
+  this->remove_index_keys(rows, error);
+  if (!error.is_ok())
+    return;
+
+  this->write_tombstones(rows, true, error);
+  if (!error.is_ok())
+    return;
+  this->m_free_rows.insert(rows.begin(), rows.end());
+  for (size_t i = 0; i < rows.size(); i++)
+    this->m_zone_map.mark_stale(rows[i]);
+
+  this->trim_deleted_rows(error);
+}
+
+/// Overwrite rows, in order.
+///
+/// Runs of rows in the same compressed page rewrite it once.
+void SqlTableFile::write_rows(const std::vector<BufferedRow> &rows,
+                              SqlError &error) {
+  this->update_indexes(rows, error);
+  if (!error.is_ok())
+    return;
+
+  for (size_t i = 0; i < rows.size();) {
+    size_t entry = 0;
+    size_t slot = 0;
+    if (rows[i].row_index < this->row_capacity())
+      this->locate_row(rows[i].row_index, entry, slot);
+
+    if (rows[i].row_index >= this->row_capacity() ||
+        this->m_page_row_counts[entry] == 0) {
+      this->insert(rows[i].row_index, rows[i].row, error);
+      if (!error.is_ok())
+        return;
+
+      i += 1;
+      continue;
+    }
+
+    // decode the page once for the whole run
+    std::vector<std::vector<uint8_t>> column_values;
+    this->read_compressed_rows(entry, column_values, error);
+    if (!error.is_ok())
+      return;
+
+    uint64_t first_row = this->m_page_first_rows[entry];
+    uint64_t end_row = first_row + this->m_page_row_counts[entry];
+    for (; i < rows.size() && rows[i].row_index >= first_row &&
+           rows[i].row_index < end_row;
+         i++) {
+      this->check_row(rows[i].row, error);
+      if (!error.is_ok())
+        return;
+
+      uint8_t buffer[ROW_MAX_SIZE];
+      encode_row(rows[i].row, this->columns, buffer);
+      this->m_zone_map.mark_stale(rows[i].row_index);
+      this->add_zone_values(rows[i].row_index, buffer);
+      slot = rows[i].row_index - first_row;
+      for (size_t j = 0; j < this->columns.size(); j++) {
+        size_t width = sql_type_width(this->columns[j].type);
+        memcpy(column_values[j].data() + (slot * width),
+               buffer + this->m_column_offsets[j], width);
+      }
+    }
+
+    this->store_compressed_rows(entry, column_values,
+                                this->m_page_row_counts[entry], error);
+    if (!error.is_ok())
+      return;
+    this->update_page_first_rows();
+    this->write_page_directory(entry, error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Get some columns of a row at a given index
+///
+/// bit j of `column_mask` selects column j. the row gets a value for every
+/// column, but columns that are not selected are left null and are not read.
+void SqlTableFile::get_row_columns(size_t index, uint32_t column_mask,
+                                   SmallVec<COLUMN_MAX, SqlValue> &row,
+                                   SqlError &error) {
+  assert(index < this->row_capacity());
+  const uint8_t *mapped_data = this->m_file.mapped_data();
+
+  if (this->m_layout == parser::SqlTableLayout::ROW) {
+    uint64_t position =
+        this->row_position(index, this->m_row_size, this->m_rows_per_page);
+
+    // decode straight from the mapping if it is still good, otherwise read
+    // the whole row in one go.
+    uint8_t buffer[ROW_MAX_SIZE];
+    const uint8_t *data = buffer;
+    if (mapped_data != nullptr) {
+      assert(position + this->m_row_size <= this->m_file.mapped_size());
+      data = mapped_data + position;
+    } else {
+      this->m_file.read_at(position, buffer, this->m_row_size, error);
+      if (!error.is_ok())
+        return;
+    }
+
+    for (size_t j = 0; j < this->columns.size(); j++) {
+      SqlValue value;
+      if ((column_mask & ((uint32_t)1 << j)) != 0 &&
+          !decode_sql_value(value, this->columns[j].type,
+                            data + this->m_column_offsets[j])) {
+        error.set_invalid_file();
+        return;
+      }
+      row.push(value);
     }
+    return;
   }
 
-  size_t column_index = -1;
+  // columnar, compressed pages decode values where they are.
+  size_t entry = 0;
+  size_t slot = 0;
+  this->locate_row(index, entry, slot);
+  if (this->m_page_row_counts[entry] != 0) {
+    uint8_t buffer[STORAGE_PAGE_SIZE];
+    const uint8_t *data = this->page_data(entry, buffer, error);
+    if (!error.is_ok())
+      return;
+    SqlCompressedPage page(data);
 
-  if (where_clause != nullptr) {
-    // find where clause column index
     for (size_t j = 0; j < this->columns.size(); j++) {
-      if (this->columns[j].name == where_clause->column_name) {
-        column_index = j;
+      SqlValue value;
+      if ((column_mask & ((uint32_t)1 << j)) != 0 &&
+          !page.decode_value(j, this->columns[j].type, slot, value)) {
+        error.set_invalid_file();
+        return;
+      }
+      row.push(value);
+    }
+    return;
+  }
+
+  // every column is in a different part of the page.
+  for (size_t j = 0; j < this->columns.size(); j++) {
+    SqlValue value;
+    if ((column_mask & ((uint32_t)1 << j)) != 0) {
+      uint64_t position = this->value_position(entry, slot, j);
+      size_t width = sql_type_width(this->columns[j].type);
+
+      uint8_t buffer[1 + MAX_TYPE_SIZE];
+      const uint8_t *data = buffer;
+      if (mapped_data != nullptr) {
+        assert(position + width <= this->m_file.mapped_size());
+        data = mapped_data + position;
+      } else {
+        this->m_file.read_at(position, buffer, width, error);
+        if (!error.is_ok())
+          return;
+      }
+      if (!decode_sql_value(value, this->columns[j].type, data)) {
+        error.set_invalid_file();
+        return;
       }
     }
+    row.push(value);
+  }
+}
+
+/// Rewrite a table in the format before pages in this format, then open it.
+void SqlTableFile::convert_old_format(SqlError &error) {
+  // the old column data is the same, it just starts right after the old magic
+  this->m_file.seek(SQL_TABLE_FILE_OLD_MAGIC_SIZE, error);
+  if (!error.is_ok())
+    return;
+  uint8_t old_num_columns = 0;
+  this->m_file.read(&old_num_columns, 1, error);
+  if (!error.is_ok())
+    return;
+  if (old_num_columns > COLUMN_MAX) {
+    error.set_invalid_file();
+    return;
+  }
+  SmallVec<COLUMN_MAX, parser::SqlColumn> old_columns;
+  for (size_t i = 0; i < old_num_columns; i++) {
+    parser::SqlColumn column;
+    read_small_string_from_file(column.name, this->m_file, error);
+    if (!error.is_ok())
+      return;
+    read_sql_type(column.type, this->m_file, error);
+    if (!error.is_ok())
+      return;
+    old_columns.push(column);
+  }
+
+  // read the u8 num_values
+  this->m_file.seek(SQL_TABLE_FILE_OLD_VALUES_OFFSET, error);
+  if (!error.is_ok())
+    return;
+  uint8_t old_num_values = 0;
+  this->m_file.read(&old_num_values, 1, error);
+  if (!error.is_ok())
+    return;
+
+  // build the new table next to this one, so a failure leaves the old file.
+  std::string converted_name = this->file_name() + ".convert";
+  SqlTableFile converted(converted_name);
+  converted.open(true, error);
+  if (!error.is_ok())
+    return;
+  for (size_t i = 0; i < old_columns.size(); i++) {
+    converted.add_column(old_columns[i], error);
+    if (!error.is_ok())
+      return;
   }
 
-  for (size_t i = 0; i < this->num_values; i++) {
-    // seek to values
-    this->seek_to_value_index(i, error);
+  // copy the rows. every old value has a MAX_TYPE_SIZE slot.
+  uint8_t old_row[COLUMN_MAX * MAX_TYPE_SIZE];
+  for (size_t i = 0; i < old_num_values; i++) {
+    this->m_file.seek(SQL_TABLE_FILE_OLD_VALUES_OFFSET + 1 +
+                          (i * sizeof(old_row)),
+                      error);
+    if (!error.is_ok())
+      return;
+    this->m_file.read(old_row, sizeof(old_row), error);
     if (!error.is_ok())
       return;
 
     SmallVec<COLUMN_MAX, SqlValue> row;
+    for (size_t j = 0; j < old_columns.size(); j++) {
+      const uint8_t *slot = old_row + (j * MAX_TYPE_SIZE);
+      SqlValue value;
+      switch (old_columns[j].type.type) {
+      case tokenizer::SqlType::INT: {
+        uint32_t integer = 0;
+        memcpy(&integer, slot, 4);
+        value.set_integer(integer);
+        break;
+      }
+      case tokenizer::SqlType::FLOAT: {
+        float float_value = 0.0;
+        memcpy(&float_value, slot, 4);
+        value.set_float(float_value);
+        break;
+      }
+      case tokenizer::SqlType::VARCHAR:
+      case tokenizer::SqlType::CHAR: {
+        // a u8 length, then the string
+        uint8_t size = slot[0];
+        if (size >= MAX_TYPE_SIZE) {
+          error.set_invalid_file();
+          return;
+        }
+        value.set_string((const char *)slot + 1, size);
+        break;
+      }
+      default:
+        panic("unknown type in `SqlTableFile::convert_old_format`");
+      }
+      row.push(value);
+    }
 
-    // read row
-    this->get_row(i, row, error);
+    converted.insert(i, row, error);
+    if (!error.is_ok())
+      return;
+    converted.update_num_values(i + 1, error);
     if (!error.is_ok())
       return;
+  }
+  converted.close(error);
+  if (!error.is_ok())
+    return;
 
-    if ((where_clause != nullptr &&
-         where_clause->value_matches(row[column_index])) ||
-        where_clause == nullptr) {
+  // replace the old file
+  this->m_file.close(error);
+  if (!error.is_ok())
+    return;
+  if (rename(converted_name.c_str(), this->file_name().c_str()) != 0) {
+    error.set_io();
+    return;
+  }
+  this->open(false, error);
+}
 
-      // append row to result
-      if (column_name_indicies.size() == 0) {
-        result.rows.push_back(row);
-      } else {
-        SmallVec<COLUMN_MAX, SqlValue> result_row;
-        for (size_t i = 0; i < column_name_indicies.size(); i++) {
-          result_row.push(row[column_name_indicies[i]]);
+/// Read some columns of a batch of live rows, and select them all.
+///
+/// The encoded values of each page are copied a column at a time.
+void SqlTableFile::read_batch(const uint64_t *row_ids, size_t num_rows,
+                              uint32_t column_mask, SqlBatch &batch,
+                              SqlError &error) {
+  assert(num_rows <= SQL_BATCH_SIZE);
+  batch.row_ids.assign(row_ids, row_ids + num_rows);
+  batch.columns.resize(this->columns.size());
+  for (size_t j = 0; j < this->columns.size(); j++)
+    batch.columns[j].clear();
+
+  // the rows of the batch in each page they are in
+  std::vector<size_t> span_ends;
+  std::vector<size_t> span_entries;
+  for (size_t i = 0; i < num_rows;) {
+    size_t entry = 0;
+    size_t slot = 0;
+    this->locate_row(row_ids[i], entry, slot);
+    uint64_t page_first_row = this->m_page_first_rows[entry];
+    uint64_t page_end_row = page_first_row + this->page_num_rows(entry);
+    size_t end = i + 1;
+    while (end < num_rows && row_ids[end] >= page_first_row &&
+           row_ids[end] < page_end_row)
+      end++;
+
+    span_ends.push_back(end);
+    span_entries.push_back(entry);
+    i = end;
+  }
+
+  // without a mapping, the pages are read up front in as few reads as
+  // possible, instead of one at a time.
+  const uint8_t *mapped_data = this->m_file.mapped_data();
+  std::vector<uint8_t> pages;
+  if (mapped_data == nullptr) {
+    this->read_pages(span_entries, pages, error);
+    if (!error.is_ok())
+      return;
+  }
+
+  size_t i = 0;
+  for (size_t span = 0; span < span_entries.size(); span++) {
+    size_t entry = span_entries[span];
+    size_t end = span_ends[span];
+    uint64_t page_first_row = this->m_page_first_rows[entry];
+
+    const uint8_t *data = pages.data() + (span * STORAGE_PAGE_SIZE);
+    if (mapped_data != nullptr)
+      data = mapped_data + (this->m_page_directory[entry] * STORAGE_PAGE_SIZE);
+    bool compressed = this->m_page_row_counts[entry] != 0;
+    SqlCompressedPage page(data);
+
+    for (size_t j = 0; j < this->columns.size(); j++) {
+      if ((column_mask & ((uint32_t)1 << j)) == 0)
+        continue;
+      const parser::SqlType &type = this->columns[j].type;
+      size_t width = sql_type_width(type);
+      std::vector<uint8_t> &values = batch.columns[j];
+      size_t position = values.size();
+      values.resize(position + ((end - i) * width));
+      uint8_t *out = values.data() + position;
+
+      if (compressed) {
+        for (size_t k = i; k < end; k++, out += width)
+          page.copy_value(j, type, row_ids[k] - page_first_row, out);
+      } else if (this->m_layout == parser::SqlTableLayout::ROW) {
+        const uint8_t *column_data = data + this->m_column_offsets[j];
+        for (size_t k = i; k < end; k++, out += width) {
+          memcpy(out,
+                 column_data + ((row_ids[k] - page_first_row) *
+                                this->m_row_size),
+                 width);
         }
-        result.rows.push_back(result_row);
+      } else {
+        // a columnar page holds the values of a column back to back
+        const uint8_t *column_data =
+            data + (this->m_rows_per_page * this->m_column_offsets[j]);
+        for (size_t k = i; k < end; k++, out += width)
+          memcpy(out, column_data + ((row_ids[k] - page_first_row) * width),
+                 width);
       }
     }
+
+    i = end;
   }
+
+  select_all(batch);
 }
 
-/// Get the columns
-const SmallVec<COLUMN_MAX, parser::SqlColumn> &
-SqlTableFile::get_columns() const {
-  return this->columns;
+/// Find the live rows of a list that match a predicate on a column of this
+/// table.
+void SqlTableFile::filter_rows(const SqlPredicate &predicate,
+                               const std::vector<uint64_t> &candidates,
+                               std::vector<uint64_t> &row_ids,
+                               SqlError &error) {
+  assert(predicate.column() < this->columns.size());
+  uint32_t column_mask = (uint32_t)1 << predicate.column();
+
+  std::vector<uint64_t> batch_rows;
+  SqlBatch batch;
+  size_t i = 0;
+  while (i < candidates.size()) {
+    batch_rows.clear();
+    for (; i < candidates.size() && batch_rows.size() < SQL_BATCH_SIZE; i++) {
+      uint64_t row_index = candidates[i];
+      if (row_index < this->num_values && !this->is_row_deleted(row_index))
+        batch_rows.push_back(row_index);
+    }
+    if (batch_rows.empty())
+      continue;
+
+    this->read_batch(batch_rows.data(), batch_rows.size(), column_mask, batch,
+                     error);
+    if (!error.is_ok())
+      return;
+    predicate.filter(batch);
+    for (size_t k = 0; k < batch.selection.size(); k++)
+      row_ids.push_back(batch.row_ids[batch.selection[k]]);
+  }
 }
 
-/// remove the table file and close this file.
-void SqlTableFile::remove_file(SqlError &error) {
-  this->m_file.remove_file(error);
-  if (!error.is_ok())
-    return;
+/// Load the page directory, starting at the given directory page.
+void SqlTableFile::load_page_directory(uint64_t first_directory_page,
+                                       SqlError &error) {
+  this->m_directory_pages.clear();
+  this->m_page_directory.clear();
+  this->m_page_row_counts.clear();
+
+  // walk the directory chain. page 0 is the header, so it ends the chain.
+  uint64_t directory_page = first_directory_page;
+  while (directory_page != 0) {
+    // a page past the end, or a chain longer than the file, is corrupt.
+    if (directory_page >= this->m_num_pages ||
+        this->m_directory_pages.size() >= this->m_num_pages) {
+      error.set_invalid_file();
+      return;
+    }
+
+    this->m_file.seek(directory_page * STORAGE_PAGE_SIZE, error);
+    if (!error.is_ok())
+      return;
+
+    // read header
+    uint64_t next_directory_page = 0;
+    this->m_file.read((uint8_t *)&next_directory_page, 8, error);
+    if (!error.is_ok())
+      return;
+    uint32_t num_entries = 0;
+    this->m_file.read((uint8_t *)&num_entries, 4, error);
+    if (!error.is_ok())
+      return;
+    if (num_entries > SQL_TABLE_FILE_DIRECTORY_ENTRIES_PER_PAGE) {
+      error.set_invalid_file();
+      return;
+    }
+
+    // read entries in one go
+    uint64_t entries[SQL_TABLE_FILE_DIRECTORY_ENTRIES_PER_PAGE];
+    this->m_file.seek((directory_page * STORAGE_PAGE_SIZE) +
+                          SQL_TABLE_FILE_DIRECTORY_HEADER_SIZE,
+                      error);
+    if (!error.is_ok())
+      return;
+    this->m_file.read((uint8_t *)entries, num_entries * 8, error);
+    if (!error.is_ok())
+      return;
+
+    this->m_directory_pages.push_back(directory_page);
+    for (uint32_t i = 0; i < num_entries; i++) {
+      uint64_t page_mask =
+          ((uint64_t)1 << SQL_TABLE_FILE_DIRECTORY_PAGE_BITS) - 1;
+      uint64_t page = entries[i] & page_mask;
+      if (page == 0 || page >= this->m_num_pages) {
+        error.set_invalid_file();
+        return;
+      }
+      this->m_page_directory.push_back(page);
+      this->m_page_row_counts.push_back(entries[i] >>
+                                        SQL_TABLE_FILE_DIRECTORY_PAGE_BITS);
+    }
+
+    directory_page = next_directory_page;
+  }
+
+  this->update_page_first_rows();
+
+  // every row must be in a data page
+  if (this->num_values > this->row_capacity())
+    error.set_invalid_file();
 }
 
-/// Returns true if this is closed
-bool SqlTableFile::is_closed() { return this->m_file.is_closed(); }
+/// Load the tombstone bitmap, starting at the given tombstone page.
+///
+/// Deleted rows are collected into the free row set.
+void SqlTableFile::load_tombstones(uint64_t first_tombstone_page,
+                                   SqlError &error) {
+  static const size_t bytes_per_page = SQL_TABLE_FILE_TOMBSTONES_PER_PAGE / 8;
+  this->m_tombstone_pages.clear();
+  this->m_tombstones.clear();
+  this->m_free_rows.clear();
 
-/// Close this file
-void SqlTableFile::close(SqlError &error) { this->m_file.close(error); }
+  // walk the tombstone chain, reading each bitmap in one go.
+  uint64_t tombstone_page = first_tombstone_page;
+  while (tombstone_page != 0) {
+    // same checks as the page directory chain
+    if (tombstone_page >= this->m_num_pages ||
+        this->m_tombstone_pages.size() >= this->m_num_pages) {
+      error.set_invalid_file();
+      return;
+    }
+
+    uint64_t next_tombstone_page = 0;
+    this->m_file.read_at(tombstone_page * STORAGE_PAGE_SIZE,
+                         (uint8_t *)&next_tombstone_page, 8, error);
+    if (!error.is_ok())
+      return;
+
+    size_t size = this->m_tombstones.size();
+    this->m_tombstones.resize(size + bytes_per_page);
+    this->m_file.read_at((tombstone_page * STORAGE_PAGE_SIZE) +
+                             SQL_TABLE_FILE_TOMBSTONE_HEADER_SIZE,
+                         this->m_tombstones.data() + size, bytes_per_page,
+                         error);
+    if (!error.is_ok())
+      return;
+
+    this->m_tombstone_pages.push_back(tombstone_page);
+    tombstone_page = next_tombstone_page;
+  }
+
+  // bits past the last row are left over from an interrupted trim.
+  for (uint64_t i = this->num_values; i < this->m_tombstones.size() * 8; i++)
+    this->m_tombstones[i / 8] &= ~(1 << (i % 8));
+
+  for (uint64_t i = 0; i < this->num_values; i++) {
+    if (this->is_row_deleted(i))
+      this->m_free_rows.insert(i);
+  }
+}
+
+/// Set or clear the tombstone bit of rows, then write the changed bytes.
+///
+/// `rows` must be sorted. Tombstone pages are chained as needed.
+void SqlTableFile::write_tombstones(const std::vector<uint64_t> &rows,
+                                    bool deleted, SqlError &error) {
+  static const size_t bytes_per_page = SQL_TABLE_FILE_TOMBSTONES_PER_PAGE / 8;
+  if (rows.empty())
+    return;
+
+  // chain new tombstone pages until the last row has a bit
+  size_t first_byte = rows.front() / 8;
+  size_t last_byte = rows.back() / 8;
+  while (this->m_tombstone_pages.size() * bytes_per_page <= last_byte) {
+    uint64_t tombstone_page = this->allocate_page(error);
+    if (!error.is_ok())
+      return;
+
+    // link from the header, or from the previous tombstone page
+    uint64_t link_position = SQL_TABLE_FILE_TOMBSTONE_OFFSET;
+    if (!this->m_tombstone_pages.empty())
+      link_position = this->m_tombstone_pages.back() * STORAGE_PAGE_SIZE;
+    this->m_file.write_at(link_position, (const uint8_t *)&tombstone_page, 8,
+                          error);
+    if (!error.is_ok())
+      return;
+
+    this->m_tombstone_pages.push_back(tombstone_page);
+    this->m_tombstones.resize(this->m_tombstones.size() + bytes_per_page);
+  }
+
+  // flip the bits in memory
+  for (size_t i = 0; i < rows.size(); i++) {
+    assert(i == 0 || rows[i - 1] < rows[i]);
+    uint8_t mask = 1 << (rows[i] % 8);
+    if (deleted) {
+      this->m_tombstones[rows[i] / 8] |= mask;
+    } else {
+      this->m_tombstones[rows[i] / 8] &= ~mask;
+    }
+  }
+
+  // write the changed range, one write per tombstone page
+  for (size_t page_index = first_byte / bytes_per_page;
+       page_index <= last_byte / bytes_per_page; page_index++) {
+    size_t page_first_byte = page_index * bytes_per_page;
+    size_t begin = std::max(first_byte, page_first_byte);
+    size_t end = std::min(last_byte + 1, page_first_byte + bytes_per_page);
+    this->m_file.write_at((this->m_tombstone_pages[page_index] *
+                           STORAGE_PAGE_SIZE) +
+                              SQL_TABLE_FILE_TOMBSTONE_HEADER_SIZE +
+                              (begin - page_first_byte),
+                          this->m_tombstones.data() + begin, end - begin,
+                          error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Drop deleted rows from the end of the table.
+///
+/// Row ids do not change, num_values just shrinks so the slots are reused by
+/// appends instead of through the free row set.
+void SqlTableFile::trim_deleted_rows(SqlError &error) {
+  uint64_t new_num_values = this->num_values;
+  while (new_num_values != 0 && this->is_row_deleted(new_num_values - 1))
+    new_num_values -= 1;
+  if (new_num_values == this->num_values)
+    return;
+
+  // shrink first, so an interrupted trim only leaves stray bits past the end.
+  std::vector<uint64_t> rows;
+  for (uint64_t i = new_num_values; i < this->num_values; i++)
+    rows.push_back(i);
+  this->update_num_values(new_num_values, error);
+  if (!error.is_ok())
+    return;
+  this->m_free_rows.erase(this->m_free_rows.lower_bound(new_num_values),
+                          this->m_free_rows.end());
+
+  this->write_tombstones(rows, false, error);
+}
+
+/// Allocate a zeroed page at the end of the file.
+///
+/// Returns the new page number.
+uint64_t SqlTableFile::allocate_page(SqlError &error) {
+  static const uint8_t zero_page[STORAGE_PAGE_SIZE] = {0};
+  uint64_t page = this->m_num_pages;
+
+  // zero the page
+  this->m_file.seek(page * STORAGE_PAGE_SIZE, error);
+  if (!error.is_ok())
+    return 0;
+  this->m_file.write(zero_page, STORAGE_PAGE_SIZE, error);
+  if (!error.is_ok())
+    return 0;
+
+  // update num_pages
+  uint64_t new_num_pages = page + 1;
+  this->m_file.seek(SQL_TABLE_FILE_NUM_PAGES_OFFSET, error);
+  if (!error.is_ok())
+    return 0;
+  this->m_file.write((const uint8_t *)&new_num_pages, 8, error);
+  if (!error.is_ok())
+    return 0;
+
+  // update memory
+  this->m_num_pages = new_num_pages;
+
+  return page;
+}
+
+/// Get a page for data, reusing a free page before growing the file.
+uint64_t SqlTableFile::take_page(SqlError &error) {
+  if (this->m_free_pages.empty())
+    return this->allocate_page(error);
+
+  uint64_t page = this->m_free_pages.back();
+  this->m_free_pages.pop_back();
+  return page;
+}
+
+/// Allocate a new data page and append it to the page directory.
+void SqlTableFile::allocate_data_page(SqlError &error) {
+  uint64_t data_page = this->take_page(error);
+  if (!error.is_ok())
+    return;
+
+  // update memory
+  this->m_page_first_rows.push_back(this->row_capacity());
+  this->m_page_directory.push_back(data_page);
+  this->m_page_row_counts.push_back(0);
+
+  this->write_page_directory(this->m_page_directory.size() - 1, error);
+}
+
+/// Write the page directory entries from the given one on.
+///
+/// Directory pages are chained as needed.
+void SqlTableFile::write_page_directory(size_t first_entry, SqlError &error) {
+  size_t num_entries = this->m_page_directory.size();
+
+  for (size_t directory_index =
+           first_entry / SQL_TABLE_FILE_DIRECTORY_ENTRIES_PER_PAGE;
+       directory_index * SQL_TABLE_FILE_DIRECTORY_ENTRIES_PER_PAGE <
+       num_entries;
+       directory_index++) {
+    // chain a new directory page if the last one is full
+    if (directory_index == this->m_directory_pages.size()) {
+      uint64_t directory_page = this->allocate_page(error);
+      if (!error.is_ok())
+        return;
+
+      // link from the header, or from the previous directory page
+      uint64_t link_position = SQL_TABLE_FILE_DIRECTORY_OFFSET;
+      if (directory_index != 0) {
+        link_position =
+            this->m_directory_pages[directory_index - 1] * STORAGE_PAGE_SIZE;
+      }
+      this->m_file.write_at(link_position, (const uint8_t *)&directory_page, 8,
+                            error);
+      if (!error.is_ok())
+        return;
+
+      this->m_directory_pages.push_back(directory_page);
+    }
+
+    // the entries of this directory page that changed
+    size_t page_first_entry =
+        directory_index * SQL_TABLE_FILE_DIRECTORY_ENTRIES_PER_PAGE;
+    size_t begin = std::max(first_entry, page_first_entry);
+    size_t end = std::min(
+        num_entries,
+        page_first_entry + SQL_TABLE_FILE_DIRECTORY_ENTRIES_PER_PAGE);
+    uint64_t entries[SQL_TABLE_FILE_DIRECTORY_ENTRIES_PER_PAGE];
+    for (size_t i = begin; i < end; i++) {
+      entries[i - begin] =
+          this->m_page_directory[i] |
+          ((uint64_t)this->m_page_row_counts[i]
+           << SQL_TABLE_FILE_DIRECTORY_PAGE_BITS);
+    }
+
+    // write the entries, then the entry count
+    uint64_t directory_position =
+        this->m_directory_pages[directory_index] * STORAGE_PAGE_SIZE;
+    this->m_file.write_at(directory_position +
+                              SQL_TABLE_FILE_DIRECTORY_HEADER_SIZE +
+                              ((begin - page_first_entry) * 8),
+                          (const uint8_t *)entries, (end - begin) * 8, error);
+    if (!error.is_ok())
+      return;
+    uint32_t page_num_entries = end - page_first_entry;
+    this->m_file.write_at(directory_position + 8,
+                          (const uint8_t *)&page_num_entries, 4, error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Recompute the row size and rows per page from the columns.
+void SqlTableFile::update_row_layout() {
+  size_t row_size = 0;
+  this->m_column_offsets = SmallVec<COLUMN_MAX, size_t>();
+  for (size_t i = 0; i < this->columns.size(); i++) {
+    this->m_column_offsets.push(row_size);
+    row_size += sql_type_width(this->columns[i].type);
+  }
+
+  this->m_row_size = row_size;
+  this->m_rows_per_page = row_size == 0 ? 0 : STORAGE_PAGE_SIZE / row_size;
+  this->update_page_first_rows();
+
+  // zones are grouped by rows per page
+  this->m_zone_map.clear();
+}
+
+/// Recompute the first row of every data page.
+void SqlTableFile::update_page_first_rows() {
+  this->m_page_first_rows.resize(this->m_page_directory.size());
+
+  uint64_t first_row = 0;
+  for (size_t i = 0; i < this->m_page_directory.size(); i++) {
+    this->m_page_first_rows[i] = first_row;
+    first_row += this->page_num_rows(i);
+  }
+}
+
+/// Get the # of rows a data page holds.
+size_t SqlTableFile::page_num_rows(size_t entry) const {
+  uint32_t num_rows = this->m_page_row_counts[entry];
+  return num_rows != 0 ? num_rows : this->m_rows_per_page;
+}
+
+/// Get the # of rows all data pages hold.
+uint64_t SqlTableFile::row_capacity() const {
+  if (this->m_page_directory.empty())
+    return 0;
+
+  size_t last = this->m_page_directory.size() - 1;
+  return this->m_page_first_rows[last] + this->page_num_rows(last);
+}
+
+/// Find the data page directory entry of a row, and its slot in the page.
+void SqlTableFile::locate_row(size_t index, size_t &entry,
+                              size_t &slot) const {
+  // find the last page that starts at or before the row
+  std::vector<uint64_t>::const_iterator it =
+      std::upper_bound(this->m_page_first_rows.begin(),
+                       this->m_page_first_rows.end(), index);
+  assert(it != this->m_page_first_rows.begin());
+
+  entry = (it - this->m_page_first_rows.begin()) - 1;
+  slot = index - this->m_page_first_rows[entry];
+  assert(slot < this->page_num_rows(entry));
+}
+
+/// Get the contents of a data page.
+///
+/// Returns a ptr into the mapping if it is still good, otherwise the page is
+/// read into `buffer`.
+const uint8_t *SqlTableFile::page_data(size_t entry, uint8_t *buffer,
+                                       SqlError &error) {
+  uint64_t page = this->m_page_directory[entry];
+  const uint8_t *mapped_data = this->m_file.mapped_data();
+  if (mapped_data != nullptr) {
+    assert((page + 1) * STORAGE_PAGE_SIZE <= this->m_file.mapped_size());
+    return mapped_data + (page * STORAGE_PAGE_SIZE);
+  }
+
+  this->m_file.read_at(page * STORAGE_PAGE_SIZE, buffer, STORAGE_PAGE_SIZE,
+                       error);
+  if (!error.is_ok())
+    return nullptr;
+  return buffer;
+}
+
+/// Read the data pages of some directory entries back to back, bypassing the
+/// buffer pool.
+///
+/// Pages next to each other in the file are read with one vectored read.
+void SqlTableFile::read_pages(const std::vector<size_t> &entries,
+                              std::vector<uint8_t> &pages, SqlError &error) {
+  // the buffer pool may hold newer pages than the file
+  this->m_file.flush(error);
+  if (!error.is_ok())
+    return;
+
+  pages.resize(entries.size() * STORAGE_PAGE_SIZE);
+  size_t i = 0;
+  while (i < entries.size()) {
+    uint64_t first_page = this->m_page_directory[entries[i]];
+    std::vector<struct iovec> iov;
+    do {
+      iov.push_back(iovec{pages.data() + (i * STORAGE_PAGE_SIZE),
+                          STORAGE_PAGE_SIZE});
+      i++;
+    } while (i < entries.size() &&
+             this->m_page_directory[entries[i]] == first_page + iov.size());
+
+    this->m_file.read_vectored(first_page * STORAGE_PAGE_SIZE, iov.data(),
+                               iov.size(), error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Read every row of a compressed page, one vector of values per column.
+void SqlTableFile::read_compressed_rows(
+    size_t entry, std::vector<std::vector<uint8_t>> &column_values,
+    SqlError &error) {
+  uint8_t buffer[STORAGE_PAGE_SIZE];
+  const uint8_t *data = this->page_data(entry, buffer, error);
+  if (!error.is_ok())
+    return;
+  SqlCompressedPage page(data);
+  size_t num_rows = page.num_rows();
+
+  column_values.resize(this->columns.size());
+  for (size_t j = 0; j < this->columns.size(); j++) {
+    size_t width = sql_type_width(this->columns[j].type);
+    column_values[j].resize(num_rows * width);
+    for (size_t i = 0; i < num_rows; i++) {
+      page.copy_value(j, this->columns[j].type, i,
+                      column_values[j].data() + (i * width));
+    }
+  }
+}
+
+/// Write rows to a data page, compressed.
+///
+/// If they do not fit, they are split over new pages after it. The caller
+/// must write the page directory.
+void SqlTableFile::store_compressed_rows(
+    size_t entry, const std::vector<std::vector<uint8_t>> &column_values,
+    size_t num_rows, SqlError &error) {
+  uint8_t page[STORAGE_PAGE_SIZE];
+  if (compress_page(this->columns, column_values, num_rows, page)) {
+    this->m_file.write_at(this->m_page_directory[entry] * STORAGE_PAGE_SIZE,
+                          page, STORAGE_PAGE_SIZE, error);
+    if (!error.is_ok())
+      return;
+
+    this->m_page_row_counts[entry] = num_rows;
+    return;
+  }
+
+  // a single row always fits as plain values
+  assert(num_rows > 1);
+
+  // split in half, the second half goes to a new page after this one.
+  size_t num_first_rows = num_rows / 2;
+  std::vector<std::vector<uint8_t>> first_values(this->columns.size());
+  std::vector<std::vector<uint8_t>> second_values(this->columns.size());
+  for (size_t j = 0; j < this->columns.size(); j++) {
+    size_t split = num_first_rows * sql_type_width(this->columns[j].type);
+    first_values[j].assign(column_values[j].begin(),
+                           column_values[j].begin() + split);
+    second_values[j].assign(column_values[j].begin() + split,
+                            column_values[j].end());
+  }
+
+  uint64_t new_page = this->take_page(error);
+  if (!error.is_ok())
+    return;
+  this->m_page_directory.insert(this->m_page_directory.begin() + entry + 1,
+                                new_page);
+  this->m_page_row_counts.insert(this->m_page_row_counts.begin() + entry + 1,
+                                 0);
+
+  this->store_compressed_rows(entry + 1, second_values,
+                              num_rows - num_first_rows, error);
+  if (!error.is_ok())
+    return;
+  this->store_compressed_rows(entry, first_values, num_first_rows, error);
+}
+
+/// Overwrite a row in a compressed page with an encoded row.
+void SqlTableFile::update_compressed_row(size_t entry, size_t slot,
+                                         const uint8_t *data,
+                                         SqlError &error) {
+  std::vector<std::vector<uint8_t>> column_values;
+  this->read_compressed_rows(entry, column_values, error);
+  if (!error.is_ok())
+    return;
+
+  for (size_t j = 0; j < this->columns.size(); j++) {
+    size_t width = sql_type_width(this->columns[j].type);
+    memcpy(column_values[j].data() + (slot * width),
+           data + this->m_column_offsets[j], width);
+  }
+
+  this->store_compressed_rows(entry, column_values,
+                              this->m_page_row_counts[entry], error);
+  if (!error.is_ok())
+    return;
+
+  this->update_page_first_rows();
+  this->write_page_directory(entry, error);
+}
+
+/// Compress the last data page, which must be full.
+///
+/// Its rows are merged into the page before it if they fit, which frees the
+/// last page for new rows.
+void SqlTableFile::seal_last_page(SqlError &error) {
+  size_t last = this->m_page_directory.size() - 1;
+  if (this->m_page_row_counts[last] != 0)
+    return;
+
+  // an uncompressed page already holds each column back to back
+  uint8_t buffer[STORAGE_PAGE_SIZE];
+  const uint8_t *data = this->page_data(last, buffer, error);
+  if (!error.is_ok())
+    return;
+  std::vector<std::vector<uint8_t>> column_values(this->columns.size());
+  for (size_t j = 0; j < this->columns.size(); j++) {
+    const uint8_t *column =
+        data + (this->m_rows_per_page * this->m_column_offsets[j]);
+    size_t size = this->m_rows_per_page * sql_type_width(this->columns[j].type);
+    column_values[j].assign(column, column + size);
+  }
+
+  // try to merge into the page before
+  uint8_t page[STORAGE_PAGE_SIZE];
+  if (last != 0 && this->m_page_row_counts[last - 1] != 0 &&
+      this->m_page_row_counts[last - 1] + this->m_rows_per_page <=
+          SQL_COMPRESSED_PAGE_MAX_ROWS) {
+    size_t num_rows = this->m_page_row_counts[last - 1] + this->m_rows_per_page;
+    std::vector<std::vector<uint8_t>> merged_values;
+    this->read_compressed_rows(last - 1, merged_values, error);
+    if (!error.is_ok())
+      return;
+    for (size_t j = 0; j < this->columns.size(); j++) {
+      merged_values[j].insert(merged_values[j].end(), column_values[j].begin(),
+                              column_values[j].end());
+    }
+
+    if (compress_page(this->columns, merged_values, num_rows, page)) {
+      this->m_file.write_at(this->m_page_directory[last - 1] *
+                                STORAGE_PAGE_SIZE,
+                            page, STORAGE_PAGE_SIZE, error);
+      if (!error.is_ok())
+        return;
+
+      // the last page is empty again
+      this->m_page_row_counts[last - 1] = num_rows;
+      this->update_page_first_rows();
+      this->write_page_directory(last - 1, error);
+      return;
+    }
+  }
+
+  // compress it on its own. it stays as it is if that does not fit.
+  if (!compress_page(this->columns, column_values, this->m_rows_per_page,
+                     page))
+    return;
+  this->m_file.write_at(this->m_page_directory[last] * STORAGE_PAGE_SIZE, page,
+                        STORAGE_PAGE_SIZE, error);
+  if (!error.is_ok())
+    return;
+  this->m_page_row_counts[last] = this->m_rows_per_page;
+  this->write_page_directory(last, error);
+}
+
+/// Check that every value of a row has the type of its column, and fits it.
+void SqlTableFile::check_row(const SmallVec<COLUMN_MAX, SqlValue> &data,
+                             SqlError &error) const {
+  if (data.size() > this->columns.size()) {
+    error.set_limit_reached();
+    return;
+  }
+
+  for (size_t i = 0; i < data.size(); i++) {
+    if (!sql_value_has_type(data[i], this->columns[i].type)) {
+      error.set_type_mismatch();
+      return;
+    }
+    if (sql_value_encoded_size(data[i]) >
+        sql_type_width(this->columns[i].type)) {
+      error.set_limit_reached();
+      return;
+    }
+  }
+}
+
+/// Convert the values of a row to the types of their columns.
+void SqlTableFile::convert_row(SmallVec<COLUMN_MAX, SqlValue> &row,
+                               SqlError &error) const {
+  for (size_t i = 0; i < row.size() && i < this->columns.size(); i++) {
+    if (!convert_sql_value(row[i], this->columns[i].type)) {
+      error.set_type_mismatch();
+      return;
+    }
+  }
+}
+
+/// Get the file position of a row for a given row layout.
+uint64_t SqlTableFile::row_position(size_t index, size_t row_size,
+                                    size_t rows_per_page) const {
+  // locate the data page through the directory, then the row in the page
+  uint64_t page = this->m_page_directory[index / rows_per_page];
+  return (page * STORAGE_PAGE_SIZE) + ((index % rows_per_page) * row_size);
+}
+
+/// Get the file position of a value in an uncompressed columnar page.
+uint64_t SqlTableFile::value_position(size_t entry, size_t slot,
+                                      size_t column) const {
+  // columnar pages hold a run of rows_per_page values for each column, in
+  // column order.
+  uint64_t page = this->m_page_directory[entry];
+  size_t width = sql_type_width(this->columns[column].type);
+  return (page * STORAGE_PAGE_SIZE) +
+         (this->m_rows_per_page * this->m_column_offsets[column]) +
+         (slot * width);
+}
+
+/// Move every row from an old row layout to the current one.
+///
+/// This is only for the row layout. The current layout must have the old
+/// columns as a prefix.
+void SqlTableFile::relayout_rows(size_t old_row_size, size_t old_rows_per_page,
+                                 SqlError &error) {
+  // make room for the wider rows
+  size_t num_data_pages =
+      (this->num_values + this->m_rows_per_page - 1) / this->m_rows_per_page;
+  while (this->m_page_directory.size() < num_data_pages) {
+    this->allocate_data_page(error);
+    if (!error.is_ok())
+      return;
+  }
+
+  // rows only get wider and data pages are in file order, so a row never
+  // moves backwards. moving the last row first never overwrites a row that
+  // has not been moved yet.
+  SmallVec<COLUMN_MAX, parser::SqlColumn> old_columns;
+  for (size_t j = 0; j + 1 < this->columns.size(); j++)
+    old_columns.push(this->columns[j]);
+  assert(sql_row_width(old_columns) == old_row_size);
+
+  for (uint64_t i = this->num_values; i > 0; i--) {
+    size_t index = i - 1;
+
+    // read with the old layout
+    uint64_t old_position =
+        this->row_position(index, old_row_size, old_rows_per_page);
+    uint8_t buffer[ROW_MAX_SIZE];
+    this->m_file.read_at(old_position, buffer, old_row_size, error);
+    if (!error.is_ok())
+      return;
+    SmallVec<COLUMN_MAX, SqlValue> row;
+    if (!decode_row(row, old_columns, buffer)) {
+      error.set_invalid_file();
+      return;
+    }
+
+    // write with the new layout, the new column is zeroed.
+    this->insert(index, row, error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Write rows again from the first data page, with the current layout.
+///
+/// The old data pages are reused as the rows need them.
+void SqlTableFile::rebuild_rows(
+    const std::vector<SmallVec<COLUMN_MAX, SqlValue>> &rows,
+    SqlError &error) {
+  // free the data pages, the first one is reused first.
+  this->m_free_pages.insert(this->m_free_pages.end(),
+                            this->m_page_directory.rbegin(),
+                            this->m_page_directory.rend());
+  this->m_page_directory.clear();
+  this->m_page_row_counts.clear();
+  this->m_page_first_rows.clear();
+
+  // empty every directory page
+  for (size_t i = 0; i < this->m_directory_pages.size(); i++) {
+    uint32_t num_entries = 0;
+    this->m_file.write_at((this->m_directory_pages[i] * STORAGE_PAGE_SIZE) + 8,
+                          (const uint8_t *)&num_entries, 4, error);
+    if (!error.is_ok())
+      return;
+  }
+
+  for (uint64_t index = 0; index < rows.size(); index++) {
+    this->insert(index, rows[index], error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Get the columns
+const SmallVec<COLUMN_MAX, parser::SqlColumn> &
+SqlTableFile::get_columns() const {
+  return this->columns;
+}
+
+/// Encode the value of a column of a row as an index key.
+///
+/// a column without a value is zeroed, like `encode_row` does.
+static void encode_index_key(const SmallVec<COLUMN_MAX, SqlValue> &row,
+                             const SmallVec<COLUMN_MAX, parser::SqlColumn>
+                                 &columns,
+                             size_t column, uint8_t *key) {
+  if (column < row.size() && row[column].type() != SqlValueType::Null) {
+    encode_sql_value(row[column], columns[column].type, key);
+  } else {
+    memset(key, 0, sql_type_width(columns[column].type));
+  }
+}
+
+/// Make an index stored in a b+tree
+SqlTableIndex::SqlTableIndex(std::string name, size_t column,
+                             SqlBTreeFile &&tree)
+    : name(name), column(column), type(parser::SqlIndexType::BTREE),
+      tree(std::move(tree)), hash("") {}
+
+/// Make an index stored in a hash table
+SqlTableIndex::SqlTableIndex(std::string name, size_t column,
+                             SqlHashFile &&hash)
+    : name(name), column(column), type(parser::SqlIndexType::HASH), tree(""),
+      hash(std::move(hash)) {}
+
+/// Add a key
+void SqlTableIndex::insert(const uint8_t *key, uint64_t row_id,
+                           SqlError &error) {
+  switch (this->type) {
+  case parser::SqlIndexType::BTREE:
+    this->tree.insert(key, row_id, error);
+    break;
+  case parser::SqlIndexType::HASH:
+    this->hash.insert(key, row_id, error);
+    break;
+  }
+}
+
+/// Remove a key
+void SqlTableIndex::remove(const uint8_t *key, uint64_t row_id,
+                           SqlError &error) {
+  switch (this->type) {
+  case parser::SqlIndexType::BTREE:
+    this->tree.remove(key, row_id, error);
+    break;
+  case parser::SqlIndexType::HASH:
+    this->hash.remove(key, row_id, error);
+    break;
+  }
+}
+
+/// Close the index file
+void SqlTableIndex::close(SqlError &error) {
+  switch (this->type) {
+  case parser::SqlIndexType::BTREE:
+    this->tree.close(error);
+    break;
+  case parser::SqlIndexType::HASH:
+    this->hash.close(error);
+    break;
+  }
+}
+
+/// Write back buffered pages to the index file
+void SqlTableIndex::flush(SqlError &error) {
+  switch (this->type) {
+  case parser::SqlIndexType::BTREE:
+    this->tree.flush(error);
+    break;
+  case parser::SqlIndexType::HASH:
+    this->hash.flush(error);
+    break;
+  }
+}
+
+/// Write back buffered pages, then wait until the index file is on disk.
+void SqlTableIndex::sync(SqlError &error) {
+  switch (this->type) {
+  case parser::SqlIndexType::BTREE:
+    this->tree.sync(error);
+    break;
+  case parser::SqlIndexType::HASH:
+    this->hash.sync(error);
+    break;
+  }
+}
+
+/// Drop cached pages if another process changed the index file.
+void SqlTableIndex::invalidate_if_modified(SqlError &error) {
+  switch (this->type) {
+  case parser::SqlIndexType::BTREE:
+    this->tree.invalidate_if_modified(error);
+    break;
+  case parser::SqlIndexType::HASH:
+    this->hash.invalidate_if_modified(error);
+    break;
+  }
+}
+
+/// remove the index file and close it.
+void SqlTableIndex::remove_file(SqlError &error) {
+  switch (this->type) {
+  case parser::SqlIndexType::BTREE:
+    this->tree.remove_file(error);
+    break;
+  case parser::SqlIndexType::HASH:
+    this->hash.remove_file(error);
+    break;
+  }
+}
+
+/// Fill a new b+tree with the keys of a column, from every live row.
+void SqlTableFile::build_index(size_t column, SqlBTreeFile &tree,
+                               SqlError &error) {
+  std::vector<uint8_t> keys;
+  std::vector<uint64_t> row_ids;
+  this->read_column_keys(column, 0, this->num_values, nullptr, keys, row_ids,
+                         error);
+  if (!error.is_ok())
+    return;
+
+  tree.bulk_load(keys, row_ids, error);
+}
+
+/// Fill a new hash table with the keys of a column, from every live row.
+void SqlTableFile::build_index(size_t column, SqlHashFile &hash,
+                               SqlError &error) {
+  std::vector<uint8_t> keys;
+  std::vector<uint64_t> row_ids;
+  this->read_column_keys(column, 0, this->num_values, nullptr, keys, row_ids,
+                         error);
+  if (!error.is_ok())
+    return;
+
+  hash.bulk_load(keys, row_ids, error);
+}
+
+/// Keep an open index of a column in step with the rows from now on.
+void SqlTableFile::attach_index(const std::string &name, size_t column,
+                                SqlBTreeFile &&tree) {
+  this->m_indexes.push_back(SqlTableIndex(name, column, std::move(tree)));
+}
+
+/// Keep an open hash index of a column in step with the rows from now on.
+void SqlTableFile::attach_index(const std::string &name, size_t column,
+                                SqlHashFile &&hash) {
+  this->m_indexes.push_back(SqlTableIndex(name, column, std::move(hash)));
+}
+
+/// Stop using an index and remove its file.
+void SqlTableFile::remove_index(const std::string &name, SqlError &error) {
+  for (size_t i = 0; i < this->m_indexes.size(); i++) {
+    if (this->m_indexes[i].name != name)
+      continue;
+
+    this->m_indexes[i].remove_file(error);
+    if (!error.is_ok())
+      return;
+    this->m_indexes.erase(this->m_indexes.begin() + i);
+    return;
+  }
+}
+
+/// Find the candidate rows of a where clause with an index of its column.
+///
+/// Returns false if no index can answer it, so every row must be scanned.
+/// Candidates are sorted, but may be deleted or stale, so they must be
+/// checked against the where clause again.
+bool SqlTableFile::find_indexed_rows(const parser::SqlWhereClause &where_clause,
+                                     size_t column_index,
+                                     std::vector<uint64_t> &row_ids,
+                                     SqlError &error) {
+  if (where_clause.op != tokenizer::SqlOperator::Equals &&
+      where_clause.op != tokenizer::SqlOperator::GreaterThan)
+    return false;
+
+  // the value must encode like the keys, values of other types compare
+  // differently.
+  const parser::SqlType &type = this->columns[column_index].type;
+  SqlValueType value_type = where_clause.value.type();
+  switch (type.type) {
+  case tokenizer::SqlType::INT:
+    if (value_type != SqlValueType::Integer)
+      return false;
+    break;
+  case tokenizer::SqlType::FLOAT:
+    if (value_type != SqlValueType::Float)
+      return false;
+    break;
+  case tokenizer::SqlType::CHAR:
+  case tokenizer::SqlType::VARCHAR:
+    if (value_type != SqlValueType::String ||
+        sql_value_encoded_size(where_clause.value) > sql_type_width(type))
+      return false;
+    break;
+  default:
+    return false;
+  }
+
+  // a hash index is one probe, so it is preferred for `=`. only a b+tree
+  // can answer `>`.
+  SqlTableIndex *index = nullptr;
+  for (size_t i = 0; i < this->m_indexes.size(); i++) {
+    if (this->m_indexes[i].column != column_index)
+      continue;
+
+    if (this->m_indexes[i].type == parser::SqlIndexType::HASH) {
+      if (where_clause.op != tokenizer::SqlOperator::Equals)
+        continue;
+      index = &this->m_indexes[i];
+      break;
+    }
+    if (index == nullptr)
+      index = &this->m_indexes[i];
+  }
+  if (index == nullptr)
+    return false;
+
+  uint8_t key[1 + MAX_TYPE_SIZE];
+  encode_sql_value(where_clause.value, type, key);
+  switch (index->type) {
+  case parser::SqlIndexType::BTREE:
+    index->tree.find(where_clause.op, key, row_ids, error);
+    break;
+  case parser::SqlIndexType::HASH:
+    index->hash.find(key, row_ids, error);
+    break;
+  }
+  if (!error.is_ok())
+    return false;
+
+  std::sort(row_ids.begin(), row_ids.end());
+  return true;
+}
+
+/// Put row ids in primary key order, with the primary key's b+tree.
+///
+/// If `all_rows` is set, `row_ids` gets every row in the tree. Otherwise it
+/// must be sorted, and only its rows are kept.
+void SqlTableFile::primary_key_order(bool all_rows,
+                                     std::vector<uint64_t> &row_ids,
+                                     SqlError &error) {
+  // the primary key's index is the one without a name
+  SqlTableIndex *index = nullptr;
+  for (size_t i = 0; i < this->m_indexes.size(); i++) {
+    if (this->m_indexes[i].name.empty())
+      index = &this->m_indexes[i];
+  }
+  assert(index != nullptr);
+
+  std::vector<uint64_t> ordered_rows;
+  index->tree.scan(ordered_rows, error);
+  if (!error.is_ok())
+    return;
+
+  // keep each wanted row once, at its first key
+  std::vector<uint8_t> wanted(this->num_values, all_rows);
+  for (size_t i = 0; i < row_ids.size(); i++) {
+    if (row_ids[i] < this->num_values)
+      wanted[row_ids[i]] = 1;
+  }
+  row_ids.clear();
+  for (size_t i = 0; i < ordered_rows.size(); i++) {
+    uint64_t row_index = ordered_rows[i];
+    if (row_index < this->num_values && wanted[row_index]) {
+      wanted[row_index] = 0;
+      row_ids.push_back(row_index);
+    }
+  }
+}
+
+/// Find the ids of the live rows that match a predicate on a column.
+///
+/// Only the rows an index finds are visited, if there is one. Otherwise row
+/// groups the zones rule out are skipped.
+void SqlTableFile::find_matching_rows(const SqlPredicate &predicate,
+                                      std::vector<uint64_t> &row_ids,
+                                      SqlError &error) {
+  // scan from memory if possible
+  this->m_file.map(error);
+  if (!error.is_ok())
+    return;
+
+  const parser::SqlWhereClause &where_clause = predicate.where_clause();
+  size_t column_index = predicate.column();
+  std::vector<uint64_t> indexed_rows;
+  bool indexed =
+      this->find_indexed_rows(where_clause, column_index, indexed_rows, error);
+  if (!error.is_ok())
+    return;
+  if (indexed) {
+    this->filter_rows(predicate, indexed_rows, row_ids, error);
+    return;
+  }
+
+  std::vector<uint64_t> group_rows;
+  uint64_t i = 0;
+  while (true) {
+    i = this->next_zone_row(where_clause, column_index, i, error);
+    if (!error.is_ok())
+      return;
+    if (i >= this->num_values)
+      break;
+
+    uint64_t group_end =
+        std::min(this->m_zone_map.next_group(i), this->num_values);
+    group_rows.clear();
+    for (; i < group_end; i++)
+      group_rows.push_back(i);
+    this->filter_rows(predicate, group_rows, row_ids, error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Get the first row from `row_index` on whose zone may match a where clause
+/// on a column.
+///
+/// The zones of the column are built on first use. Returns num_values if no
+/// later row can match.
+uint64_t SqlTableFile::next_zone_row(const parser::SqlWhereClause &where_clause,
+                                     size_t column_index, uint64_t row_index,
+                                     SqlError &error) {
+  if (!this->m_zone_map.has_column(column_index)) {
+    this->build_zones(column_index, error);
+    if (!error.is_ok())
+      return row_index;
+  }
+
+  while (row_index < this->num_values) {
+    bool may_match =
+        this->zone_may_match(where_clause, column_index, row_index, error);
+    if (!error.is_ok() || may_match)
+      break;
+    row_index = this->m_zone_map.next_group(row_index);
+  }
+
+  return std::min(row_index, this->num_values);
+}
+
+/// Returns false if no row in the zone of a row can match a where clause on
+/// a column.
+///
+/// The zones of the column must be built. A stale zone is built again
+/// first.
+bool SqlTableFile::zone_may_match(const parser::SqlWhereClause &where_clause,
+                                  size_t column_index, uint64_t row_index,
+                                  SqlError &error) {
+  if (this->m_zone_map.is_stale(column_index, row_index)) {
+    uint64_t first_row = row_index - (row_index % this->m_rows_per_page);
+    this->m_zone_map.clear_group(column_index, first_row);
+    this->add_zone_rows(column_index, first_row,
+                        std::min(this->m_zone_map.next_group(first_row),
+                                 this->num_values),
+                        error);
+    if (!error.is_ok())
+      return true;
+  }
+
+  return this->m_zone_map.may_match(column_index,
+                                    this->columns[column_index].type,
+                                    row_index, where_clause);
+}
+
+/// Build the zones of a column from every live row.
+void SqlTableFile::build_zones(size_t column, SqlError &error) {
+  this->m_zone_map.start_column(column, this->m_rows_per_page,
+                                this->num_values);
+  this->add_zone_rows(column, 0, this->num_values, error);
+}
+
+/// Add the values of a column in a range of live rows to their zones.
+void SqlTableFile::add_zone_rows(size_t column, uint64_t first_row,
+                                 uint64_t end_row, SqlError &error) {
+  // scan from memory if possible
+  this->m_file.map(error);
+  if (!error.is_ok())
+    return;
+
+  const parser::SqlType &type = this->columns[column].type;
+  for (uint64_t row_index = first_row; row_index < end_row; row_index++) {
+    if (this->is_row_deleted(row_index))
+      continue;
+
+    SmallVec<COLUMN_MAX, SqlValue> row;
+    this->get_row_columns(row_index, (uint32_t)1 << column, row, error);
+    if (!error.is_ok())
+      return;
+
+    uint8_t value[1 + MAX_TYPE_SIZE];
+    encode_sql_value(row[column], type, value);
+    this->m_zone_map.add_value(column, type, row_index, value);
+  }
+}
+
+/// Widen the zones of a row for its encoded values.
+void SqlTableFile::add_zone_values(uint64_t row_index, const uint8_t *data) {
+  for (size_t j = 0; j < this->columns.size(); j++) {
+    this->m_zone_map.add_value(j, this->columns[j].type, row_index,
+                               data + this->m_column_offsets[j]);
+  }
+}
+
+/// Read the encoded value of a column from the live rows in a range.
+///
+/// Each value is appended to `keys`, padded to the width of the column, and
+/// its row to `row_ids`.
+void SqlTableFile::read_column_keys(size_t column, uint64_t first_row,
+                                    uint64_t end_row,
+                                    const SqlPredicate *predicate,
+                                    std::vector<uint8_t> &keys,
+                                    std::vector<uint64_t> &row_ids,
+                                    SqlError &error) {
+  // scan from memory if possible
+  this->m_file.map(error);
+  if (!error.is_ok())
+    return;
+
+  int where_column = -1;
+  if (predicate != nullptr)
+    where_column = predicate->column();
+  uint32_t column_mask = (uint32_t)1 << column;
+  if (where_column != -1)
+    column_mask |= (uint32_t)1 << where_column;
+
+  size_t key_size = sql_type_width(this->columns[column].type);
+  uint64_t zone_end = first_row;
+  std::vector<uint64_t> batch_rows;
+  SqlBatch batch;
+  uint64_t row_index = first_row;
+  while (row_index < end_row) {
+    // row groups the zones rule out are skipped
+    if (where_column != -1 && row_index >= zone_end) {
+      uint64_t next_row =
+          this->next_zone_row(predicate->where_clause(), where_column,
+                              row_index, error);
+      if (!error.is_ok())
+        return;
+      if (next_row >= end_row)
+        break;
+      row_index = next_row;
+      zone_end = this->m_zone_map.next_group(row_index);
+    }
+
+    // a batch stays in a row group
+    uint64_t batch_end =
+        std::min<uint64_t>(row_index + SQL_BATCH_SIZE, end_row);
+    if (where_column != -1)
+      batch_end = std::min(batch_end, zone_end);
+    batch_rows.clear();
+    for (; row_index < batch_end; row_index++) {
+      if (!this->is_row_deleted(row_index))
+        batch_rows.push_back(row_index);
+    }
+    if (batch_rows.empty())
+      continue;
+
+    this->read_batch(batch_rows.data(), batch_rows.size(), column_mask, batch,
+                     error);
+    if (!error.is_ok())
+      return;
+    if (predicate != nullptr)
+      predicate->filter(batch);
+
+    // values are stored encoded like the keys
+    const uint8_t *values = batch.columns[column].data();
+    for (size_t i = 0; i < batch.selection.size(); i++) {
+      size_t position = batch.selection[i];
+      keys.insert(keys.end(), values + (position * key_size),
+                  values + ((position + 1) * key_size));
+      row_ids.push_back(batch.row_ids[position]);
+    }
+  }
+}
+
+/// Update the indexes for rows about to be written.
+///
+/// The old keys of existing rows are read, so this must run before the rows
+/// are written.
+void SqlTableFile::update_indexes(const std::vector<BufferedRow> &rows,
+                                  SqlError &error) {
+  if (this->m_indexes.empty())
+    return;
+
+  uint32_t column_mask = 0;
+  for (size_t i = 0; i < this->m_indexes.size(); i++)
+    column_mask |= (uint32_t)1 << this->m_indexes[i].column;
+
+  for (size_t i = 0; i < rows.size(); i++) {
+    uint64_t row_index = rows[i].row_index;
+
+    // the old keys of rows past the end were never indexed
+    bool has_old_row = row_index < this->num_values;
+    SmallVec<COLUMN_MAX, SqlValue> old_row;
+    if (has_old_row) {
+      this->get_row_columns(row_index, column_mask, old_row, error);
+      if (!error.is_ok())
+        return;
+    }
+
+    for (size_t j = 0; j < this->m_indexes.size(); j++) {
+      SqlTableIndex &index = this->m_indexes[j];
+      size_t key_size = sql_type_width(this->columns[index.column].type);
+      uint8_t key[1 + MAX_TYPE_SIZE];
+      encode_index_key(rows[i].row, this->columns, index.column, key);
+
+      // an unchanged key is added again, in case a crash lost it.
+      if (has_old_row) {
+        uint8_t old_key[1 + MAX_TYPE_SIZE];
+        encode_index_key(old_row, this->columns, index.column, old_key);
+        if (memcmp(old_key, key, key_size) != 0) {
+          index.remove(old_key, row_index, error);
+          if (!error.is_ok())
+            return;
+        }
+      }
+      index.insert(key, row_index, error);
+      if (!error.is_ok())
+        return;
+    }
+  }
+}
+
+/// Remove the keys of live rows about to be deleted from the indexes.
+void SqlTableFile::remove_index_keys(const std::vector<uint64_t> &rows,
+                                     SqlError &error) {
+  if (this->m_indexes.empty())
+    return;
+
+  uint32_t column_mask = 0;
+  for (size_t i = 0; i < this->m_indexes.size(); i++)
+    column_mask |= (uint32_t)1 << this->m_indexes[i].column;
+
+  for (size_t i = 0; i < rows.size(); i++) {
+    if (rows[i] >= this->num_values || this->is_row_deleted(rows[i]))
+      continue;
+
+    SmallVec<COLUMN_MAX, SqlValue> row;
+    this->get_row_columns(rows[i], column_mask, row, error);
+    if (!error.is_ok())
+      return;
+
+    for (size_t j = 0; j < this->m_indexes.size(); j++) {
+      SqlTableIndex &index = this->m_indexes[j];
+      uint8_t key[1 + MAX_TYPE_SIZE];
+      encode_index_key(row, this->columns, index.column, key);
+      index.remove(key, rows[i], error);
+      if (!error.is_ok())
+        return;
+    }
+  }
+}
+
+/// remove the table file and close this file.
+void SqlTableFile::remove_file(SqlError &error) {
+  this->m_file.remove_file(error);
+  if (!error.is_ok())
+    return;
+}
+
+/// Returns true if this is closed
+bool SqlTableFile::is_closed() { return this->m_file.is_closed(); }
+
+/// Close this file
+///
+/// Its indexes are closed too.
+void SqlTableFile::close(SqlError &error) {
+  for (size_t i = 0; i < this->m_indexes.size(); i++) {
+    this->m_indexes[i].close(error);
+    if (!error.is_ok())
+      return;
+  }
+  this->m_indexes.clear();
+
+  this->m_file.close(error);
+}
+
+/// Write back buffered pages to the file
+void SqlTableFile::flush(SqlError &error) {
+  this->m_file.flush(error);
+  if (!error.is_ok())
+    return;
+
+  for (size_t i = 0; i < this->m_indexes.size(); i++) {
+    this->m_indexes[i].flush(error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Write back buffered pages, then wait until the file is on disk.
+void SqlTableFile::sync(SqlError &error) {
+  this->m_file.sync(error);
+  if (!error.is_ok())
+    return;
+
+  for (size_t i = 0; i < this->m_indexes.size(); i++) {
+    this->m_indexes[i].sync(error);
+    if (!error.is_ok())
+      return;
+  }
+}
+
+/// Read the file again, picking up changes by other processes.
+///
+/// Pages are written back first. Rows held for a transaction are kept.
+void SqlTableFile::reload(SqlError &error) {
+  // the indexes stay open, they only need their header read again
+  this->m_file.close(error);
+  if (!error.is_ok())
+    return;
+  for (size_t i = 0; i < this->m_indexes.size(); i++) {
+    this->m_indexes[i].invalidate_if_modified(error);
+    if (!error.is_ok())
+      return;
+  }
+
+  this->num_columns = 0;
+  this->num_values = 0;
+  this->columns = SmallVec<COLUMN_MAX, parser::SqlColumn>();
+  this->m_free_pages.clear();
+  this->open(false, error);
+}
+
+/// Read the file again if another process changed it.
+///
+/// Otherwise only the indexes drop their cached pages if they changed.
+void SqlTableFile::invalidate_if_modified(SqlError &error) {
+  bool modified = this->m_file.invalidate_if_modified(error);
+  if (!error.is_ok())
+    return;
+
+  // the header, page directory and tombstones may all be stale
+  if (modified) {
+    this->reload(error);
+    return;
+  }
+
+  for (size_t i = 0; i < this->m_indexes.size(); i++) {
+    this->m_indexes[i].invalidate_if_modified(error);
+    if (!error.is_ok())
+      return;
+  }
+}
 
 /// Get the file name
 const std::string &SqlTableFile::file_name() const {
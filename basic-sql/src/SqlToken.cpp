@@ -125,6 +125,9 @@ std::ostream &operator<<(std::ostream &os, const SqlTokenType &t) {
   case SqlTokenType::OPERATOR:
     os << "OPERATOR";
     break;
+  case SqlTokenType::PERIOD:
+    os << "PERIOD";
+    break;
   default:
     panic("unknown SqlTokenType in ostream fmt");
     return os;
@@ -329,6 +332,9 @@ std::ostream &operator<<(std::ostream &os, const SqlToken &t) {
   case SqlTokenType::OPERATOR:
     os << SqlTokenType::OPERATOR;
     break;
+  case SqlTokenType::PERIOD:
+    os << SqlTokenType::PERIOD;
+    break;
   default:
     os << t.token_type();
     panic("unknown SqlToken in fmt");
@@ -363,6 +369,14 @@ bool operator==(const SqlToken &lhs, const SqlToken &rhs) {
     return lhs.type() == rhs.type();
   case SqlTokenType::ASTERISK:
     return true;
+  case SqlTokenType::STRING_LITERAL:
+    return lhs.string_literal() == rhs.string_literal();
+  case SqlTokenType::FLOAT_LITERAL:
+    return lhs.float_literal() == rhs.float_literal();
+  case SqlTokenType::OPERATOR:
+    return lhs.op() == rhs.op();
+  case SqlTokenType::PERIOD:
+    return true;
   default:
     panic("unknown SqlToken in cmp");
     return false;
@@ -2,6 +2,7 @@
 /// Date: 10-17-2021
 
 #include "SqlValue.h"
+#include <algorithm>
 
 namespace basic_sql {
 /// fmt sql value
@@ -53,6 +54,8 @@ bool operator==(const SqlValue &lhs, const SqlValue &rhs) {
     return lhs.get_string() == rhs.get_string();
   case SqlValueType::Integer:
     return lhs.get_integer() == rhs.get_integer();
+  case SqlValueType::Float:
+    return lhs.get_float() == rhs.get_float();
   default:
     panic("Unknown SqlValueType in `bool operator==(const SqlValue &lhs, const "
           "SqlValue &rhs)`");
@@ -79,8 +82,20 @@ bool operator>(const SqlValue &lhs, const SqlValue &rhs) {
   }
 
   switch (lhs_type) {
+  case SqlValueType::Integer:
+    return lhs.get_integer() > rhs.get_integer();
   case SqlValueType::Float:
     return lhs.get_float() > rhs.get_float();
+  case SqlValueType::String: {
+    // bytewise, a prefix sorts first
+    const SmallString<MAX_TYPE_SIZE> &lhs_string = lhs.get_string();
+    const SmallString<MAX_TYPE_SIZE> &rhs_string = rhs.get_string();
+    size_t len = std::min(lhs_string.size(), rhs_string.size());
+    int cmp = memcmp(lhs_string.get_ptr(), rhs_string.get_ptr(), len);
+    if (cmp != 0)
+      return cmp > 0;
+    return lhs_string.size() > rhs_string.size();
+  }
   default:
     panic(
         "Unknown `SqlValueType` in `bool operator==(const SqlValue &lhs, const "
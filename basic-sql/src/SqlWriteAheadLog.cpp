@@ -0,0 +1,360 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlWriteAheadLog.h"
+#include "SerDe.h"
+#include "Util.h"
+
+namespace basic_sql {
+/// Get the FNV-1a hash of a record body
+static uint32_t record_checksum(const uint8_t *data, size_t len) {
+  uint32_t hash = 2166136261;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+/// Append a record to a buffer.
+///
+/// The body is a u8 type, a u8 table name length and the padded name, a u64
+/// row id, a u8 value count, then each value as a u8 `SqlValueType` and its
+/// data. Values carry their own type, so a record can be read back after the
+/// table gains a column.
+static void push_record(std::vector<uint8_t> &buffer, SqlWalRecordType type,
+                        const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+                        uint64_t row_id,
+                        const SmallVec<COLUMN_MAX, SqlValue> &row) {
+  // leave room for the header
+  size_t header = buffer.size();
+  buffer.insert(buffer.end(), SQL_WAL_RECORD_HEADER_SIZE, 0);
+  size_t body = buffer.size();
+
+  buffer.push_back((uint8_t)type);
+  buffer.push_back(table_name.size());
+  buffer.insert(buffer.end(), table_name.get_ptr(),
+                table_name.get_ptr() + table_name.size());
+  buffer.insert(buffer.end(), TABLE_NAME_MAX_LENGTH - table_name.size(), 0);
+  push_u64(buffer, row_id);
+
+  buffer.push_back(row.size());
+  for (size_t i = 0; i < row.size(); i++) {
+    buffer.push_back((uint8_t)row[i].type());
+    switch (row[i].type()) {
+    case SqlValueType::Null:
+      break;
+    case SqlValueType::Integer:
+      push_u32(buffer, row[i].get_integer());
+      break;
+    case SqlValueType::Float: {
+      uint32_t bits = 0;
+      memcpy(&bits, &row[i].get_float(), 4);
+      push_u32(buffer, bits);
+      break;
+    }
+    case SqlValueType::String: {
+      const SmallString<MAX_TYPE_SIZE> &string = row[i].get_string();
+      buffer.push_back(string.size());
+      buffer.insert(buffer.end(), string.get_ptr(),
+                    string.get_ptr() + string.size());
+      break;
+    }
+    default:
+      panic("unknown `SqlValueType` in `push_record`");
+      break;
+    }
+  }
+
+  // fill in the header
+  uint32_t body_size = buffer.size() - body;
+  uint32_t checksum = record_checksum(buffer.data() + body, body_size);
+  memcpy(buffer.data() + header, &body_size, 4);
+  memcpy(buffer.data() + header + 4, &checksum, 4);
+}
+
+/// Decode a record body.
+///
+/// Returns false if the body is malformed.
+static bool decode_record(const uint8_t *data, size_t len,
+                          SqlWalRecord &record) {
+  size_t fixed_size = 1 + 1 + TABLE_NAME_MAX_LENGTH + 8 + 1;
+  if (len < fixed_size)
+    return false;
+
+  uint8_t type = data[0];
+  if (type < (uint8_t)SqlWalRecordType::INSERT ||
+      type > (uint8_t)SqlWalRecordType::DELETE)
+    return false;
+  record.type = (SqlWalRecordType)type;
+
+  uint8_t name_size = data[1];
+  if (name_size > TABLE_NAME_MAX_LENGTH)
+    return false;
+  record.table_name =
+      SmallString<TABLE_NAME_MAX_LENGTH>((const char *)data + 2, name_size);
+  record.row_id = read_u64(data + 2 + TABLE_NAME_MAX_LENGTH);
+
+  uint8_t num_values = data[fixed_size - 1];
+  if (num_values > COLUMN_MAX)
+    return false;
+  record.row = SmallVec<COLUMN_MAX, SqlValue>();
+  size_t offset = fixed_size;
+  for (size_t i = 0; i < num_values; i++) {
+    if (offset + 1 > len)
+      return false;
+    SqlValueType value_type = (SqlValueType)data[offset];
+    offset += 1;
+
+    SqlValue value;
+    switch (value_type) {
+    case SqlValueType::Null:
+      break;
+    case SqlValueType::Integer:
+      if (offset + 4 > len)
+        return false;
+      value.set_integer(read_u32(data + offset));
+      offset += 4;
+      break;
+    case SqlValueType::Float: {
+      if (offset + 4 > len)
+        return false;
+      float float_value = 0;
+      memcpy(&float_value, data + offset, 4);
+      value.set_float(float_value);
+      offset += 4;
+      break;
+    }
+    case SqlValueType::String: {
+      if (offset + 1 > len || offset + 1 + data[offset] > len)
+        return false;
+      if (!value.set_string((const char *)data + offset + 1, data[offset]))
+        return false;
+      offset += 1 + data[offset];
+      break;
+    }
+    default:
+      return false;
+    }
+    record.row.push(value);
+  }
+
+  return offset == len;
+}
+
+/// Make a new log for the file at `name`.
+///
+/// This does not open the file.
+SqlWriteAheadLog::SqlWriteAheadLog(std::string name)
+    : m_file(name), m_lock_depth(0) {}
+SqlWriteAheadLog::SqlWriteAheadLog(SqlWriteAheadLog &&other) noexcept
+    : m_file(std::move(other.m_file)), m_pending(std::move(other.m_pending)),
+      m_lock_depth(other.m_lock_depth) {
+  other.m_lock_depth = 0;
+}
+SqlWriteAheadLog &SqlWriteAheadLog::operator=(SqlWriteAheadLog &&other) {
+  SqlError error;
+  this->close(error);
+  this->m_file = std::move(other.m_file);
+  this->m_pending = std::move(other.m_pending);
+  this->m_lock_depth = other.m_lock_depth;
+  other.m_lock_depth = 0;
+  return *this;
+}
+
+/// Open the log file
+void SqlWriteAheadLog::open(bool create, SqlError &error) {
+  // flags setup
+  const char *flags = create ? "w+b" : "r+b";
+
+  // open file
+  this->m_file.open(flags, error);
+  if (!error.is_ok())
+    return;
+
+  if (create) {
+    // write magic
+    this->m_file.write((const uint8_t *)SQL_WAL_FILE_MAGIC,
+                       SQL_WAL_FILE_MAGIC_SIZE, error);
+    if (!error.is_ok())
+      return;
+
+    // write synced end, there are no records yet.
+    uint64_t synced_end = SQL_WAL_FILE_HEADER_SIZE;
+    this->m_file.write((const uint8_t *)&synced_end, 8, error);
+    if (!error.is_ok())
+      return;
+  } else {
+    // prep buffer for magic
+    char buffer[SQL_WAL_FILE_MAGIC_SIZE] = {0};
+
+    // read magic
+    this->m_file.read((uint8_t *)buffer, SQL_WAL_FILE_MAGIC_SIZE, error);
+    if (!error.is_ok())
+      return;
+
+    // validate magic
+    for (size_t i = 0; i < SQL_WAL_FILE_MAGIC_SIZE; i++) {
+      if (SQL_WAL_FILE_MAGIC[i] != buffer[i]) {
+        error.set_invalid_file();
+        return;
+      }
+    }
+  }
+}
+
+/// Log a new row, or new values for a row.
+void SqlWriteAheadLog::log_row(
+    SqlWalRecordType type, const SmallString<TABLE_NAME_MAX_LENGTH> &table_name,
+    uint64_t row_id, const SmallVec<COLUMN_MAX, SqlValue> &row) {
+  assert(type != SqlWalRecordType::DELETE);
+  push_record(this->m_pending, type, table_name, row_id, row);
+}
+
+/// Log a deleted row.
+void SqlWriteAheadLog::log_delete(
+    const SmallString<TABLE_NAME_MAX_LENGTH> &table_name, uint64_t row_id) {
+  push_record(this->m_pending, SqlWalRecordType::DELETE, table_name, row_id,
+              SmallVec<COLUMN_MAX, SqlValue>());
+}
+
+/// Append the logged records to the file, and wait until they are on disk.
+void SqlWriteAheadLog::commit(SqlError &error) {
+  if (this->m_pending.empty())
+    return;
+
+  // append at the end, which another process may have moved.
+  this->lock(error);
+  if (!error.is_ok())
+    return;
+  uint64_t end = this->m_file.size() + this->m_pending.size();
+  this->m_file.write_at(this->m_file.size(), this->m_pending.data(),
+                        this->m_pending.size(), error);
+  SqlError unlock_error;
+  this->unlock(unlock_error);
+  if (error.is_ok())
+    error = unlock_error;
+  if (!error.is_ok())
+    return;
+  this->m_pending.clear();
+
+  this->sync_to(end, error);
+}
+
+/// Drop the logged records that were not committed.
+void SqlWriteAheadLog::discard() { this->m_pending.clear(); }
+
+/// Take the log lock, which keeps other processes from appending.
+void SqlWriteAheadLog::lock(SqlError &error) {
+  if (this->m_lock_depth == 0) {
+    this->m_file.lock(error);
+    if (!error.is_ok())
+      return;
+  }
+  this->m_lock_depth++;
+}
+
+/// Release the log lock.
+void SqlWriteAheadLog::unlock(SqlError &error) {
+  assert(this->m_lock_depth > 0);
+  this->m_lock_depth--;
+  if (this->m_lock_depth == 0)
+    this->m_file.unlock(error);
+}
+
+/// Read every committed record, in order.
+///
+/// The log lock must be held. Reading stops at the first torn record.
+void SqlWriteAheadLog::read_records(std::vector<SqlWalRecord> &records,
+                                    SqlError &error) {
+  uint64_t size = this->m_file.size();
+  if (size <= SQL_WAL_FILE_HEADER_SIZE)
+    return;
+
+  // read the whole log in one go
+  std::vector<uint8_t> data(size - SQL_WAL_FILE_HEADER_SIZE);
+  this->m_file.read_at(SQL_WAL_FILE_HEADER_SIZE, data.data(), data.size(),
+                       error);
+  if (!error.is_ok())
+    return;
+
+  size_t offset = 0;
+  while (offset + SQL_WAL_RECORD_HEADER_SIZE <= data.size()) {
+    uint32_t body_size = read_u32(data.data() + offset);
+    uint32_t checksum = read_u32(data.data() + offset + 4);
+    const uint8_t *body = data.data() + offset + SQL_WAL_RECORD_HEADER_SIZE;
+    if (offset + SQL_WAL_RECORD_HEADER_SIZE + body_size > data.size() ||
+        record_checksum(body, body_size) != checksum)
+      break;
+
+    SqlWalRecord record;
+    if (!decode_record(body, body_size, record))
+      break;
+    records.push_back(record);
+
+    offset += SQL_WAL_RECORD_HEADER_SIZE + body_size;
+  }
+}
+
+/// Drop every record, after they were applied to the tables.
+///
+/// The log lock must be held.
+void SqlWriteAheadLog::reset(SqlError &error) {
+  this->m_file.truncate(SQL_WAL_FILE_HEADER_SIZE, error);
+  if (!error.is_ok())
+    return;
+
+  uint64_t synced_end = SQL_WAL_FILE_HEADER_SIZE;
+  this->m_file.write_at(SQL_WAL_FILE_SYNCED_END_OFFSET,
+                        (const uint8_t *)&synced_end, 8, error);
+}
+
+/// Get the # of bytes of committed records
+uint64_t SqlWriteAheadLog::size() const {
+  return this->m_file.size() - SQL_WAL_FILE_HEADER_SIZE;
+}
+
+/// Returns true if this is closed.
+bool SqlWriteAheadLog::is_closed() const { return this->m_file.is_closed(); }
+
+/// Close this file
+void SqlWriteAheadLog::close(SqlError &error) { this->m_file.close(error); }
+
+/// Get the file name
+const std::string &SqlWriteAheadLog::file_name() const {
+  return this->m_file.name();
+}
+
+/// remove the log file and close this file.
+void SqlWriteAheadLog::remove_file(SqlError &error) {
+  this->m_file.remove_file(error);
+}
+
+/// Wait until the file is on disk up to `end`, unless another process already
+/// synced past it.
+void SqlWriteAheadLog::sync_to(uint64_t end, SqlError &error) {
+  this->lock(error);
+  if (!error.is_ok())
+    return;
+
+  uint64_t synced_end = 0;
+  this->m_file.read_at(SQL_WAL_FILE_SYNCED_END_OFFSET, (uint8_t *)&synced_end,
+                       8, error);
+
+  // one sync covers every record appended so far, including those of other
+  // processes still waiting for the lock.
+  if (error.is_ok() && synced_end < end) {
+    uint64_t size = this->m_file.size();
+    this->m_file.sync(error);
+    if (error.is_ok()) {
+      this->m_file.write_at(SQL_WAL_FILE_SYNCED_END_OFFSET,
+                            (const uint8_t *)&size, 8, error);
+    }
+  }
+
+  SqlError unlock_error;
+  this->unlock(unlock_error);
+  if (error.is_ok())
+    error = unlock_error;
+}
+} // namespace basic_sql
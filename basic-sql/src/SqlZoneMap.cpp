@@ -0,0 +1,267 @@
+/// Author: Nathaniel Daniel
+/// Date: 10-17-2021
+
+#include "SqlZoneMap.h"
+#include "SerDe.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace basic_sql {
+/// Get the key of a float, in float order
+///
+/// -0 gets the key of 0, since they are equal.
+static uint64_t float_key(float value) {
+  if (value == 0.0f)
+    value = 0.0f;
+
+  uint32_t bits = 0;
+  memcpy(&bits, &value, 4);
+  if ((bits & 0x80000000) != 0)
+    return (uint32_t)~bits;
+  return bits | 0x80000000;
+}
+
+/// Get the key of a string, its first 8 bytes as a big endian number
+///
+/// Shorter strings are padded with zeros, so a prefix gets a key no larger.
+static uint64_t string_key(const char *data, size_t size) {
+  uint64_t key = 0;
+  for (size_t i = 0; i < 8; i++) {
+    key <<= 8;
+    if (i < size)
+      key |= (uint8_t)data[i];
+  }
+  return key;
+}
+
+/// Get the key of an encoded value of a type
+static uint64_t value_key(const parser::SqlType &type, const uint8_t *data) {
+  switch (type.type) {
+  case tokenizer::SqlType::INT: {
+    uint32_t value = 0;
+    memcpy(&value, data, 4);
+    return value;
+  }
+  case tokenizer::SqlType::FLOAT: {
+    float value = 0.0f;
+    memcpy(&value, data, 4);
+    return float_key(value);
+  }
+  case tokenizer::SqlType::CHAR:
+  case tokenizer::SqlType::VARCHAR:
+    return string_key((const char *)data + 1, data[0]);
+  default:
+    return 0;
+  }
+}
+
+/// Get the key of a where clause value compared to a column of a type
+///
+/// Returns false if the value has another type, since it compares
+/// differently. `exact` is cleared if unequal values may share the key.
+static bool where_key(const parser::SqlType &type, const SqlValue &value,
+                      uint64_t &key, bool &exact) {
+  SqlValueType value_type = value.type();
+  exact = true;
+  switch (type.type) {
+  case tokenizer::SqlType::INT:
+    if (value_type != SqlValueType::Integer)
+      return false;
+    key = value.get_integer();
+    return true;
+  case tokenizer::SqlType::FLOAT:
+    if (value_type != SqlValueType::Float)
+      return false;
+    key = float_key(value.get_float());
+    return true;
+  case tokenizer::SqlType::CHAR:
+  case tokenizer::SqlType::VARCHAR: {
+    if (value_type != SqlValueType::String)
+      return false;
+    const SmallString<MAX_TYPE_SIZE> &string = value.get_string();
+    key = string_key(string.get_ptr(), string.size());
+    exact = false;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+/// Get the bit of a Bloom filter of `num_bits` bits that a hash sets for
+/// its i-th probe
+static uint64_t bloom_bit(uint64_t hash, size_t i, uint64_t num_bits) {
+  // the high half steps through the bits the low half starts at
+  uint64_t step = (hash >> 32) | 1;
+  return (hash + (i * step)) % num_bits;
+}
+
+/// Make a zone map without columns
+SqlZoneMap::SqlZoneMap() : m_group_rows(0), m_bloom_words(0) {}
+
+/// Forget the zones of every column
+void SqlZoneMap::clear() {
+  this->m_zones.clear();
+  this->m_blooms.clear();
+  this->m_started.clear();
+}
+
+/// Returns true if the zones of a column were started.
+bool SqlZoneMap::has_column(size_t column) const {
+  return column < this->m_started.size() && this->m_started[column];
+}
+
+/// Start the zones of a column, with groups of `group_rows` rows.
+///
+/// Every group of the first `num_rows` rows starts empty, their values must
+/// be added after. Columns with another group size are forgotten.
+void SqlZoneMap::start_column(size_t column, size_t group_rows,
+                              uint64_t num_rows) {
+  assert(group_rows != 0);
+  if (group_rows != this->m_group_rows) {
+    this->clear();
+    this->m_group_rows = group_rows;
+    this->m_bloom_words =
+        ((group_rows * SQL_ZONE_BLOOM_BITS_PER_ROW) + 63) / 64;
+  }
+  if (column >= this->m_zones.size()) {
+    this->m_zones.resize(column + 1);
+    this->m_blooms.resize(column + 1);
+    this->m_started.resize(column + 1, false);
+  }
+
+  uint64_t num_groups = (num_rows + group_rows - 1) / group_rows;
+  this->m_zones[column].assign(num_groups, SqlZone{UINT64_MAX, 0, 0});
+  this->m_blooms[column].assign(num_groups * this->m_bloom_words, 0);
+  this->m_started[column] = true;
+}
+
+/// Empty the zone of the group of a row, so it can be built again.
+///
+/// The column zones must be started.
+void SqlZoneMap::clear_group(size_t column, uint64_t row) {
+  assert(this->has_column(column));
+  this->group_zone(column, row) = SqlZone{UINT64_MAX, 0, 0};
+
+  uint64_t *bloom = this->m_blooms[column].data() +
+                    ((row / this->m_group_rows) * this->m_bloom_words);
+  std::fill(bloom, bloom + this->m_bloom_words, 0);
+}
+
+/// Add an encoded value of a column to the zone of a row.
+///
+/// Does nothing if the zones of the column were not started.
+void SqlZoneMap::add_value(size_t column, const parser::SqlType &type,
+                           uint64_t row, const uint8_t *data) {
+  if (!this->has_column(column))
+    return;
+
+  uint64_t key = value_key(type, data);
+  SqlZone &zone = this->group_zone(column, row);
+  zone.min = std::min(zone.min, key);
+  zone.max = std::max(zone.max, key);
+
+  uint64_t *bloom = this->m_blooms[column].data() +
+                    ((row / this->m_group_rows) * this->m_bloom_words);
+  uint64_t hash = hash_sql_value(type, data);
+  for (size_t i = 0; i < SQL_ZONE_BLOOM_HASHES; i++) {
+    uint64_t bit = bloom_bit(hash, i, this->m_bloom_words * 64);
+    bloom[bit / 64] |= (uint64_t)1 << (bit % 64);
+  }
+}
+
+/// Note that the values of a row are about to be overwritten or deleted.
+void SqlZoneMap::mark_stale(uint64_t row) {
+  if (this->m_group_rows == 0)
+    return;
+
+  uint64_t group = row / this->m_group_rows;
+  for (size_t j = 0; j < this->m_zones.size(); j++) {
+    if (this->m_started[j] && group < this->m_zones[j].size())
+      this->m_zones[j][group].stale += 1;
+  }
+}
+
+/// Returns true if the group of a row had over half of its values
+/// overwritten or deleted since it was built.
+///
+/// The column zones must be started.
+bool SqlZoneMap::is_stale(size_t column, uint64_t row) const {
+  assert(this->has_column(column));
+  const std::vector<SqlZone> &zones = this->m_zones[column];
+  uint64_t group = row / this->m_group_rows;
+  return group < zones.size() &&
+         zones[group].stale > this->m_group_rows / 2;
+}
+
+/// Returns false if no row in the group of `row` can match a where clause on
+/// a column.
+///
+/// The column zones must be started.
+bool SqlZoneMap::may_match(size_t column, const parser::SqlType &type,
+                           uint64_t row,
+                           const parser::SqlWhereClause &where_clause) const {
+  assert(this->has_column(column));
+  const std::vector<SqlZone> &zones = this->m_zones[column];
+  uint64_t group = row / this->m_group_rows;
+  if (group >= zones.size())
+    return true;
+
+  uint64_t key = 0;
+  bool exact = true;
+  if (!where_key(type, where_clause.value, key, exact))
+    return true;
+
+  const SqlZone &zone = zones[group];
+  if (zone.min > zone.max)
+    return false;
+
+  switch (where_clause.op) {
+  case tokenizer::SqlOperator::Equals: {
+    if (key < zone.min || key > zone.max)
+      return false;
+
+    // a value too long for the column equals no row
+    if (sql_value_encoded_size(where_clause.value) > sql_type_width(type))
+      return false;
+    uint8_t data[1 + MAX_TYPE_SIZE];
+    encode_sql_value(where_clause.value, type, data);
+
+    const uint64_t *bloom = this->m_blooms[column].data() +
+                            (group * this->m_bloom_words);
+    uint64_t hash = hash_sql_value(type, data);
+    for (size_t i = 0; i < SQL_ZONE_BLOOM_HASHES; i++) {
+      uint64_t bit = bloom_bit(hash, i, this->m_bloom_words * 64);
+      if (((bloom[bit / 64] >> (bit % 64)) & 1) == 0)
+        return false;
+    }
+    return true;
+  }
+  case tokenizer::SqlOperator::GreaterThan:
+    // strings above the value may share its key
+    return exact ? zone.max > key : zone.max >= key;
+  case tokenizer::SqlOperator::NotEqual:
+    return !exact || zone.min != zone.max || zone.min != key;
+  default:
+    return true;
+  }
+}
+
+/// Get the first row of the group after the group of a row
+uint64_t SqlZoneMap::next_group(uint64_t row) const {
+  return (row / this->m_group_rows + 1) * this->m_group_rows;
+}
+
+/// Get the zone of the group of a row, adding empty groups up to it.
+SqlZone &SqlZoneMap::group_zone(size_t column, uint64_t row) {
+  // groups past the end only hold rows added since the zones started
+  std::vector<SqlZone> &zones = this->m_zones[column];
+  uint64_t group = row / this->m_group_rows;
+  if (group >= zones.size()) {
+    zones.resize(group + 1, SqlZone{UINT64_MAX, 0, 0});
+    this->m_blooms[column].resize(zones.size() * this->m_bloom_words, 0);
+  }
+  return zones[group];
+}
+} // namespace basic_sql
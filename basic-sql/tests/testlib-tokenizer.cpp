@@ -6,6 +6,7 @@ using basic_sql::ConstStringSlice;
 using basic_sql::tokenizer::SqlIdentifier;
 using basic_sql::tokenizer::SqlIntegerLiteral;
 using basic_sql::tokenizer::SqlKeyword;
+using basic_sql::tokenizer::SqlOperator;
 using basic_sql::tokenizer::SqlToken;
 using basic_sql::tokenizer::SqlTokenizer;
 using basic_sql::tokenizer::SqlTokenizerError;
@@ -161,6 +162,104 @@ TEST_CASE("Project1Tokenizer", "[main]") {
     REQUIRE(expected_tokens == tokens);
   }
 
+  SECTION("tokenize 'CREATE TABLE tbl_1 (a1 int) USING columnar;'") {
+    std::string sql("CREATE TABLE tbl_1 (a1 int) USING columnar;");
+    std::vector<SqlToken> expected_tokens{
+        SqlToken(SqlKeyword::CREATE),
+        SqlToken(SqlKeyword::TABLE),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("tbl_1"),
+        }),
+        SqlToken::left_parenthesis(),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("a1"),
+        }),
+        SqlToken(SqlType::INT),
+        SqlToken::right_parenthesis(),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("USING"),
+        }),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("columnar"),
+        }),
+        SqlToken::semicolon(),
+    };
+
+    SqlTokenizer tokenizer(sql);
+    std::vector<SqlToken> tokens;
+    SqlTokenizerError e;
+    tokenizer.tokenize(tokens, e);
+
+    INFO(e.message);
+    REQUIRE(e.is_ok());
+    REQUIRE(expected_tokens == tokens);
+  }
+
+  SECTION("tokenize 'CREATE TABLE tbl_1 (a1 int PRIMARY KEY);'") {
+    std::string sql("CREATE TABLE tbl_1 (a1 int PRIMARY KEY);");
+    std::vector<SqlToken> expected_tokens{
+        SqlToken(SqlKeyword::CREATE),
+        SqlToken(SqlKeyword::TABLE),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("tbl_1"),
+        }),
+        SqlToken::left_parenthesis(),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("a1"),
+        }),
+        SqlToken(SqlType::INT),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("PRIMARY"),
+        }),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("KEY"),
+        }),
+        SqlToken::right_parenthesis(),
+        SqlToken::semicolon(),
+    };
+
+    SqlTokenizer tokenizer(sql);
+    std::vector<SqlToken> tokens;
+    SqlTokenizerError e;
+    tokenizer.tokenize(tokens, e);
+
+    INFO(e.message);
+    REQUIRE(e.is_ok());
+    REQUIRE(expected_tokens == tokens);
+  }
+
+  SECTION("tokenize 'CREATE INDEX idx_1 ON tbl_1 (a1);'") {
+    std::string sql("CREATE INDEX idx_1 ON tbl_1 (a1);");
+    std::vector<SqlToken> expected_tokens{
+        SqlToken(SqlKeyword::CREATE),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("INDEX"),
+        }),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("idx_1"),
+        }),
+        SqlToken(SqlKeyword::ON),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("tbl_1"),
+        }),
+        SqlToken::left_parenthesis(),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("a1"),
+        }),
+        SqlToken::right_parenthesis(),
+        SqlToken::semicolon(),
+    };
+
+    SqlTokenizer tokenizer(sql);
+    std::vector<SqlToken> tokens;
+    SqlTokenizerError e;
+    tokenizer.tokenize(tokens, e);
+
+    INFO(e.message);
+    REQUIRE(e.is_ok());
+    REQUIRE(expected_tokens == tokens);
+  }
+
   SECTION("tokenize 'DROP TABLE tbl_1;'") {
     std::string sql("DROP TABLE tbl_1;");
     std::vector<SqlToken> expected_tokens{
@@ -204,6 +303,68 @@ TEST_CASE("Project1Tokenizer", "[main]") {
     REQUIRE(expected_tokens == tokens);
   }
 
+  SECTION("tokenize 'SELECT * FROM tbl_1 T, tbl_2 U WHERE T.a1 = U.a2 AND "
+          "T.a3 = 1;'") {
+    std::string sql(
+        "SELECT * FROM tbl_1 T, tbl_2 U WHERE T.a1 = U.a2 AND T.a3 = 1;");
+    std::vector<SqlToken> expected_tokens{
+        SqlToken(SqlKeyword::SELECT),
+        SqlToken::asterisk(),
+        SqlToken(SqlKeyword::FROM),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("tbl_1"),
+        }),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("T"),
+        }),
+        SqlToken::comma(),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("tbl_2"),
+        }),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("U"),
+        }),
+        SqlToken(SqlKeyword::WHERE),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("T"),
+        }),
+        SqlToken::period(),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("a1"),
+        }),
+        SqlToken(SqlOperator::Equals),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("U"),
+        }),
+        SqlToken::period(),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("a2"),
+        }),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("AND"),
+        }),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("T"),
+        }),
+        SqlToken::period(),
+        SqlToken(SqlIdentifier{
+          value : ConstStringSlice("a3"),
+        }),
+        SqlToken(SqlOperator::Equals),
+        SqlToken(SqlIntegerLiteral{value : 1}),
+        SqlToken::semicolon(),
+    };
+
+    SqlTokenizer tokenizer(sql);
+    std::vector<SqlToken> tokens;
+    SqlTokenizerError e;
+    tokenizer.tokenize(tokens, e);
+
+    INFO(e.message);
+    REQUIRE(e.is_ok());
+    REQUIRE(expected_tokens == tokens);
+  }
+
   SECTION("tokenize 'ALTER TABLE tbl_1 ADD a3 float;'") {
     std::string sql("ALTER TABLE tbl_1 ADD a3 float;");
     std::vector<SqlToken> expected_tokens{